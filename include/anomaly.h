@@ -0,0 +1,88 @@
+// On-device anomaly detection on every new measurement
+//
+// Each temperature / humidity sample is checked in O(1) against :
+//   - static high / low thresholds, cleared with hysteresis,
+//   - a rate-of-change limit (per minute, smoothed over a few samples),
+//   - an EWMA z-score : distance to the exponentially weighted mean, in
+//     noise standard deviations (EWMA of successive differences) after a
+//     warm-up, outliers kept out of the baseline,
+// and invalid readings raise a sensor alarm. A condition raises its alarm
+// after ALARM_RAISE_SAMPLES consecutive samples (1 : on the first faulty
+// sample) and clears it after ALARM_CLEAR_SAMPLES consecutive normal ones.
+// Raise / clear transitions are events, kept in a small log for the API and
+// handed to an optional handler (serial).
+
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <stdint.h>
+#include "measurement.h"
+#include "rolling_stats.h"
+
+#define ALARM_RAISE_SAMPLES 1 // consecutive samples to raise an alarm
+#define ALARM_CLEAR_SAMPLES 3 // consecutive normal samples to clear it
+#define ALARM_LOG_LEN 16      // events kept for the API
+
+#define ALARM_RATE_ALPHA 0.3f   // EWMA weight of a new rate of change
+#define ALARM_EWMA_ALPHA 0.05f  // EWMA weight of a new sample (~20 samples = 10 min memory)
+#define ALARM_EWMA_WARMUP 20    // samples before the z-score is trusted
+#define ALARM_Z_LIMIT 4.0f      // |z| limit
+
+// Per channel limits : high, low, hysteresis, rate (per minute), min. std dev (sensor resolution)
+#define ALARM_TMP_LIMITS {30.0f, 10.0f, 0.5f, 0.5f, 0.1f}
+#define ALARM_HUM_LIMITS {70.0f, 20.0f, 2.0f, 5.0f, 0.5f}
+
+struct AlarmLimits
+{
+  float fHigh;
+  float fLow;
+  float fHysteresis;
+  float fRatePerMin;
+  float fMinStdDev; // floor of the EWMA std dev : flat series do not give huge z-scores
+};
+
+// Alarm kinds
+enum AlarmKind : uint8_t
+{
+  ALARM_HIGH = 0,
+  ALARM_LOW,
+  ALARM_RATE,
+  ALARM_ZSCORE,
+  ALARM_SENSOR, // invalid reading
+  ALARM_KIND_COUNT
+};
+
+// Raise / clear transition
+struct AlarmEvent
+{
+  uint32_t uNumber;   // event number, +1 per event
+  uint32_t uSeq;      // measurement sequence number
+  uint32_t uEpoch;    // measurement time (UTC)
+  uint8_t uChannel;   // StatsChannel
+  uint8_t uKind;      // AlarmKind
+  bool bRaised;       // raised, else cleared
+  float fValue;       // value, rate (per minute) or z-score that triggered
+  float fLimit;       // limit it was compared with
+};
+
+typedef void (*AlarmHandler)(const AlarmEvent &oEvent);
+
+// Handler called on each event (from the measurement bus task), nullptr for none
+void setAlarmHandler(AlarmHandler pHandler);
+
+// Check a measurement (measurement bus handler)
+void checkAnomalies(const Measurement &oMeasurement);
+
+// Active alarms : bit (uChannel * ALARM_KIND_COUNT + uKind)
+uint32_t activeAlarms();
+
+// Copy the event number uNumber, false if it is not (or no longer) in the log
+bool getAlarmEvent(uint32_t uNumber, AlarmEvent &oEvent);
+
+// Number of the last event, 0 if none
+uint32_t lastAlarmEvent();
+
+// Name of an alarm kind
+const char *alarmKindName(uint8_t uKind);
+
+#endif // ANOMALY_H
@@ -0,0 +1,23 @@
+// AsyncWebServer handler for the static assets of the flash partition
+//
+// A handler rather than the onNotFound() callback : the catch-all callback
+// never declares interesting headers, so the server strips If-None-Match and
+// Accept-Encoding before it runs. A gzip-only asset is refused (406) to a
+// client that does not accept gzip, and every gzip response carries
+// "Vary: Accept-Encoding" for the caches in between.
+
+#ifndef ASSET_HANDLER_H
+#define ASSET_HANDLER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+class AssetHandler : public AsyncWebHandler
+{
+public:
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  bool isRequestHandlerTrivial() override { return false; }
+};
+
+#endif // ASSET_HANDLER_H
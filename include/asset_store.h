@@ -0,0 +1,77 @@
+// Static assets served from a dedicated flash partition
+//
+// Pre-compressed assets are packed by tools/mkassets.py into an image
+// (header + fixed-size index + data) written to the "assets" partition. The
+// whole partition is memory-mapped once, so an asset is just a pointer into
+// flash that can be handed to the TCP send path without any copy. Assets can
+// be updated by rewriting the partition, without reflashing the application.
+// On host builds the image file is mapped with mmap() instead.
+
+#ifndef ASSET_STORE_H
+#define ASSET_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ASSET_PARTITION_LABEL "assets"
+#define ASSET_PARTITION_SUBTYPE 0x40 // custom data partition subtype
+#define ASSET_MAGIC 0x53545341UL     // "ASTS" (little endian)
+#define ASSET_VERSION 1
+#define ASSET_MAX_COUNT 32
+#define ASSET_PATH_LEN 48
+#define ASSET_TYPE_LEN 32
+
+enum AssetEncoding : uint8_t
+{
+  ASSET_IDENTITY = 0,
+  ASSET_GZIP = 1
+};
+
+// Image header (little endian, as written by tools/mkassets.py)
+struct __attribute__((packed)) AssetImageHeader
+{
+  uint32_t uMagic;
+  uint16_t uVersion;
+  uint16_t uCount;      // number of AssetEntry following the header
+  uint32_t uImageLen;   // total image length
+  uint32_t uReserved;
+};
+
+// One index entry, data offsets are relative to the start of the image
+struct __attribute__((packed)) AssetEntry
+{
+  char acPath[ASSET_PATH_LEN];        // e.g. "/app.js" ('\0'-terminated)
+  char acContentType[ASSET_TYPE_LEN]; // e.g. "application/javascript"
+  uint32_t uOffset;
+  uint32_t uLength;                   // stored (possibly compressed) length
+  uint32_t uCrc32;                    // CRC32 of the stored data, used as ETag
+  uint8_t uEncoding;                  // AssetEncoding
+  uint8_t auPadding[3];
+};
+
+// Map the image (partition label on the ESP32, file path on host)
+bool beginAssetStore(const char *pSource);
+
+// Find an asset by path, nullptr if none
+const AssetEntry *findAsset(const char *pPath);
+
+// Mapped data of an asset
+const uint8_t *assetData(const AssetEntry *pAsset);
+
+// Quoted ETag of an asset ("xxxxxxxx"), pBuffer must hold 11 chars
+void assetETag(const AssetEntry *pAsset, char *pBuffer);
+
+// Is the content coding pCoding accepted by an Accept-Encoding header
+// (nullptr if absent : no) ? An explicit entry wins over "*", a "q=0" (or
+// "q=0.0"...) entry refuses the coding
+bool acceptsEncoding(const char *pAcceptEncoding, const char *pCoding);
+
+// Can a response in pAsset's encoding be sent to a client whose
+// Accept-Encoding header is pAcceptEncoding (nullptr if absent) ? A gzip
+// asset needs "gzip" or "*" with a non-zero q, an identity asset always can
+bool assetAcceptable(const AssetEntry *pAsset, const char *pAcceptEncoding);
+
+// Number of assets in the mapped image
+uint16_t assetCount();
+
+#endif // ASSET_STORE_H
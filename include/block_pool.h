@@ -0,0 +1,46 @@
+// Fixed-size block pools (slab allocator) with heap fallback
+//
+// Small, short-lived objects of the web layer (AsyncWebServerRequest,
+// responses, AsyncClient, std::function captures, template snapshots...)
+// are allocated with operator new. Serving them from a few static pools of
+// fixed-size blocks instead of the heap keeps their churn from fragmenting
+// the heap on long-running devices : the largest free heap block then stays
+// flat. A request that does not fit (too large, or its pool is empty) falls
+// back to malloc() and is counted as a miss.
+//
+// operator new/delete are routed to the pools on the ESP32 only when
+// POOLED_NEW is defined ([env:release_pooled]) : the override is global, so
+// it is an explicit choice rather than a side effect of linking this module.
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POOL_CLASS_COUNT 5 // number of block sizes (see aPoolClasses in block_pool.cpp)
+
+// Counters of one block size
+struct BlockPoolStats
+{
+  uint16_t uBlockSize;
+  uint16_t uBlockCount;
+  uint16_t uInUse;      // blocks currently allocated
+  uint16_t uHighWater;  // max. blocks ever allocated at once
+  uint32_t uHits;       // allocations served by this pool
+  uint32_t uMisses;     // allocations of this size sent to the heap (pool empty)
+};
+
+// Allocate uSize bytes from the smallest fitting pool, else from the heap
+void *poolAlloc(size_t uSize);
+
+// Release a block (pool or heap), nullptr is ignored
+void poolFree(void *pBlock);
+
+// Counters of pool uClass, false if out of range
+bool getPoolStats(uint8_t uClass, BlockPoolStats &oStats);
+
+// Allocations larger than the largest block (always sent to the heap)
+uint32_t poolOversize();
+
+#endif // BLOCK_POOL_H
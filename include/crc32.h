@@ -0,0 +1,45 @@
+// CRC-32 (IEEE 802.3, reflected, as in gzip and zlib) shared by the flash
+// log, the RTC snapshot and the gzip stream
+//
+// On the ESP32 the mask ROM crc32_le() does the work (table-driven, no
+// flash or RAM cost), on host a 16-entry nibble table (2 lookups per byte).
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <rom/crc.h>
+#endif
+
+// Continue a CRC over pData (start with 0) : updateCrc32(updateCrc32(0, a), b) == CRC of a then b
+inline uint32_t updateCrc32(uint32_t uCrc, const void *pData, size_t uLen)
+{
+#ifdef ARDUINO
+  return crc32_le(uCrc, (const uint8_t *)pData, uLen);
+#else
+  static const uint32_t auCrcNibble[16] = {0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL,
+                                           0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+                                           0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL,
+                                           0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL};
+  const uint8_t *pByte = (const uint8_t *)pData;
+  uCrc = ~uCrc;
+  while (uLen--)
+  {
+    uCrc ^= *pByte++;
+    uCrc = (uCrc >> 4) ^ auCrcNibble[uCrc & 0x0F];
+    uCrc = (uCrc >> 4) ^ auCrcNibble[uCrc & 0x0F];
+  }
+  return ~uCrc;
+#endif
+}
+
+// CRC of one buffer
+inline uint32_t crc32(const void *pData, size_t uLen)
+{
+  return updateCrc32(0, pData, uLen);
+}
+
+#endif // CRC32_H
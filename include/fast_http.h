@@ -0,0 +1,68 @@
+// Minimal HTTP/1.1 responder on AsyncTCP for the read-only sensor endpoints
+//
+// Runs next to the AsyncWebServer (which keeps serving the HTML page) on its
+// own port. Connections come from a fixed pool, each with a fixed-size parse
+// buffer : it only has to hold the request line and the few headers the
+// responder reads, the others (cookies, user agent...) are dropped as they
+// arrive once it fills. Responses use precomputed headers and connections
+// are kept alive : no request object, no header String and no heap
+// allocation per request.
+// On host builds AsyncTCP.h is the in-memory stand-in of test/host, so the
+// parsing, dispatch and response path can be tested (test/test_fast_http).
+
+#ifndef FAST_HTTP_H
+#define FAST_HTTP_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+#include <AsyncTCP.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "path_hash.h"
+
+#define FAST_HTTP_MAX_CLIENTS 4    // simultaneous connections (pool size)
+#define FAST_HTTP_BUFFER_LEN 512   // per-connection request parse buffer (request line + headers read)
+#define FAST_HTTP_BODY_LEN 2048    // max. response body length (one static buffer)
+#define FAST_HTTP_IDLE_TIMEOUT 15  // close idle keep-alive connections after n seconds
+#define FAST_HTTP_EXTRA_LEN 64     // max. length of the extra response headers of an endpoint
+
+// Writes a response body into pBuffer, returns its length
+typedef size_t (*FastHttpWriter)(char *pBuffer, size_t uLen);
+
+// One read-only endpoint : path, content type, body writer and optional
+// extra headers writer (each header starting with CRLF, e.g. "\r\nAge: 12")
+struct FastHttpEndpoint
+{
+  uint32_t uHash;
+  const char *pPath;
+  const char *pContentType;
+  FastHttpWriter pWriter;
+  FastHttpWriter pHeaderWriter;
+
+  constexpr FastHttpEndpoint(const char *pPath_, const char *pContentType_, FastHttpWriter pWriter_,
+                             FastHttpWriter pHeaderWriter_ = nullptr)
+      : uHash(hashPath(pPath_)), pPath(pPath_), pContentType(pContentType_), pWriter(pWriter_),
+        pHeaderWriter(pHeaderWriter_) {}
+};
+
+// Start listening on uPort and serve the given endpoints
+void beginFastHttp(uint16_t uPort, const FastHttpEndpoint *pEndpoints, uint8_t uCount);
+
+#ifndef ARDUINO
+// Host build, driven by the tests instead of the AsyncTCP callbacks
+
+// Accept a connection into the pool (as on a new TCP client), false if full
+bool acceptFastHttp(AsyncClient *pClient);
+
+// Bytes received on an accepted connection
+void receiveFastHttp(AsyncClient *pClient, const char *pData, size_t uLen);
+
+// Connection gone : release its pool slot
+void dropFastHttp(AsyncClient *pClient);
+
+// Static RAM of one pooled connection
+size_t fastHttpConnBytes();
+#endif
+
+#endif // FAST_HTTP_H
@@ -0,0 +1,190 @@
+// Persistent sample log in a dedicated flash partition, with a sparse time
+// index and retention tiers
+//
+// The "history" partition is split into FLOG_TIER_COUNT tiers, each a ring
+// of FLOG_SECTOR_LEN blocks : raw samples, then 5-min and 1-h aggregates
+// (FLOG_TIER_STEPS). Every live measurement is appended as a 16-byte
+// CRC-protected record to the raw tier, whose oldest block is erased when
+// it is full : raw samples are kept for the span of that tier (a week), the
+// aggregates for months. A compaction task turns closed steps of each tier
+// into aggregates (count / mean / min / max per channel) of the next one,
+// incrementally : FLOG_COMPACT_SLICE records per slice, at idle priority,
+// so it never delays sampling or HTTP.
+//
+// Every block starts with a header (block number, time of its first
+// record). The first time of every block is kept in RAM (the sparse index,
+// rebuilt from the block headers at boot), so a from/to query picks a tier,
+// binary-searches its first block and then streams only the blocks it
+// needs, aggregating the records per time step on the fly. Records are
+// appended without erase (NOR flash bits only go 1 -> 0); a record torn by
+// a power loss fails its CRC and is skipped. On host builds the partition
+// is a file.
+
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include "measurement.h"
+#include "rolling_stats.h"
+
+#define FLOG_PARTITION_LABEL "history"
+#define FLOG_PARTITION_SUBTYPE 0x41 // custom data partition subtype
+#define FLOG_MAGIC 0x32474C48UL     // "HLG2" (little endian), change with the record layout or the tiers
+#define FLOG_SECTOR_LEN 4096        // flash erase unit = one block
+#define FLOG_MAX_BLOCKS 256         // sparse index capacity (1 MB partition)
+#define FLOG_HOST_LEN (FLOG_MAX_BLOCKS * FLOG_SECTOR_LEN) // partition file size created on host builds
+
+#define FLOG_TIER_COUNT 3
+#ifndef FLOG_TIER_BLOCKS
+#define FLOG_TIER_BLOCKS {96, 128, 32} // blocks per tier : 8.5 days raw (30 s), 75 days of 5 min, 226 days of 1 h
+#endif
+#define FLOG_TIER_STEPS {0, 300, 3600} // aggregation step per tier (seconds, 0 : raw samples)
+#define FLOG_COMPACT_SLICE 64          // source records read per compaction slice
+#define FLOG_COMPACT_PERIOD 200        // pause between compaction slices (milliseconds)
+
+// Block header, at the start of every block (little endian)
+struct __attribute__((packed)) FlogBlockHeader
+{
+  uint32_t uMagic;
+  uint32_t uBlockNo;    // increasing over the tier lifetime, sector = tier start + uBlockNo % tier blocks
+  uint32_t uFirstEpoch; // time of the first record (sparse index key)
+  uint32_t uCrc;        // CRC32 of the fields above
+};
+
+// One raw sample (16 bytes, all 0xFF while unwritten)
+struct __attribute__((packed)) FlogRecord
+{
+  uint32_t uSeq;   // measurement sequence number
+  uint32_t uEpoch; // UTC time (seconds since 1970), non-decreasing
+  int16_t iTmp;    // temperature (hundredths of Celcius), INT16_MIN if invalid
+  int16_t iHum;    // humidity (hundredths of percent), INT16_MIN if invalid
+  uint32_t uCrc;   // CRC32 of the fields above
+};
+
+// One aggregate of an aggregated tier (24 bytes), values in hundredths
+struct __attribute__((packed)) FlogAggregate
+{
+  uint32_t uEpoch;                        // step start (a multiple of the tier step)
+  uint16_t auCount[STATS_CHANNEL_COUNT];  // valid samples per channel
+  int16_t aiMean[STATS_CHANNEL_COUNT];
+  int16_t aiMin[STATS_CHANNEL_COUNT];
+  int16_t aiMax[STATS_CHANNEL_COUNT];
+  uint32_t uCrc;                          // CRC32 of the fields above
+};
+
+// Aggregate of one query time step [uStart, uStart + step)
+struct FlogStep
+{
+  uint32_t uStart;
+  uint16_t auCount[STATS_CHANNEL_COUNT]; // valid values per channel
+  float afMean[STATS_CHANNEL_COUNT];
+  float afMin[STATS_CHANNEL_COUNT];
+  float afMax[STATS_CHANNEL_COUNT];
+};
+
+// Called for every non-empty step, in time order, false to stop the query
+typedef bool (*FlogStepHandler)(const FlogStep &oStep, void *pContext);
+
+// One stored record of a tier, values in hundredths (INT16_MIN : no value)
+struct FlogItem
+{
+  uint32_t uEpoch;                       // sample time, or step start of an aggregate
+  uint32_t uSeq;                         // measurement sequence number (raw tier), 0 for aggregates
+  uint16_t auCount[STATS_CHANNEL_COUNT]; // samples behind the values (0 or 1 on the raw tier)
+  int16_t aiMean[STATS_CHANNEL_COUNT];
+  int16_t aiMin[STATS_CHANNEL_COUNT];
+  int16_t aiMax[STATS_CHANNEL_COUNT];
+};
+
+// Position of a record by record read of one tier (bulk export)
+struct FlogCursor
+{
+  uint8_t uTier;
+  uint32_t uBlockNo; // next record : block number
+  uint32_t uSlot;    // and slot in that block
+  uint32_t uFrom;    // time range read
+  uint32_t uTo;
+  bool bDone;
+};
+
+// Cost of a query
+struct FlogQueryStats
+{
+  uint8_t uTier;         // tier read
+  uint32_t uBlocksRead;  // blocks streamed
+  uint32_t uRecordsRead; // records read (valid or not) from those blocks
+  uint32_t uSteps;       // steps handed to the handler
+};
+
+// State of one tier
+struct FlashLogStats
+{
+  uint32_t uStep;         // aggregation step (seconds, 0 : raw samples)
+  uint32_t uCapacity;     // blocks of the tier (0 : no log)
+  uint32_t uBlocks;       // blocks in use
+  uint32_t uRecords;      // records stored
+  uint32_t uOldestEpoch;  // time of the oldest stored record, 0 if empty
+  uint32_t uNewestEpoch;  // time of the newest record, 0 if empty
+  uint32_t uAppended;     // records appended since boot
+  uint32_t uBytesWritten; // flash bytes written since boot (headers included)
+  uint32_t uErases;       // blocks erased since boot
+  uint32_t uErrors;       // flash read / write / erase failures since boot
+};
+
+// Compaction counters since boot
+struct CompactionStats
+{
+  uint32_t uSlices;         // slices run
+  uint32_t uRecordsRead;    // source records read
+  uint32_t uAggregates;     // aggregates written
+  uint64_t ullBusyMicros;   // time spent in slices
+  uint32_t uMaxSliceMicros; // longest slice
+  uint32_t uBacklog;        // source records still to compact (approx.)
+};
+
+// Open the log (partition label on the ESP32, file path on host) and
+// rebuild the sparse index, false if there is no usable partition
+bool beginFlashLog(const char *pSource);
+
+// Start the compaction task (ESP32 only, on host builds call compactFlashLog())
+void beginFlashCompaction();
+
+// Append a measurement to the raw tier (measurement bus handler) : restored
+// records and records without wall-clock time (never NTP synchronised) are skipped
+void appendFlashLog(const Measurement &oMeasurement);
+
+// Run one compaction slice : read up to uMaxRecords source records of every
+// aggregated tier, write the aggregates of the steps they close. Returns the
+// number of source records read (0 : nothing to compact)
+uint32_t compactFlashLog(uint32_t uMaxRecords);
+
+// Aggregate the records of [uFrom, uTo] per uStep seconds (steps start at
+// uFrom), returns the number of steps handed to pHandler. The data comes
+// from the coarsest tier whose step fits uStep and that still covers uFrom
+// (else the tier reaching furthest back), or from iFirstTier if given : a
+// query resumed after its handler stopped passes the tier the first one
+// started with (FlogQueryStats::uTier), to get the same steps. pStats, if
+// not nullptr, receives the query cost.
+uint32_t queryFlashLog(uint32_t uFrom, uint32_t uTo, uint32_t uStep, FlogStepHandler pHandler, void *pContext,
+                       FlogQueryStats *pStats, int8_t iFirstTier = -1);
+
+// Start reading the records of tier uTier in [uFrom, uTo], false if out of range
+bool openFlashCursor(FlogCursor &oCursor, uint8_t uTier, uint32_t uFrom, uint32_t uTo);
+
+// Read the next records of a cursor (at most uMaxItems, in time order) into
+// pItems and, if pStored is not nullptr, their stored bytes (FlogRecord or
+// FlogAggregate) into pStored. Returns the number of records, 0 once the
+// range or the written part of the tier is over. Records recycled while the
+// cursor lagged behind are skipped.
+uint32_t readFlashCursor(FlogCursor &oCursor, FlogItem *pItems, uint32_t uMaxItems, uint8_t *pStored);
+
+// Size of the stored records of tier uTier (0 if out of range)
+uint32_t flashRecordLen(uint8_t uTier);
+
+// State of tier uTier, false if out of range
+bool getFlashLogStats(uint8_t uTier, FlashLogStats &oStats);
+
+// Compaction counters
+void getCompactionStats(CompactionStats &oStats);
+
+#endif // FLASH_LOG_H
@@ -0,0 +1,51 @@
+// Data freshness and end-to-end latency instrumentation
+//
+// With a 30 s sample period and 10 s page polling, a displayed value may be
+// ~40 s old. Two histograms quantify it : the age of the sample when a data
+// endpoint serves it (recorded per request by the servers), and the
+// sensor-to-screen latency reported back by the page when it displays a new
+// sample (served age + half the request round trip).
+
+#ifndef FRESHNESS_H
+#define FRESHNESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRESH_BUCKET_COUNT 10 // histogram buckets (see FRESH_BUCKET_BOUNDS)
+
+// Bucket upper bounds (milliseconds), the last bucket is unbounded
+#define FRESH_BUCKET_BOUNDS {1000, 2000, 5000, 10000, 20000, 30000, 40000, 60000, 120000, UINT32_MAX}
+
+// FRESH_DISPLAYED values come from any client : larger ones are recorded as
+// this (5 sample periods, in the unbounded bucket), so one bogus report
+// cannot pin the max. or drag the mean
+#define FRESH_DISPLAYED_MAX_MS 150000
+
+// Measured latency
+enum FreshnessKind : uint8_t
+{
+  FRESH_SERVED = 0, // sample age when served
+  FRESH_DISPLAYED,  // sensor-to-screen latency reported by the page
+  FRESH_KIND_COUNT
+};
+
+struct FreshnessHistogram
+{
+  uint32_t uCount;
+  uint32_t uMeanMs;
+  uint32_t uMaxMs;
+  uint32_t uLastMs;
+  uint32_t auBuckets[FRESH_BUCKET_COUNT];
+};
+
+// Record one latency (milliseconds, FRESH_DISPLAYED ones clamped to FRESH_DISPLAYED_MAX_MS)
+void recordFreshness(FreshnessKind eKind, uint32_t uMs);
+
+// Copy a histogram, false if eKind is out of range
+bool getFreshness(FreshnessKind eKind, FreshnessHistogram &oHistogram);
+
+// Upper bound of bucket uBucket (milliseconds)
+uint32_t freshnessBound(uint8_t uBucket);
+
+#endif // FRESHNESS_H
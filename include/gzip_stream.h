@@ -0,0 +1,73 @@
+// Small-window streaming gzip compressor
+//
+// Deflate (RFC 1951) behind a gzip (RFC 1952) header, with LZ77 matches
+// searched in a GZIP_WINDOW sliding window through hash chains bounded to
+// GZIP_MAX_CHAIN candidates, and one byte of lazy matching. The input is
+// cut into blocks of GZIP_DEFLATE_BLOCK bytes, each sent with its own
+// Huffman codes, the fixed ones or stored as is, whichever is smaller
+// (incompressible input grows by 5 bytes per block at most). All the state
+// lives in the caller's GzipStream (about 21 KB, meant to be static), there
+// is no allocation, and every call compresses at most GZIP_BLOCK_LEN input
+// bytes and writes at most GZIP_OUT_MAX bytes : RAM and CPU per call are
+// bounded, so responses can be compressed chunk by chunk while they are sent.
+
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GZIP_WINDOW 2048        // LZ77 window (bytes, power of 2, <= 32768)
+#define GZIP_HASH_BITS 10       // hash chain heads : 1 << GZIP_HASH_BITS
+#define GZIP_MAX_CHAIN 16       // match candidates tried per position (CPU bound)
+#define GZIP_LAZY_MATCH 16      // shorter matches are retried one byte later
+#define GZIP_BLOCK_LEN 1024     // max. input bytes per gzipCompress() call (<= GZIP_WINDOW)
+#define GZIP_DEFLATE_BLOCK 2048 // input bytes per deflate block (Huffman codes sent per block)
+
+#define GZIP_LITLEN_CODES 288 // 286 used, the fixed code has 288
+#define GZIP_DIST_CODES 30
+#define GZIP_CODES (GZIP_LITLEN_CODES + GZIP_DIST_CODES)
+
+// Max. output of one gzipCompress() / gzipFinish() call (a block costs at
+// most 9 bits per input byte, the fixed-code literal cost, else it is stored)
+#define GZIP_OUT_MAX (GZIP_DEFLATE_BLOCK * 9 / 8 + 24)
+#define GZIP_HEADER_LEN 10 // gzipBegin() output
+
+struct GzipStream
+{
+  uint8_t auWindow[2 * GZIP_WINDOW];    // previous GZIP_WINDOW bytes, then the input being compressed
+  uint16_t auHead[1 << GZIP_HASH_BITS]; // newest window position per hash
+  uint16_t auPrev[GZIP_WINDOW];         // previous position with the same hash, per stream offset % GZIP_WINDOW
+  uint32_t uPos;                        // bytes in auWindow
+  uint32_t uBase;                       // stream offset of auWindow[0] (mod 2^32)
+  // Symbols of the current block : literal byte or match length - 3, distance (0 : literal)
+  uint8_t auSymbol[GZIP_DEFLATE_BLOCK];
+  uint16_t auDistance[GZIP_DEFLATE_BLOCK];
+  uint16_t uSymbols;
+  uint16_t uBlockIn;                    // input bytes of the current block
+  uint16_t auFreq[GZIP_CODES];          // literal / length then distance code frequencies
+  uint8_t auLength[GZIP_CODES];         // code lengths of the block
+  uint16_t auCode[GZIP_CODES];          // codes, bit-reversed for output
+  // Huffman construction scratch : leaves by frequency, then the merged nodes
+  uint16_t auOrder[GZIP_LITLEN_CODES];
+  uint16_t auWeight[2 * GZIP_LITLEN_CODES];
+  uint16_t auParent[2 * GZIP_LITLEN_CODES];
+  uint8_t auRle[GZIP_CODES];            // run-length coded code lengths (symbols 0..18)
+  uint8_t auRleExtra[GZIP_CODES];
+  uint32_t uBits;                       // pending output bits (LSB first)
+  uint8_t uBitCount;
+  uint32_t uCrc;                        // CRC32 of the input
+  uint32_t uInLen;                      // input bytes (mod 2^32)
+};
+
+// Start a stream, writes the gzip header to pOut (GZIP_HEADER_LEN bytes)
+size_t gzipBegin(GzipStream &oStream, uint32_t uMtime, uint8_t *pOut);
+
+// Compress uLen (<= GZIP_BLOCK_LEN) input bytes, writes the blocks they
+// complete to pOut (at most GZIP_OUT_MAX bytes) and returns their length
+size_t gzipCompress(GzipStream &oStream, const uint8_t *pIn, size_t uLen, uint8_t *pOut);
+
+// End the stream, writes the last block and the gzip trailer to pOut (at most GZIP_OUT_MAX bytes)
+size_t gzipFinish(GzipStream &oStream, uint8_t *pOut);
+
+#endif // GZIP_STREAM_H
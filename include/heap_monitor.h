@@ -0,0 +1,54 @@
+// Heap fragmentation monitor
+//
+// Samples free heap and largest free block periodically and keeps a linear
+// regression of the fragmentation (1 - largest block / free heap) over the
+// last HEAP_HISTORY_LEN samples, with running sums (O(1) per sample). A
+// slope above HEAP_FRAG_SLOPE_LIMIT flags an upward fragmentation trend,
+// the usual precursor of allocation failures after weeks of uptime.
+// The sampling function takes the values as arguments, so a simulation can
+// feed it with an instrumented allocator at accelerated virtual time.
+//
+// In DEBUG builds operator new also records allocation counts per call site.
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HEAP_SAMPLE_PERIOD 7200000UL // sample every 2 h (milliseconds), window = 7 days
+#define HEAP_HISTORY_LEN 84          // regression window (samples), long enough to average request churn
+#define HEAP_FRAG_SLOPE_LIMIT 5.0f   // max. fragmentation increase (permille per day)
+#define HEAP_MAX_SITES 16            // call sites tracked in DEBUG builds
+
+struct HeapTrend
+{
+  uint32_t uSamples;      // samples taken since boot
+  uint32_t uFreeHeap;     // last sample
+  uint32_t uMaxBlock;     // last sample
+  uint32_t uMinMaxBlock;  // smallest largest-block ever seen
+  uint16_t uFragPermille; // last fragmentation (permille)
+  float fSlopePerDay;     // fragmentation trend (permille per day)
+  bool bRising;           // window full and slope above HEAP_FRAG_SLOPE_LIMIT
+};
+
+struct HeapSite
+{
+  const void *pCaller; // return address of the operator new caller
+  uint32_t uCount;     // allocations
+  uint32_t uBytes;     // bytes allocated
+};
+
+// Record one sample (ulMillis : sample time), returns true if the trend is rising
+bool sampleHeap(unsigned long ulMillis, uint32_t uFreeHeap, uint32_t uMaxBlock);
+
+// Current trend
+void getHeapTrend(HeapTrend &oTrend);
+
+// Record an allocation by pCaller (lock-free, safe from any task)
+void recordAllocSite(const void *pCaller, size_t uSize);
+
+// Call site uSite (by insertion order), false if out of range
+bool getHeapSite(uint8_t uSite, HeapSite &oSite);
+
+#endif // HEAP_MONITOR_H
@@ -0,0 +1,66 @@
+// Bulk history export
+//
+// Streams the records of one flash log tier over a time range as CSV,
+// NDJSON or the stored binary records, optionally gzip compressed on the
+// fly (gzip_stream.h), for chunked HTTP responses. Each fillExport() call
+// formats and compresses at most EXPORT_CHUNK_INPUT bytes, so a long export
+// is spread over many short slices of the web server task instead of
+// holding it (or the RAM of the whole file) at once. The buffers are static
+// (about 26 KB with the compressor) : one export runs at a time, an export
+// whose client stopped pulling for EXPORT_IDLE_TIMEOUT can be taken over.
+// Called from the web server task only.
+
+#ifndef HISTORY_EXPORT_H
+#define HISTORY_EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EXPORT_CHUNK_INPUT 2048    // max. formatted bytes per fillExport() call (CPU bound per chunk)
+#define EXPORT_IDLE_TIMEOUT 30000  // an export not pulled for this long is abandoned (milliseconds)
+
+enum ExportFormat
+{
+  EXPORT_CSV,    // header line, then one line per record
+  EXPORT_NDJSON, // one JSON object per line
+  EXPORT_BINARY  // stored records as is (FlogRecord or FlogAggregate, little endian, with their CRC)
+};
+
+// Outcome of beginExport()
+enum ExportResult : uint8_t
+{
+  EXPORT_STARTED = 0, // uId is the new export
+  EXPORT_BUSY,        // another export is running (retry later)
+  EXPORT_NO_LOG,      // no flash log (no usable partition)
+  EXPORT_BAD_TIER,    // tier out of range
+  EXPORT_EMPTY        // the tier holds no records yet
+};
+
+// Export counters since boot
+struct ExportStats
+{
+  uint32_t uStarted;        // exports started
+  uint32_t uCompleted;      // exports sent to the end
+  uint32_t uRefused;        // refused while another export was running
+  uint32_t uRecords;        // records exported
+  uint64_t ullBytesIn;      // formatted bytes (before compression)
+  uint64_t ullBytesOut;     // bytes sent (after compression)
+  uint64_t ullBusyMicros;   // time spent formatting and compressing
+  uint32_t uMaxChunkMicros; // longest fillExport() call
+};
+
+// Start an export of tier uTier records in [uFrom, uTo], uId receives its
+// id (0 unless EXPORT_STARTED)
+ExportResult beginExport(ExportFormat eFormat, uint8_t uTier, uint32_t uFrom, uint32_t uTo, bool bGzip, uint32_t &uId);
+
+// Next bytes of export uId (at most uMaxLen) into pBuffer, 0 once it is over
+// (or if uId was taken over)
+size_t fillExport(uint32_t uId, uint8_t *pBuffer, size_t uMaxLen);
+
+// Release export uId (end of the response or client gone)
+void endExport(uint32_t uId);
+
+// Export counters
+void getExportStats(ExportStats &oStats);
+
+#endif // HISTORY_EXPORT_H
@@ -0,0 +1,99 @@
+// Sample history store
+//
+// Every measurement is appended as a compact record (sequence number, UTC
+// time, values in hundredths) to a RAM ring. Records are addressed by a
+// monotonic index : readers walk [historyFirst(), historyEnd()) and simply
+// get false for records that were overwritten meanwhile, so queries stream
+// the store without copying it or holding a lock for more than one block.
+//
+// beginHistoryStore() places the ring in PSRAM when the module has some
+// (WROVER : HISTORY_PSRAM_LEN samples, weeks instead of hours), else takes
+// HISTORY_RAM_LEN samples of internal RAM from the heap (fewer if it cannot
+// spare them) : no internal RAM is reserved for a ring in PSRAM. Samples
+// before it, or without any ring, are not kept. PSRAM is reached through the
+// 32-byte lines of the external RAM cache, and a miss costs far more than
+// an internal RAM access : the ring is cut into blocks of HISTORY_BLOCK_LEN
+// records aligned on cache lines, and bulk readers copy a whole block under
+// one lock (readHistoryBlock()) so every line is fetched once, sequentially.
+// On host builds, defining HISTORY_EMULATE_PSRAM places the ring in a heap
+// region of the PSRAM size, to benchmark the layout.
+
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <stdint.h>
+#include "measurement.h"
+
+#ifndef HISTORY_RAM_LEN
+#define HISTORY_RAM_LEN 1024 // records kept in internal RAM (8.5 h at 30 s, power of 2)
+#endif
+#ifndef HISTORY_PSRAM_LEN
+#define HISTORY_PSRAM_LEN 131072 // records kept in PSRAM (45 days at 30 s, 1.5 MB, power of 2)
+#endif
+#define HISTORY_BLOCK_LEN 32  // records per block (384 bytes = 12 cache lines)
+#define HISTORY_CACHE_LINE 32 // external RAM cache line (block alignment)
+
+#define HISTORY_NONE INT16_MIN // value of an invalid reading
+
+// One stored sample (12 bytes)
+struct HistoryRecord
+{
+  uint32_t uSeq;   // measurement sequence number
+  uint32_t uEpoch; // UTC time (seconds since 1970)
+  int16_t iTmp;    // temperature (hundredths of Celcius), HISTORY_NONE if invalid
+  int16_t iHum;    // humidity (hundredths of percent), HISTORY_NONE if invalid
+};
+
+// Where the ring lives
+enum HistoryMemory
+{
+  HISTORY_DRAM,  // internal RAM
+  HISTORY_PSRAM  // external SPI RAM
+};
+
+struct HistoryInfo
+{
+  HistoryMemory eMemory;
+  uint32_t uCapacity; // records
+  uint32_t uBytes;    // ring size
+};
+
+// Place the ring (call once, before the first sample) : in PSRAM if found
+// and large enough for more than the internal RAM ring, else internal RAM
+// (capacity 0 if the heap cannot spare a block)
+void beginHistoryStore();
+
+// Memory and capacity of the ring
+void getHistoryInfo(HistoryInfo &oInfo);
+
+// Append a measurement (measurement bus handler)
+void addHistorySample(const Measurement &oMeasurement);
+
+// Index of the oldest record still stored
+uint32_t historyFirst();
+
+// Index after the newest record
+uint32_t historyEnd();
+
+// Copy record uIndex, false if it is not (or no longer) stored
+bool readHistory(uint32_t uIndex, HistoryRecord &oRecord);
+
+// Copy the stored records from uIndex to the end of its block (at most
+// HISTORY_BLOCK_LEN) into pRecords, returns their number (0 if uIndex is
+// not stored)
+uint32_t readHistoryBlock(uint32_t uIndex, HistoryRecord *pRecords);
+
+// Index of the first stored record at or after uEpoch (historyEnd() if none),
+// by binary search : the record times are increasing
+uint32_t findHistory(uint32_t uEpoch);
+
+// Index of the first stored record newer than sequence number uSeq
+// (historyEnd() if none) : the delta a client holding up to uSeq misses.
+// Sequence numbers increase within a boot (see historyGeneration()).
+uint32_t findHistorySince(uint32_t uSeq);
+
+// Random id of this boot's ring (31 bits, never 0, set by
+// beginHistoryStore()) : a client cursor from another generation is stale
+uint32_t historyGeneration();
+
+#endif // HISTORY_STORE_H
@@ -0,0 +1,68 @@
+// Pre-split HTML template renderer
+//
+// The %PLACEHOLDER% template (index_html) is scanned once at boot into a
+// table of literal spans and placeholder IDs. Each page request then
+// streams the literal spans straight from flash and the placeholder values
+// from a small pre-formatted cache : no byte-by-byte scanning, no String
+// allocation and no name comparison per request. Pages being sent render
+// from one of TPL_MAX_RENDERS static snapshots of the cache, so a request
+// costs no heap beyond the web server's own response object.
+
+#ifndef HTML_TEMPLATE_H
+#define HTML_TEMPLATE_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#define PGM_P const char * // host build : templates live in RAM
+#endif
+
+#define TPL_MAX_SEGMENTS 32 // max. literal spans + placeholders in a template
+#define TPL_VALUE_LEN 24    // max. formatted value length (incl. '\0')
+#define TPL_NAME_LEN 32     // max. placeholder name length (same as AsyncWebServer)
+#define TPL_MAX_RENDERS 4   // pages sent at once (static snapshots of the value cache)
+
+// Placeholder IDs (index into the value cache)
+enum TemplateVar : uint8_t
+{
+  TPL_MEASURETIME = 0,
+  TPL_REFRESHTIME,
+  TPL_TEMPERATURE,
+  TPL_HUMIDITY,
+  TPL_VAR_COUNT,
+  TPL_LITERAL = 0xFF // segment is a literal span of the template
+};
+
+// Values of the cache taken when a page starts, so that it is rendered from
+// one consistent set of values
+struct TemplateSnapshot
+{
+  char acValue[TPL_VAR_COUNT][TPL_VALUE_LEN];
+  uint8_t auLen[TPL_VAR_COUNT];
+};
+
+// Split a PROGMEM template into segments (call once from setup())
+bool initTemplate(PGM_P pTemplate);
+
+// Update one pre-formatted value of the cache (safe from any task)
+void setTemplateValue(TemplateVar eVar, const char *pValue);
+
+// Copy one cached value into pBuffer (safe from any task)
+void getTemplateValue(TemplateVar eVar, char *pBuffer, size_t uLen);
+
+// Snapshot of the cache, returns the length of the page rendered from it
+size_t snapshotTemplate(TemplateSnapshot &oSnapshot);
+
+// Render bytes uIndex.. of the page (at most uMaxLen), returns the bytes written
+size_t renderTemplate(const TemplateSnapshot &oSnapshot, uint8_t *pBuffer, size_t uMaxLen, size_t uIndex);
+
+#ifdef ARDUINO
+// Build a response rendering the template with a snapshot of the cache,
+// nullptr if TPL_MAX_RENDERS pages are already being sent
+AsyncWebServerResponse *beginTemplateResponse(AsyncWebServerRequest *request, const char *pContentType);
+#endif
+
+#endif // HTML_TEMPLATE_H
@@ -1,7 +1,11 @@
 // The main web page
 
 // for PROGMEM
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#define PROGMEM // host build (tests)
+#endif
 
 const char index_html[] PROGMEM = R"rawliteral(
 <!DOCTYPE HTML><html>
@@ -23,6 +27,8 @@ const char index_html[] PROGMEM = R"rawliteral(
       vertical-align:middle;
       padding-bottom: 15px;
     }
+    table { margin: 0px auto; font-size: 1.2rem; border-collapse: collapse; }
+    td, th { padding: 2px 12px; }
   </style>
 </head>
 <body>
@@ -32,7 +38,7 @@ const char index_html[] PROGMEM = R"rawliteral(
     <span id="measuretime">%MEASURETIME%</span>
   </p>
   <p>
-    <span class="dht-labels">Display refreshed at : </span>
+    <span class="dht-labels">Device time : </span>
     <span id="refreshtime">%REFRESHTIME%</span>
   </p>
   <p/>
@@ -48,50 +54,220 @@ const char index_html[] PROGMEM = R"rawliteral(
     <span id="humidity">%HUMIDITY%</span>
     <sup class="units">%</sup>
   </p>
+  <p class="dht-labels" id="trend"></p>
+  <table>
+    <thead><tr><th></th><th>Temp. min / mean / max</th><th>Humid. min / mean / max</th></tr></thead>
+    <tbody id="stats"></tbody>
+  </table>
+  <canvas id="history" width="600" height="200"></canvas>
+  <p class="dht-labels"><a href="/api/export?format=csv">Download the history (CSV)</a></p>
 </body>
 <script>
-setInterval(function ( ) {
+// Measurement record : values, then report the sensor-to-screen latency of
+// each new sample (age when served + half the request round trip). Fetched
+// again just after the next sample (X-Next-Sample-Ms), with a random extra
+// delay so that the viewers do not all ask at the same instant. A new sample
+// also refreshes the statistics, the trend and (every other one) the history
+var REFRESH_DELAY_MS = 500;   // after the next sample time
+var REFRESH_JITTER_MS = 3000; // random extra delays (0 to this)
+var REFRESH_RETRY_MS = 10000; // when the device did not tell the next sample time
+var lastSeq = -1;
+var newSamples = 0;
+function refresh() {
+  var sentAt = Date.now();
   var xhttp = new XMLHttpRequest();
   xhttp.onreadystatechange = function() {
-    if (this.readyState == 4 && this.status == 200) {
-      document.getElementById("measuretime").innerHTML = this.responseText;
+    if (this.readyState != 4) return;
+    var next = parseInt(this.getResponseHeader("X-Next-Sample-Ms"), 10);
+    if (this.status == 200) {
+      var m = JSON.parse(this.responseText);
+      document.getElementById("measuretime").innerHTML = m.time + ((m.flags & 4) ? " (restored)" : "");
+      document.getElementById("temperature").innerHTML = (m.temperature === null) ? "N/A" : m.temperature.toFixed(2);
+      document.getElementById("humidity").innerHTML = (m.humidity === null) ? "N/A" : m.humidity.toFixed(2);
+      if (m.seq != lastSeq) {
+        if (m.ageMs !== null) {
+          var report = new XMLHttpRequest();
+          report.open("POST", "/api/freshness/report?seq=" + m.seq + "&ms=" + Math.round(m.ageMs + (Date.now() - sentAt) / 2), true);
+          report.send();
+        }
+        setTimeout(showStats, Math.random() * REFRESH_JITTER_MS);
+        setTimeout(showTrend, Math.random() * REFRESH_JITTER_MS);
+        if (lastSeq >= 0 && (++newSamples & 1) == 0) setTimeout(syncHistory, Math.random() * REFRESH_JITTER_MS);
+        lastSeq = m.seq;
+      }
     }
+    setTimeout(refresh, (isNaN(next) ? REFRESH_RETRY_MS : next + REFRESH_DELAY_MS) + Math.random() * REFRESH_JITTER_MS);
   };
-  xhttp.open("GET", "/measuretime", true);
+  xhttp.open("GET", "/api/measurement", true);
   xhttp.send();
-}, 10000 ) ;
+}
+refresh();
 
-setInterval(function ( ) {
+// Rolling min / mean / max per window
+function showStats() {
   var xhttp = new XMLHttpRequest();
   xhttp.onreadystatechange = function() {
     if (this.readyState == 4 && this.status == 200) {
-      document.getElementById("refreshtime").innerHTML = this.responseText;
+      var s = JSON.parse(this.responseText);
+      var cell = function(c) { return (c === null) ? "N/A" : c[3].toFixed(1) + " / " + c[1].toFixed(1) + " / " + c[4].toFixed(1); };
+      var rows = "";
+      for (var i = 0; i < s.windows.length; i++) {
+        var w = s.windows[i];
+        var label = (w.seconds >= 3600) ? (w.seconds / 3600) + " h" : (w.seconds / 60) + " min";
+        rows += "<tr><td>" + label + "</td><td>" + cell(w.temperature) + "</td><td>" + cell(w.humidity) + "</td></tr>";
+      }
+      document.getElementById("stats").innerHTML = rows;
     }
   };
-  xhttp.open("GET", "/refreshtime", true);
+  xhttp.open("GET", "/api/stats", true);
   xhttp.send();
-}, 10000 ) ;
+}
 
-setInterval(function ( ) {
+// Temperature trend and time to the next threshold crossing
+function showTrend() {
   var xhttp = new XMLHttpRequest();
   xhttp.onreadystatechange = function() {
     if (this.readyState == 4 && this.status == 200) {
-      document.getElementById("temperature").innerHTML = this.responseText;
+      var t = JSON.parse(this.responseText).temperature;
+      var text = "";
+      if (t !== null) {
+        text = "Trend : " + (t.slopePerHour >= 0 ? "+" : "") + t.slopePerHour.toFixed(1) + " &deg;C/h";
+        if (t.highEta !== null || t.lowEta !== null) {
+          var eta = (t.highEta !== null) ? t.highEta : t.lowEta;
+          var limit = (t.highEta !== null) ? t.high : t.low;
+          text += (eta == 0) ? ", beyond " + limit + " &deg;C" : ", will cross " + limit + " &deg;C in ~" + Math.max(1, Math.round(eta / 60)) + " min";
+        }
+      }
+      document.getElementById("trend").innerHTML = text;
     }
   };
-  xhttp.open("GET", "/temperature", true);
+  xhttp.open("GET", "/api/trend", true);
   xhttp.send();
-}, 10000 ) ;
+}
+
+// Temperature history, kept in the browser (IndexedDB) : only the samples
+// newer than the last one stored are fetched (/api/samples?since=), so a
+// reload or a reconnection costs one small request
+var HISTORY_KEEP_DAYS = 60;
+var samples = [];   // [epoch, temperature], in time order
+var sync = {key: "sync", generation: 0, last: 0};
+var db = null;
+var syncing = false;
 
-setInterval(function ( ) {
+function openHistory(done) {
+  if (!window.indexedDB) { done(); return; }
+  var request = indexedDB.open("climate", 1);
+  request.onupgradeneeded = function() {
+    request.result.createObjectStore("samples", {keyPath: "epoch"});
+    request.result.createObjectStore("meta", {keyPath: "key"});
+  };
+  request.onsuccess = function() {
+    db = request.result;
+    var tx = db.transaction(["samples", "meta"], "readwrite");
+    var store = tx.objectStore("samples");
+    store.delete(IDBKeyRange.upperBound(Date.now() / 1000 - HISTORY_KEEP_DAYS * 86400));
+    store.getAll().onsuccess = function(e) {
+      var stored = e.target.result;
+      for (var i = 0; i < stored.length; i++) {
+        if (stored[i].t !== null) samples.push([stored[i].epoch, stored[i].t]);
+      }
+    };
+    tx.objectStore("meta").get("sync").onsuccess = function(e) { if (e.target.result) sync = e.target.result; };
+    tx.oncomplete = function() { drawHistory(); done(); };
+  };
+  request.onerror = function() { done(); };
+}
+
+function syncHistory() {
+  if (syncing) return;
+  syncing = true;
   var xhttp = new XMLHttpRequest();
   xhttp.onreadystatechange = function() {
-    if (this.readyState == 4 && this.status == 200) {
-      document.getElementById("humidity").innerHTML = this.responseText;
+    if (this.readyState != 4) return;
+    syncing = false;
+    if (this.status != 200) return;
+    var r = JSON.parse(this.responseText);
+    var tx = db ? db.transaction(["samples", "meta"], "readwrite") : null;
+    for (var i = 0; i < r.samples.length; i++) {
+      var s = r.samples[i];
+      if (tx) tx.objectStore("samples").put({epoch: s[1], seq: s[0], t: s[2], h: s[3]});
+      if (s[2] !== null && (samples.length == 0 || s[1] > samples[samples.length - 1][0])) samples.push([s[1], s[2]]);
+    }
+    sync.generation = r.generation;
+    sync.last = r.last;
+    if (tx) tx.objectStore("meta").put(sync);
+    if (r.more) syncHistory(); else drawHistory();
+  };
+  xhttp.open("GET", "/api/samples?since=" + sync.last + "&generation=" + sync.generation, true);
+  xhttp.send();
+}
+
+// One min-max stroke per pixel column : every sample counts, whatever their number
+function drawHistory() {
+  var canvas = document.getElementById("history");
+  var ctx = canvas.getContext("2d");
+  ctx.clearRect(0, 0, canvas.width, canvas.height);
+  if (samples.length < 2) return;
+  var t0 = samples[0][0], t1 = samples[samples.length - 1][0], lo = samples[0][1], hi = samples[0][1];
+  for (var i = 1; i < samples.length; i++) { lo = Math.min(lo, samples[i][1]); hi = Math.max(hi, samples[i][1]); }
+  if (hi - lo < 1) { lo -= 0.5; hi += 0.5; }
+  var y = function(v) { return 15 + (hi - v) / (hi - lo) * (canvas.height - 30); };
+  ctx.strokeStyle = "#059e8a";
+  ctx.beginPath();
+  var column = -1, low = 0, high = 0;
+  for (var i = 0; i <= samples.length; i++) {
+    var x = (i < samples.length) ? Math.round((samples[i][0] - t0) / Math.max(1, t1 - t0) * (canvas.width - 1)) : -2;
+    if (x != column) {
+      if (column < 0) ctx.moveTo(x, y(samples[i][1]));
+      else { ctx.lineTo(column, y(high)); ctx.lineTo(column, y(low)); }
+      if (i == samples.length) break;
+      column = x;
+      low = high = samples[i][1];
+    } else {
+      low = Math.min(low, samples[i][1]);
+      high = Math.max(high, samples[i][1]);
+    }
+  }
+  ctx.stroke();
+  ctx.fillStyle = "#000";
+  ctx.font = "12px Arial";
+  ctx.fillText(hi.toFixed(1), 2, 12);
+  ctx.fillText(lo.toFixed(1), 2, canvas.height - 3);
+}
+openHistory(syncHistory);
+
+// Device clock : a single /api/time exchange gives its offset to the browser
+// clock (plus half the round trip), then it is ticked locally on each second.
+// Synchronised again hourly, or every minute while the device has no NTP time
+var clockOffsetMs = null; // device local time - Date.now()
+function syncClock() {
+  var sentAt = Date.now();
+  var xhttp = new XMLHttpRequest();
+  xhttp.onreadystatechange = function() {
+    if (this.readyState != 4) return;
+    var next = 60000;
+    if (this.status == 200) {
+      var c = JSON.parse(this.responseText);
+      var now = Date.now();
+      clockOffsetMs = (c.epoch + c.offset) * 1000 + c.ms + (now - sentAt) / 2 - now;
+      if (c.ntp != 0) next = 3600000;
     }
+    setTimeout(syncClock, next);
   };
-  xhttp.open("GET", "/humidity", true);
+  xhttp.open("GET", "/api/time", true);
   xhttp.send();
-}, 10000 ) ;
+}
+function tickClock() {
+  var t = Date.now() + clockOffsetMs;
+  if (clockOffsetMs !== null) {
+    var s = Math.floor(t / 1000);
+    var two = function(v) { return (v < 10 ? "0" : "") + v; };
+    document.getElementById("refreshtime").innerHTML = two(Math.floor(s / 3600) - Math.floor(s / 86400) * 24) + ":" +
+      two(Math.floor(s / 60) - Math.floor(s / 3600) * 60) + ":" + two(s - Math.floor(s / 60) * 60);
+  }
+  setTimeout(tickClock, 1000 - (t - Math.floor(t / 1000) * 1000));
+}
+syncClock();
+tickClock();
 </script>
 </html>)rawliteral";
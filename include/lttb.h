@@ -0,0 +1,26 @@
+// Largest-Triangle-Three-Buckets downsampling
+//
+// Reduces a series to uPoints points that keep its visual shape (peaks and
+// dips), for charts. The points are read through a callback, in two
+// sequential passes over the source (bucket averages, then the selection),
+// so the series is streamed from its store and memory is O(uPoints) : the
+// caller provides the output and scratch buffers.
+
+#ifndef LTTB_H
+#define LTTB_H
+
+#include <stdint.h>
+
+// Read point uIndex of the source, false if it has no value (hole, skipped)
+typedef bool (*LttbReader)(uint32_t uIndex, float &fX, float &fY, void *pContext);
+
+// Scratch floats needed for uPoints output points
+#define LTTB_SCRATCH_LEN(uPoints) (3 * (uPoints))
+
+// Downsample the source points [uFirst, uEnd) to at most uPoints (>= 3)
+// points : their indexes, increasing, go to puSelected. Returns the number
+// of selected points (all the valid points if there are no more than uPoints)
+uint16_t lttbDownsample(uint32_t uFirst, uint32_t uEnd, uint16_t uPoints, LttbReader pReader, void *pContext,
+                        uint32_t *puSelected, float *pfScratch);
+
+#endif // LTTB_H
@@ -0,0 +1,52 @@
+// Coalesced on-demand measurement requests
+//
+// /api/measure-now asks for a fresh reading without waiting for the next
+// periodic sample. The web task only registers the request (never waits for
+// the sensor) : every caller arriving while a read is pending joins it, so
+// concurrent callers cost a single sensor read. A request within
+// MEASURE_NOW_MIN_INTERVAL of the last sample (the DHT22 cannot be read more
+// often) is answered with that sample. The sampler polls for a pending
+// request and reports every sample taken, periodic ones included : any new
+// sample satisfies the pending callers. The interval holds for the periodic
+// slots too : a slot within MEASURE_NOW_MIN_INTERVAL of the last sensor read
+// reuses that read instead of reading the sensor again.
+//
+// The functions take the times as arguments, so they can be exercised on a
+// host with simulated concurrent callers.
+
+#ifndef MEASURE_NOW_H
+#define MEASURE_NOW_H
+
+#include <stdint.h>
+
+#define MEASURE_NOW_MIN_INTERVAL 2000UL // DHT22 minimum sampling interval (milliseconds)
+
+// Outcome of a request
+enum MeasureNowResult : uint8_t
+{
+  MEASURE_NOW_CACHED = 0, // last sample recent enough : uSeq is the last sample
+  MEASURE_NOW_SCHEDULED,  // first caller : a read is scheduled, uSeq is the sample to wait for
+  MEASURE_NOW_JOINED      // a read was already pending : uSeq is the sample to wait for
+};
+
+// Sampler : sequence number of the last sample before the first one (restored), at boot
+void beginMeasureNow(uint32_t uSeq);
+
+// Caller (web task) : register a request at ulMillis, uSeq receives the sample number to read
+MeasureNowResult requestMeasureNow(unsigned long ulMillis, uint32_t &uSeq);
+
+// Sampler : true if a read is pending and allowed at ulMillis
+bool measureNowPending(unsigned long ulMillis);
+
+// Sampler : true if the sensor may be read at ulMillis, false if the last
+// read is less than MEASURE_NOW_MIN_INTERVAL old and must be reused
+bool sensorReadAllowed(unsigned long ulMillis);
+
+// Sampler : sample uSeq was taken, with values read from the sensor at
+// ulReadMillis (earlier than the sample for a reused read), clears the pending request
+void measureNowTaken(uint32_t uSeq, unsigned long ulReadMillis);
+
+// Requests answered from the last sample, scheduled reads, joined callers
+void getMeasureNowStats(uint32_t &uCached, uint32_t &uScheduled, uint32_t &uJoined);
+
+#endif // MEASURE_NOW_H
@@ -0,0 +1,40 @@
+// Measurement record, published by the sampler to every consumer
+
+#ifndef MEASUREMENT_H
+#define MEASUREMENT_H
+
+#include <stdint.h>
+
+// Validity flags (Measurement::uFlags)
+#define MEAS_TMP_VALID 0x01 // fTmp (and fHtIdx, fSndSpd) read from the sensor
+#define MEAS_HUM_VALID 0x02 // fHum read from the sensor
+#define MEAS_RESTORED 0x04  // restored from RTC memory after a reset, not sampled on this boot
+#define MEAS_ON_DEMAND 0x08 // on-demand read (/api/measure-now), not a scheduled sample slot
+#define MEAS_REUSED 0x10    // slot sample carrying the previous read (sensor read less than 2 s before)
+
+// NTP synchronisation quality when sampled (Measurement::uNtpQuality)
+enum NtpQuality : uint8_t
+{
+  NTP_NONE = 0, // never synchronised : uEpoch and acTime are not wall-clock time
+  NTP_STALE,    // synchronised before, but the last update failed
+  NTP_SYNCED    // last update succeeded
+};
+
+struct Measurement
+{
+  uint32_t uSeq;          // sequence number, +1 per sample (gap = lost sample)
+  uint64_t ullMicros;     // esp_timer time when sampled (microseconds since boot, before boot if restored)
+  uint32_t uEpoch;        // UTC time when sampled (seconds since 1970)
+  uint32_t uReadMicros;   // sensor read duration, retries included
+  uint8_t uRetries;       // sensor read retries
+  uint8_t uFlags;         // MEAS_xxx validity flags
+  uint8_t uNtpQuality;    // NtpQuality
+  float fTmp;             // Temperature (Celcius)
+  float fHum;             // Humidity (percent)
+  float fHtIdx;           // Heat Index (Celcius)
+  float fSndSpd;          // Sound Speed (m/s)
+  unsigned long ulMillis; // millis() when sampled
+  char acTime[9];         // measurement time (HH:MM:SS, local)
+};
+
+#endif // MEASUREMENT_H
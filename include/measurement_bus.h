@@ -0,0 +1,62 @@
+// In-firmware publish/subscribe bus for measurement records
+//
+// The sampler publishes each new Measurement once. Every sink owns a bounded
+// lock-free SPSC queue (the sampler is the only producer, the bus delivery
+// task the only consumer) and a delivery policy. Publishing only copies the
+// record into the sink queues, so a slow sink never delays sampling : when
+// its queue is full the record is dropped for that sink and counted.
+
+#ifndef MEASUREMENT_BUS_H
+#define MEASUREMENT_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "measurement.h"
+#include "ring_buffer.h"
+
+#define MBUS_MAX_SINKS 12  // max. number of subscribed sinks
+#define MBUS_QUEUE_LEN 8   // records queued per sink (power of 2)
+
+// Delivery policy of a sink
+enum SinkPolicy : uint8_t
+{
+  SINK_EVERY = 0, // every record, in order
+  SINK_LATEST,    // only the newest record, older queued ones are skipped
+  SINK_DECIMATED  // one record out of uDecimation
+};
+
+typedef void (*MeasurementHandler)(const Measurement &oMeasurement);
+
+// Per-sink counters
+struct MeasurementSinkStats
+{
+  const char *pName;
+  uint32_t uOffered;   // records published while subscribed
+  uint32_t uDelivered; // records handed to the handler
+  uint32_t uSkipped;   // superseded (latest-only) or decimated records
+  uint32_t uDropped;   // records lost because the queue was full
+  uint32_t uLag;       // records waiting in the queue
+  uint32_t uMaxLag;    // max. records ever waiting in the queue
+};
+
+// Subscribe a sink (call from setup(), before the first publish),
+// returns the sink number or -1 if MBUS_MAX_SINKS is reached
+int subscribeMeasurements(const char *pName, SinkPolicy ePolicy, uint8_t uDecimation, MeasurementHandler pHandler);
+
+// Start the delivery task
+void beginMeasurementBus();
+
+// Publish a record to every sink (sampler only, never blocks)
+void publishMeasurement(const Measurement &oMeasurement);
+
+// Deliver the queued records of every sink (called by the delivery task,
+// or directly on host builds), returns the number of records delivered
+uint32_t deliverMeasurements();
+
+// Counters of one sink, false if uSink is not subscribed
+bool getSinkStats(uint8_t uSink, MeasurementSinkStats &oStats);
+
+// Number of subscribed sinks
+uint8_t sinkCount();
+
+#endif // MEASUREMENT_BUS_H
@@ -0,0 +1,14 @@
+// Compile-time path hashing shared by the route tables and the asset index
+
+#ifndef PATH_HASH_H
+#define PATH_HASH_H
+
+#include <stdint.h>
+
+// FNV-1a hash of a path, usable at compile time (C++11 constexpr)
+constexpr uint32_t hashPath(const char *pPath, uint32_t uHash = 2166136261UL)
+{
+  return *pPath ? hashPath(pPath + 1, (uHash ^ (uint8_t)*pPath) * 16777619UL) : uHash;
+}
+
+#endif // PATH_HASH_H
@@ -0,0 +1,78 @@
+// Open-addressing index of a const table of paths
+//
+// Entries carry their path (pPath) and its compile-time hashPath() (uHash).
+// A lookup hashes the path once and probes from its slot, the full path is
+// only compared on a hash match : the cost does not depend on the number of
+// entries as long as the index stays less than half full. Header-only, no
+// Arduino dependency (host benchmark in test/test_route_table).
+
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+#include "path_hash.h"
+
+template <typename T, uint16_t SIZE>
+class PathIndex
+{
+  static_assert(SIZE >= 2 && SIZE <= 512 && (SIZE & (SIZE - 1)) == 0,
+                "PathIndex size must be a power of 2, at most 512 (8-bit entry numbers)");
+
+public:
+  PathIndex() : _pEntries(nullptr) { memset(_auIndex, 0, sizeof(_auIndex)); }
+
+  // Index uCount entries, false on a duplicate path (*ppRefused : the
+  // duplicate) or if the index would be half full or more
+  bool begin(const T *pEntries, uint16_t uCount, const T **ppRefused = nullptr)
+  {
+    memset(_auIndex, 0, sizeof(_auIndex));
+    _pEntries = pEntries;
+    if (uCount >= SIZE / 2)
+    {
+      return false;
+    }
+    for (uint16_t uEntry = 0; uEntry < uCount; uEntry++)
+    {
+      if (find(pEntries[uEntry].pPath) != nullptr)
+      {
+        if (ppRefused != nullptr)
+        {
+          *ppRefused = &pEntries[uEntry];
+        }
+        return false;
+      }
+      // Linear probing from the hash slot
+      uint32_t uSlot = pEntries[uEntry].uHash & (SIZE - 1);
+      while (_auIndex[uSlot] != 0)
+      {
+        uSlot = (uSlot + 1) & (SIZE - 1);
+      }
+      _auIndex[uSlot] = uEntry + 1;
+    }
+    return true;
+  }
+
+  // Entry of a path, nullptr if none
+  const T *find(const char *pPath) const
+  {
+    uint32_t uHash = hashPath(pPath);
+    uint32_t uSlot = uHash & (SIZE - 1);
+    while (_auIndex[uSlot] != 0)
+    {
+      const T *pEntry = &_pEntries[_auIndex[uSlot] - 1];
+      if (pEntry->uHash == uHash && strcmp(pEntry->pPath, pPath) == 0)
+      {
+        return pEntry;
+      }
+      uSlot = (uSlot + 1) & (SIZE - 1);
+    }
+    return nullptr;
+  }
+
+private:
+  const T *_pEntries;
+  uint8_t _auIndex[SIZE]; // entry number + 1, 0 = empty slot
+};
+
+#endif // PATH_INDEX_H
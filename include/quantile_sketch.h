@@ -0,0 +1,56 @@
+// Streaming quantile sketches of temperature and humidity
+//
+// Percentiles (p5/p50/p95...) over the last days, computed on the device
+// with bounded memory. DHT readings are quantised (0.1 unit) and bounded,
+// so the sketch is a fixed-bin histogram per UTC day : QSKETCH_TMP_STEP /
+// QSKETCH_HUM_STEP wide bins, far below the sensor accuracy (+-0.5 C,
+// +-2 %RH). Quantiles are exact in rank and within half a bin in value,
+// whatever the number of samples.
+//
+// Sketches merge by adding the counts of equal bins : days are merged on
+// the fly by the queries, and the serialized sketch (sparse [bin, count]
+// pairs, bin value = min + (bin + 0.5) * step) can be merged across devices
+// the same way. Only scheduled samples are counted.
+
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <stdint.h>
+#include "measurement.h"
+#include "rolling_stats.h"
+
+#define QSKETCH_DAYS 7 // daily sketches kept, today included
+
+#define QSKETCH_TMP_MIN -40.0f // DHT22 range -40..80 C
+#define QSKETCH_TMP_STEP 0.25f
+#define QSKETCH_TMP_BINS 480
+#define QSKETCH_HUM_MIN 0.0f // 0..100 %RH
+#define QSKETCH_HUM_STEP 0.5f
+#define QSKETCH_HUM_BINS 200
+
+// Bin layout of one channel
+struct SketchAxis
+{
+  float fMin;     // lower bound of bin 0 (values below are counted in bin 0)
+  float fStep;    // bin width (values above the last bin are counted in it)
+  uint16_t uBins; // number of bins
+};
+
+// Add a measurement to today's sketch (measurement bus handler)
+void addSketchSample(const Measurement &oMeasurement);
+
+// Quantiles of one channel over the last uDays days (today included) :
+// pfQuantiles (increasing, 0..1) -> pfValues. Returns the number of samples,
+// 0 if there is none (pfValues left untouched)
+uint32_t getQuantiles(StatsChannel eChannel, uint8_t uDays, const float *pfQuantiles, uint8_t uCount, float *pfValues);
+
+// Count of bin uBin of one channel over the last uDays days
+uint32_t sketchBinCount(StatsChannel eChannel, uint8_t uDays, uint16_t uBin);
+
+// Bin layout of one channel
+const SketchAxis &sketchAxis(StatsChannel eChannel);
+
+// Days since the first sketched sample, today included (max. QSKETCH_DAYS)
+uint8_t sketchDays();
+
+#endif // QUANTILE_SKETCH_H
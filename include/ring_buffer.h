@@ -0,0 +1,160 @@
+// Lock-free fixed-capacity ring buffers for ISR / task hand-off
+//
+// SpscRing : one producer, one consumer (e.g. ISR or Ticker -> loop()).
+// MpscRing : several producers, one consumer (e.g. web + network tasks -> loop()).
+//
+// Header-only, capacity fixed at compile time (power of 2), no allocation and
+// no lock : push/pop are wait-free (SPSC) or lock-free (MPSC) and can be
+// called from an ISR. They are forced inline so that they end up in IRAM
+// when called from an IRAM_ATTR function. Producer and consumer indexes live
+// on separate cache lines to avoid false sharing between cores. Instances
+// are meant to be static/global objects (C++11 new ignores over-alignment).
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#ifdef ARDUINO
+#define RING_CACHE_LINE 32 // ESP32 cache line
+#else
+#define RING_CACHE_LINE 64
+#endif
+
+#define RING_INLINE inline __attribute__((always_inline))
+
+// Single-producer / single-consumer ring
+template <typename T, size_t N>
+class SpscRing
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of 2");
+
+public:
+  SpscRing() : _uHead(0), _uTail(0) {}
+
+  // Producer side, false if full
+  RING_INLINE bool push(const T &oItem)
+  {
+    uint32_t uHead = _uHead.load(std::memory_order_relaxed);
+    if (uHead - _uTail.load(std::memory_order_acquire) >= N)
+    {
+      return false;
+    }
+    _aItems[uHead & (N - 1)] = oItem;
+    _uHead.store(uHead + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, false if empty
+  RING_INLINE bool pop(T &oItem)
+  {
+    uint32_t uTail = _uTail.load(std::memory_order_relaxed);
+    if (uTail == _uHead.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    oItem = _aItems[uTail & (N - 1)];
+    _uTail.store(uTail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Number of queued items (exact from either side, a snapshot otherwise)
+  RING_INLINE uint32_t size() const
+  {
+    return _uHead.load(std::memory_order_acquire) - _uTail.load(std::memory_order_acquire);
+  }
+
+  RING_INLINE bool empty() const { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  alignas(RING_CACHE_LINE) std::atomic<uint32_t> _uHead; // written by the producer only
+  alignas(RING_CACHE_LINE) std::atomic<uint32_t> _uTail; // written by the consumer only
+  alignas(RING_CACHE_LINE) T _aItems[N];
+};
+
+// Multi-producer / single-consumer ring (bounded, per-slot sequence numbers)
+template <typename T, size_t N>
+class MpscRing
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscRing capacity must be a power of 2");
+
+public:
+  MpscRing() : _uHead(0), _uTail(0)
+  {
+    for (uint32_t uSlot = 0; uSlot < N; uSlot++)
+    {
+      _aSlots[uSlot].uSeq.store(uSlot, std::memory_order_relaxed);
+    }
+  }
+
+  // Producer side (any task or ISR), false if full
+  RING_INLINE bool push(const T &oItem)
+  {
+    uint32_t uPos = _uHead.load(std::memory_order_relaxed);
+    Slot *pSlot;
+    for (;;)
+    {
+      pSlot = &_aSlots[uPos & (N - 1)];
+      int32_t iDiff = (int32_t)(pSlot->uSeq.load(std::memory_order_acquire) - uPos);
+      if (iDiff == 0)
+      {
+        // Slot free for this position : claim it
+        if (_uHead.compare_exchange_weak(uPos, uPos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (iDiff < 0)
+      {
+        return false; // full
+      }
+      else
+      {
+        uPos = _uHead.load(std::memory_order_relaxed); // another producer got it
+      }
+    }
+    pSlot->oItem = oItem;
+    pSlot->uSeq.store(uPos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, false if empty (or the oldest item is still being written)
+  RING_INLINE bool pop(T &oItem)
+  {
+    uint32_t uPos = _uTail.load(std::memory_order_relaxed);
+    Slot *pSlot = &_aSlots[uPos & (N - 1)];
+    if ((int32_t)(pSlot->uSeq.load(std::memory_order_acquire) - (uPos + 1)) < 0)
+    {
+      return false;
+    }
+    oItem = pSlot->oItem;
+    pSlot->uSeq.store(uPos + N, std::memory_order_release);
+    _uTail.store(uPos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Approximate number of queued items
+  RING_INLINE uint32_t size() const
+  {
+    return _uHead.load(std::memory_order_relaxed) - _uTail.load(std::memory_order_relaxed);
+  }
+
+  RING_INLINE bool empty() const { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  struct Slot
+  {
+    std::atomic<uint32_t> uSeq;
+    T oItem;
+  };
+
+  alignas(RING_CACHE_LINE) std::atomic<uint32_t> _uHead; // shared by the producers
+  alignas(RING_CACHE_LINE) std::atomic<uint32_t> _uTail; // consumer only
+  alignas(RING_CACHE_LINE) Slot _aSlots[N];
+};
+
+#endif // RING_BUFFER_H
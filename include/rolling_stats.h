@@ -0,0 +1,68 @@
+// Sliding-window statistics of temperature and humidity
+//
+// Rolling mean, variance, min and max over the last RSTATS_WINDOWS samples
+// (5 min, 1 h and 24 h at one sample per 30 s), without rescanning history :
+// every window keeps a Welford mean/variance that is updated with the new
+// sample and downdated with the sample leaving the window, and monotonic
+// deques of ring positions for its min and max. A sample costs O(1)
+// amortised per window.
+//
+// All windows share one ring of the last RSTATS_RING_LEN samples, values
+// kept in hundredths (int16, exact for DHT readings). Only scheduled samples
+// are counted (on-demand reads would shorten the windows), restored records
+// are ignored and invalid values leave a hole (not counted).
+//
+// The engine is fed by a measurement bus sink and publishes a small summary
+// under a lock, so readers never walk the deques.
+
+#ifndef ROLLING_STATS_H
+#define ROLLING_STATS_H
+
+#include <stdint.h>
+#include "measurement.h"
+
+#define RSTATS_WINDOW_COUNT 3             // number of windows
+#define RSTATS_WINDOWS {10, 120, 2880}    // window lengths (samples), increasing
+#define RSTATS_RING_LEN 2880              // = largest window
+
+// Statistics channel
+enum StatsChannel : uint8_t
+{
+  STATS_TMP = 0, // temperature (Celcius)
+  STATS_HUM,     // humidity (percent)
+  STATS_CHANNEL_COUNT
+};
+
+// Statistics of one channel over one window
+struct WindowStats
+{
+  uint32_t uCount; // valid samples in the window
+  float fMean;
+  float fVariance; // population variance
+  float fMin;
+  float fMax;
+};
+
+// Update cost of the engine (microseconds, all windows and channels)
+struct StatsCost
+{
+  uint32_t uSamples; // samples added since boot
+  uint32_t uLastMicros;
+  uint32_t uMaxMicros;
+  uint32_t uMeanMicros;
+};
+
+// Add a measurement (measurement bus handler)
+void addStatsSample(const Measurement &oMeasurement);
+
+// Copy the statistics of one channel over one window, false if out of range
+// or if the window holds no valid sample yet
+bool getWindowStats(uint8_t uWindow, StatsChannel eChannel, WindowStats &oStats);
+
+// Length of window uWindow (samples), 0 if out of range
+uint16_t statsWindowLength(uint8_t uWindow);
+
+// Copy the update cost counters
+void getStatsCost(StatsCost &oCost);
+
+#endif // ROLLING_STATS_H
@@ -0,0 +1,57 @@
+// Route table with constant-time dispatch
+//
+// Routes are declared as a const table (the path hash is computed at compile
+// time) and served by a single catch-all AsyncWebHandler. A request is
+// dispatched with one hash of its URL and one probe in an open-addressing
+// index (path_index.h), whatever the number of routes. Like the stock
+// handlers, it keeps the request headers and lets the server parse form
+// bodies of the routes it serves.
+
+#ifndef ROUTE_TABLE_H
+#define ROUTE_TABLE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "path_index.h"
+
+#ifndef ROUTE_INDEX_SIZE
+#define ROUTE_INDEX_SIZE 64 // open-addressing index slots (power of 2, > 2x route count)
+#endif
+
+typedef void (*RouteHandler)(AsyncWebServerRequest *request);
+
+// One route : path, accepted method(s) and handler
+struct Route
+{
+  uint32_t uHash;
+  const char *pPath;
+  WebRequestMethodComposite uMethod;
+  RouteHandler pHandler;
+
+  constexpr Route(const char *pPath_, WebRequestMethodComposite uMethod_, RouteHandler pHandler_)
+      : uHash(hashPath(pPath_)), pPath(pPath_), uMethod(uMethod_), pHandler(pHandler_) {}
+};
+
+// Catch-all handler dispatching to a route table
+class RouteTable : public AsyncWebHandler
+{
+public:
+  RouteTable(const Route *pRoutes, uint8_t uCount);
+
+  // Build the index, returns false on a duplicate path or a full index
+  bool begin();
+
+  // Find the route for a path, nullptr if none
+  const Route *find(const char *pPath) const;
+
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  bool isRequestHandlerTrivial() override { return false; }
+
+private:
+  const Route *_pRoutes;
+  uint8_t _uCount;
+  PathIndex<Route, ROUTE_INDEX_SIZE> _oIndex;
+};
+
+#endif // ROUTE_TABLE_H
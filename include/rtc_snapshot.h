@@ -0,0 +1,47 @@
+// Last measurement snapshot in RTC slow memory, for instant warm restart
+//
+// RTC slow memory keeps its content over software, watchdog, OTA and
+// brownout resets (not over a power cycle). The sampler saves the last
+// measurement record, the sequence counter and the clock state there after
+// every sample. setup() restores them, after CRC validation, so the device
+// serves meaningful data (flagged MEAS_RESTORED) right after a reboot and
+// sequence numbers stay monotonic.
+
+#ifndef RTC_SNAPSHOT_H
+#define RTC_SNAPSHOT_H
+
+#include <stdint.h>
+#include "measurement.h"
+
+#define RTC_SNAPSHOT_MAGIC 0x52544331UL // "RTC1", change with the RtcSnapshot layout
+
+// Content of the RTC memory
+struct RtcSnapshot
+{
+  uint32_t uMagic;
+  uint32_t uSize;         // sizeof(RtcSnapshot), catches a layout change without magic update
+  uint32_t uRestoreCount; // warm restarts
+  Measurement oMeasurement;
+  uint32_t uCrc;          // CRC32 of everything above
+};
+
+// Save the last measurement (and its sequence number)
+void saveRtcSnapshot(const Measurement &oMeasurement);
+
+// Restore the saved measurement, false if RTC memory holds no valid snapshot.
+// uEpochNow (UTC, 0 if unknown) and ullMicrosNow (esp_timer) rebase the
+// record time stamp on the new boot : ullMicros then usually lies before
+// boot (negative when read as signed). With an unknown epoch the record is
+// dated ullMicrosNow.
+bool restoreRtcSnapshot(Measurement &oMeasurement, uint32_t uEpochNow, uint64_t ullMicrosNow);
+
+// Warm restarts with a valid snapshot since the last power-on
+uint32_t rtcRestoreCount();
+
+#ifndef ARDUINO
+// Host build : the emulated RTC memory, for the tests to stage power-on
+// garbage, corruption or another firmware's layout
+RtcSnapshot &rtcSnapshotMemory();
+#endif
+
+#endif // RTC_SNAPSHOT_H
@@ -0,0 +1,81 @@
+// Wall-clock aligned sample clock
+//
+// Samples are triggered by an esp_timer alarm on wall-clock slot boundaries
+// (every :00 and :30 seconds of NTP time for a 30 s period), not by loop()
+// noticing that the period elapsed : intervals do not drift and devices of
+// a fleet sample at the same instants, so their series join without
+// resampling. The timer callback only marks the slot due, the sensor is read
+// by loop() (the read and NTP must not run on the esp_timer task).
+//
+// The slot grid follows the SNTP system clock through syncSampleClock(),
+// called on every observed epoch second change with the esp_timer time the
+// second started (from tv_usec, not when it was seen). Until then slots are
+// aligned on boot. A clock step keeps the armed slot, so no slot is skipped
+// or taken twice, unless it goes back by more than a period.
+// Jitter histograms compare the timer alarm and the actual sample start to
+// the scheduled slot time.
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <stdint.h>
+
+#define JITTER_BUCKET_COUNT 10 // histogram buckets (see JITTER_BUCKET_BOUNDS)
+
+// Bucket upper bounds (microseconds), the last bucket is unbounded
+#define JITTER_BUCKET_BOUNDS {50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000, UINT32_MAX}
+
+// One sample slot
+struct SampleSlot
+{
+  uint64_t ullMicros; // scheduled esp_timer time
+  uint32_t uEpoch;    // scheduled wall-clock time (UTC), a multiple of the period
+  bool bSynced;       // uEpoch is NTP time (else seconds since boot)
+};
+
+// Measured delay after the scheduled slot time
+enum JitterKind : uint8_t
+{
+  JITTER_ALARM = 0, // timer callback
+  JITTER_SAMPLE,    // sensor read start
+  JITTER_KIND_COUNT
+};
+
+struct SampleJitter
+{
+  uint32_t uCount;
+  uint32_t uMeanMicros;
+  uint32_t uMaxMicros;
+  uint32_t auBuckets[JITTER_BUCKET_COUNT];
+};
+
+// Create the timer and arm the first slot (uPeriod : seconds, divides a day for aligned slots)
+bool beginSampleClock(uint32_t uPeriod);
+
+// Anchor the slot grid on the wall clock : uEpoch (UTC) started at ullMicros (esp_timer)
+void syncSampleClock(uint32_t uEpoch, uint64_t ullMicros);
+
+// Take the due slot if any (loop), true if a sample is due
+bool sampleDue(SampleSlot &oSlot);
+
+// The sample of oSlot started at ullMicros (esp_timer)
+void recordSampleStart(const SampleSlot &oSlot, uint64_t ullMicros);
+
+// Next armed slot
+void getNextSlot(SampleSlot &oSlot);
+
+// Slots that became due before the previous one was taken
+uint32_t missedSlots();
+
+// Copy a jitter histogram, false if eKind is out of range
+bool getSampleJitter(JitterKind eKind, SampleJitter &oJitter);
+
+// Upper bound of bucket uBucket (microseconds)
+uint32_t jitterBound(uint8_t uBucket);
+
+#ifndef ARDUINO
+// Host build : no esp_timer, the tests fire the alarm at esp_timer time ullMicros
+void fireSampleTimer(uint64_t ullMicros);
+#endif
+
+#endif // SAMPLE_CLOCK_H
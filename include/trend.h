@@ -0,0 +1,45 @@
+// Incremental trend estimation and short-horizon forecasting
+//
+// Holt's linear exponential smoothing per channel, updated in O(1) on every
+// measurement with the actual time step (on-demand samples included) : a
+// smoothed level and slope, the forecasts at TREND_HORIZONS and the
+// estimated time until the level crosses the alarm thresholds of anomaly.h
+// ("temperature will cross 30 C in ~20 min"). No history is kept.
+
+#ifndef TREND_H
+#define TREND_H
+
+#include <stdint.h>
+#include "measurement.h"
+#include "rolling_stats.h"
+
+#define TREND_ALPHA 0.1f        // level smoothing (weight of a new sample)
+#define TREND_BETA 0.05f        // slope smoothing (weight of a new slope)
+#define TREND_WARMUP 20         // samples before the trend is reported
+#define TREND_HORIZON_COUNT 3   // forecast horizons (see TREND_HORIZONS)
+#define TREND_HORIZONS {600, 1800, 3600} // seconds
+#define TREND_ETA_MAX 21600     // threshold crossings further away are not reported (seconds)
+
+// Trend of one channel
+struct ChannelTrend
+{
+  uint32_t uSamples; // samples since boot
+  float fLevel;
+  float fSlopePerHour;
+  float afForecasts[TREND_HORIZON_COUNT]; // level at each horizon
+  int32_t iHighEta;  // seconds until the high threshold is crossed, -1 if not within TREND_ETA_MAX
+  int32_t iLowEta;   // same for the low threshold
+  float fHigh;       // thresholds
+  float fLow;
+};
+
+// Update the trends with a measurement (measurement bus handler)
+void updateTrend(const Measurement &oMeasurement);
+
+// Copy the trend of one channel, false if out of range or still warming up
+bool getTrend(StatsChannel eChannel, ChannelTrend &oTrend);
+
+// Horizon uHorizon (seconds), 0 if out of range
+uint32_t trendHorizon(uint8_t uHorizon);
+
+#endif // TREND_H
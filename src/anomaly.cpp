@@ -0,0 +1,238 @@
+// On-device anomaly detection on every new measurement (see anomaly.h)
+
+#include "anomaly.h"
+
+#include <math.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define ALARM_LOCK() portENTER_CRITICAL(&muxAlarms)
+#define ALARM_UNLOCK() portEXIT_CRITICAL(&muxAlarms)
+#else
+#include <atomic>
+#define ALARM_LOCK()                                         \
+  while (flagAlarms.test_and_set(std::memory_order_acquire)) \
+  {                                                          \
+  }
+#define ALARM_UNLOCK() flagAlarms.clear(std::memory_order_release)
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Debounce state of one alarm
+struct AlarmState
+{
+  bool bActive;
+  uint8_t uRaise; // consecutive samples with the condition
+  uint8_t uClear; // consecutive samples without it
+};
+
+// Running state of one channel
+struct ChannelState
+{
+  bool bHasLast;
+  float fLast;
+  uint64_t ullLastMicros;
+  float fRate; // smoothed rate of change (per minute)
+  uint32_t uEwmaCount;
+  uint32_t uOutliers; // consecutive samples beyond the z-score limit
+  float fMean;
+  float fVariance; // noise variance, from successive differences
+  AlarmState aAlarms[ALARM_KIND_COUNT];
+};
+
+static const AlarmLimits aLimits[STATS_CHANNEL_COUNT] = {ALARM_TMP_LIMITS, ALARM_HUM_LIMITS};
+static const char *apKindNames[ALARM_KIND_COUNT] = {"high", "low", "rate", "zscore", "sensor"};
+
+static ChannelState aChannels[STATS_CHANNEL_COUNT];
+static AlarmHandler pAlarmHandler = nullptr;
+
+// Event log and active alarms (lock)
+static AlarmEvent aEvents[ALARM_LOG_LEN];
+static uint32_t uEventCount = 0;
+static uint32_t uActiveMask = 0;
+
+#ifdef ARDUINO
+static portMUX_TYPE muxAlarms = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagAlarms = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+void setAlarmHandler(AlarmHandler pHandler)
+{
+  pAlarmHandler = pHandler;
+} // void setAlarmHandler(AlarmHandler pHandler)
+//-------------------------------------
+
+// Debounce one condition, log and hand over a raise / clear transition.
+// bSet : the condition is tested and true, bTested : false if it cannot be
+// evaluated on this sample (the alarm then keeps its state)
+static void debounce(const Measurement &oMeasurement, uint8_t uChannel, uint8_t uKind, bool bTested, bool bSet,
+                     float fValue, float fLimit)
+{
+  if (!bTested)
+  {
+    return;
+  }
+  AlarmState &oState = aChannels[uChannel].aAlarms[uKind];
+  bool bChanged = false;
+  if (bSet)
+  {
+    oState.uClear = 0;
+    if (!oState.bActive && ++oState.uRaise >= ALARM_RAISE_SAMPLES)
+    {
+      oState.bActive = true;
+      bChanged = true;
+    }
+  }
+  else
+  {
+    oState.uRaise = 0;
+    if (oState.bActive && ++oState.uClear >= ALARM_CLEAR_SAMPLES)
+    {
+      oState.bActive = false;
+      bChanged = true;
+    }
+  }
+  if (!bChanged)
+  {
+    return;
+  }
+
+  AlarmEvent oEvent;
+  oEvent.uSeq = oMeasurement.uSeq;
+  oEvent.uEpoch = oMeasurement.uEpoch;
+  oEvent.uChannel = uChannel;
+  oEvent.uKind = uKind;
+  oEvent.bRaised = oState.bActive;
+  oEvent.fValue = fValue;
+  oEvent.fLimit = fLimit;
+  uint32_t uBit = 1UL << (uChannel * ALARM_KIND_COUNT + uKind);
+  ALARM_LOCK();
+  oEvent.uNumber = ++uEventCount;
+  aEvents[uEventCount % ALARM_LOG_LEN] = oEvent;
+  uActiveMask = oState.bActive ? (uActiveMask | uBit) : (uActiveMask & ~uBit);
+  ALARM_UNLOCK();
+  if (pAlarmHandler != nullptr)
+  {
+    pAlarmHandler(oEvent);
+  }
+} // static void debounce(...)
+//-------------------------------------
+
+// Check one channel value
+static void checkChannel(const Measurement &oMeasurement, uint8_t uChannel, float fValue, bool bValid)
+{
+  ChannelState &oChannel = aChannels[uChannel];
+  const AlarmLimits &oLimits = aLimits[uChannel];
+
+  debounce(oMeasurement, uChannel, ALARM_SENSOR, true, !bValid, bValid ? 0.0f : 1.0f, 0.0f);
+  if (!bValid)
+  {
+    return; // other alarms keep their state
+  }
+
+  // Thresholds : active alarms clear only beyond the hysteresis band
+  const AlarmState *pAlarms = oChannel.aAlarms;
+  float fHigh = pAlarms[ALARM_HIGH].bActive ? oLimits.fHigh - oLimits.fHysteresis : oLimits.fHigh;
+  float fLow = pAlarms[ALARM_LOW].bActive ? oLimits.fLow + oLimits.fHysteresis : oLimits.fLow;
+  debounce(oMeasurement, uChannel, ALARM_HIGH, true, fValue > fHigh, fValue, oLimits.fHigh);
+  debounce(oMeasurement, uChannel, ALARM_LOW, true, fValue < fLow, fValue, oLimits.fLow);
+
+  // Rate of change since the previous valid sample, smoothed : the sensor
+  // noise between two samples alone would exceed the limit
+  float fStep = oChannel.bHasLast ? fValue - oChannel.fLast : 0.0f;
+  if (oChannel.bHasLast && oMeasurement.ullMicros > oChannel.ullLastMicros)
+  {
+    float fRate = fStep * 60.0e6f / (float)(oMeasurement.ullMicros - oChannel.ullLastMicros);
+    oChannel.fRate += ALARM_RATE_ALPHA * (fRate - oChannel.fRate);
+    debounce(oMeasurement, uChannel, ALARM_RATE, true, fabsf(oChannel.fRate) > oLimits.fRatePerMin, oChannel.fRate,
+             oLimits.fRatePerMin);
+  }
+  oChannel.bHasLast = true;
+  oChannel.fLast = fValue;
+  oChannel.ullLastMicros = oMeasurement.ullMicros;
+
+  // EWMA z-score against the baseline before this sample, then update the baseline
+  if (oChannel.uEwmaCount == 0)
+  {
+    oChannel.fMean = fValue;
+    oChannel.fVariance = 0.0f;
+    oChannel.uOutliers = 0;
+  }
+  else
+  {
+    float fStdDev = sqrtf(oChannel.fVariance);
+    float fZ = (fValue - oChannel.fMean) / ((fStdDev > oLimits.fMinStdDev) ? fStdDev : oLimits.fMinStdDev);
+    bool bWarm = oChannel.uEwmaCount >= ALARM_EWMA_WARMUP;
+    debounce(oMeasurement, uChannel, ALARM_ZSCORE, bWarm, fabsf(fZ) > ALARM_Z_LIMIT, fZ, ALARM_Z_LIMIT);
+    // Outliers stay out of the baseline, else a slow drift (failing AC)
+    // would drag the mean and inflate the std dev it is measured with.
+    // A shift lasting ALARM_EWMA_WARMUP samples is a new level : re-learn it.
+    if (bWarm && fabsf(fZ) > ALARM_Z_LIMIT)
+    {
+      if (++oChannel.uOutliers >= ALARM_EWMA_WARMUP)
+      {
+        oChannel.uEwmaCount = 0;
+      }
+      return;
+    }
+    oChannel.uOutliers = 0;
+    // Noise from successive differences (E[d^2] = 2 var) : unlike the
+    // deviations from the mean, they do not grow with a slow drift
+    oChannel.fMean += ALARM_EWMA_ALPHA * (fValue - oChannel.fMean);
+    oChannel.fVariance += ALARM_EWMA_ALPHA * (fStep * fStep / 2.0f - oChannel.fVariance);
+  }
+  oChannel.uEwmaCount++;
+} // static void checkChannel(const Measurement &oMeasurement, uint8_t uChannel, float fValue, bool bValid)
+//-------------------------------------
+
+void checkAnomalies(const Measurement &oMeasurement)
+{
+  if (oMeasurement.uFlags & MEAS_RESTORED)
+  {
+    return;
+  }
+  checkChannel(oMeasurement, STATS_TMP, oMeasurement.fTmp, oMeasurement.uFlags & MEAS_TMP_VALID);
+  checkChannel(oMeasurement, STATS_HUM, oMeasurement.fHum, oMeasurement.uFlags & MEAS_HUM_VALID);
+} // void checkAnomalies(const Measurement &oMeasurement)
+//-------------------------------------
+
+uint32_t activeAlarms()
+{
+  ALARM_LOCK();
+  uint32_t uMask = uActiveMask;
+  ALARM_UNLOCK();
+  return uMask;
+} // uint32_t activeAlarms()
+//-------------------------------------
+
+bool getAlarmEvent(uint32_t uNumber, AlarmEvent &oEvent)
+{
+  ALARM_LOCK();
+  bool bFound = uNumber != 0 && uNumber <= uEventCount && uEventCount - uNumber < ALARM_LOG_LEN;
+  if (bFound)
+  {
+    oEvent = aEvents[uNumber % ALARM_LOG_LEN];
+  }
+  ALARM_UNLOCK();
+  return bFound;
+} // bool getAlarmEvent(uint32_t uNumber, AlarmEvent &oEvent)
+//-------------------------------------
+
+uint32_t lastAlarmEvent()
+{
+  ALARM_LOCK();
+  uint32_t uNumber = uEventCount;
+  ALARM_UNLOCK();
+  return uNumber;
+} // uint32_t lastAlarmEvent()
+//-------------------------------------
+
+const char *alarmKindName(uint8_t uKind)
+{
+  return (uKind < ALARM_KIND_COUNT) ? apKindNames[uKind] : "?";
+} // const char *alarmKindName(uint8_t uKind)
+//-------------------------------------
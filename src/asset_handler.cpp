@@ -0,0 +1,54 @@
+// AsyncWebServer handler for the static assets (see asset_handler.h)
+
+#include "asset_handler.h"
+#include "asset_store.h"
+
+bool AssetHandler::canHandle(AsyncWebServerRequest *request)
+{
+  if (!(request->method() & (HTTP_GET | HTTP_HEAD)) || findAsset(request->url().c_str()) == nullptr)
+  {
+    return false;
+  }
+  request->addInterestingHeader("ANY");
+  return true;
+} // bool AssetHandler::canHandle(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void AssetHandler::handleRequest(AsyncWebServerRequest *request)
+{
+  const AssetEntry *pAsset = findAsset(request->url().c_str());
+  if (pAsset == nullptr)
+  {
+    request->send(404, "text/plain", "Not found");
+    return;
+  }
+  bool bGzip = (pAsset->uEncoding == ASSET_GZIP);
+
+  AsyncWebServerResponse *response;
+  char acETag[12];
+  assetETag(pAsset, acETag);
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == acETag)
+  {
+    response = request->beginResponse(304);
+    response->addHeader("ETag", acETag);
+  }
+  else if (!assetAcceptable(pAsset, request->hasHeader("Accept-Encoding") ? request->header("Accept-Encoding").c_str() : nullptr))
+  {
+    response = request->beginResponse(406, "text/plain", "gzip only");
+  }
+  else
+  {
+    response = request->beginResponse_P(200, pAsset->acContentType, assetData(pAsset), pAsset->uLength);
+    response->addHeader("ETag", acETag);
+    if (bGzip)
+    {
+      response->addHeader("Content-Encoding", "gzip");
+    }
+  }
+  if (bGzip)
+  {
+    response->addHeader("Vary", "Accept-Encoding");
+  }
+  request->send(response);
+} // void AssetHandler::handleRequest(AsyncWebServerRequest *request)
+//-------------------------------------
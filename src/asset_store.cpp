@@ -0,0 +1,183 @@
+// Static assets served from a dedicated flash partition (see asset_store.h)
+
+#include "asset_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "path_hash.h"
+
+#ifdef ARDUINO
+#include <esp_partition.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+static const uint8_t *pAssetImage = nullptr; // mapped image
+static const AssetEntry *pAssetIndex = nullptr;
+static uint16_t uAssetCount = 0;
+static uint32_t auAssetHash[ASSET_MAX_COUNT]; // path hashes, kept in RAM
+
+// ============================== FUNCTIONS ==============================
+
+// Map the image source, returns the mapped length (0 on failure)
+static size_t mapImage(const char *pSource, const uint8_t **ppImage)
+{
+#ifdef ARDUINO
+  const esp_partition_t *pPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                               (esp_partition_subtype_t)ASSET_PARTITION_SUBTYPE,
+                                                               pSource);
+  spi_flash_mmap_handle_t hMap;
+  const void *pMapped;
+  if (pPartition == nullptr ||
+      esp_partition_mmap(pPartition, 0, pPartition->size, SPI_FLASH_MMAP_DATA, &pMapped, &hMap) != ESP_OK)
+  {
+    return 0;
+  }
+  *ppImage = (const uint8_t *)pMapped;
+  return pPartition->size;
+#else
+  int iFile = open(pSource, O_RDONLY);
+  struct stat oStat;
+  if (iFile < 0 || fstat(iFile, &oStat) != 0 || oStat.st_size == 0)
+  {
+    if (iFile >= 0)
+    {
+      close(iFile);
+    }
+    return 0;
+  }
+  void *pMapped = mmap(nullptr, oStat.st_size, PROT_READ, MAP_PRIVATE, iFile, 0);
+  close(iFile);
+  if (pMapped == MAP_FAILED)
+  {
+    return 0;
+  }
+  *ppImage = (const uint8_t *)pMapped;
+  return oStat.st_size;
+#endif
+} // static size_t mapImage(const char *pSource, const uint8_t **ppImage)
+//-------------------------------------
+
+bool beginAssetStore(const char *pSource)
+{
+  const uint8_t *pImage = nullptr;
+  size_t uMapped = mapImage(pSource, &pImage);
+
+  uAssetCount = 0;
+  if (uMapped < sizeof(AssetImageHeader))
+  {
+    return false;
+  }
+
+  // Validate the header and every index entry against the mapped length
+  const AssetImageHeader *pHeader = (const AssetImageHeader *)pImage;
+  if (pHeader->uMagic != ASSET_MAGIC || pHeader->uVersion != ASSET_VERSION ||
+      pHeader->uCount > ASSET_MAX_COUNT || pHeader->uImageLen > uMapped ||
+      sizeof(AssetImageHeader) + pHeader->uCount * sizeof(AssetEntry) > pHeader->uImageLen)
+  {
+    return false;
+  }
+  const AssetEntry *pIndex = (const AssetEntry *)(pImage + sizeof(AssetImageHeader));
+  for (uint16_t uAsset = 0; uAsset < pHeader->uCount; uAsset++)
+  {
+    const AssetEntry &oEntry = pIndex[uAsset];
+    if (oEntry.acPath[ASSET_PATH_LEN - 1] != '\0' || oEntry.acContentType[ASSET_TYPE_LEN - 1] != '\0' ||
+        oEntry.uOffset > pHeader->uImageLen || oEntry.uLength > pHeader->uImageLen - oEntry.uOffset)
+    {
+      return false;
+    }
+    auAssetHash[uAsset] = hashPath(oEntry.acPath);
+  }
+
+  pAssetImage = pImage;
+  pAssetIndex = pIndex;
+  uAssetCount = pHeader->uCount;
+  return true;
+} // bool beginAssetStore(const char *pSource)
+//-------------------------------------
+
+const AssetEntry *findAsset(const char *pPath)
+{
+  uint32_t uHash = hashPath(pPath);
+  for (uint16_t uAsset = 0; uAsset < uAssetCount; uAsset++)
+  {
+    if (auAssetHash[uAsset] == uHash && strcmp(pAssetIndex[uAsset].acPath, pPath) == 0)
+    {
+      return &pAssetIndex[uAsset];
+    }
+  }
+  return nullptr;
+} // const AssetEntry *findAsset(const char *pPath)
+//-------------------------------------
+
+const uint8_t *assetData(const AssetEntry *pAsset)
+{
+  return pAssetImage + pAsset->uOffset;
+} // const uint8_t *assetData(const AssetEntry *pAsset)
+//-------------------------------------
+
+void assetETag(const AssetEntry *pAsset, char *pBuffer)
+{
+  snprintf(pBuffer, 11, "\"%08x\"", (unsigned)pAsset->uCrc32);
+} // void assetETag(const AssetEntry *pAsset, char *pBuffer)
+//-------------------------------------
+
+bool acceptsEncoding(const char *pAcceptEncoding, const char *pCoding)
+{
+  if (pAcceptEncoding == nullptr)
+  {
+    return false;
+  }
+  size_t uCodingLen = strlen(pCoding);
+  bool bStar = false;
+  const char *pItem = pAcceptEncoding;
+  while (*pItem != '\0')
+  {
+    while (*pItem == ' ' || *pItem == ',')
+    {
+      pItem++;
+    }
+    const char *pEnd = pItem + strcspn(pItem, ",");
+    size_t uNameLen = strcspn(pItem, " ;,");
+    const char *pQ = pItem + uNameLen;
+    while (pQ < pEnd && (*pQ == ' ' || *pQ == ';'))
+    {
+      pQ++;
+    }
+    bool bAccepted = pEnd - pQ < 2 || strncasecmp(pQ, "q=", 2) != 0 || strtod(pQ + 2, nullptr) > 0.0;
+    if (uNameLen == uCodingLen && strncasecmp(pItem, pCoding, uCodingLen) == 0)
+    {
+      return bAccepted;
+    }
+    if (uNameLen == 1 && *pItem == '*')
+    {
+      bStar = bAccepted;
+    }
+    pItem = pEnd;
+  }
+  return bStar;
+} // bool acceptsEncoding(const char *pAcceptEncoding, const char *pCoding)
+//-------------------------------------
+
+bool assetAcceptable(const AssetEntry *pAsset, const char *pAcceptEncoding)
+{
+  if (pAsset->uEncoding != ASSET_GZIP)
+  {
+    return true;
+  }
+  return acceptsEncoding(pAcceptEncoding, "gzip");
+} // bool assetAcceptable(const AssetEntry *pAsset, const char *pAcceptEncoding)
+//-------------------------------------
+
+uint16_t assetCount()
+{
+  return uAssetCount;
+} // uint16_t assetCount()
+//-------------------------------------
@@ -0,0 +1,223 @@
+// Fixed-size block pools (slab allocator) with heap fallback (see block_pool.h)
+
+#include "block_pool.h"
+
+#include <stdlib.h>
+#include <new>
+#include "heap_monitor.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define POOL_LOCK() portENTER_CRITICAL(&muxPool)
+#define POOL_UNLOCK() portEXIT_CRITICAL(&muxPool)
+#else
+#include <atomic>
+#define POOL_LOCK()                                        \
+  while (flagPool.test_and_set(std::memory_order_acquire)) \
+  {                                                        \
+  }
+#define POOL_UNLOCK() flagPool.clear(std::memory_order_release)
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Block sizes and counts, sized for the web layer objects (about 15 KB)
+#define POOL_32_COUNT 48
+#define POOL_64_COUNT 32
+#define POOL_128_COUNT 24
+#define POOL_256_COUNT 16
+#define POOL_512_COUNT 8
+
+// One pool : a static slab of equal blocks and the list of the free ones
+struct BlockPool
+{
+  uint16_t uBlockSize;
+  uint16_t uBlockCount;
+  uint8_t *pStorage;
+  void *pFreeList; // each free block holds the next free block pointer
+  bool bReady;     // free list built (done on first use, no static init order issue)
+  uint16_t uInUse;
+  uint16_t uHighWater;
+  uint32_t uHits;
+  uint32_t uMisses;
+};
+
+alignas(8) static uint8_t aStorage32[32 * POOL_32_COUNT];
+alignas(8) static uint8_t aStorage64[64 * POOL_64_COUNT];
+alignas(8) static uint8_t aStorage128[128 * POOL_128_COUNT];
+alignas(8) static uint8_t aStorage256[256 * POOL_256_COUNT];
+alignas(8) static uint8_t aStorage512[512 * POOL_512_COUNT];
+
+// Constant-initialized (no constructor), usable before any static constructor
+static BlockPool aPoolClasses[POOL_CLASS_COUNT] = {
+    {32, POOL_32_COUNT, aStorage32, nullptr, false, 0, 0, 0, 0},
+    {64, POOL_64_COUNT, aStorage64, nullptr, false, 0, 0, 0, 0},
+    {128, POOL_128_COUNT, aStorage128, nullptr, false, 0, 0, 0, 0},
+    {256, POOL_256_COUNT, aStorage256, nullptr, false, 0, 0, 0, 0},
+    {512, POOL_512_COUNT, aStorage512, nullptr, false, 0, 0, 0, 0},
+};
+static uint32_t uOversize = 0;
+
+#ifdef ARDUINO
+static portMUX_TYPE muxPool = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagPool = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// Chain all the blocks of a pool in its free list
+static void preparePool(BlockPool &oPool)
+{
+  oPool.pFreeList = nullptr;
+  for (int iBlock = oPool.uBlockCount - 1; iBlock >= 0; iBlock--)
+  {
+    void **pBlock = (void **)(oPool.pStorage + iBlock * oPool.uBlockSize);
+    *pBlock = oPool.pFreeList;
+    oPool.pFreeList = pBlock;
+  }
+  oPool.bReady = true;
+} // static void preparePool(BlockPool &oPool)
+//-------------------------------------
+
+void *poolAlloc(size_t uSize)
+{
+  void *pBlock = nullptr;
+
+  POOL_LOCK();
+  uint8_t uClass = 0;
+  while (uClass < POOL_CLASS_COUNT && aPoolClasses[uClass].uBlockSize < uSize)
+  {
+    uClass++;
+  }
+  if (uClass == POOL_CLASS_COUNT)
+  {
+    uOversize++;
+  }
+  else
+  {
+    BlockPool &oPool = aPoolClasses[uClass];
+    if (!oPool.bReady)
+    {
+      preparePool(oPool);
+    }
+    if (oPool.pFreeList != nullptr)
+    {
+      pBlock = oPool.pFreeList;
+      oPool.pFreeList = *(void **)pBlock;
+      oPool.uHits++;
+      if (++oPool.uInUse > oPool.uHighWater)
+      {
+        oPool.uHighWater = oPool.uInUse;
+      }
+    }
+    else
+    {
+      oPool.uMisses++;
+    }
+  }
+  POOL_UNLOCK();
+
+  return (pBlock != nullptr) ? pBlock : malloc(uSize == 0 ? 1 : uSize);
+} // void *poolAlloc(size_t uSize)
+//-------------------------------------
+
+void poolFree(void *pBlock)
+{
+  if (pBlock == nullptr)
+  {
+    return;
+  }
+  uint8_t *pByte = (uint8_t *)pBlock;
+  for (uint8_t uClass = 0; uClass < POOL_CLASS_COUNT; uClass++)
+  {
+    BlockPool &oPool = aPoolClasses[uClass];
+    if (pByte >= oPool.pStorage && pByte < oPool.pStorage + oPool.uBlockSize * oPool.uBlockCount)
+    {
+      POOL_LOCK();
+      *(void **)pBlock = oPool.pFreeList;
+      oPool.pFreeList = pBlock;
+      oPool.uInUse--;
+      POOL_UNLOCK();
+      return;
+    }
+  }
+  free(pBlock);
+} // void poolFree(void *pBlock)
+//-------------------------------------
+
+bool getPoolStats(uint8_t uClass, BlockPoolStats &oStats)
+{
+  if (uClass >= POOL_CLASS_COUNT)
+  {
+    return false;
+  }
+  POOL_LOCK();
+  const BlockPool &oPool = aPoolClasses[uClass];
+  oStats.uBlockSize = oPool.uBlockSize;
+  oStats.uBlockCount = oPool.uBlockCount;
+  oStats.uInUse = oPool.uInUse;
+  oStats.uHighWater = oPool.uHighWater;
+  oStats.uHits = oPool.uHits;
+  oStats.uMisses = oPool.uMisses;
+  POOL_UNLOCK();
+  return true;
+} // bool getPoolStats(uint8_t uClass, BlockPoolStats &oStats)
+//-------------------------------------
+
+uint32_t poolOversize()
+{
+  return uOversize;
+} // uint32_t poolOversize()
+//-------------------------------------
+
+// ============================== OPERATOR NEW/DELETE ==============================
+
+// Opt-in (POOLED_NEW) : the replaced operator new serves every C++
+// allocation of the firmware (Arduino core, WiFi, libraries), not only the
+// web layer's. DEBUG builds replace it anyway, to record the call sites.
+#if defined(ARDUINO) && (defined(POOLED_NEW) || defined(DEBUG))
+#ifdef POOLED_NEW
+#define NEW_ALLOC(uSize) poolAlloc(uSize)
+#define NEW_FREE(pBlock) poolFree(pBlock)
+#else
+#define NEW_ALLOC(uSize) malloc((uSize) == 0 ? 1 : (uSize))
+#define NEW_FREE(pBlock) free(pBlock)
+#endif
+
+void *operator new(size_t uSize)
+{
+#ifdef DEBUG
+  recordAllocSite(__builtin_return_address(0), uSize);
+#endif
+  return NEW_ALLOC(uSize);
+}
+
+void *operator new[](size_t uSize)
+{
+#ifdef DEBUG
+  recordAllocSite(__builtin_return_address(0), uSize);
+#endif
+  return NEW_ALLOC(uSize);
+}
+
+void *operator new(size_t uSize, const std::nothrow_t &) noexcept
+{
+  return NEW_ALLOC(uSize);
+}
+
+void *operator new[](size_t uSize, const std::nothrow_t &) noexcept
+{
+  return NEW_ALLOC(uSize);
+}
+
+void operator delete(void *pBlock) noexcept
+{
+  NEW_FREE(pBlock);
+}
+
+void operator delete[](void *pBlock) noexcept
+{
+  NEW_FREE(pBlock);
+}
+#endif // defined(ARDUINO) && (defined(POOLED_NEW) || defined(DEBUG))
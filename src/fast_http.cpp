@@ -0,0 +1,597 @@
+// Minimal HTTP/1.1 responder on AsyncTCP (see fast_http.h)
+
+#include "fast_http.h"
+#include "asset_store.h"
+
+#ifndef ARDUINO
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// One pooled connection
+struct FastHttpConn
+{
+  AsyncClient *pClient;                    // nullptr = free slot
+  uint16_t uLen;                           // bytes pending in acBuffer
+  char acBuffer[FAST_HTTP_BUFFER_LEN + 1]; // +1 for the '\0' used while parsing
+  const uint8_t *pPending;                 // mapped asset data still to send
+  size_t uPendingLen;
+  bool bKeepAlive;                         // keep the connection once pPending is sent
+  bool bSkipLine;                          // discard received bytes up to the next LF
+};
+
+static FastHttpConn aConns[FAST_HTTP_MAX_CLIENTS];
+#ifdef ARDUINO
+static AsyncServer *pFastServer = nullptr;
+#endif
+static const FastHttpEndpoint *pFastEndpoints = nullptr;
+static uint8_t uFastEndpointCount = 0;
+
+// Response body : all the AsyncTCP callbacks run on the one async_tcp task,
+// so a single buffer serves every connection (and stays off that task's stack)
+static char acFastBody[FAST_HTTP_BODY_LEN];
+
+// Precomputed response header parts
+static const char pcStatus200[] = "HTTP/1.1 200 OK\r\nContent-Type: ";
+static const char pcStatus304[] = "HTTP/1.1 304 Not Modified";
+static const char pcStatus400[] = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain";
+static const char pcStatus404[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain";
+static const char pcStatus405[] = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET, HEAD\r\nContent-Type: text/plain";
+static const char pcStatus406[] = "HTTP/1.1 406 Not Acceptable\r\nContent-Type: text/plain";
+static const char pcStatus431[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Type: text/plain";
+static const char pcCommon[] = "\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\nContent-Length: ";
+static const char pcKeepAlive[] = "\r\nConnection: keep-alive\r\n\r\n";
+static const char pcClose[] = "\r\nConnection: close\r\n\r\n";
+static const char pcGzip[] = "\r\nContent-Encoding: gzip";
+static const char pcVary[] = "\r\nVary: Accept-Encoding";
+static const char pcETag[] = "\r\nETag: ";
+
+// The only request headers read : the others are dropped when the buffer fills
+static const char *const apcReadHeaders[] = {"Connection", "If-None-Match", "Accept-Encoding"};
+
+// ============================== FUNCTIONS ==============================
+
+// Find the endpoint for a path, nullptr if none
+static const FastHttpEndpoint *findEndpoint(const char *pPath)
+{
+  uint32_t uHash = hashPath(pPath);
+  for (uint8_t uEndpoint = 0; uEndpoint < uFastEndpointCount; uEndpoint++)
+  {
+    if (pFastEndpoints[uEndpoint].uHash == uHash && strcmp(pFastEndpoints[uEndpoint].pPath, pPath) == 0)
+    {
+      return &pFastEndpoints[uEndpoint];
+    }
+  }
+  return nullptr;
+} // static const FastHttpEndpoint *findEndpoint(const char *pPath)
+//-------------------------------------
+
+// Queue the response headers : status line (+ content type), pExtra headers
+// (each starting with CRLF, may be nullptr), then the common headers
+static void sendHeaders(AsyncClient *pClient, const char *pStatus, const char *pContentType,
+                        const char *pExtra, size_t uBodyLen, bool bKeepAlive)
+{
+  char acLength[12];
+#ifdef ARDUINO
+  utoa(uBodyLen, acLength, 10);
+#else
+  snprintf(acLength, sizeof(acLength), "%u", (unsigned)uBodyLen);
+#endif
+
+  pClient->add(pStatus, strlen(pStatus));
+  if (pContentType != nullptr)
+  {
+    pClient->add(pContentType, strlen(pContentType));
+  }
+  if (pExtra != nullptr)
+  {
+    pClient->add(pExtra, strlen(pExtra));
+  }
+  pClient->add(pcCommon, sizeof(pcCommon) - 1);
+  pClient->add(acLength, strlen(acLength));
+  if (bKeepAlive)
+  {
+    pClient->add(pcKeepAlive, sizeof(pcKeepAlive) - 1);
+  }
+  else
+  {
+    pClient->add(pcClose, sizeof(pcClose) - 1);
+  }
+} // static void sendHeaders(...)
+//-------------------------------------
+
+// Queue and send one complete response with a (copied) body
+static void sendResponse(AsyncClient *pClient, const char *pStatus, const char *pContentType,
+                         const char *pBody, size_t uBodyLen, bool bHead, bool bKeepAlive)
+{
+  sendHeaders(pClient, pStatus, pContentType, nullptr, uBodyLen, bKeepAlive);
+  if (!bHead && uBodyLen > 0)
+  {
+    pClient->add(pBody, uBodyLen);
+  }
+  pClient->send();
+} // static void sendResponse(...)
+//-------------------------------------
+
+// Case-insensitive search of a request header, returns its value (up to CRLF) or nullptr
+static const char *findHeader(const char *pHeaders, const char *pName)
+{
+  size_t uNameLen = strlen(pName);
+  const char *pLine = pHeaders;
+  while (pLine != nullptr && *pLine != '\0')
+  {
+    if (strncasecmp(pLine, pName, uNameLen) == 0 && pLine[uNameLen] == ':')
+    {
+      const char *pValue = pLine + uNameLen + 1;
+      while (*pValue == ' ')
+      {
+        pValue++;
+      }
+      return pValue;
+    }
+    pLine = strstr(pLine, "\r\n");
+    if (pLine != nullptr)
+    {
+      pLine += 2;
+    }
+  }
+  return nullptr;
+} // static const char *findHeader(const char *pHeaders, const char *pName)
+//-------------------------------------
+
+// Is the "Connection" header of the request pValue ?
+static bool hasConnectionHeader(const char *pHeaders, const char *pValue)
+{
+  const char *pHeader = findHeader(pHeaders, "Connection");
+  return pHeader != nullptr && strncasecmp(pHeader, pValue, strlen(pValue)) == 0;
+} // static bool hasConnectionHeader(const char *pHeaders, const char *pValue)
+//-------------------------------------
+
+// Hand as much pending asset data as the TCP window allows to the send path,
+// straight from the mapped flash (no copy), returns true once all is sent
+static bool sendPending(FastHttpConn *pConn)
+{
+  while (pConn->uPendingLen > 0)
+  {
+    size_t uSpace = pConn->pClient->space();
+    if (uSpace == 0)
+    {
+      return false;
+    }
+    size_t uCount = (uSpace < pConn->uPendingLen) ? uSpace : pConn->uPendingLen;
+    if (pConn->pClient->add((const char *)pConn->pPending, uCount, 0) != uCount)
+    {
+      return false;
+    }
+    pConn->pClient->send();
+    pConn->pPending += uCount;
+    pConn->uPendingLen -= uCount;
+  }
+  pConn->pPending = nullptr;
+  return true;
+} // static bool sendPending(FastHttpConn *pConn)
+//-------------------------------------
+
+// Serve a static asset : 304 if the client copy is current, 406 if the
+// client does not accept its gzip encoding, else headers then the mapped
+// data, returns false if the request was not for an asset
+static bool serveAsset(FastHttpConn *pConn, const char *pPath, const char *pHeaders, bool bHead, bool bKeepAlive)
+{
+  const AssetEntry *pAsset = findAsset(pPath);
+  if (pAsset == nullptr)
+  {
+    return false;
+  }
+
+  char acExtra[sizeof(pcETag) + 12 + sizeof(pcVary) + sizeof(pcGzip)];
+  char acETag[12];
+  assetETag(pAsset, acETag);
+  strcpy(acExtra, pcETag);
+  strcat(acExtra, acETag);
+  bool bGzip = (pAsset->uEncoding == ASSET_GZIP);
+  if (bGzip)
+  {
+    strcat(acExtra, pcVary);
+  }
+
+  const char *pIfNoneMatch = findHeader(pHeaders, "If-None-Match");
+  if (pIfNoneMatch != nullptr && strncmp(pIfNoneMatch, acETag, strlen(acETag)) == 0)
+  {
+    sendHeaders(pConn->pClient, pcStatus304, nullptr, acExtra, 0, bKeepAlive);
+    pConn->pClient->send();
+    return true;
+  }
+
+  // No identity copy of a gzip asset : refuse it to a client without gzip
+  char acAccept[FAST_HTTP_EXTRA_LEN];
+  const char *pAcceptEncoding = findHeader(pHeaders, "Accept-Encoding");
+  if (pAcceptEncoding != nullptr)
+  {
+    size_t uValueLen = strcspn(pAcceptEncoding, "\r\n");
+    uValueLen = (uValueLen < sizeof(acAccept) - 1) ? uValueLen : sizeof(acAccept) - 1;
+    memcpy(acAccept, pAcceptEncoding, uValueLen);
+    acAccept[uValueLen] = '\0';
+    pAcceptEncoding = acAccept;
+  }
+  if (!assetAcceptable(pAsset, pAcceptEncoding))
+  {
+    sendHeaders(pConn->pClient, pcStatus406, nullptr, pcVary, 9, bKeepAlive);
+    if (!bHead)
+    {
+      pConn->pClient->add("gzip only", 9);
+    }
+    pConn->pClient->send();
+    return true;
+  }
+
+  if (bGzip)
+  {
+    strcat(acExtra, pcGzip);
+  }
+  sendHeaders(pConn->pClient, pcStatus200, pAsset->acContentType, acExtra, pAsset->uLength, bKeepAlive);
+  pConn->pClient->send();
+  if (!bHead)
+  {
+    pConn->pPending = assetData(pAsset);
+    pConn->uPendingLen = pAsset->uLength;
+    sendPending(pConn);
+  }
+  return true;
+} // static bool serveAsset(...)
+//-------------------------------------
+
+// Handle one complete request (headers '\0'-terminated), returns keep-alive
+static bool handleRequest(FastHttpConn *pConn, char *pRequest)
+{
+  AsyncClient *pClient = pConn->pClient;
+
+  // Request line : METHOD SP PATH[?QUERY] SP VERSION CRLF
+  char *pPath = strchr(pRequest, ' ');
+  if (pPath == nullptr)
+  {
+    sendResponse(pClient, pcStatus400, nullptr, "", 0, false, false);
+    return false;
+  }
+  *pPath++ = '\0';
+  char *pVersion = strchr(pPath, ' ');
+  if (pVersion == nullptr)
+  {
+    sendResponse(pClient, pcStatus400, nullptr, "", 0, false, false);
+    return false;
+  }
+  *pVersion++ = '\0';
+  char *pQuery = strchr(pPath, '?');
+  if (pQuery != nullptr)
+  {
+    *pQuery = '\0';
+  }
+  char *pHeaders = strstr(pVersion, "\r\n");
+  pHeaders = (pHeaders != nullptr) ? pHeaders + 2 : pVersion + strlen(pVersion);
+
+  // HTTP/1.1 defaults to keep-alive, HTTP/1.0 to close
+  bool bKeepAlive = (strncmp(pVersion, "HTTP/1.1", 8) == 0) ? !hasConnectionHeader(pHeaders, "close")
+                                                             : hasConnectionHeader(pHeaders, "keep-alive");
+  bool bHead = (strcmp(pRequest, "HEAD") == 0);
+  if (!bHead && strcmp(pRequest, "GET") != 0)
+  {
+    sendResponse(pClient, pcStatus405, nullptr, "", 0, false, bKeepAlive);
+    return bKeepAlive;
+  }
+
+  const FastHttpEndpoint *pEndpoint = findEndpoint(pPath);
+  if (pEndpoint == nullptr)
+  {
+    if (!serveAsset(pConn, pPath, pHeaders, bHead, bKeepAlive))
+    {
+      sendResponse(pClient, pcStatus404, nullptr, "Not found", 9, bHead, bKeepAlive);
+    }
+    return bKeepAlive;
+  }
+
+  char acExtra[FAST_HTTP_EXTRA_LEN];
+  acExtra[0] = '\0';
+  if (pEndpoint->pHeaderWriter != nullptr)
+  {
+    pEndpoint->pHeaderWriter(acExtra, sizeof(acExtra));
+  }
+  size_t uBodyLen = pEndpoint->pWriter(acFastBody, sizeof(acFastBody));
+  sendHeaders(pClient, pcStatus200, pEndpoint->pContentType, acExtra, uBodyLen, bKeepAlive);
+  if (!bHead && uBodyLen > 0)
+  {
+    pClient->add(acFastBody, uBodyLen);
+  }
+  pClient->send();
+  return bKeepAlive;
+} // static bool handleRequest(FastHttpConn *pConn, char *pRequest)
+//-------------------------------------
+
+// Serve every complete (possibly pipelined) request in the buffer, pausing
+// while an asset is still being streamed, returns false once the
+// connection is closed
+static bool processBuffer(FastHttpConn *pConn)
+{
+  char *pEnd;
+  while (pConn->pPending == nullptr && (pEnd = strstr(pConn->acBuffer, "\r\n\r\n")) != nullptr)
+  {
+    size_t uRequestLen = pEnd - pConn->acBuffer + 4;
+    pEnd[2] = '\0'; // keep the last header CRLF, drop the empty line
+    pConn->bKeepAlive = handleRequest(pConn, pConn->acBuffer);
+
+    // Shift any pipelined request to the start of the buffer
+    pConn->uLen -= uRequestLen;
+    memmove(pConn->acBuffer, pConn->acBuffer + uRequestLen, pConn->uLen);
+    pConn->acBuffer[pConn->uLen] = '\0';
+
+    if (!pConn->bKeepAlive && pConn->pPending == nullptr)
+    {
+      pConn->pClient->close();
+      pConn->uLen = 0;
+      return false;
+    }
+  }
+  return true;
+} // static bool processBuffer(FastHttpConn *pConn)
+//-------------------------------------
+
+// Is the header line pLine (uLen bytes, name complete) one the responder reads ?
+static bool isReadHeader(const char *pLine, size_t uLen)
+{
+  for (const char *pName : apcReadHeaders)
+  {
+    size_t uNameLen = strlen(pName);
+    if (uNameLen < uLen && pLine[uNameLen] == ':' && strncasecmp(pLine, pName, uNameLen) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+} // static bool isReadHeader(const char *pLine, size_t uLen)
+//-------------------------------------
+
+// Make room in a full buffer : drop the header lines the responder never
+// reads (cookies, user agent...) of every buffered request, and skip the
+// rest of the unfinished last line if it is one of them. Returns false if
+// nothing could be dropped (request line or a read header too long).
+static bool compactBuffer(FastHttpConn *pConn)
+{
+  char *pBuffer = pConn->acBuffer;
+  size_t uRead = 0, uWrite = 0;
+  bool bRequestLine = true; // the buffer always starts with a request line
+  bool bDropped = false;
+  while (uRead < pConn->uLen)
+  {
+    const char *pLine = pBuffer + uRead;
+    const char *pLineEnd = (const char *)memchr(pLine, '\n', pConn->uLen - uRead);
+    size_t uLineLen = (pLineEnd != nullptr) ? pLineEnd - pLine + 1 : pConn->uLen - uRead;
+    bool bKeep = true;
+    if (bRequestLine)
+    {
+      bRequestLine = false;
+    }
+    else if (pLineEnd != nullptr && uLineLen <= 2)
+    {
+      bRequestLine = true; // empty line : end of this request's headers
+    }
+    else if (memchr(pLine, ':', uLineLen) != nullptr && !isReadHeader(pLine, uLineLen))
+    {
+      bKeep = false;
+      bDropped = true;
+      pConn->bSkipLine = (pLineEnd == nullptr);
+    }
+    if (bKeep)
+    {
+      memmove(pBuffer + uWrite, pLine, uLineLen);
+      uWrite += uLineLen;
+    }
+    uRead += uLineLen;
+  }
+  pConn->uLen = uWrite;
+  pBuffer[uWrite] = '\0';
+  return bDropped;
+} // static bool compactBuffer(FastHttpConn *pConn)
+//-------------------------------------
+
+// Data received : buffer it and serve the complete requests. Only the
+// request line and the headers read have to fit in the buffer : the
+// others are dropped whenever it fills.
+static void onFastData(void *pArg, AsyncClient *pClient, void *pData, size_t uLen)
+{
+  FastHttpConn *pConn = (FastHttpConn *)pArg;
+  const char *pBytes = (const char *)pData;
+
+  while (uLen > 0)
+  {
+    if (pConn->bSkipLine)
+    {
+      const char *pLineEnd = (const char *)memchr(pBytes, '\n', uLen);
+      if (pLineEnd == nullptr)
+      {
+        return;
+      }
+      uLen -= pLineEnd + 1 - pBytes;
+      pBytes = pLineEnd + 1;
+      pConn->bSkipLine = false;
+      continue;
+    }
+    if (pConn->uLen == FAST_HTTP_BUFFER_LEN)
+    {
+      if (!compactBuffer(pConn))
+      {
+        sendResponse(pClient, pcStatus431, nullptr, "", 0, false, false);
+        pClient->close();
+        pConn->uLen = 0;
+        return;
+      }
+      continue;
+    }
+    size_t uCount = FAST_HTTP_BUFFER_LEN - pConn->uLen;
+    uCount = (uCount < uLen) ? uCount : uLen;
+    memcpy(pConn->acBuffer + pConn->uLen, pBytes, uCount);
+    pConn->uLen += uCount;
+    pConn->acBuffer[pConn->uLen] = '\0';
+    pBytes += uCount;
+    uLen -= uCount;
+    if (!processBuffer(pConn))
+    {
+      return;
+    }
+  }
+} // static void onFastData(...)
+//-------------------------------------
+
+// Data acknowledged : continue streaming the pending asset, then resume
+static void onFastAck(void *pArg, AsyncClient *pClient, size_t /* uLen */, uint32_t /* uTime */)
+{
+  FastHttpConn *pConn = (FastHttpConn *)pArg;
+
+  if (pConn->pPending == nullptr || !sendPending(pConn))
+  {
+    return;
+  }
+  if (!pConn->bKeepAlive)
+  {
+    pClient->close();
+    return;
+  }
+  processBuffer(pConn);
+} // static void onFastAck(...)
+//-------------------------------------
+
+// Take a free pool slot for a new connection, nullptr if the pool is full
+static FastHttpConn *takeConn(AsyncClient *pClient)
+{
+  for (uint8_t uConn = 0; uConn < FAST_HTTP_MAX_CLIENTS; uConn++)
+  {
+    FastHttpConn *pConn = &aConns[uConn];
+    if (pConn->pClient == nullptr)
+    {
+      pConn->pClient = pClient;
+      pConn->uLen = 0;
+      pConn->pPending = nullptr;
+      pConn->uPendingLen = 0;
+      pConn->bKeepAlive = true;
+      pConn->bSkipLine = false;
+      return pConn;
+    }
+  }
+  return nullptr;
+} // static FastHttpConn *takeConn(AsyncClient *pClient)
+//-------------------------------------
+
+static void releaseConn(FastHttpConn *pConn)
+{
+  pConn->pClient = nullptr;
+  pConn->uLen = 0;
+  pConn->pPending = nullptr;
+  pConn->uPendingLen = 0;
+  pConn->bSkipLine = false;
+} // static void releaseConn(FastHttpConn *pConn)
+//-------------------------------------
+
+#ifdef ARDUINO
+static void onFastDisconnect(void *pArg, AsyncClient *pClient)
+{
+  releaseConn((FastHttpConn *)pArg);
+  delete pClient;
+} // static void onFastDisconnect(void *pArg, AsyncClient *pClient)
+//-------------------------------------
+
+static void onFastTimeout(void * /* pArg */, AsyncClient *pClient, uint32_t /* uTime */)
+{
+  pClient->close();
+} // static void onFastTimeout(void *pArg, AsyncClient *pClient, uint32_t uTime)
+//-------------------------------------
+
+// New connection : take a slot from the pool or refuse it
+static void onFastClient(void * /* pArg */, AsyncClient *pClient)
+{
+  FastHttpConn *pConn = takeConn(pClient);
+  if (pConn == nullptr)
+  {
+    pClient->onDisconnect([](void * /* pArg */, AsyncClient *pClient) { delete pClient; });
+    pClient->close(true);
+    return;
+  }
+  pClient->setNoDelay(true);
+  pClient->setRxTimeout(FAST_HTTP_IDLE_TIMEOUT);
+  pClient->onData(onFastData, pConn);
+  pClient->onAck(onFastAck, pConn);
+  pClient->onDisconnect(onFastDisconnect, pConn);
+  pClient->onTimeout(onFastTimeout, pConn);
+} // static void onFastClient(void *pArg, AsyncClient *pClient)
+//-------------------------------------
+#endif
+
+void beginFastHttp(uint16_t uPort, const FastHttpEndpoint *pEndpoints, uint8_t uCount)
+{
+  pFastEndpoints = pEndpoints;
+  uFastEndpointCount = uCount;
+  memset(aConns, 0, sizeof(aConns));
+
+#ifdef ARDUINO
+  pFastServer = new AsyncServer(uPort);
+  pFastServer->setNoDelay(true);
+  pFastServer->onClient(onFastClient, nullptr);
+  pFastServer->begin();
+#else
+  (void)uPort; // no listening socket on host : see acceptFastHttp()
+#endif
+} // void beginFastHttp(uint16_t uPort, const FastHttpEndpoint *pEndpoints, uint8_t uCount)
+//-------------------------------------
+
+#ifndef ARDUINO
+// ============================== HOST DRIVER ==============================
+
+static FastHttpConn *findConn(AsyncClient *pClient)
+{
+  for (uint8_t uConn = 0; uConn < FAST_HTTP_MAX_CLIENTS; uConn++)
+  {
+    if (aConns[uConn].pClient == pClient)
+    {
+      return &aConns[uConn];
+    }
+  }
+  return nullptr;
+} // static FastHttpConn *findConn(AsyncClient *pClient)
+//-------------------------------------
+
+bool acceptFastHttp(AsyncClient *pClient)
+{
+  return takeConn(pClient) != nullptr;
+} // bool acceptFastHttp(AsyncClient *pClient)
+//-------------------------------------
+
+void receiveFastHttp(AsyncClient *pClient, const char *pData, size_t uLen)
+{
+  FastHttpConn *pConn = findConn(pClient);
+  if (pConn != nullptr)
+  {
+    onFastData(pConn, pClient, (void *)pData, uLen);
+    // The host window never fills : acknowledge any asset being streamed
+    while (pConn->pClient == pClient && pConn->pPending != nullptr)
+    {
+      onFastAck(pConn, pClient, 0, 0);
+    }
+  }
+} // void receiveFastHttp(AsyncClient *pClient, const char *pData, size_t uLen)
+//-------------------------------------
+
+void dropFastHttp(AsyncClient *pClient)
+{
+  FastHttpConn *pConn = findConn(pClient);
+  if (pConn != nullptr)
+  {
+    releaseConn(pConn);
+  }
+} // void dropFastHttp(AsyncClient *pClient)
+//-------------------------------------
+
+size_t fastHttpConnBytes()
+{
+  return sizeof(FastHttpConn);
+} // size_t fastHttpConnBytes()
+//-------------------------------------
+#endif
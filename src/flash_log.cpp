@@ -0,0 +1,933 @@
+// Persistent sample log with a sparse time index and retention tiers (see flash_log.h)
+
+#include "flash_log.h"
+#include "crc32.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#define FLOG_LOCK() portENTER_CRITICAL(&muxFlashLog)
+#define FLOG_UNLOCK() portEXIT_CRITICAL(&muxFlashLog)
+#define FLOG_MICROS() ((uint64_t)esp_timer_get_time())
+#else
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FLOG_LOCK()                                            \
+  while (flagFlashLog.test_and_set(std::memory_order_acquire)) \
+  {                                                            \
+  }
+#define FLOG_UNLOCK() flagFlashLog.clear(std::memory_order_release)
+#define FLOG_MICROS() ((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count())
+#endif
+
+#define FLOG_READ_RECORDS 32      // records read from flash at once (768 bytes of stack at most)
+#define FLOG_TASK_STACK 3072      // compaction task stack
+#define FLOG_TASK_PRIORITY 0      // idle priority : only runs when nothing else has work
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Records of one tier, and the compaction of the previous tier into it
+struct LogTier
+{
+  uint32_t uFirstSector;     // first sector of the tier in the partition
+  uint32_t uBlockCount;      // sectors of the tier
+  uint32_t uStep;            // aggregation step (seconds, 0 : raw samples)
+  uint32_t uRecordLen;       // sizeof(FlogRecord) or sizeof(FlogAggregate)
+  uint32_t uRecordsPerBlock;
+  uint32_t uOldestBlock;     // oldest block number still stored
+  uint32_t uNextBlock;       // block number opened next (newest + 1)
+  uint32_t uWriteSlot;       // next record slot of the newest block
+  uint32_t uNewestEpoch;     // time of the newest record
+  uint32_t uAppended;
+  uint32_t uBytesWritten;
+  uint32_t uErases;
+  uint32_t uErrors;
+  // Compaction task only
+  uint32_t uCursorBlock;     // next source record : block number in the previous tier
+  uint32_t uCursorSlot;      // and slot in that block
+  uint32_t uCompactedTo;     // source records before this time are compacted
+};
+
+// Samples or aggregates merged together, values in hundredths
+struct LogItem
+{
+  uint32_t uEpoch; // time of the first merged record
+  uint32_t auCount[STATS_CHANNEL_COUNT];
+  int64_t aiSum[STATS_CHANNEL_COUNT];
+  int16_t aiMin[STATS_CHANNEL_COUNT];
+  int16_t aiMax[STATS_CHANNEL_COUNT];
+};
+
+static LogTier aTiers[FLOG_TIER_COUNT];
+static uint32_t auFirstEpoch[FLOG_MAX_BLOCKS]; // sparse index : first record time per sector
+static bool bLogOpen = false;
+
+static LogItem aPending[FLOG_TIER_COUNT]; // aggregate being built by the compaction, per tier
+static bool abPending[FLOG_TIER_COUNT];
+static CompactionStats oCompaction = {0, 0, 0, 0, 0, 0};
+
+#ifdef ARDUINO
+static const esp_partition_t *pLogPartition = nullptr;
+static portMUX_TYPE muxFlashLog = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t hCompactionTask = nullptr;
+#else
+static int iLogFile = -1;
+static std::atomic_flag flagFlashLog = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// Flash access, relative to the start of the partition
+
+static bool flashRead(uint32_t uOffset, void *pData, size_t uLen)
+{
+#ifdef ARDUINO
+  return esp_partition_read(pLogPartition, uOffset, pData, uLen) == ESP_OK;
+#else
+  return pread(iLogFile, pData, uLen, uOffset) == (ssize_t)uLen;
+#endif
+} // static bool flashRead(uint32_t uOffset, void *pData, size_t uLen)
+//-------------------------------------
+
+static bool flashWrite(uint32_t uOffset, const void *pData, size_t uLen)
+{
+#ifdef ARDUINO
+  return esp_partition_write(pLogPartition, uOffset, pData, uLen) == ESP_OK;
+#else
+  return pwrite(iLogFile, pData, uLen, uOffset) == (ssize_t)uLen;
+#endif
+} // static bool flashWrite(uint32_t uOffset, const void *pData, size_t uLen)
+//-------------------------------------
+
+static bool flashErase(uint32_t uSector)
+{
+#ifdef ARDUINO
+  return esp_partition_erase_range(pLogPartition, uSector * FLOG_SECTOR_LEN, FLOG_SECTOR_LEN) == ESP_OK;
+#else
+  uint8_t auErased[FLOG_SECTOR_LEN];
+  memset(auErased, 0xFF, sizeof(auErased));
+  return flashWrite(uSector * FLOG_SECTOR_LEN, auErased, sizeof(auErased));
+#endif
+} // static bool flashErase(uint32_t uSector)
+//-------------------------------------
+
+// Open the partition, returns its length (0 on failure)
+static uint32_t openPartition(const char *pSource)
+{
+#ifdef ARDUINO
+  pLogPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)FLOG_PARTITION_SUBTYPE,
+                                           pSource);
+  return (pLogPartition != nullptr) ? pLogPartition->size : 0;
+#else
+  if (iLogFile >= 0)
+  {
+    close(iLogFile);
+  }
+  iLogFile = open(pSource, O_RDWR | O_CREAT, 0644);
+  struct stat oStat;
+  if (iLogFile < 0 || fstat(iLogFile, &oStat) != 0)
+  {
+    return 0;
+  }
+  if (oStat.st_size == 0)
+  {
+    // New file : an erased partition
+    for (uint32_t uSector = 0; uSector < FLOG_HOST_LEN / FLOG_SECTOR_LEN; uSector++)
+    {
+      if (!flashErase(uSector))
+      {
+        return 0;
+      }
+    }
+    return FLOG_HOST_LEN;
+  }
+  return oStat.st_size;
+#endif
+} // static uint32_t openPartition(const char *pSource)
+//-------------------------------------
+
+static uint32_t sectorOf(const LogTier &oTier, uint32_t uBlockNo)
+{
+  return oTier.uFirstSector + uBlockNo % oTier.uBlockCount;
+} // static uint32_t sectorOf(const LogTier &oTier, uint32_t uBlockNo)
+//-------------------------------------
+
+static uint32_t recordOffset(const LogTier &oTier, uint32_t uBlockNo, uint32_t uSlot)
+{
+  return sectorOf(oTier, uBlockNo) * FLOG_SECTOR_LEN + sizeof(FlogBlockHeader) + uSlot * oTier.uRecordLen;
+} // static uint32_t recordOffset(const LogTier &oTier, uint32_t uBlockNo, uint32_t uSlot)
+//-------------------------------------
+
+static bool readHeader(uint32_t uSector, FlogBlockHeader &oHeader)
+{
+  return flashRead(uSector * FLOG_SECTOR_LEN, &oHeader, sizeof(oHeader)) && oHeader.uMagic == FLOG_MAGIC &&
+         oHeader.uCrc == crc32(&oHeader, offsetof(FlogBlockHeader, uCrc));
+} // static bool readHeader(uint32_t uSector, FlogBlockHeader &oHeader)
+//-------------------------------------
+
+// Read uCount records of block uBlockNo from uSlot, false if unreadable or recycled meanwhile
+static bool readRecords(const LogTier &oTier, uint32_t uBlockNo, uint32_t uSlot, uint32_t uCount, uint8_t *pBuffer)
+{
+  bool bRead = flashRead(recordOffset(oTier, uBlockNo, uSlot), pBuffer, uCount * oTier.uRecordLen);
+  FLOG_LOCK();
+  bool bStored = uBlockNo >= oTier.uOldestBlock; // not erased while being read
+  FLOG_UNLOCK();
+  return bRead && bStored;
+} // static bool readRecords(...)
+//-------------------------------------
+
+static void clearItem(LogItem &oItem, uint32_t uEpoch)
+{
+  oItem.uEpoch = uEpoch;
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    oItem.auCount[uChannel] = 0;
+    oItem.aiSum[uChannel] = 0;
+    oItem.aiMin[uChannel] = INT16_MAX;
+    oItem.aiMax[uChannel] = INT16_MIN;
+  }
+} // static void clearItem(LogItem &oItem, uint32_t uEpoch)
+//-------------------------------------
+
+static void mergeItem(LogItem &oInto, const LogItem &oItem)
+{
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    if (oItem.auCount[uChannel] != 0)
+    {
+      oInto.auCount[uChannel] += oItem.auCount[uChannel];
+      oInto.aiSum[uChannel] += oItem.aiSum[uChannel];
+      oInto.aiMin[uChannel] = (oItem.aiMin[uChannel] < oInto.aiMin[uChannel]) ? oItem.aiMin[uChannel] : oInto.aiMin[uChannel];
+      oInto.aiMax[uChannel] = (oItem.aiMax[uChannel] > oInto.aiMax[uChannel]) ? oItem.aiMax[uChannel] : oInto.aiMax[uChannel];
+    }
+  }
+} // static void mergeItem(LogItem &oInto, const LogItem &oItem)
+//-------------------------------------
+
+// Decode a record of oTier : 1 valid, 0 bad CRC (torn), -1 erased (end of the written part)
+static int8_t decodeRecord(const LogTier &oTier, const uint8_t *pRecord, LogItem &oItem)
+{
+  uint8_t uAnd = 0xFF;
+  for (uint32_t uByte = 0; uByte < oTier.uRecordLen; uByte++)
+  {
+    uAnd &= pRecord[uByte];
+  }
+  if (uAnd == 0xFF)
+  {
+    return -1;
+  }
+  if (oTier.uStep == 0)
+  {
+    FlogRecord oRecord;
+    memcpy(&oRecord, pRecord, sizeof(oRecord));
+    if (oRecord.uCrc != crc32(&oRecord, offsetof(FlogRecord, uCrc)))
+    {
+      return 0;
+    }
+    const int16_t aiValues[STATS_CHANNEL_COUNT] = {oRecord.iTmp, oRecord.iHum};
+    clearItem(oItem, oRecord.uEpoch);
+    for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+    {
+      if (aiValues[uChannel] != INT16_MIN)
+      {
+        oItem.auCount[uChannel] = 1;
+        oItem.aiSum[uChannel] = oItem.aiMin[uChannel] = oItem.aiMax[uChannel] = aiValues[uChannel];
+      }
+    }
+    return 1;
+  }
+  FlogAggregate oAggregate;
+  memcpy(&oAggregate, pRecord, sizeof(oAggregate));
+  if (oAggregate.uCrc != crc32(&oAggregate, offsetof(FlogAggregate, uCrc)))
+  {
+    return 0;
+  }
+  clearItem(oItem, oAggregate.uEpoch);
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    if (oAggregate.auCount[uChannel] != 0)
+    {
+      oItem.auCount[uChannel] = oAggregate.auCount[uChannel];
+      oItem.aiSum[uChannel] = (int64_t)oAggregate.aiMean[uChannel] * oAggregate.auCount[uChannel];
+      oItem.aiMin[uChannel] = oAggregate.aiMin[uChannel];
+      oItem.aiMax[uChannel] = oAggregate.aiMax[uChannel];
+    }
+  }
+  return 1;
+} // static int8_t decodeRecord(const LogTier &oTier, const uint8_t *pRecord, LogItem &oItem)
+//-------------------------------------
+
+// Last block of oTier starting at or before uEpoch (its oldest block if none)
+static uint32_t findBlock(const LogTier &oTier, uint32_t uEpoch)
+{
+  FLOG_LOCK();
+  uint32_t uLow = oTier.uOldestBlock;
+  uint32_t uHigh = oTier.uNextBlock;
+  FLOG_UNLOCK();
+  while (uHigh - uLow > 1)
+  {
+    uint32_t uMiddle = uLow + (uHigh - uLow) / 2;
+    FLOG_LOCK();
+    uint32_t uFirstEpoch = auFirstEpoch[sectorOf(oTier, uMiddle)];
+    FLOG_UNLOCK();
+    if (uFirstEpoch <= uEpoch)
+    {
+      uLow = uMiddle;
+    }
+    else
+    {
+      uHigh = uMiddle;
+    }
+  }
+  return uLow;
+} // static uint32_t findBlock(const LogTier &oTier, uint32_t uEpoch)
+//-------------------------------------
+
+// Rebuild the index of a tier from its block headers and find its write position
+static void openTier(LogTier &oTier)
+{
+  // Newest valid block, then walk back through consecutive block numbers
+  FlogBlockHeader oHeader;
+  bool bAny = false;
+  uint32_t uNewest = 0;
+  for (uint32_t uBlock = 0; uBlock < oTier.uBlockCount; uBlock++)
+  {
+    if (readHeader(oTier.uFirstSector + uBlock, oHeader) && oHeader.uBlockNo % oTier.uBlockCount == uBlock &&
+        (!bAny || oHeader.uBlockNo > uNewest))
+    {
+      uNewest = oHeader.uBlockNo;
+      bAny = true;
+    }
+  }
+  oTier.uOldestBlock = oTier.uNextBlock = bAny ? uNewest + 1 : 0;
+  oTier.uWriteSlot = oTier.uRecordsPerBlock;
+  oTier.uNewestEpoch = 0;
+  while (bAny && oTier.uNextBlock - oTier.uOldestBlock < oTier.uBlockCount && oTier.uOldestBlock > 0 &&
+         readHeader(sectorOf(oTier, oTier.uOldestBlock - 1), oHeader) && oHeader.uBlockNo == oTier.uOldestBlock - 1)
+  {
+    oTier.uOldestBlock--;
+    auFirstEpoch[sectorOf(oTier, oTier.uOldestBlock)] = oHeader.uFirstEpoch;
+  }
+  if (oTier.uNextBlock == oTier.uOldestBlock)
+  {
+    return;
+  }
+
+  // Write position : after the last non-erased record of the newest block
+  uint8_t auBuffer[FLOG_READ_RECORDS * sizeof(FlogAggregate)];
+  LogItem oItem;
+  oTier.uNewestEpoch = auFirstEpoch[sectorOf(oTier, uNewest)];
+  oTier.uWriteSlot = 0;
+  for (uint32_t uSlot = 0; uSlot < oTier.uRecordsPerBlock; uSlot += FLOG_READ_RECORDS)
+  {
+    uint32_t uRead = (oTier.uRecordsPerBlock - uSlot < FLOG_READ_RECORDS) ? oTier.uRecordsPerBlock - uSlot
+                                                                          : FLOG_READ_RECORDS;
+    if (!readRecords(oTier, uNewest, uSlot, uRead, auBuffer))
+    {
+      oTier.uErrors++;
+      oTier.uWriteSlot = oTier.uRecordsPerBlock; // start a new block
+      return;
+    }
+    for (uint32_t uRecord = 0; uRecord < uRead; uRecord++)
+    {
+      int8_t iDecoded = decodeRecord(oTier, auBuffer + uRecord * oTier.uRecordLen, oItem);
+      if (iDecoded >= 0)
+      {
+        oTier.uWriteSlot = uSlot + uRecord + 1;
+      }
+      if (iDecoded > 0)
+      {
+        oTier.uNewestEpoch = oItem.uEpoch;
+      }
+    }
+  }
+} // static void openTier(LogTier &oTier)
+//-------------------------------------
+
+bool beginFlashLog(const char *pSource)
+{
+  static const uint32_t auBlocks[FLOG_TIER_COUNT] = FLOG_TIER_BLOCKS;
+  static const uint32_t auSteps[FLOG_TIER_COUNT] = FLOG_TIER_STEPS;
+  uint32_t uSectors = openPartition(pSource) / FLOG_SECTOR_LEN;
+  uint32_t uNeeded = 0;
+  for (uint8_t uTier = 0; uTier < FLOG_TIER_COUNT; uTier++)
+  {
+    uNeeded += auBlocks[uTier];
+  }
+  bLogOpen = false;
+  if (uSectors < uNeeded || uNeeded > FLOG_MAX_BLOCKS)
+  {
+    return false;
+  }
+
+  uint32_t uFirstSector = 0;
+  for (uint8_t uTier = 0; uTier < FLOG_TIER_COUNT; uTier++)
+  {
+    LogTier &oTier = aTiers[uTier];
+    memset(&oTier, 0, sizeof(oTier));
+    oTier.uFirstSector = uFirstSector;
+    oTier.uBlockCount = auBlocks[uTier];
+    oTier.uStep = auSteps[uTier];
+    oTier.uRecordLen = (uTier == 0) ? sizeof(FlogRecord) : sizeof(FlogAggregate);
+    oTier.uRecordsPerBlock = (FLOG_SECTOR_LEN - sizeof(FlogBlockHeader)) / oTier.uRecordLen;
+    uFirstSector += oTier.uBlockCount;
+    openTier(oTier);
+    abPending[uTier] = false;
+  }
+
+  // Resume the compaction after the newest aggregate of every tier
+  for (uint8_t uTier = 1; uTier < FLOG_TIER_COUNT; uTier++)
+  {
+    LogTier &oTier = aTiers[uTier];
+    oTier.uCompactedTo = (oTier.uNextBlock != oTier.uOldestBlock) ? oTier.uNewestEpoch + oTier.uStep : 0;
+    oTier.uCursorBlock = findBlock(aTiers[uTier - 1], oTier.uCompactedTo);
+    oTier.uCursorSlot = 0;
+  }
+  bLogOpen = true;
+  return true;
+} // bool beginFlashLog(const char *pSource)
+//-------------------------------------
+
+// Start block oTier.uNextBlock with a record at uEpoch, erasing the oldest block if the tier is full
+static bool openBlock(LogTier &oTier, uint32_t uEpoch)
+{
+  uint32_t uSector = sectorOf(oTier, oTier.uNextBlock);
+  FLOG_LOCK();
+  if (oTier.uNextBlock - oTier.uOldestBlock >= oTier.uBlockCount)
+  {
+    oTier.uOldestBlock++; // queries stop reading it before it is erased
+  }
+  FLOG_UNLOCK();
+
+  FlogBlockHeader oHeader;
+  oHeader.uMagic = FLOG_MAGIC;
+  oHeader.uBlockNo = oTier.uNextBlock;
+  oHeader.uFirstEpoch = uEpoch;
+  oHeader.uCrc = crc32(&oHeader, offsetof(FlogBlockHeader, uCrc));
+  if (!flashErase(uSector) || !flashWrite(uSector * FLOG_SECTOR_LEN, &oHeader, sizeof(oHeader)))
+  {
+    return false;
+  }
+
+  FLOG_LOCK();
+  auFirstEpoch[uSector] = uEpoch;
+  oTier.uNextBlock++;
+  oTier.uWriteSlot = 0;
+  oTier.uErases++;
+  oTier.uBytesWritten += sizeof(oHeader);
+  FLOG_UNLOCK();
+  return true;
+} // static bool openBlock(LogTier &oTier, uint32_t uEpoch)
+//-------------------------------------
+
+// Append a record at uEpoch to oTier (one writer per tier)
+static bool appendRecord(LogTier &oTier, const void *pRecord, uint32_t uEpoch)
+{
+  if ((oTier.uWriteSlot >= oTier.uRecordsPerBlock && !openBlock(oTier, uEpoch)) ||
+      !flashWrite(recordOffset(oTier, oTier.uNextBlock - 1, oTier.uWriteSlot), pRecord, oTier.uRecordLen))
+  {
+    FLOG_LOCK();
+    oTier.uErrors++;
+    FLOG_UNLOCK();
+    return false;
+  }
+  FLOG_LOCK();
+  oTier.uWriteSlot++;
+  oTier.uNewestEpoch = uEpoch;
+  oTier.uAppended++;
+  oTier.uBytesWritten += oTier.uRecordLen;
+  FLOG_UNLOCK();
+  return true;
+} // static bool appendRecord(LogTier &oTier, const void *pRecord, uint32_t uEpoch)
+//-------------------------------------
+
+// Value in hundredths, INT16_MIN if invalid or out of the int16 range
+static int16_t toHundredths(float fValue, bool bValid)
+{
+  if (!bValid || isnan(fValue) || fabsf(fValue) >= 327.0f)
+  {
+    return INT16_MIN;
+  }
+  return (int16_t)lroundf(fValue * 100.0f);
+} // static int16_t toHundredths(float fValue, bool bValid)
+//-------------------------------------
+
+void appendFlashLog(const Measurement &oMeasurement)
+{
+  if (!bLogOpen || (oMeasurement.uFlags & MEAS_RESTORED) || oMeasurement.uNtpQuality == NTP_NONE)
+  {
+    return;
+  }
+  LogTier &oRaw = aTiers[0];
+  FlogRecord oRecord;
+  oRecord.uSeq = oMeasurement.uSeq;
+  oRecord.uEpoch = (oMeasurement.uEpoch < oRaw.uNewestEpoch) ? oRaw.uNewestEpoch : oMeasurement.uEpoch; // keep the index sorted
+  oRecord.iTmp = toHundredths(oMeasurement.fTmp, oMeasurement.uFlags & MEAS_TMP_VALID);
+  oRecord.iHum = toHundredths(oMeasurement.fHum, oMeasurement.uFlags & MEAS_HUM_VALID);
+  oRecord.uCrc = crc32(&oRecord, offsetof(FlogRecord, uCrc));
+  appendRecord(oRaw, &oRecord, oRecord.uEpoch);
+} // void appendFlashLog(const Measurement &oMeasurement)
+//-------------------------------------
+
+// Write the pending aggregate of oTier
+static void writeAggregate(LogTier &oTier, const LogItem &oItem)
+{
+  FlogAggregate oAggregate;
+  oAggregate.uEpoch = oItem.uEpoch;
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    uint32_t uCount = oItem.auCount[uChannel];
+    int64_t iSum = oItem.aiSum[uChannel];
+    oAggregate.auCount[uChannel] = (uCount > UINT16_MAX) ? UINT16_MAX : uCount;
+    oAggregate.aiMean[uChannel] = uCount ? (int16_t)((iSum + (iSum >= 0 ? 1 : -1) * (int64_t)(uCount / 2)) / (int64_t)uCount)
+                                         : INT16_MIN;
+    oAggregate.aiMin[uChannel] = uCount ? oItem.aiMin[uChannel] : INT16_MIN;
+    oAggregate.aiMax[uChannel] = uCount ? oItem.aiMax[uChannel] : INT16_MIN;
+  }
+  oAggregate.uCrc = crc32(&oAggregate, offsetof(FlogAggregate, uCrc));
+  if (appendRecord(oTier, &oAggregate, oAggregate.uEpoch))
+  {
+    oCompaction.uAggregates++;
+  }
+  oTier.uCompactedTo = oItem.uEpoch + oTier.uStep;
+} // static void writeAggregate(LogTier &oTier, const LogItem &oItem)
+//-------------------------------------
+
+// Compact up to uMaxRecords records of the tier below uTier into it, returns the records read
+static uint32_t compactTier(uint8_t uTier, uint32_t uMaxRecords)
+{
+  LogTier &oTier = aTiers[uTier];
+  const LogTier &oSource = aTiers[uTier - 1];
+  LogItem &oAggregate = aPending[uTier];
+  uint8_t auBuffer[FLOG_READ_RECORDS * sizeof(FlogAggregate)];
+  uint32_t uRead = 0;
+
+  while (uRead < uMaxRecords)
+  {
+    FLOG_LOCK();
+    uint32_t uOldest = oSource.uOldestBlock;
+    uint32_t uNext = oSource.uNextBlock;
+    uint32_t uWriteSlot = oSource.uWriteSlot;
+    FLOG_UNLOCK();
+    if (oTier.uCursorBlock < uOldest)
+    {
+      oTier.uCursorBlock = uOldest; // lagged behind the source ring
+      oTier.uCursorSlot = 0;
+    }
+    if (oTier.uCursorBlock >= uNext)
+    {
+      break;
+    }
+    uint32_t uAvailable = (oTier.uCursorBlock == uNext - 1) ? uWriteSlot : oSource.uRecordsPerBlock;
+    if (oTier.uCursorSlot >= uAvailable)
+    {
+      if (oTier.uCursorBlock == uNext - 1)
+      {
+        break; // caught up
+      }
+      oTier.uCursorBlock++;
+      oTier.uCursorSlot = 0;
+      continue;
+    }
+    uint32_t uCount = uAvailable - oTier.uCursorSlot;
+    uCount = (uCount > FLOG_READ_RECORDS) ? FLOG_READ_RECORDS : uCount;
+    uCount = (uCount > uMaxRecords - uRead) ? uMaxRecords - uRead : uCount;
+    if (!readRecords(oSource, oTier.uCursorBlock, oTier.uCursorSlot, uCount, auBuffer))
+    {
+      oTier.uCursorSlot = oSource.uRecordsPerBlock; // recycled or unreadable : next block
+      continue;
+    }
+
+    LogItem oItem;
+    for (uint32_t uRecord = 0; uRecord < uCount; uRecord++)
+    {
+      if (decodeRecord(oSource, auBuffer + uRecord * oSource.uRecordLen, oItem) <= 0 ||
+          oItem.uEpoch < oTier.uCompactedTo)
+      {
+        continue; // torn, or compacted before a reboot
+      }
+      uint32_t uStart = oItem.uEpoch - oItem.uEpoch % oTier.uStep;
+      if (abPending[uTier] && uStart != oAggregate.uEpoch)
+      {
+        writeAggregate(oTier, oAggregate); // step closed
+        abPending[uTier] = false;
+      }
+      if (!abPending[uTier])
+      {
+        clearItem(oAggregate, uStart);
+        abPending[uTier] = true;
+      }
+      mergeItem(oAggregate, oItem);
+    }
+    oTier.uCursorSlot += uCount;
+    uRead += uCount;
+  }
+  return uRead;
+} // static uint32_t compactTier(uint8_t uTier, uint32_t uMaxRecords)
+//-------------------------------------
+
+uint32_t compactFlashLog(uint32_t uMaxRecords)
+{
+  if (!bLogOpen)
+  {
+    return 0;
+  }
+  uint64_t ullStart = FLOG_MICROS();
+  uint32_t uRead = 0;
+  for (uint8_t uTier = 1; uTier < FLOG_TIER_COUNT; uTier++)
+  {
+    uRead += compactTier(uTier, uMaxRecords);
+  }
+
+  // Source records not read yet
+  uint32_t uBacklog = 0;
+  for (uint8_t uTier = 1; uTier < FLOG_TIER_COUNT; uTier++)
+  {
+    const LogTier &oSource = aTiers[uTier - 1];
+    FLOG_LOCK();
+    uint32_t uNext = oSource.uNextBlock;
+    uint32_t uWriteSlot = oSource.uWriteSlot;
+    FLOG_UNLOCK();
+    uint32_t uCursorBlock = aTiers[uTier].uCursorBlock;
+    if (uCursorBlock < uNext)
+    {
+      uint32_t uRecords = (uNext - 1 - uCursorBlock) * oSource.uRecordsPerBlock + uWriteSlot;
+      uBacklog += (uRecords > aTiers[uTier].uCursorSlot) ? uRecords - aTiers[uTier].uCursorSlot : 0;
+    }
+  }
+
+  uint32_t uMicros = (uint32_t)(FLOG_MICROS() - ullStart);
+  FLOG_LOCK();
+  oCompaction.uSlices++;
+  oCompaction.uRecordsRead += uRead;
+  oCompaction.ullBusyMicros += uMicros;
+  oCompaction.uMaxSliceMicros = (uMicros > oCompaction.uMaxSliceMicros) ? uMicros : oCompaction.uMaxSliceMicros;
+  oCompaction.uBacklog = uBacklog;
+  FLOG_UNLOCK();
+  return uRead;
+} // uint32_t compactFlashLog(uint32_t uMaxRecords)
+//-------------------------------------
+
+#ifdef ARDUINO
+// Compaction task : one slice, then a pause
+static void compactionTask(void *pParameters)
+{
+  for (;;)
+  {
+    compactFlashLog(FLOG_COMPACT_SLICE);
+    vTaskDelay(pdMS_TO_TICKS(FLOG_COMPACT_PERIOD));
+  }
+} // static void compactionTask(void *pParameters)
+//-------------------------------------
+#endif
+
+void beginFlashCompaction()
+{
+#ifdef ARDUINO
+  if (bLogOpen && hCompactionTask == nullptr)
+  {
+    xTaskCreate(compactionTask, "flogc", FLOG_TASK_STACK, nullptr, FLOG_TASK_PRIORITY, &hCompactionTask);
+  }
+#endif
+} // void beginFlashCompaction()
+//-------------------------------------
+
+// Hand a non-empty step to the handler, false to stop the query
+static bool flushStep(const LogItem &oItem, FlogStepHandler pHandler, void *pContext, uint32_t &uSteps)
+{
+  FlogStep oStep;
+  bool bEmpty = true;
+  oStep.uStart = oItem.uEpoch;
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    uint32_t uCount = oItem.auCount[uChannel];
+    oStep.auCount[uChannel] = (uCount > UINT16_MAX) ? UINT16_MAX : uCount;
+    oStep.afMean[uChannel] = uCount ? oItem.aiSum[uChannel] / (100.0f * uCount) : NAN;
+    oStep.afMin[uChannel] = uCount ? oItem.aiMin[uChannel] / 100.0f : NAN;
+    oStep.afMax[uChannel] = uCount ? oItem.aiMax[uChannel] / 100.0f : NAN;
+    bEmpty = bEmpty && uCount == 0;
+  }
+  if (bEmpty)
+  {
+    return true;
+  }
+  uSteps++;
+  return pHandler(oStep, pContext);
+} // static bool flushStep(...)
+//-------------------------------------
+
+// Tier a query of [uFrom, ...] per uStep starts with, -1 if the log is empty
+static int8_t queryTier(uint32_t uFrom, uint32_t uStep)
+{
+  int8_t iCovering = -1;
+  int8_t iFurthest = -1;
+  uint32_t uFurthestEpoch = UINT32_MAX;
+  for (uint8_t uTier = 0; uTier < FLOG_TIER_COUNT; uTier++)
+  {
+    const LogTier &oTier = aTiers[uTier];
+    FLOG_LOCK();
+    bool bEmpty = oTier.uNextBlock == oTier.uOldestBlock;
+    uint32_t uOldestEpoch = auFirstEpoch[sectorOf(oTier, oTier.uOldestBlock)];
+    FLOG_UNLOCK();
+    if (bEmpty)
+    {
+      continue;
+    }
+    if (oTier.uStep <= uStep && uOldestEpoch <= uFrom)
+    {
+      iCovering = uTier; // the coarsest one wins
+    }
+    if (uOldestEpoch < uFurthestEpoch)
+    {
+      iFurthest = uTier;
+      uFurthestEpoch = uOldestEpoch;
+    }
+  }
+  return (iCovering >= 0) ? iCovering : iFurthest;
+} // static int8_t queryTier(uint32_t uFrom, uint32_t uStep)
+//-------------------------------------
+
+uint32_t queryFlashLog(uint32_t uFrom, uint32_t uTo, uint32_t uStep, FlogStepHandler pHandler, void *pContext,
+                       FlogQueryStats *pStats, int8_t iFirstTier)
+{
+  FlogQueryStats oStats = {0, 0, 0, 0};
+  int8_t iTier = (!bLogOpen || uFrom > uTo || uStep == 0) ? -1
+                 : (iFirstTier >= 0 && iFirstTier < FLOG_TIER_COUNT) ? iFirstTier
+                                                                      : queryTier(uFrom, uStep);
+  if (iTier < 0)
+  {
+    if (pStats != nullptr)
+    {
+      *pStats = oStats;
+    }
+    return 0;
+  }
+  oStats.uTier = iTier;
+
+  // From the chosen tier down to the raw one : every tier covers up to the
+  // end of its newest aggregate, the next finer tier continues from there
+  uint8_t auBuffer[FLOG_READ_RECORDS * sizeof(FlogAggregate)];
+  LogItem oStep;
+  clearItem(oStep, uFrom);
+  bool bDone = false;
+  bool bStopped = false; // by the handler
+  uint32_t uScanFrom = uFrom;
+  for (; iTier >= 0 && !bDone; iTier--)
+  {
+    const LogTier &oTier = aTiers[iTier];
+    FLOG_LOCK();
+    bool bEmpty = oTier.uNextBlock == oTier.uOldestBlock;
+    uint32_t uEnd = oTier.uNextBlock;
+    uint32_t uCoveredTo = (iTier == 0) ? UINT32_MAX : oTier.uNewestEpoch + oTier.uStep;
+    FLOG_UNLOCK();
+    if (bEmpty || uCoveredTo <= uScanFrom)
+    {
+      continue;
+    }
+
+    // Binary search of the first block, then stream the blocks until a record is past the range
+    bool bTierDone = false;
+    for (uint32_t uBlockNo = findBlock(oTier, uScanFrom); uBlockNo < uEnd && !bTierDone; uBlockNo++)
+    {
+      oStats.uBlocksRead++;
+      for (uint32_t uSlot = 0; uSlot < oTier.uRecordsPerBlock && !bTierDone; uSlot += FLOG_READ_RECORDS)
+      {
+        uint32_t uRead = (oTier.uRecordsPerBlock - uSlot < FLOG_READ_RECORDS) ? oTier.uRecordsPerBlock - uSlot
+                                                                              : FLOG_READ_RECORDS;
+        if (!readRecords(oTier, uBlockNo, uSlot, uRead, auBuffer))
+        {
+          break; // next block
+        }
+        for (uint32_t uRecord = 0; uRecord < uRead; uRecord++)
+        {
+          LogItem oItem;
+          oStats.uRecordsRead++;
+          int8_t iDecoded = decodeRecord(oTier, auBuffer + uRecord * oTier.uRecordLen, oItem);
+          if (iDecoded < 0)
+          {
+            uSlot = oTier.uRecordsPerBlock; // end of the written part of the block
+            break;
+          }
+          if (iDecoded == 0 || oItem.uEpoch < uScanFrom)
+          {
+            continue;
+          }
+          if (oItem.uEpoch > uTo || oItem.uEpoch >= uCoveredTo)
+          {
+            bTierDone = true;
+            bDone = oItem.uEpoch > uTo;
+            break;
+          }
+          uint32_t uStart = uFrom + (oItem.uEpoch - uFrom) / uStep * uStep;
+          if (uStart != oStep.uEpoch)
+          {
+            if (!flushStep(oStep, pHandler, pContext, oStats.uSteps))
+            {
+              bTierDone = bDone = bStopped = true;
+              break;
+            }
+            clearItem(oStep, uStart);
+          }
+          mergeItem(oStep, oItem);
+        }
+      }
+    }
+    uScanFrom = uCoveredTo;
+  }
+  if (!bStopped)
+  {
+    flushStep(oStep, pHandler, pContext, oStats.uSteps);
+  }
+  if (pStats != nullptr)
+  {
+    *pStats = oStats;
+  }
+  return oStats.uSteps;
+} // uint32_t queryFlashLog(...)
+//-------------------------------------
+
+bool openFlashCursor(FlogCursor &oCursor, uint8_t uTier, uint32_t uFrom, uint32_t uTo)
+{
+  if (uTier >= FLOG_TIER_COUNT)
+  {
+    return false;
+  }
+  oCursor.uTier = uTier;
+  oCursor.uBlockNo = bLogOpen ? findBlock(aTiers[uTier], uFrom) : 0;
+  oCursor.uSlot = 0;
+  oCursor.uFrom = uFrom;
+  oCursor.uTo = uTo;
+  oCursor.bDone = !bLogOpen || uFrom > uTo;
+  return true;
+} // bool openFlashCursor(FlogCursor &oCursor, uint8_t uTier, uint32_t uFrom, uint32_t uTo)
+//-------------------------------------
+
+uint32_t readFlashCursor(FlogCursor &oCursor, FlogItem *pItems, uint32_t uMaxItems, uint8_t *pStored)
+{
+  const LogTier &oTier = aTiers[oCursor.uTier];
+  uint8_t auBuffer[FLOG_READ_RECORDS * sizeof(FlogAggregate)];
+  uint32_t uItems = 0;
+  while (uItems < uMaxItems && !oCursor.bDone)
+  {
+    FLOG_LOCK();
+    uint32_t uOldest = oTier.uOldestBlock;
+    uint32_t uNext = oTier.uNextBlock;
+    uint32_t uWriteSlot = oTier.uWriteSlot;
+    FLOG_UNLOCK();
+    if (oCursor.uBlockNo < uOldest)
+    {
+      oCursor.uBlockNo = uOldest; // lagged behind the ring
+      oCursor.uSlot = 0;
+    }
+    uint32_t uAvailable = (oCursor.uBlockNo == uNext - 1) ? uWriteSlot : oTier.uRecordsPerBlock;
+    if (oCursor.uBlockNo >= uNext || (oCursor.uBlockNo == uNext - 1 && oCursor.uSlot >= uAvailable))
+    {
+      oCursor.bDone = true; // end of the written part : records appended later are not read
+      break;
+    }
+    if (oCursor.uSlot >= uAvailable)
+    {
+      oCursor.uBlockNo++;
+      oCursor.uSlot = 0;
+      continue;
+    }
+    uint32_t uCount = uAvailable - oCursor.uSlot;
+    uCount = (uCount > FLOG_READ_RECORDS) ? FLOG_READ_RECORDS : uCount;
+    uCount = (uCount > uMaxItems - uItems) ? uMaxItems - uItems : uCount;
+    if (!readRecords(oTier, oCursor.uBlockNo, oCursor.uSlot, uCount, auBuffer))
+    {
+      oCursor.uSlot = oTier.uRecordsPerBlock; // recycled or unreadable : next block
+      continue;
+    }
+
+    for (uint32_t uRecord = 0; uRecord < uCount; uRecord++)
+    {
+      const uint8_t *pRecord = auBuffer + uRecord * oTier.uRecordLen;
+      LogItem oItem;
+      int8_t iDecoded = decodeRecord(oTier, pRecord, oItem);
+      if (iDecoded < 0)
+      {
+        uCount = oTier.uRecordsPerBlock; // end of the written part of the block
+        break;
+      }
+      if (iDecoded == 0 || oItem.uEpoch < oCursor.uFrom)
+      {
+        continue;
+      }
+      if (oItem.uEpoch > oCursor.uTo)
+      {
+        oCursor.bDone = true;
+        break;
+      }
+      FlogItem &oOut = pItems[uItems];
+      oOut.uEpoch = oItem.uEpoch;
+      oOut.uSeq = 0;
+      if (oTier.uStep == 0)
+      {
+        memcpy(&oOut.uSeq, pRecord + offsetof(FlogRecord, uSeq), sizeof(oOut.uSeq));
+      }
+      for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+      {
+        uint32_t uSamples = oItem.auCount[uChannel];
+        oOut.auCount[uChannel] = (uSamples > UINT16_MAX) ? UINT16_MAX : uSamples;
+        oOut.aiMean[uChannel] = uSamples ? (int16_t)(oItem.aiSum[uChannel] / (int64_t)uSamples) : INT16_MIN;
+        oOut.aiMin[uChannel] = uSamples ? oItem.aiMin[uChannel] : INT16_MIN;
+        oOut.aiMax[uChannel] = uSamples ? oItem.aiMax[uChannel] : INT16_MIN;
+      }
+      if (pStored != nullptr)
+      {
+        memcpy(pStored + uItems * oTier.uRecordLen, pRecord, oTier.uRecordLen);
+      }
+      uItems++;
+    }
+    oCursor.uSlot += uCount;
+  }
+  return uItems;
+} // uint32_t readFlashCursor(FlogCursor &oCursor, FlogItem *pItems, uint32_t uMaxItems, uint8_t *pStored)
+//-------------------------------------
+
+uint32_t flashRecordLen(uint8_t uTier)
+{
+  return (uTier == 0) ? sizeof(FlogRecord) : (uTier < FLOG_TIER_COUNT) ? sizeof(FlogAggregate) : 0;
+} // uint32_t flashRecordLen(uint8_t uTier)
+//-------------------------------------
+
+bool getFlashLogStats(uint8_t uTier, FlashLogStats &oStats)
+{
+  if (uTier >= FLOG_TIER_COUNT)
+  {
+    return false;
+  }
+  const LogTier &oTier = aTiers[uTier];
+  FLOG_LOCK();
+  uint32_t uBlocks = oTier.uNextBlock - oTier.uOldestBlock;
+  oStats.uStep = oTier.uStep;
+  oStats.uCapacity = bLogOpen ? oTier.uBlockCount : 0;
+  oStats.uBlocks = uBlocks;
+  oStats.uRecords = uBlocks ? (uBlocks - 1) * oTier.uRecordsPerBlock + oTier.uWriteSlot : 0;
+  oStats.uOldestEpoch = uBlocks ? auFirstEpoch[sectorOf(oTier, oTier.uOldestBlock)] : 0;
+  oStats.uNewestEpoch = uBlocks ? oTier.uNewestEpoch : 0;
+  oStats.uAppended = oTier.uAppended;
+  oStats.uBytesWritten = oTier.uBytesWritten;
+  oStats.uErases = oTier.uErases;
+  oStats.uErrors = oTier.uErrors;
+  FLOG_UNLOCK();
+  return true;
+} // bool getFlashLogStats(uint8_t uTier, FlashLogStats &oStats)
+//-------------------------------------
+
+void getCompactionStats(CompactionStats &oStats)
+{
+  FLOG_LOCK();
+  oStats = oCompaction;
+  FLOG_UNLOCK();
+} // void getCompactionStats(CompactionStats &oStats)
+//-------------------------------------
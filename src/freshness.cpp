@@ -0,0 +1,95 @@
+// Data freshness and end-to-end latency instrumentation (see freshness.h)
+
+#include "freshness.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define FRESH_LOCK() portENTER_CRITICAL(&muxFreshness)
+#define FRESH_UNLOCK() portEXIT_CRITICAL(&muxFreshness)
+#else
+#include <atomic>
+#define FRESH_LOCK()                                            \
+  while (flagFreshness.test_and_set(std::memory_order_acquire)) \
+  {                                                             \
+  }
+#define FRESH_UNLOCK() flagFreshness.clear(std::memory_order_release)
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+struct FreshnessCounters
+{
+  uint32_t uCount;
+  uint64_t ullSumMs; // 64 bits : 40 s per request would wrap 32 bits after ~100k requests
+  uint32_t uMaxMs;
+  uint32_t uLastMs;
+  uint32_t auBuckets[FRESH_BUCKET_COUNT];
+};
+
+static const uint32_t auBounds[FRESH_BUCKET_COUNT] = FRESH_BUCKET_BOUNDS;
+static FreshnessCounters aCounters[FRESH_KIND_COUNT];
+
+#ifdef ARDUINO
+static portMUX_TYPE muxFreshness = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagFreshness = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+void recordFreshness(FreshnessKind eKind, uint32_t uMs)
+{
+  if (eKind >= FRESH_KIND_COUNT)
+  {
+    return;
+  }
+  if (eKind == FRESH_DISPLAYED && uMs > FRESH_DISPLAYED_MAX_MS)
+  {
+    uMs = FRESH_DISPLAYED_MAX_MS;
+  }
+  uint8_t uBucket = 0;
+  while (uBucket < FRESH_BUCKET_COUNT - 1 && uMs > auBounds[uBucket])
+  {
+    uBucket++;
+  }
+
+  FRESH_LOCK();
+  FreshnessCounters &oCounters = aCounters[eKind];
+  oCounters.uCount++;
+  oCounters.ullSumMs += uMs;
+  if (uMs > oCounters.uMaxMs)
+  {
+    oCounters.uMaxMs = uMs;
+  }
+  oCounters.uLastMs = uMs;
+  oCounters.auBuckets[uBucket]++;
+  FRESH_UNLOCK();
+} // void recordFreshness(FreshnessKind eKind, uint32_t uMs)
+//-------------------------------------
+
+bool getFreshness(FreshnessKind eKind, FreshnessHistogram &oHistogram)
+{
+  if (eKind >= FRESH_KIND_COUNT)
+  {
+    return false;
+  }
+  FRESH_LOCK();
+  const FreshnessCounters &oCounters = aCounters[eKind];
+  oHistogram.uCount = oCounters.uCount;
+  oHistogram.uMeanMs = (oCounters.uCount == 0) ? 0 : (uint32_t)(oCounters.ullSumMs / oCounters.uCount);
+  oHistogram.uMaxMs = oCounters.uMaxMs;
+  oHistogram.uLastMs = oCounters.uLastMs;
+  for (uint8_t uBucket = 0; uBucket < FRESH_BUCKET_COUNT; uBucket++)
+  {
+    oHistogram.auBuckets[uBucket] = oCounters.auBuckets[uBucket];
+  }
+  FRESH_UNLOCK();
+  return true;
+} // bool getFreshness(FreshnessKind eKind, FreshnessHistogram &oHistogram)
+//-------------------------------------
+
+uint32_t freshnessBound(uint8_t uBucket)
+{
+  return (uBucket < FRESH_BUCKET_COUNT) ? auBounds[uBucket] : UINT32_MAX;
+} // uint32_t freshnessBound(uint8_t uBucket)
+//-------------------------------------
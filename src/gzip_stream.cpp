@@ -0,0 +1,582 @@
+// Small-window streaming gzip compressor (see gzip_stream.h)
+
+#include "gzip_stream.h"
+#include "crc32.h"
+
+#include <string.h>
+
+#define GZIP_NONE 0xFFFF  // empty hash chain link
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Length codes 257..285 : base length and extra bits
+static const uint16_t auLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t auLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+// Distance codes 0..29 : base distance and extra bits
+static const uint16_t auDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                        193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                        6145, 8193, 12289, 16385, 24577};
+static const uint8_t auDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Transmission order of the code length code lengths
+static const uint8_t auClOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// ============================== FUNCTIONS ==============================
+
+// Append uCount bits (LSB first), completed bytes go to pOut
+static void putBits(GzipStream &oStream, uint32_t uValue, uint8_t uCount, uint8_t *pOut, size_t &uOutLen)
+{
+  oStream.uBits |= uValue << oStream.uBitCount;
+  oStream.uBitCount += uCount;
+  while (oStream.uBitCount >= 8)
+  {
+    pOut[uOutLen++] = (uint8_t)oStream.uBits;
+    oStream.uBits >>= 8;
+    oStream.uBitCount -= 8;
+  }
+} // static void putBits(...)
+//-------------------------------------
+
+// Huffman codes are sent MSB first : reverse them for putBits()
+static uint32_t reverseBits(uint32_t uCode, uint8_t uCount)
+{
+  uint32_t uReversed = 0;
+  while (uCount--)
+  {
+    uReversed = (uReversed << 1) | (uCode & 1);
+    uCode >>= 1;
+  }
+  return uReversed;
+} // static uint32_t reverseBits(uint32_t uCode, uint8_t uCount)
+//-------------------------------------
+
+static uint8_t lengthCode(uint16_t uLength)
+{
+  uint8_t uCode = 28;
+  while (auLengthBase[uCode] > uLength)
+  {
+    uCode--;
+  }
+  return uCode;
+} // static uint8_t lengthCode(uint16_t uLength)
+//-------------------------------------
+
+static uint8_t distanceCode(uint16_t uDistance)
+{
+  uint8_t uCode = 29;
+  while (auDistBase[uCode] > uDistance)
+  {
+    uCode--;
+  }
+  return uCode;
+} // static uint8_t distanceCode(uint16_t uDistance)
+//-------------------------------------
+
+// Huffman code lengths (at most uLimit bits) of the uCount symbols of pFreq :
+// two-queue merge of the leaves sorted by frequency. Frequencies are halved
+// until the tree is shallow enough.
+static void buildLengths(GzipStream &oStream, const uint16_t *pFreq, uint16_t uCount, uint8_t uLimit,
+                         uint8_t *pLength)
+{
+  uint16_t *pOrder = oStream.auOrder;
+  uint16_t *pWeight = oStream.auWeight;
+  uint16_t *pParent = oStream.auParent;
+  uint16_t uLeaves = 0;
+  for (uint16_t uSymbol = 0; uSymbol < uCount; uSymbol++)
+  {
+    pLength[uSymbol] = 0;
+    if (pFreq[uSymbol] == 0)
+    {
+      continue;
+    }
+    uint16_t uAt = uLeaves++;
+    while (uAt > 0 && pFreq[pOrder[uAt - 1]] > pFreq[uSymbol])
+    {
+      pOrder[uAt] = pOrder[uAt - 1];
+      uAt--;
+    }
+    pOrder[uAt] = uSymbol;
+  }
+  if (uLeaves < 2)
+  {
+    // Deflate needs a complete code : two 1-bit codes
+    pLength[(uLeaves == 1 && pOrder[0] == 0) ? 1 : 0] = 1;
+    if (uLeaves == 1)
+    {
+      pLength[pOrder[0]] = 1;
+    }
+    return;
+  }
+
+  for (uint8_t uShift = 0;; uShift++)
+  {
+    for (uint16_t uLeaf = 0; uLeaf < uLeaves; uLeaf++)
+    {
+      pWeight[uLeaf] = (uShift == 0) ? pFreq[pOrder[uLeaf]] : (pFreq[pOrder[uLeaf]] >> uShift) | 1;
+    }
+    uint16_t uLeaf = 0;
+    uint16_t uNode = uLeaves;
+    for (uint16_t uNext = uLeaves; uNext < 2 * uLeaves - 1; uNext++)
+    {
+      uint16_t auPick[2];
+      for (uint8_t uPick = 0; uPick < 2; uPick++)
+      {
+        auPick[uPick] = (uLeaf < uLeaves && (uNode >= uNext || pWeight[uLeaf] <= pWeight[uNode])) ? uLeaf++ : uNode++;
+      }
+      pWeight[uNext] = pWeight[auPick[0]] + pWeight[auPick[1]];
+      pParent[auPick[0]] = uNext;
+      pParent[auPick[1]] = uNext;
+    }
+
+    // Depths from the root down (a parent comes after its children), into pWeight
+    uint8_t uMaxDepth = 0;
+    pWeight[2 * uLeaves - 2] = 0;
+    for (int32_t iNode = 2 * uLeaves - 3; iNode >= 0; iNode--)
+    {
+      pWeight[iNode] = pWeight[pParent[iNode]] + 1;
+      if (iNode < uLeaves && pWeight[iNode] > uMaxDepth)
+      {
+        uMaxDepth = pWeight[iNode];
+      }
+    }
+    if (uMaxDepth <= uLimit)
+    {
+      for (uint16_t uLeaf = 0; uLeaf < uLeaves; uLeaf++)
+      {
+        pLength[pOrder[uLeaf]] = (uint8_t)pWeight[uLeaf];
+      }
+      return;
+    }
+  }
+} // static void buildLengths(...)
+//-------------------------------------
+
+// Canonical codes of the code lengths (RFC 1951 3.2.2), bit-reversed for putBits()
+static void buildCodes(const uint8_t *pLength, uint16_t uCount, uint16_t *pCode)
+{
+  uint16_t auLengthCount[16] = {0};
+  uint16_t auNext[16];
+  for (uint16_t uSymbol = 0; uSymbol < uCount; uSymbol++)
+  {
+    auLengthCount[pLength[uSymbol]]++;
+  }
+  auLengthCount[0] = 0;
+  uint16_t uCode = 0;
+  for (uint8_t uBits = 1; uBits < 16; uBits++)
+  {
+    uCode = (uCode + auLengthCount[uBits - 1]) << 1;
+    auNext[uBits] = uCode;
+  }
+  for (uint16_t uSymbol = 0; uSymbol < uCount; uSymbol++)
+  {
+    if (pLength[uSymbol] > 0)
+    {
+      pCode[uSymbol] = (uint16_t)reverseBits(auNext[pLength[uSymbol]]++, pLength[uSymbol]);
+    }
+  }
+} // static void buildCodes(const uint8_t *pLength, uint16_t uCount, uint16_t *pCode)
+//-------------------------------------
+
+static uint8_t fixedLength(uint16_t uCode)
+{
+  if (uCode >= GZIP_LITLEN_CODES)
+  {
+    return 5; // distance
+  }
+  return (uCode < 144) ? 8 : (uCode < 256) ? 9 : (uCode < 280) ? 7 : 8;
+} // static uint8_t fixedLength(uint16_t uCode)
+//-------------------------------------
+
+// Write the buffered symbols as one block, with dynamic Huffman codes unless
+// the fixed ones are cheaper, or the input of the block stored as is if that
+// is cheaper still, then start a new block
+static void flushBlock(GzipStream &oStream, bool bFinal, uint8_t *pOut, size_t &uOutLen)
+{
+  uint16_t *pFreq = oStream.auFreq;
+  uint8_t *pLength = oStream.auLength;
+  pFreq[256] = 1; // end of block
+  buildLengths(oStream, pFreq, GZIP_LITLEN_CODES, 15, pLength);
+  buildLengths(oStream, pFreq + GZIP_LITLEN_CODES, GZIP_DIST_CODES, 15, pLength + GZIP_LITLEN_CODES);
+  uint16_t uLitCodes = GZIP_LITLEN_CODES;
+  while (uLitCodes > 257 && pLength[uLitCodes - 1] == 0)
+  {
+    uLitCodes--;
+  }
+  uint16_t uDistCodes = GZIP_DIST_CODES;
+  while (uDistCodes > 1 && pLength[GZIP_LITLEN_CODES + uDistCodes - 1] == 0)
+  {
+    uDistCodes--;
+  }
+
+  // Code lengths of both alphabets as one run-length coded sequence
+  uint16_t uTotal = uLitCodes + uDistCodes;
+  uint16_t uRle = 0;
+  uint16_t auClFreq[19] = {0};
+  uint32_t uDynamicBits = 3 + 5 + 5 + 4;
+  for (uint16_t uAt = 0; uAt < uTotal;)
+  {
+    uint8_t uLength = pLength[(uAt < uLitCodes) ? uAt : GZIP_LITLEN_CODES + uAt - uLitCodes];
+    uint16_t uRun = 1;
+    while (uAt + uRun < uTotal &&
+           pLength[(uAt + uRun < uLitCodes) ? uAt + uRun : GZIP_LITLEN_CODES + uAt + uRun - uLitCodes] == uLength)
+    {
+      uRun++;
+    }
+    uAt += uRun;
+    if (uLength > 0)
+    {
+      oStream.auRle[uRle++] = uLength;
+      uRun--;
+    }
+    while (uRun > 0)
+    {
+      uint16_t uRepeat = uRun;
+      if (uLength == 0 && uRun >= 11)
+      {
+        uRepeat = (uRun > 138) ? 138 : uRun;
+        oStream.auRle[uRle] = 18;
+        oStream.auRleExtra[uRle++] = uRepeat - 11;
+        uDynamicBits += 7;
+      }
+      else if (uLength == 0 && uRun >= 3)
+      {
+        oStream.auRle[uRle] = 17;
+        oStream.auRleExtra[uRle++] = uRepeat - 3;
+        uDynamicBits += 3;
+      }
+      else if (uLength > 0 && uRun >= 3)
+      {
+        uRepeat = (uRun > 6) ? 6 : uRun;
+        oStream.auRle[uRle] = 16;
+        oStream.auRleExtra[uRle++] = uRepeat - 3;
+        uDynamicBits += 2;
+      }
+      else
+      {
+        uRepeat = 1;
+        oStream.auRle[uRle++] = uLength;
+      }
+      uRun -= uRepeat;
+    }
+  }
+  for (uint16_t uAt = 0; uAt < uRle; uAt++)
+  {
+    auClFreq[oStream.auRle[uAt]]++;
+  }
+  uint8_t auClLength[19];
+  uint16_t auClCode[19];
+  buildLengths(oStream, auClFreq, 19, 7, auClLength);
+  buildCodes(auClLength, 19, auClCode);
+  uint8_t uClCodes = 19;
+  while (uClCodes > 4 && auClLength[auClOrder[uClCodes - 1]] == 0)
+  {
+    uClCodes--;
+  }
+  uDynamicBits += 3 * uClCodes;
+  uint32_t uFixedBits = 3;
+  for (uint8_t uSymbol = 0; uSymbol < 19; uSymbol++)
+  {
+    uDynamicBits += auClFreq[uSymbol] * auClLength[uSymbol];
+  }
+  for (uint16_t uCode = 0; uCode < GZIP_CODES; uCode++)
+  {
+    uDynamicBits += pFreq[uCode] * pLength[uCode];
+    uFixedBits += pFreq[uCode] * fixedLength(uCode);
+  }
+
+  // Stored : byte aligned after the block header, LEN and NLEN, then the input
+  uint32_t uStoredBits = 3 + ((8 - (oStream.uBitCount + 3) % 8) % 8) + 32 + 8 * oStream.uBlockIn;
+  if (uStoredBits < uFixedBits && uStoredBits < uDynamicBits)
+  {
+    putBits(oStream, bFinal ? 1 : 0, 3, pOut, uOutLen); // BTYPE = 00 (stored)
+    putBits(oStream, 0, (8 - oStream.uBitCount % 8) % 8, pOut, uOutLen);
+    putBits(oStream, oStream.uBlockIn, 16, pOut, uOutLen);
+    putBits(oStream, (uint16_t)~oStream.uBlockIn, 16, pOut, uOutLen);
+    memcpy(pOut + uOutLen, oStream.auWindow + oStream.uPos - oStream.uBlockIn, oStream.uBlockIn); // still in the window
+    uOutLen += oStream.uBlockIn;
+    memset(oStream.auFreq, 0, sizeof(oStream.auFreq));
+    oStream.uSymbols = 0;
+    oStream.uBlockIn = 0;
+    return;
+  }
+
+  if (uFixedBits <= uDynamicBits)
+  {
+    putBits(oStream, (bFinal ? 1 : 0) | (1 << 1), 3, pOut, uOutLen); // BTYPE = 01 (fixed Huffman)
+    for (uint16_t uCode = 0; uCode < GZIP_CODES; uCode++)
+    {
+      pLength[uCode] = fixedLength(uCode);
+    }
+    buildCodes(pLength, GZIP_LITLEN_CODES, oStream.auCode);
+  }
+  else
+  {
+    putBits(oStream, (bFinal ? 1 : 0) | (2 << 1), 3, pOut, uOutLen); // BTYPE = 10 (dynamic Huffman)
+    putBits(oStream, uLitCodes - 257, 5, pOut, uOutLen);
+    putBits(oStream, uDistCodes - 1, 5, pOut, uOutLen);
+    putBits(oStream, uClCodes - 4, 4, pOut, uOutLen);
+    for (uint8_t uAt = 0; uAt < uClCodes; uAt++)
+    {
+      putBits(oStream, auClLength[auClOrder[uAt]], 3, pOut, uOutLen);
+    }
+    for (uint16_t uAt = 0; uAt < uRle; uAt++)
+    {
+      uint8_t uSymbol = oStream.auRle[uAt];
+      putBits(oStream, auClCode[uSymbol], auClLength[uSymbol], pOut, uOutLen);
+      if (uSymbol >= 16)
+      {
+        putBits(oStream, oStream.auRleExtra[uAt], (uSymbol == 16) ? 2 : (uSymbol == 17) ? 3 : 7, pOut, uOutLen);
+      }
+    }
+    buildCodes(pLength, GZIP_LITLEN_CODES, oStream.auCode);
+  }
+  buildCodes(pLength + GZIP_LITLEN_CODES, GZIP_DIST_CODES, oStream.auCode + GZIP_LITLEN_CODES);
+
+  const uint16_t *pCode = oStream.auCode;
+  for (uint16_t uAt = 0; uAt < oStream.uSymbols; uAt++)
+  {
+    uint16_t uDistance = oStream.auDistance[uAt];
+    if (uDistance == 0)
+    {
+      uint8_t uLiteral = oStream.auSymbol[uAt];
+      putBits(oStream, pCode[uLiteral], pLength[uLiteral], pOut, uOutLen);
+      continue;
+    }
+    uint16_t uLength = oStream.auSymbol[uAt] + GZIP_MIN_MATCH;
+    uint8_t uCode = lengthCode(uLength);
+    putBits(oStream, pCode[257 + uCode], pLength[257 + uCode], pOut, uOutLen);
+    putBits(oStream, uLength - auLengthBase[uCode], auLengthExtra[uCode], pOut, uOutLen);
+    uCode = distanceCode(uDistance);
+    putBits(oStream, pCode[GZIP_LITLEN_CODES + uCode], pLength[GZIP_LITLEN_CODES + uCode], pOut, uOutLen);
+    putBits(oStream, uDistance - auDistBase[uCode], auDistExtra[uCode], pOut, uOutLen);
+  }
+  putBits(oStream, pCode[256], pLength[256], pOut, uOutLen);
+
+  memset(oStream.auFreq, 0, sizeof(oStream.auFreq));
+  oStream.uSymbols = 0;
+  oStream.uBlockIn = 0;
+} // static void flushBlock(GzipStream &oStream, bool bFinal, uint8_t *pOut, size_t &uOutLen)
+//-------------------------------------
+
+static void addLiteral(GzipStream &oStream, uint8_t uLiteral)
+{
+  oStream.auSymbol[oStream.uSymbols] = uLiteral;
+  oStream.auDistance[oStream.uSymbols++] = 0;
+  oStream.auFreq[uLiteral]++;
+} // static void addLiteral(GzipStream &oStream, uint8_t uLiteral)
+//-------------------------------------
+
+static void addMatch(GzipStream &oStream, uint16_t uLength, uint16_t uDistance)
+{
+  oStream.auSymbol[oStream.uSymbols] = (uint8_t)(uLength - GZIP_MIN_MATCH);
+  oStream.auDistance[oStream.uSymbols++] = uDistance;
+  oStream.auFreq[257 + lengthCode(uLength)]++;
+  oStream.auFreq[GZIP_LITLEN_CODES + distanceCode(uDistance)]++;
+} // static void addMatch(GzipStream &oStream, uint16_t uLength, uint16_t uDistance)
+//-------------------------------------
+
+static uint16_t hashAt(const uint8_t *pData)
+{
+  uint32_t uKey = ((uint32_t)pData[0] << 16) | ((uint32_t)pData[1] << 8) | pData[2];
+  return (uint16_t)((uint32_t)(uKey * 2654435761UL) >> (32 - GZIP_HASH_BITS));
+} // static uint16_t hashAt(const uint8_t *pData)
+//-------------------------------------
+
+// Chain link slot of window position uAt : by stream offset, so that it
+// stays the same when the window slides
+static uint16_t &prevLink(GzipStream &oStream, uint32_t uAt)
+{
+  return oStream.auPrev[(oStream.uBase + uAt) & (GZIP_WINDOW - 1)];
+} // static uint16_t &prevLink(GzipStream &oStream, uint32_t uAt)
+//-------------------------------------
+
+static void insertHash(GzipStream &oStream, uint32_t uAt)
+{
+  uint16_t uHash = hashAt(oStream.auWindow + uAt);
+  prevLink(oStream, uAt) = oStream.auHead[uHash];
+  oStream.auHead[uHash] = (uint16_t)uAt;
+} // static void insertHash(GzipStream &oStream, uint32_t uAt)
+//-------------------------------------
+
+// Longest match for window position uAt among the chain candidates within
+// the window, 0 if none. Input ends at uEnd.
+static uint32_t longestMatch(GzipStream &oStream, uint32_t uAt, uint32_t uEnd, uint32_t &uBestDist)
+{
+  uint32_t uBestLen = 0;
+  if (uAt + GZIP_MIN_MATCH > uEnd)
+  {
+    return 0;
+  }
+  uint32_t uMaxLen = (uEnd - uAt < GZIP_MAX_MATCH) ? uEnd - uAt : GZIP_MAX_MATCH;
+  uint16_t uCandidate = oStream.auHead[hashAt(oStream.auWindow + uAt)];
+  for (uint8_t uChain = 0; uChain < GZIP_MAX_CHAIN && uCandidate != GZIP_NONE && uCandidate < uAt &&
+                           uAt - uCandidate <= GZIP_WINDOW;
+       uChain++)
+  {
+    const uint8_t *pA = oStream.auWindow + uCandidate;
+    const uint8_t *pB = oStream.auWindow + uAt;
+    uint32_t uMatch = 0;
+    while (uMatch < uMaxLen && pA[uMatch] == pB[uMatch])
+    {
+      uMatch++;
+    }
+    if (uMatch > uBestLen)
+    {
+      uBestLen = uMatch;
+      uBestDist = uAt - uCandidate;
+      if (uMatch == uMaxLen)
+      {
+        break;
+      }
+    }
+    uint16_t uNext = prevLink(oStream, uCandidate);
+    if (uNext >= uCandidate)
+    {
+      break; // link overwritten by a newer position
+    }
+    uCandidate = uNext;
+  }
+  return uBestLen;
+} // static uint32_t longestMatch(GzipStream &oStream, uint32_t uAt, uint32_t uEnd, uint32_t &uBestDist)
+//-------------------------------------
+
+// Keep the last GZIP_WINDOW bytes at the start of the buffer, rebase the chains
+static void slideWindow(GzipStream &oStream)
+{
+  uint32_t uShift = oStream.uPos - GZIP_WINDOW;
+  memmove(oStream.auWindow, oStream.auWindow + uShift, GZIP_WINDOW);
+  oStream.uPos = GZIP_WINDOW;
+  oStream.uBase += uShift;
+  for (uint32_t uEntry = 0; uEntry < (1 << GZIP_HASH_BITS); uEntry++)
+  {
+    uint16_t uAt = oStream.auHead[uEntry];
+    oStream.auHead[uEntry] = (uAt == GZIP_NONE || uAt < uShift) ? GZIP_NONE : uAt - uShift;
+  }
+  for (uint32_t uEntry = 0; uEntry < GZIP_WINDOW; uEntry++)
+  {
+    uint16_t uAt = oStream.auPrev[uEntry];
+    oStream.auPrev[uEntry] = (uAt == GZIP_NONE || uAt < uShift) ? GZIP_NONE : uAt - uShift;
+  }
+} // static void slideWindow(GzipStream &oStream)
+//-------------------------------------
+
+size_t gzipBegin(GzipStream &oStream, uint32_t uMtime, uint8_t *pOut)
+{
+  memset(oStream.auHead, 0xFF, sizeof(oStream.auHead));
+  memset(oStream.auPrev, 0xFF, sizeof(oStream.auPrev));
+  oStream.uPos = 0;
+  oStream.uBase = 0;
+  oStream.uBits = 0;
+  oStream.uBitCount = 0;
+  oStream.uCrc = 0;
+  oStream.uInLen = 0;
+  oStream.uSymbols = 0;
+  oStream.uBlockIn = 0;
+  memset(oStream.auFreq, 0, sizeof(oStream.auFreq));
+
+  // ID1 ID2 CM=deflate FLG=0 MTIME XFL=0 OS=unknown
+  const uint8_t auHeader[GZIP_HEADER_LEN] = {0x1F, 0x8B, 8, 0, (uint8_t)uMtime, (uint8_t)(uMtime >> 8),
+                                             (uint8_t)(uMtime >> 16), (uint8_t)(uMtime >> 24), 0, 255};
+  memcpy(pOut, auHeader, GZIP_HEADER_LEN);
+  return GZIP_HEADER_LEN;
+} // size_t gzipBegin(GzipStream &oStream, uint32_t uMtime, uint8_t *pOut)
+//-------------------------------------
+
+size_t gzipCompress(GzipStream &oStream, const uint8_t *pIn, size_t uLen, uint8_t *pOut)
+{
+  size_t uOutLen = 0;
+  if (uLen > GZIP_BLOCK_LEN)
+  {
+    uLen = GZIP_BLOCK_LEN;
+  }
+  if (oStream.uBlockIn + uLen > GZIP_DEFLATE_BLOCK)
+  {
+    flushBlock(oStream, false, pOut, uOutLen);
+  }
+  oStream.uCrc = updateCrc32(oStream.uCrc, pIn, uLen);
+  oStream.uInLen += uLen;
+  oStream.uBlockIn += uLen;
+  if (oStream.uPos + uLen > 2 * GZIP_WINDOW)
+  {
+    slideWindow(oStream);
+  }
+  memcpy(oStream.auWindow + oStream.uPos, pIn, uLen);
+
+  uint32_t uAt = oStream.uPos;
+  uint32_t uEnd = oStream.uPos + uLen;
+  while (uAt < uEnd)
+  {
+    uint32_t uBestDist = 0;
+    uint32_t uBestLen = longestMatch(oStream, uAt, uEnd, uBestDist);
+
+    // Lazy matching : while the next byte starts a longer match, this byte
+    // goes out as a literal
+    bool bInserted = false;
+    while (uBestLen >= GZIP_MIN_MATCH && uBestLen < GZIP_LAZY_MATCH && uAt + 1 + GZIP_MIN_MATCH <= uEnd)
+    {
+      insertHash(oStream, uAt);
+      bInserted = true;
+      uint32_t uNextDist = 0;
+      uint32_t uNextLen = longestMatch(oStream, uAt + 1, uEnd, uNextDist);
+      if (uNextLen <= uBestLen)
+      {
+        break;
+      }
+      addLiteral(oStream, oStream.auWindow[uAt]);
+      uAt++;
+      bInserted = false;
+      uBestLen = uNextLen;
+      uBestDist = uNextDist;
+    }
+
+    if (uBestLen >= GZIP_MIN_MATCH)
+    {
+      addMatch(oStream, uBestLen, uBestDist);
+      for (uint32_t uInsert = 0; uInsert < uBestLen; uInsert++, uAt++)
+      {
+        if (uAt + GZIP_MIN_MATCH <= uEnd && !(uInsert == 0 && bInserted))
+        {
+          insertHash(oStream, uAt);
+        }
+      }
+    }
+    else
+    {
+      addLiteral(oStream, oStream.auWindow[uAt]);
+      if (uAt + GZIP_MIN_MATCH <= uEnd)
+      {
+        insertHash(oStream, uAt);
+      }
+      uAt++;
+    }
+  }
+  oStream.uPos = uEnd;
+  return uOutLen;
+} // size_t gzipCompress(GzipStream &oStream, const uint8_t *pIn, size_t uLen, uint8_t *pOut)
+//-------------------------------------
+
+size_t gzipFinish(GzipStream &oStream, uint8_t *pOut)
+{
+  size_t uOutLen = 0;
+  flushBlock(oStream, true, pOut, uOutLen);
+  if (oStream.uBitCount > 0)
+  {
+    putBits(oStream, 0, 8 - oStream.uBitCount, pOut, uOutLen);
+  }
+  for (uint8_t uByte = 0; uByte < 4; uByte++)
+  {
+    pOut[uOutLen++] = (uint8_t)(oStream.uCrc >> (8 * uByte));
+  }
+  for (uint8_t uByte = 0; uByte < 4; uByte++)
+  {
+    pOut[uOutLen++] = (uint8_t)(oStream.uInLen >> (8 * uByte));
+  }
+  return uOutLen;
+} // size_t gzipFinish(GzipStream &oStream, uint8_t *pOut)
+//-------------------------------------
@@ -0,0 +1,122 @@
+// Heap fragmentation monitor (see heap_monitor.h)
+
+#include "heap_monitor.h"
+
+#include <atomic>
+
+#define MS_PER_DAY 86400000.0
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+struct HeapSample
+{
+  float fDay;          // sample time (days since boot)
+  float fFragPermille;
+};
+
+static HeapSample aHistory[HEAP_HISTORY_LEN];
+static uint32_t uSampleCount = 0;
+static unsigned long ulLastMillis = 0;
+static double dDays = 0.0; // accumulated, survives millis() wrap-around
+
+// Running sums of the regression window
+static double dSumX = 0.0, dSumY = 0.0, dSumXX = 0.0, dSumXY = 0.0;
+
+static HeapTrend oHeapTrend = {0, 0, 0, UINT32_MAX, 0, 0.0f, false};
+
+// Call sites (DEBUG builds), claimed with a CAS on the caller address
+static std::atomic<uintptr_t> auSiteCaller[HEAP_MAX_SITES];
+static std::atomic<uint32_t> auSiteCount[HEAP_MAX_SITES];
+static std::atomic<uint32_t> auSiteBytes[HEAP_MAX_SITES];
+
+// ============================== FUNCTIONS ==============================
+
+bool sampleHeap(unsigned long ulMillis, uint32_t uFreeHeap, uint32_t uMaxBlock)
+{
+  if (uSampleCount > 0)
+  {
+    dDays += (unsigned long)(ulMillis - ulLastMillis) / MS_PER_DAY;
+  }
+  ulLastMillis = ulMillis;
+
+  HeapSample oSample;
+  oSample.fDay = (float)dDays;
+  oSample.fFragPermille = (uFreeHeap == 0) ? 1000.0f : (float)(1000.0 * (1.0 - (double)uMaxBlock / uFreeHeap));
+
+  // Slide the window : remove the oldest sample from the sums, add the new one
+  HeapSample &oSlot = aHistory[uSampleCount % HEAP_HISTORY_LEN];
+  if (uSampleCount >= HEAP_HISTORY_LEN)
+  {
+    dSumX -= oSlot.fDay;
+    dSumY -= oSlot.fFragPermille;
+    dSumXX -= (double)oSlot.fDay * oSlot.fDay;
+    dSumXY -= (double)oSlot.fDay * oSlot.fFragPermille;
+  }
+  oSlot = oSample;
+  dSumX += oSample.fDay;
+  dSumY += oSample.fFragPermille;
+  dSumXX += (double)oSample.fDay * oSample.fDay;
+  dSumXY += (double)oSample.fDay * oSample.fFragPermille;
+  uSampleCount++;
+
+  uint32_t uWindow = (uSampleCount < HEAP_HISTORY_LEN) ? uSampleCount : HEAP_HISTORY_LEN;
+  double dDenominator = uWindow * dSumXX - dSumX * dSumX;
+  double dSlope = (uWindow > 1 && dDenominator > 0.0) ? (uWindow * dSumXY - dSumX * dSumY) / dDenominator : 0.0;
+
+  oHeapTrend.uSamples = uSampleCount;
+  oHeapTrend.uFreeHeap = uFreeHeap;
+  oHeapTrend.uMaxBlock = uMaxBlock;
+  if (uMaxBlock < oHeapTrend.uMinMaxBlock)
+  {
+    oHeapTrend.uMinMaxBlock = uMaxBlock;
+  }
+  oHeapTrend.uFragPermille = (uint16_t)oSample.fFragPermille;
+  oHeapTrend.fSlopePerDay = (float)dSlope;
+  oHeapTrend.bRising = (uWindow == HEAP_HISTORY_LEN) && (dSlope > HEAP_FRAG_SLOPE_LIMIT);
+  return oHeapTrend.bRising;
+} // bool sampleHeap(unsigned long ulMillis, uint32_t uFreeHeap, uint32_t uMaxBlock)
+//-------------------------------------
+
+void getHeapTrend(HeapTrend &oTrend)
+{
+  oTrend = oHeapTrend;
+} // void getHeapTrend(HeapTrend &oTrend)
+//-------------------------------------
+
+void recordAllocSite(const void *pCaller, size_t uSize)
+{
+  uintptr_t uCaller = (uintptr_t)pCaller;
+  for (uint8_t uSite = 0; uSite < HEAP_MAX_SITES; uSite++)
+  {
+    uintptr_t uCurrent = auSiteCaller[uSite].load(std::memory_order_acquire);
+    if (uCurrent == 0)
+    {
+      // Free slot : try to claim it, another task may be quicker
+      if (auSiteCaller[uSite].compare_exchange_strong(uCurrent, uCaller, std::memory_order_acq_rel) ||
+          uCurrent == uCaller)
+      {
+        uCurrent = uCaller;
+      }
+    }
+    if (uCurrent == uCaller)
+    {
+      auSiteCount[uSite].fetch_add(1, std::memory_order_relaxed);
+      auSiteBytes[uSite].fetch_add(uSize, std::memory_order_relaxed);
+      return;
+    }
+  }
+} // void recordAllocSite(const void *pCaller, size_t uSize)
+//-------------------------------------
+
+bool getHeapSite(uint8_t uSite, HeapSite &oSite)
+{
+  if (uSite >= HEAP_MAX_SITES || auSiteCaller[uSite].load(std::memory_order_acquire) == 0)
+  {
+    return false;
+  }
+  oSite.pCaller = (const void *)auSiteCaller[uSite].load(std::memory_order_relaxed);
+  oSite.uCount = auSiteCount[uSite].load(std::memory_order_relaxed);
+  oSite.uBytes = auSiteBytes[uSite].load(std::memory_order_relaxed);
+  return true;
+} // bool getHeapSite(uint8_t uSite, HeapSite &oSite)
+//-------------------------------------
@@ -0,0 +1,297 @@
+// Bulk history export (see history_export.h)
+
+#include "history_export.h"
+#include "flash_log.h"
+#include "gzip_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#define EXPORT_MICROS() ((uint64_t)esp_timer_get_time())
+#else
+#include <chrono>
+#define EXPORT_MICROS() ((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count())
+#endif
+
+#define EXPORT_READ_ITEMS 32 // records read from the log at once
+#define EXPORT_LINE_MAX 160  // longest formatted record
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// The running export
+struct ExportState
+{
+  uint32_t uId; // 0 : no export
+  ExportFormat eFormat;
+  bool bGzip;
+  bool bRaw;       // raw tier (samples), else aggregates
+  bool bInputDone; // every record formatted
+  bool bFinished;  // ... and the gzip trailer produced
+  bool bCompleted; // ... and sent
+  uint64_t ullLastPull;
+  FlogCursor oCursor;
+  uint32_t uRecordLen;
+  FlogItem aItems[EXPORT_READ_ITEMS];
+  uint8_t auStored[EXPORT_READ_ITEMS * sizeof(FlogAggregate)];
+  uint32_t uItems;
+  uint32_t uNextItem;
+  uint8_t auText[GZIP_BLOCK_LEN]; // formatted records, the input of the compressor
+  size_t uTextLen;
+  uint8_t auOut[GZIP_OUT_MAX]; // compressed bytes
+  const uint8_t *pPending;     // bytes produced, not sent yet
+  size_t uPendingLen;
+};
+
+static ExportState oExport;
+static GzipStream oGzip;
+static ExportStats oExportStats = {0, 0, 0, 0, 0, 0, 0, 0};
+static uint32_t uLastExportId = 0;
+
+static const char *const acCsvHeader[2] = {
+    "epoch,temperature_count,temperature_mean,temperature_min,temperature_max,"
+    "humidity_count,humidity_mean,humidity_min,humidity_max\n",
+    "epoch,seq,temperature,humidity\n"};
+
+// ============================== FUNCTIONS ==============================
+
+// Value in hundredths as a decimal, pNone if there is no value
+static int printHundredths(char *pBuffer, size_t uLen, int16_t iValue, const char *pNone)
+{
+  if (iValue == INT16_MIN)
+  {
+    return snprintf(pBuffer, uLen, "%s", pNone);
+  }
+  int iAbs = abs(iValue);
+  return snprintf(pBuffer, uLen, "%s%d.%02d", (iValue < 0) ? "-" : "", iAbs / 100, iAbs % 100);
+} // static int printHundredths(char *pBuffer, size_t uLen, int16_t iValue, const char *pNone)
+//-------------------------------------
+
+// One record as a CSV line or a JSON object, returns its length
+static size_t formatItem(const FlogItem &oItem, char *pBuffer, size_t uLen)
+{
+  static const char *const acChannels[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+  bool bCsv = oExport.eFormat == EXPORT_CSV;
+  const char *pNone = bCsv ? "" : "null";
+  int iLen = bCsv ? snprintf(pBuffer, uLen, "%u", oItem.uEpoch) : snprintf(pBuffer, uLen, "{\"epoch\":%u", oItem.uEpoch);
+  if (oExport.bRaw)
+  {
+    iLen += snprintf(pBuffer + iLen, uLen - iLen, bCsv ? ",%u" : ",\"seq\":%u", oItem.uSeq);
+  }
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    if (!bCsv)
+    {
+      iLen += snprintf(pBuffer + iLen, uLen - iLen, ",\"%s\":", acChannels[uChannel]);
+    }
+    else
+    {
+      pBuffer[iLen++] = ',';
+    }
+    if (oExport.bRaw)
+    {
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMean[uChannel], pNone);
+    }
+    else if (bCsv)
+    {
+      iLen += snprintf(pBuffer + iLen, uLen - iLen, "%u,", oItem.auCount[uChannel]);
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMean[uChannel], pNone);
+      pBuffer[iLen++] = ',';
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMin[uChannel], pNone);
+      pBuffer[iLen++] = ',';
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMax[uChannel], pNone);
+    }
+    else if (oItem.auCount[uChannel] == 0)
+    {
+      iLen += snprintf(pBuffer + iLen, uLen - iLen, "null");
+    }
+    else
+    {
+      iLen += snprintf(pBuffer + iLen, uLen - iLen, "{\"count\":%u,\"mean\":", oItem.auCount[uChannel]);
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMean[uChannel], pNone);
+      iLen += snprintf(pBuffer + iLen, uLen - iLen, ",\"min\":");
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMin[uChannel], pNone);
+      iLen += snprintf(pBuffer + iLen, uLen - iLen, ",\"max\":");
+      iLen += printHundredths(pBuffer + iLen, uLen - iLen, oItem.aiMax[uChannel], pNone);
+      pBuffer[iLen++] = '}';
+    }
+  }
+  if (!bCsv)
+  {
+    pBuffer[iLen++] = '}';
+  }
+  pBuffer[iLen++] = '\n';
+  return iLen;
+} // static size_t formatItem(const FlogItem &oItem, char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Append records to auText until it is full, sets bInputDone after the last one
+static void formatRecords()
+{
+  while (oExport.uTextLen + EXPORT_LINE_MAX <= sizeof(oExport.auText))
+  {
+    if (oExport.uNextItem >= oExport.uItems)
+    {
+      oExport.uItems = readFlashCursor(oExport.oCursor, oExport.aItems, EXPORT_READ_ITEMS,
+                                       (oExport.eFormat == EXPORT_BINARY) ? oExport.auStored : nullptr);
+      oExport.uNextItem = 0;
+      if (oExport.uItems == 0)
+      {
+        oExport.bInputDone = true;
+        return;
+      }
+      oExportStats.uRecords += oExport.uItems;
+    }
+    uint32_t uItem = oExport.uNextItem++;
+    if (oExport.eFormat == EXPORT_BINARY)
+    {
+      memcpy(oExport.auText + oExport.uTextLen, oExport.auStored + uItem * oExport.uRecordLen, oExport.uRecordLen);
+      oExport.uTextLen += oExport.uRecordLen;
+    }
+    else
+    {
+      oExport.uTextLen += formatItem(oExport.aItems[uItem], (char *)oExport.auText + oExport.uTextLen,
+                                     sizeof(oExport.auText) - oExport.uTextLen);
+    }
+  }
+} // static void formatRecords()
+//-------------------------------------
+
+ExportResult beginExport(ExportFormat eFormat, uint8_t uTier, uint32_t uFrom, uint32_t uTo, bool bGzip, uint32_t &uId)
+{
+  uId = 0;
+  FlashLogStats oTier;
+  if (!getFlashLogStats(uTier, oTier))
+  {
+    return EXPORT_BAD_TIER;
+  }
+  if (oTier.uCapacity == 0)
+  {
+    return EXPORT_NO_LOG;
+  }
+  if (oTier.uRecords == 0)
+  {
+    return EXPORT_EMPTY;
+  }
+  uint64_t ullNow = EXPORT_MICROS();
+  if (oExport.uId != 0 && ullNow - oExport.ullLastPull < EXPORT_IDLE_TIMEOUT * 1000ULL)
+  {
+    oExportStats.uRefused++;
+    return EXPORT_BUSY;
+  }
+  FlogCursor oCursor;
+  openFlashCursor(oCursor, uTier, uFrom, uTo);
+
+  if (++uLastExportId == 0)
+  {
+    uLastExportId = 1;
+  }
+  oExport.uId = uLastExportId;
+  oExport.eFormat = eFormat;
+  oExport.bGzip = bGzip;
+  oExport.bRaw = uTier == 0;
+  oExport.bInputDone = oExport.bFinished = oExport.bCompleted = false;
+  oExport.ullLastPull = ullNow;
+  oExport.oCursor = oCursor;
+  oExport.uRecordLen = flashRecordLen(uTier);
+  oExport.uItems = oExport.uNextItem = 0;
+  oExport.uTextLen = 0;
+  oExport.uPendingLen = 0;
+  if (eFormat == EXPORT_CSV)
+  {
+    const char *pHeader = acCsvHeader[oExport.bRaw ? 1 : 0];
+    oExport.uTextLen = strlen(pHeader);
+    memcpy(oExport.auText, pHeader, oExport.uTextLen);
+  }
+  if (bGzip)
+  {
+    oExport.uPendingLen = gzipBegin(oGzip, 0, oExport.auOut);
+    oExport.pPending = oExport.auOut;
+  }
+  oExportStats.uStarted++;
+  uId = oExport.uId;
+  return EXPORT_STARTED;
+} // ExportResult beginExport(...)
+//-------------------------------------
+
+size_t fillExport(uint32_t uId, uint8_t *pBuffer, size_t uMaxLen)
+{
+  if (uId == 0 || uId != oExport.uId)
+  {
+    return 0;
+  }
+  uint64_t ullStart = EXPORT_MICROS();
+  size_t uCopied = 0;
+  size_t uFormatted = 0;
+  while (uCopied < uMaxLen)
+  {
+    if (oExport.uPendingLen > 0)
+    {
+      size_t uLen = (oExport.uPendingLen < uMaxLen - uCopied) ? oExport.uPendingLen : uMaxLen - uCopied;
+      memcpy(pBuffer + uCopied, oExport.pPending, uLen);
+      oExport.pPending += uLen;
+      oExport.uPendingLen -= uLen;
+      uCopied += uLen;
+      continue;
+    }
+    // Budget spent : the rest in the next chunk (the compressor may need a
+    // few calls before it outputs a block, so never stop empty-handed)
+    if (oExport.bFinished || (uFormatted >= EXPORT_CHUNK_INPUT && uCopied > 0))
+    {
+      break;
+    }
+
+    if (oExport.bInputDone)
+    {
+      oExport.uPendingLen = oExport.bGzip ? gzipFinish(oGzip, oExport.auOut) : 0;
+      oExport.pPending = oExport.auOut;
+      oExport.bFinished = true;
+      continue;
+    }
+    formatRecords();
+    uFormatted += oExport.uTextLen;
+    oExportStats.ullBytesIn += oExport.uTextLen;
+    if (oExport.bGzip)
+    {
+      oExport.uPendingLen = gzipCompress(oGzip, oExport.auText, oExport.uTextLen, oExport.auOut);
+      oExport.pPending = oExport.auOut;
+    }
+    else
+    {
+      oExport.uPendingLen = oExport.uTextLen;
+      oExport.pPending = oExport.auText;
+    }
+    oExport.uTextLen = 0;
+  }
+
+  if (oExport.bFinished && oExport.uPendingLen == 0 && !oExport.bCompleted)
+  {
+    oExport.bCompleted = true;
+    oExportStats.uCompleted++;
+  }
+  uint64_t ullEnd = EXPORT_MICROS();
+  uint32_t uMicros = (uint32_t)(ullEnd - ullStart);
+  oExport.ullLastPull = ullEnd;
+  oExportStats.ullBytesOut += uCopied;
+  oExportStats.ullBusyMicros += uMicros;
+  oExportStats.uMaxChunkMicros = (uMicros > oExportStats.uMaxChunkMicros) ? uMicros : oExportStats.uMaxChunkMicros;
+  return uCopied;
+} // size_t fillExport(uint32_t uId, uint8_t *pBuffer, size_t uMaxLen)
+//-------------------------------------
+
+void endExport(uint32_t uId)
+{
+  if (uId != 0 && uId == oExport.uId)
+  {
+    oExport.uId = 0;
+  }
+} // void endExport(uint32_t uId)
+//-------------------------------------
+
+void getExportStats(ExportStats &oStats)
+{
+  oStats = oExportStats;
+} // void getExportStats(ExportStats &oStats)
+//-------------------------------------
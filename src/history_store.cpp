@@ -0,0 +1,269 @@
+// Sample history store (see history_store.h)
+
+#include "history_store.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#define HISTORY_LOCK() portENTER_CRITICAL(&muxHistory)
+#define HISTORY_UNLOCK() portEXIT_CRITICAL(&muxHistory)
+#else
+#include <atomic>
+#define HISTORY_LOCK()                                        \
+  while (flagHistory.test_and_set(std::memory_order_acquire)) \
+  {                                                           \
+  }
+#define HISTORY_UNLOCK() flagHistory.clear(std::memory_order_release)
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+static HistoryRecord *pRecords = nullptr; // the ring, nullptr until placed
+static uint32_t uCapacity = 0;            // its records (power of 2, multiple of HISTORY_BLOCK_LEN)
+static HistoryMemory eHistoryMemory = HISTORY_DRAM;
+static bool bStorePlaced = false;
+static uint32_t uGeneration = 0; // identifies the ring contents of this boot
+static uint32_t uHistoryEnd = 0; // records appended since boot
+
+#ifdef ARDUINO
+static portMUX_TYPE muxHistory = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagHistory = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// First cache line aligned address of a block allocated one line larger
+static HistoryRecord *alignRing(void *pBlock)
+{
+  uintptr_t uAligned = ((uintptr_t)pBlock + HISTORY_CACHE_LINE - 1) & ~(uintptr_t)(HISTORY_CACHE_LINE - 1);
+  return (HistoryRecord *)uAligned;
+} // static HistoryRecord *alignRing(void *pBlock)
+//-------------------------------------
+
+// Largest PSRAM ring that can be allocated (cache line aligned), nullptr if
+// none beats the internal RAM ring
+static HistoryRecord *allocatePsramRing(uint32_t &uRecords)
+{
+#if defined(ARDUINO) || defined(HISTORY_EMULATE_PSRAM)
+  for (uRecords = HISTORY_PSRAM_LEN; uRecords > HISTORY_RAM_LEN; uRecords /= 2)
+  {
+    size_t uBytes = uRecords * sizeof(HistoryRecord) + HISTORY_CACHE_LINE;
+#ifdef ARDUINO
+    if (!psramFound() || heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) < uBytes)
+    {
+      continue;
+    }
+    void *pBlock = heap_caps_malloc(uBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    void *pBlock = malloc(uBytes); // host build : heap region standing for the PSRAM
+#endif
+    if (pBlock != nullptr)
+    {
+      return alignRing(pBlock);
+    }
+  }
+#endif
+  uRecords = 0;
+  return nullptr;
+} // static HistoryRecord *allocatePsramRing(uint32_t &uRecords)
+//-------------------------------------
+
+// Internal RAM ring, only when there is no PSRAM one : HISTORY_RAM_LEN
+// records, fewer if the heap cannot spare them, nullptr if not even a block
+static HistoryRecord *allocateDramRing(uint32_t &uRecords)
+{
+  for (uRecords = HISTORY_RAM_LEN; uRecords >= HISTORY_BLOCK_LEN; uRecords /= 2)
+  {
+    size_t uBytes = uRecords * sizeof(HistoryRecord) + HISTORY_CACHE_LINE;
+#ifdef ARDUINO
+    void *pBlock = heap_caps_malloc(uBytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    void *pBlock = malloc(uBytes);
+#endif
+    if (pBlock != nullptr)
+    {
+      return alignRing(pBlock);
+    }
+  }
+  uRecords = 0;
+  return nullptr;
+} // static HistoryRecord *allocateDramRing(uint32_t &uRecords)
+//-------------------------------------
+
+void beginHistoryStore()
+{
+  if (bStorePlaced)
+  {
+    return;
+  }
+  bStorePlaced = true;
+#ifdef ARDUINO
+  uGeneration = (esp_random() & 0x7FFFFFFFUL) | 1;
+#else
+  uGeneration = ((uint32_t)time(nullptr) & 0x7FFFFFFFUL) | 1;
+#endif
+  uint32_t uRecords;
+  HistoryMemory eMemory = HISTORY_PSRAM;
+  HistoryRecord *pRing = allocatePsramRing(uRecords);
+  if (pRing == nullptr)
+  {
+    eMemory = HISTORY_DRAM;
+    pRing = allocateDramRing(uRecords);
+  }
+  HISTORY_LOCK();
+  pRecords = pRing;
+  uCapacity = uRecords;
+  eHistoryMemory = eMemory;
+  uHistoryEnd = 0;
+  HISTORY_UNLOCK();
+} // void beginHistoryStore()
+//-------------------------------------
+
+void getHistoryInfo(HistoryInfo &oInfo)
+{
+  HISTORY_LOCK();
+  oInfo.eMemory = eHistoryMemory;
+  oInfo.uCapacity = uCapacity;
+  HISTORY_UNLOCK();
+  oInfo.uBytes = oInfo.uCapacity * sizeof(HistoryRecord);
+} // void getHistoryInfo(HistoryInfo &oInfo)
+//-------------------------------------
+
+// Value in hundredths, HISTORY_NONE if invalid or out of the int16 range
+static int16_t toHundredths(float fValue, bool bValid)
+{
+  if (!bValid || isnan(fValue) || fabsf(fValue) >= 327.0f)
+  {
+    return HISTORY_NONE;
+  }
+  return (int16_t)lroundf(fValue * 100.0f);
+} // static int16_t toHundredths(float fValue, bool bValid)
+//-------------------------------------
+
+void addHistorySample(const Measurement &oMeasurement)
+{
+  if (oMeasurement.uFlags & MEAS_RESTORED)
+  {
+    return;
+  }
+  HistoryRecord oRecord;
+  oRecord.uSeq = oMeasurement.uSeq;
+  oRecord.uEpoch = oMeasurement.uEpoch;
+  oRecord.iTmp = toHundredths(oMeasurement.fTmp, oMeasurement.uFlags & MEAS_TMP_VALID);
+  oRecord.iHum = toHundredths(oMeasurement.fHum, oMeasurement.uFlags & MEAS_HUM_VALID);
+
+  HISTORY_LOCK();
+  if (pRecords == nullptr)
+  {
+    HISTORY_UNLOCK(); // not placed (yet) : nothing is kept
+    return;
+  }
+  // Keep the times increasing (clock stepped back, first NTP sync...) : findHistory() relies on it
+  if (uHistoryEnd > 0 && oRecord.uEpoch < pRecords[(uHistoryEnd - 1) & (uCapacity - 1)].uEpoch)
+  {
+    oRecord.uEpoch = pRecords[(uHistoryEnd - 1) & (uCapacity - 1)].uEpoch;
+  }
+  pRecords[uHistoryEnd & (uCapacity - 1)] = oRecord;
+  uHistoryEnd++;
+  HISTORY_UNLOCK();
+} // void addHistorySample(const Measurement &oMeasurement)
+//-------------------------------------
+
+uint32_t historyFirst()
+{
+  HISTORY_LOCK();
+  uint32_t uFirst = (uHistoryEnd > uCapacity) ? uHistoryEnd - uCapacity : 0;
+  HISTORY_UNLOCK();
+  return uFirst;
+} // uint32_t historyFirst()
+//-------------------------------------
+
+uint32_t historyEnd()
+{
+  HISTORY_LOCK();
+  uint32_t uEnd = uHistoryEnd;
+  HISTORY_UNLOCK();
+  return uEnd;
+} // uint32_t historyEnd()
+//-------------------------------------
+
+bool readHistory(uint32_t uIndex, HistoryRecord &oRecord)
+{
+  HISTORY_LOCK();
+  bool bStored = uIndex < uHistoryEnd && uHistoryEnd - uIndex <= uCapacity;
+  if (bStored)
+  {
+    oRecord = pRecords[uIndex & (uCapacity - 1)];
+  }
+  HISTORY_UNLOCK();
+  return bStored;
+} // bool readHistory(uint32_t uIndex, HistoryRecord &oRecord)
+//-------------------------------------
+
+uint32_t readHistoryBlock(uint32_t uIndex, HistoryRecord *pBlock)
+{
+  uint32_t uCount = 0;
+  HISTORY_LOCK();
+  if (uIndex < uHistoryEnd && uHistoryEnd - uIndex <= uCapacity)
+  {
+    // A block never wraps : the capacity is a multiple of the block length
+    uCount = HISTORY_BLOCK_LEN - uIndex % HISTORY_BLOCK_LEN;
+    uCount = (uCount > uHistoryEnd - uIndex) ? uHistoryEnd - uIndex : uCount;
+    memcpy(pBlock, pRecords + (uIndex & (uCapacity - 1)), uCount * sizeof(HistoryRecord));
+  }
+  HISTORY_UNLOCK();
+  return uCount;
+} // uint32_t readHistoryBlock(uint32_t uIndex, HistoryRecord *pBlock)
+//-------------------------------------
+
+// Index of the first stored record whose time (or sequence number, if
+// bBySeq) is at least uKey, by binary search : both are increasing
+static uint32_t searchHistory(uint32_t uKey, bool bBySeq)
+{
+  uint32_t uLow = historyFirst();
+  uint32_t uHigh = historyEnd();
+  HistoryRecord oRecord;
+  while (uLow < uHigh)
+  {
+    uint32_t uMiddle = uLow + (uHigh - uLow) / 2;
+    if (!readHistory(uMiddle, oRecord))
+    {
+      uLow = historyFirst(); // overwritten meanwhile : restart from the new oldest record
+      continue;
+    }
+    if ((bBySeq ? oRecord.uSeq : oRecord.uEpoch) < uKey)
+    {
+      uLow = uMiddle + 1;
+    }
+    else
+    {
+      uHigh = uMiddle;
+    }
+  }
+  return uLow;
+} // static uint32_t searchHistory(uint32_t uKey, bool bBySeq)
+//-------------------------------------
+
+uint32_t findHistory(uint32_t uEpoch)
+{
+  return searchHistory(uEpoch, false);
+} // uint32_t findHistory(uint32_t uEpoch)
+//-------------------------------------
+
+uint32_t findHistorySince(uint32_t uSeq)
+{
+  return (uSeq == UINT32_MAX) ? historyEnd() : searchHistory(uSeq + 1, true);
+} // uint32_t findHistorySince(uint32_t uSeq)
+//-------------------------------------
+
+uint32_t historyGeneration()
+{
+  return uGeneration;
+} // uint32_t historyGeneration()
+//-------------------------------------
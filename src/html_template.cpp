@@ -0,0 +1,243 @@
+// Pre-split HTML template renderer (see html_template.h)
+
+#include "html_template.h"
+
+#include <string.h>
+
+#ifdef ARDUINO
+#define TPL_LOCK() portENTER_CRITICAL(&muxValueCache)
+#define TPL_UNLOCK() portEXIT_CRITICAL(&muxValueCache)
+#else
+#include <atomic>
+#define TPL_LOCK()                                             \
+  while (flagValueCache.test_and_set(std::memory_order_acquire)) \
+  {                                                              \
+  }
+#define TPL_UNLOCK() flagValueCache.clear(std::memory_order_release)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strncmp_P strncmp
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// One template segment : a literal span of the template or a placeholder
+struct TemplateSegment
+{
+  uint16_t uOffset; // literal : offset in the template
+  uint16_t uLength; // literal : span length
+  uint8_t uVar;     // TemplateVar (TPL_LITERAL for a literal span)
+};
+
+// Placeholder names, in TemplateVar order
+static const char *const apVarNames[TPL_VAR_COUNT] = {
+    "MEASURETIME",
+    "REFRESHTIME",
+    "TEMPERATURE",
+    "HUMIDITY",
+};
+
+static PGM_P pTemplateText = nullptr;
+static TemplateSegment aSegments[TPL_MAX_SEGMENTS];
+static uint8_t uSegmentCount = 0;
+static size_t uLiteralLength = 0; // sum of all literal spans
+
+// Value cache, shared between the main loop and the web server task
+static TemplateSnapshot oValueCache;
+#ifdef ARDUINO
+static portMUX_TYPE muxValueCache = portMUX_INITIALIZER_UNLOCKED;
+
+// Snapshots of the pages being sent (web server task only)
+static TemplateSnapshot aRenderSlots[TPL_MAX_RENDERS];
+static bool abRenderBusy[TPL_MAX_RENDERS];
+#else
+static std::atomic_flag flagValueCache = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// Append a literal span to the segment table (merging with a previous literal)
+static bool addLiteral(size_t uOffset, size_t uLength)
+{
+  if (uLength == 0)
+  {
+    return true;
+  }
+  if (uSegmentCount > 0 && aSegments[uSegmentCount - 1].uVar == TPL_LITERAL &&
+      aSegments[uSegmentCount - 1].uOffset + aSegments[uSegmentCount - 1].uLength == uOffset)
+  {
+    aSegments[uSegmentCount - 1].uLength += uLength;
+  }
+  else
+  {
+    if (uSegmentCount >= TPL_MAX_SEGMENTS)
+    {
+      return false;
+    }
+    aSegments[uSegmentCount++] = {(uint16_t)uOffset, (uint16_t)uLength, TPL_LITERAL};
+  }
+  uLiteralLength += uLength;
+  return true;
+} // static bool addLiteral(size_t uOffset, size_t uLength)
+//-------------------------------------
+
+// Look up a placeholder name, returns TPL_LITERAL if unknown
+static uint8_t findVar(PGM_P pName, size_t uLength)
+{
+  for (uint8_t uVar = 0; uVar < TPL_VAR_COUNT; uVar++)
+  {
+    if (strlen(apVarNames[uVar]) == uLength && strncmp_P(apVarNames[uVar], pName, uLength) == 0)
+    {
+      return uVar;
+    }
+  }
+  return TPL_LITERAL;
+} // static uint8_t findVar(PGM_P pName, size_t uLength)
+//-------------------------------------
+
+bool initTemplate(PGM_P pTemplate)
+{
+  size_t uLength = strlen_P(pTemplate);
+  size_t uStart = 0; // start of the pending literal span
+  size_t uPos = 0;
+
+  pTemplateText = pTemplate;
+  uSegmentCount = 0;
+  uLiteralLength = 0;
+
+  while (uPos < uLength)
+  {
+    if (pgm_read_byte(pTemplate + uPos) != '%')
+    {
+      uPos++;
+      continue;
+    }
+    // Find the closing '%' (a lone '%', e.g. a unit, stays literal)
+    size_t uEnd = uPos + 1;
+    while (uEnd < uLength && uEnd - uPos <= TPL_NAME_LEN && pgm_read_byte(pTemplate + uEnd) != '%')
+    {
+      uEnd++;
+    }
+    uint8_t uVar = TPL_LITERAL;
+    if (uEnd < uLength && pgm_read_byte(pTemplate + uEnd) == '%')
+    {
+      uVar = findVar(pTemplate + uPos + 1, uEnd - uPos - 1);
+    }
+    if (uVar == TPL_LITERAL)
+    {
+      uPos++;
+      continue;
+    }
+    if (!addLiteral(uStart, uPos - uStart) || uSegmentCount >= TPL_MAX_SEGMENTS)
+    {
+      uSegmentCount = 0;
+      return false;
+    }
+    aSegments[uSegmentCount++] = {0, 0, uVar};
+    uPos = uEnd + 1;
+    uStart = uPos;
+  }
+  if (!addLiteral(uStart, uLength - uStart))
+  {
+    uSegmentCount = 0;
+    return false;
+  }
+  return true;
+} // bool initTemplate(PGM_P pTemplate)
+//-------------------------------------
+
+void setTemplateValue(TemplateVar eVar, const char *pValue)
+{
+  TPL_LOCK();
+  strncpy(oValueCache.acValue[eVar], pValue, TPL_VALUE_LEN - 1);
+  oValueCache.acValue[eVar][TPL_VALUE_LEN - 1] = '\0';
+  oValueCache.auLen[eVar] = strlen(oValueCache.acValue[eVar]);
+  TPL_UNLOCK();
+} // void setTemplateValue(TemplateVar eVar, const char *pValue)
+//-------------------------------------
+
+void getTemplateValue(TemplateVar eVar, char *pBuffer, size_t uLen)
+{
+  TPL_LOCK();
+  strncpy(pBuffer, oValueCache.acValue[eVar], uLen - 1);
+  TPL_UNLOCK();
+  pBuffer[uLen - 1] = '\0';
+} // void getTemplateValue(TemplateVar eVar, char *pBuffer, size_t uLen)
+//-------------------------------------
+
+size_t snapshotTemplate(TemplateSnapshot &oSnapshot)
+{
+  TPL_LOCK();
+  oSnapshot = oValueCache;
+  TPL_UNLOCK();
+
+  size_t uTotal = uLiteralLength;
+  for (uint8_t uSeg = 0; uSeg < uSegmentCount; uSeg++)
+  {
+    if (aSegments[uSeg].uVar != TPL_LITERAL)
+    {
+      uTotal += oSnapshot.auLen[aSegments[uSeg].uVar];
+    }
+  }
+  return uTotal;
+} // size_t snapshotTemplate(TemplateSnapshot &oSnapshot)
+//-------------------------------------
+
+// The filler may be called with any index : locate the segment holding it,
+// then copy literal spans from flash and values from the snapshot
+size_t renderTemplate(const TemplateSnapshot &oSnapshot, uint8_t *pBuffer, size_t uMaxLen, size_t uIndex)
+{
+  size_t uSegStart = 0;
+  size_t uWritten = 0;
+  for (uint8_t uSeg = 0; uSeg < uSegmentCount && uWritten < uMaxLen; uSeg++)
+  {
+    const TemplateSegment &oSeg = aSegments[uSeg];
+    size_t uSegLen = (oSeg.uVar == TPL_LITERAL) ? oSeg.uLength : oSnapshot.auLen[oSeg.uVar];
+    size_t uPos = uIndex + uWritten;
+    if (uPos < uSegStart + uSegLen)
+    {
+      size_t uFrom = uPos - uSegStart;
+      size_t uCount = (uSegLen - uFrom < uMaxLen - uWritten) ? uSegLen - uFrom : uMaxLen - uWritten;
+      if (oSeg.uVar == TPL_LITERAL)
+      {
+        memcpy_P(pBuffer + uWritten, pTemplateText + oSeg.uOffset + uFrom, uCount);
+      }
+      else
+      {
+        memcpy(pBuffer + uWritten, oSnapshot.acValue[oSeg.uVar] + uFrom, uCount);
+      }
+      uWritten += uCount;
+    }
+    uSegStart += uSegLen;
+  }
+  return uWritten;
+} // size_t renderTemplate(const TemplateSnapshot &oSnapshot, uint8_t *pBuffer, size_t uMaxLen, size_t uIndex)
+//-------------------------------------
+
+#ifdef ARDUINO
+AsyncWebServerResponse *beginTemplateResponse(AsyncWebServerRequest *request, const char *pContentType)
+{
+  uint8_t uSlot = 0;
+  while (uSlot < TPL_MAX_RENDERS && abRenderBusy[uSlot])
+  {
+    uSlot++;
+  }
+  if (uSlot == TPL_MAX_RENDERS)
+  {
+    return nullptr;
+  }
+  abRenderBusy[uSlot] = true;
+  TemplateSnapshot *pSnapshot = &aRenderSlots[uSlot];
+  size_t uTotal = snapshotTemplate(*pSnapshot);
+
+  // The lambdas only capture a slot number or a pointer : they fit in the
+  // std::function itself, no heap block per request. The slot is released
+  // when the client goes away (the request always ends with a disconnection)
+  request->onDisconnect([uSlot]() { abRenderBusy[uSlot] = false; });
+  return request->beginResponse(pContentType, uTotal, [pSnapshot](uint8_t *pBuffer, size_t uMaxLen, size_t uIndex) -> size_t {
+    return renderTemplate(*pSnapshot, pBuffer, uMaxLen, uIndex);
+  });
+} // AsyncWebServerResponse *beginTemplateResponse(...)
+//-------------------------------------
+#endif
@@ -0,0 +1,137 @@
+// Largest-Triangle-Three-Buckets downsampling (see lttb.h)
+
+#include "lttb.h"
+
+#include <math.h>
+
+// ============================== FUNCTIONS ==============================
+
+// Index after the last point of interior bucket iBucket (-1 : the first point)
+static uint32_t bucketEnd(uint32_t uFirst, uint32_t uEnd, int32_t iBucket, uint16_t uBuckets, double dEvery)
+{
+  if (iBucket < 0)
+  {
+    return uFirst + 1;
+  }
+  return (iBucket + 1 >= uBuckets) ? uEnd - 1 : uFirst + 1 + (uint32_t)((iBucket + 1) * dEvery);
+} // static uint32_t bucketEnd(...)
+//-------------------------------------
+
+uint16_t lttbDownsample(uint32_t uFirst, uint32_t uEnd, uint16_t uPoints, LttbReader pReader, void *pContext,
+                        uint32_t *puSelected, float *pfScratch)
+{
+  float fX, fY;
+  uint16_t uSelected = 0;
+
+  // Small series : every valid point
+  if (uEnd - uFirst <= uPoints || uPoints < 3)
+  {
+    for (uint32_t uIndex = uFirst; uIndex < uEnd && uSelected < uPoints; uIndex++)
+    {
+      if (pReader(uIndex, fX, fY, pContext))
+      {
+        puSelected[uSelected++] = uIndex;
+      }
+    }
+    return uSelected;
+  }
+
+  // Interior points [uFirst + 1, uEnd - 1) in uPoints - 2 buckets, the first
+  // and last points are always kept. Scratch : per bucket sum X, sum Y, count
+  uint16_t uBuckets = uPoints - 2;
+  double dEvery = (double)(uEnd - uFirst - 2) / uBuckets;
+  float *pfSumX = pfScratch;
+  float *pfSumY = pfScratch + uBuckets;
+  float *pfCount = pfScratch + 2 * uBuckets;
+
+  // Pass 1 : bucket averages, and the last point
+  for (uint16_t uBucket = 0; uBucket < uBuckets; uBucket++)
+  {
+    pfSumX[uBucket] = pfSumY[uBucket] = pfCount[uBucket] = 0.0f;
+    uint32_t uBucketEnd = bucketEnd(uFirst, uEnd, uBucket, uBuckets, dEvery);
+    for (uint32_t uIndex = bucketEnd(uFirst, uEnd, uBucket - 1, uBuckets, dEvery); uIndex < uBucketEnd; uIndex++)
+    {
+      if (pReader(uIndex, fX, fY, pContext))
+      {
+        pfSumX[uBucket] += fX;
+        pfSumY[uBucket] += fY;
+        pfCount[uBucket] += 1.0f;
+      }
+    }
+  }
+  float fLastX = 0.0f, fLastY = 0.0f;
+  bool bLast = pReader(uEnd - 1, fLastX, fLastY, pContext);
+  // Averages, an empty bucket takes the next non-empty one (or the last point)
+  for (int32_t iBucket = uBuckets - 1; iBucket >= 0; iBucket--)
+  {
+    if (pfCount[iBucket] > 0.0f)
+    {
+      pfSumX[iBucket] /= pfCount[iBucket];
+      pfSumY[iBucket] /= pfCount[iBucket];
+    }
+    else if (iBucket + 1 < uBuckets)
+    {
+      pfSumX[iBucket] = pfSumX[iBucket + 1];
+      pfSumY[iBucket] = pfSumY[iBucket + 1];
+    }
+    else
+    {
+      pfSumX[iBucket] = fLastX;
+      pfSumY[iBucket] = fLastY;
+    }
+  }
+
+  // Pass 2 : in each bucket, the point making the largest triangle with the
+  // previously selected point (A) and the next bucket average (C)
+  float fAX = 0.0f, fAY = 0.0f;
+  bool bHasA = pReader(uFirst, fAX, fAY, pContext);
+  if (bHasA)
+  {
+    puSelected[uSelected++] = uFirst;
+  }
+  uint32_t uIndex = uFirst + 1;
+  for (uint16_t uBucket = 0; uBucket < uBuckets; uBucket++)
+  {
+    uint32_t uBucketEnd = bucketEnd(uFirst, uEnd, uBucket, uBuckets, dEvery);
+    float fCX = (uBucket + 1 < uBuckets) ? pfSumX[uBucket + 1] : fLastX;
+    float fCY = (uBucket + 1 < uBuckets) ? pfSumY[uBucket + 1] : fLastY;
+    float fMaxArea = -1.0f, fMaxX = 0.0f, fMaxY = 0.0f;
+    uint32_t uMaxIndex = 0;
+    for (; uIndex < uBucketEnd; uIndex++)
+    {
+      if (!pReader(uIndex, fX, fY, pContext))
+      {
+        continue;
+      }
+      if (!bHasA)
+      {
+        // Leading holes : the first valid point starts the series
+        fAX = fX;
+        fAY = fY;
+        bHasA = true;
+        puSelected[uSelected++] = uIndex;
+        continue;
+      }
+      float fArea = fabsf((fAX - fCX) * (fY - fAY) - (fAX - fX) * (fCY - fAY));
+      if (fArea > fMaxArea)
+      {
+        fMaxArea = fArea;
+        uMaxIndex = uIndex;
+        fMaxX = fX;
+        fMaxY = fY;
+      }
+    }
+    if (fMaxArea >= 0.0f)
+    {
+      puSelected[uSelected++] = uMaxIndex;
+      fAX = fMaxX;
+      fAY = fMaxY;
+    }
+  }
+  if (bLast && uSelected < uPoints)
+  {
+    puSelected[uSelected++] = uEnd - 1;
+  }
+  return uSelected;
+} // uint16_t lttbDownsample(...)
+//-------------------------------------
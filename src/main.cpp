@@ -17,9 +17,9 @@
 #include <FS.h> // Required for AsyncWebServer
 #include <ESPAsyncWebServer.h>
 
-// NTP Client
-#include <WiFiUdp.h>
-#include <NTPClient.h>
+// SNTP system clock : wall-clock time (sub-second for the sample slots) and NTP quality
+#include <esp_sntp.h>
+#include <sys/time.h>
 
 // DHT Temperature & humidity sensor
 #include "DHT.h"
@@ -33,12 +33,57 @@
 
 #define DHT_PIN 27            // pin for DHT data
 #define DHT_TYPE DHT22        // DHT11 / DHT21 / DHT22
-#define DHT_MEASURETIME 30000 // measure every 15s
+#define DHT_MEASURETIME 30000 // measure every 30s, on wall-clock :00 and :30 (divides a day)
+#define DHT_READ_RETRIES 2    // extra sensor reads when a read fails
+#define DHT_RETRY_DELAY 50    // pause before retrying a failed read (milliseconds)
+#define DHT_PUBLISH_MAX 5000  // a slot sample is published within this after its slot, else missed (milliseconds)
+
+#define NTP_SERVER "europe.pool.ntp.org"                  // SNTP server
+#define NTP_TIME_OFFSET 3600                              // local time offset (seconds)
+#define NTP_VALID_EPOCH 1577836800UL                      // 2020-01-01 : anything earlier is not NTP time
+#define NTP_SYNC_INTERVAL 600000UL                        // SNTP update interval (milliseconds, >= 15000)
+#define NTP_STALE_AFTER (2 * NTP_SYNC_INTERVAL + 60000UL) // no update for this long (one missed) : NTP_STALE
+
+#define FAST_HTTP_PORT 8080 // lightweight read-only data endpoints (comment out to disable)
+#define WEB_BODY_LEN 512    // body of the small web server responses (built on the async_tcp task stack)
+
+#define BUS_SINK_JSON_LEN 152 // one sink of /api/bus (name cut at 16 chars, 10-digit counters, comma)
+#define BUS_STATS_JSON_LEN (2 + MBUS_MAX_SINKS * BUS_SINK_JSON_LEN)
+#define HEAP_REPORT_SITES 8    // call sites listed by /api/heap, largest first
+#define HEAP_SITE_JSON_LEN 38  // one site of /api/heap (10-char pointer, 10-digit counters, comma)
+#define HEAP_TREND_TAIL_LEN 20 // closing of /api/heap with the otherSites count
+#define HEAP_TREND_JSON_LEN (170 + HEAP_REPORT_SITES * HEAP_SITE_JSON_LEN + HEAP_TREND_TAIL_LEN)
+
+#define SERIES_DEFAULT_POINTS 300 // /api/series chart points when ?points= is not given
+#define SERIES_MAX_POINTS 1000    // max. /api/series chart points (16 bytes of heap each while answering)
+#define SAMPLES_MAX_RECORDS 500   // max. /api/samples records per response (the client pages with "more")
+#define HISTORY_DEFAULT_STEP 300  // /api/history aggregation step when ?step= is not given (seconds)
+#define HISTORY_MAX_STEPS 1000    // max. /api/history steps (a finer ?step= is widened)
 
 // ============================== GLOBAL VARS/CONSTS ==============================
 
 // Include the main Web page definition
 #include "index_html.h"
+#include "html_template.h"
+#include "route_table.h"
+#include "fast_http.h"
+#include "asset_store.h"
+#include "asset_handler.h"
+#include "measurement_bus.h"
+#include "block_pool.h"
+#include "heap_monitor.h"
+#include "freshness.h"
+#include "rtc_snapshot.h"
+#include "measure_now.h"
+#include "sample_clock.h"
+#include "rolling_stats.h"
+#include "quantile_sketch.h"
+#include "anomaly.h"
+#include "trend.h"
+#include "history_store.h"
+#include "lttb.h"
+#include "flash_log.h"
+#include "history_export.h"
 
 // Ticker object for WiFi Autoconfig mode (AP) LED status
 Ticker ledTicker;
@@ -47,27 +92,57 @@ Ticker ledTicker;
 DHT dhtSensor(DHT_PIN, DHT_TYPE);
 
 // Sensor measurements
-float fTmp;          // Temperature (Celcius)
-float fHum;          // Humidity (percent)
-float fHtIdx;        // Heat Index (Celcius)
-float fSndSpd;       // Sound Speed (m/s)
-String sMeasureTime; // measurement time (HH:MM:SS)
+uint32_t uMeasureSeq = 0;     // sequence number of the last measurement
+Measurement oLastMeasurement; // last measurement (kept by the "api" sink)
+Measurement oLastRead;        // last sensor read (sampler only), reused by a slot right after it
+portMUX_TYPE muxLastMeasurement = portMUX_INITIALIZER_UNLOCKED;
+
+// /api/series source : channel and time origin of the points read by LTTB,
+// and the history block holding the last point read (LTTB reads
+// sequentially). Taken from the heap per request, with the LTTB buffers.
+struct SeriesContext
+{
+  uint32_t uEpoch0;
+  StatsChannel eChannel;
+  uint32_t uBlockFirst; // index of aBlock[0]
+  uint32_t uBlockCount; // records in aBlock
+  HistoryRecord aBlock[HISTORY_BLOCK_LEN];
+};
+
+// /api/history response, streamed chunk by chunk : every chunk queries the
+// log again from the step after the last one sent, from the tier the first
+// query started with (the steps of a single query). Taken from the heap per
+// request, released when the client is gone.
+struct HistoryContext
+{
+  uint64_t ullNext;      // start of the next step to query (past uTo : steps done)
+  uint32_t uTo;
+  uint32_t uStep;
+  uint32_t uSteps;       // steps sent
+  uint32_t uQueries;     // queries run (one per chunk)
+  FlogQueryStats oQuery; // tier of the first query, blocks / records read by all
+  bool bStepsDone;
+  bool bDone;            // closing text formatted
+  char acLine[96];       // text not sent yet (header, a step that did not fit, closing)
+  size_t uLineLen;
+  size_t uLineSent;
+  uint8_t *pBuffer;      // chunk being filled
+  size_t uMaxLen;
+  size_t uLen;
+  bool bFull;            // a step did not fit in the chunk
+};
 
 // AsyncWebServer object on port 80
 AsyncWebServer oWebServer(80);
 
-// Create UDP client for NTP
-WiFiUDP ntpUDP;
-
-// NTP Client :
-// You can specify the time server pool and the offset (in seconds, can be
-// changed later with setTimeOffset() ). Additionaly you can specify the
-// update interval (in milliseconds, can be changed using setUpdateInterval() ).
-NTPClient clientNTP(ntpUDP, "europe.pool.ntp.org", 3600, 60000);
+// Last SNTP synchronisation (set by onNtpSync() in the lwIP task)
+volatile unsigned long ulNtpSyncMillis = 0UL; // millis() of the last update
+volatile bool bNtpSynced = false;             // an update succeeded on this boot
 
 // Measurement timing
 unsigned long ulTime;              // current time (milliseconds)
-unsigned long ulMeasureTime = 0UL; // last measurement time (milliseconds)
+unsigned long ulHeapTime = 0UL;    // last heap fragmentation sample (milliseconds)
+time_t tLoopEpoch = 0;             // system clock second seen by the previous loop() (UTC)
 
 // Server running normally ?
 bool bRunServer;
@@ -75,12 +150,117 @@ bool bRunServer;
 // ============================== FUNCTION PROTOTYPES ==============================
 
 void configModeCallback(WiFiManager *myWiFiManager);
+void onNtpSync(struct timeval *pTime);
 void tickLED();
-String processOutput(const String &var);
-String outputTemperature();
-String outputHumidity();
-String outputMeasureTime();
-String outputCurrentTime();
+uint8_t ntpQuality(time_t tNow);
+void formatLocalTime(uint32_t uEpoch, char *pTime);
+void takeMeasurement(const SampleSlot *pSlot);
+void keepLastMeasurement(const Measurement &oMeasurement);
+void sendFromWriter(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter);
+void sendMeasurementData(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter);
+void sendSampleData(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter);
+void addNextSampleHeader(AsyncWebServerResponse *response);
+bool getMeasurementAge(uint32_t &uAgeMs);
+uint32_t nextSampleMs();
+void updateTemplateValues(const Measurement &oMeasurement);
+void printMeasurement(const Measurement &oMeasurement);
+void printAlarm(const AlarmEvent &oEvent);
+void handleRoot(AsyncWebServerRequest *request);
+void handleTemperature(AsyncWebServerRequest *request);
+void handleHumidity(AsyncWebServerRequest *request);
+void handleMeasureTime(AsyncWebServerRequest *request);
+void handleTime(AsyncWebServerRequest *request);
+void handleNotFound(AsyncWebServerRequest *request);
+void handleBusStats(AsyncWebServerRequest *request);
+void handleMemoryStats(AsyncWebServerRequest *request);
+void handleHeapTrend(AsyncWebServerRequest *request);
+void handleMeasurement(AsyncWebServerRequest *request);
+void handleFreshness(AsyncWebServerRequest *request);
+void handleFreshnessReport(AsyncWebServerRequest *request);
+void handleMeasureNow(AsyncWebServerRequest *request);
+void handleSampling(AsyncWebServerRequest *request);
+void handleStats(AsyncWebServerRequest *request);
+void handleQuantiles(AsyncWebServerRequest *request);
+void handleSketch(AsyncWebServerRequest *request);
+uint8_t requestedDays(AsyncWebServerRequest *request);
+void handleAlarms(AsyncWebServerRequest *request);
+void handleTrend(AsyncWebServerRequest *request);
+void handleSeries(AsyncWebServerRequest *request);
+void handleSamples(AsyncWebServerRequest *request);
+const HistoryRecord *readSeriesRecord(uint32_t uIndex, SeriesContext *pSeries);
+bool readSeriesPoint(uint32_t uIndex, float &fX, float &fY, void *pContext);
+void handleHistory(AsyncWebServerRequest *request);
+void handleHistoryStats(AsyncWebServerRequest *request);
+void handleExport(AsyncWebServerRequest *request);
+void handleExportStats(AsyncWebServerRequest *request);
+size_t fillHistory(HistoryContext *pHistory, uint8_t *pBuffer, size_t uMaxLen);
+bool printHistoryStep(const FlogStep &oStep, void *pContext);
+size_t writeTemperature(char *pBuffer, size_t uLen);
+size_t writeHumidity(char *pBuffer, size_t uLen);
+size_t writeMeasureTime(char *pBuffer, size_t uLen);
+size_t writeTime(char *pBuffer, size_t uLen);
+size_t writeSinkStats(uint8_t uSink, char *pBuffer, size_t uLen);
+size_t writeBusStats(char *pBuffer, size_t uLen);
+size_t writeMemoryStats(char *pBuffer, size_t uLen);
+size_t writeHeapTrend(char *pBuffer, size_t uLen);
+size_t writeMeasurement(char *pBuffer, size_t uLen);
+size_t writeFreshness(char *pBuffer, size_t uLen);
+size_t writeAgeHeader(char *pBuffer, size_t uLen);
+size_t writeNextSampleHeader(char *pBuffer, size_t uLen);
+size_t writeSampling(char *pBuffer, size_t uLen);
+size_t writeStats(char *pBuffer, size_t uLen);
+size_t writeTrend(char *pBuffer, size_t uLen);
+
+// ============================== WEB ROUTES ==============================
+
+// Routes for root / web page and measurement output
+// (served by oRouteTable in constant time, whatever the number of routes)
+const Route aRoutes[] = {
+    Route("/", HTTP_GET, handleRoot),
+    Route("/temperature", HTTP_GET, handleTemperature),
+    Route("/humidity", HTTP_GET, handleHumidity),
+    Route("/measuretime", HTTP_GET, handleMeasureTime),
+    Route("/api/time", HTTP_GET, handleTime),
+    Route("/api/bus", HTTP_GET, handleBusStats),
+    Route("/api/memory", HTTP_GET, handleMemoryStats),
+    Route("/api/heap", HTTP_GET, handleHeapTrend),
+    Route("/api/measurement", HTTP_GET, handleMeasurement),
+    Route("/api/freshness", HTTP_GET, handleFreshness),
+    Route("/api/freshness/report", HTTP_POST, handleFreshnessReport),
+    Route("/api/measure-now", HTTP_GET | HTTP_POST, handleMeasureNow),
+    Route("/api/sampling", HTTP_GET, handleSampling),
+    Route("/api/stats", HTTP_GET, handleStats),
+    Route("/api/quantiles", HTTP_GET, handleQuantiles),
+    Route("/api/sketch", HTTP_GET, handleSketch),
+    Route("/api/alarms", HTTP_GET, handleAlarms),
+    Route("/api/trend", HTTP_GET, handleTrend),
+    Route("/api/series", HTTP_GET, handleSeries),
+    Route("/api/samples", HTTP_GET, handleSamples),
+    Route("/api/history", HTTP_GET, handleHistory),
+    Route("/api/history/stats", HTTP_GET, handleHistoryStats),
+    Route("/api/export", HTTP_GET, handleExport),
+    Route("/api/export/stats", HTTP_GET, handleExportStats),
+};
+RouteTable oRouteTable(aRoutes, sizeof(aRoutes) / sizeof(aRoutes[0]));
+AssetHandler oAssetHandler; // static assets, after the routes
+
+#ifdef FAST_HTTP_PORT
+// Read-only data endpoints also served by the lightweight responder
+const FastHttpEndpoint aFastEndpoints[] = {
+    FastHttpEndpoint("/temperature", "text/plain", writeTemperature, writeAgeHeader),
+    FastHttpEndpoint("/humidity", "text/plain", writeHumidity, writeAgeHeader),
+    FastHttpEndpoint("/measuretime", "text/plain", writeMeasureTime, writeAgeHeader),
+    FastHttpEndpoint("/api/time", "application/json", writeTime),
+    FastHttpEndpoint("/api/bus", "application/json", writeBusStats),
+    FastHttpEndpoint("/api/memory", "application/json", writeMemoryStats),
+    FastHttpEndpoint("/api/heap", "application/json", writeHeapTrend),
+    FastHttpEndpoint("/api/measurement", "application/json", writeMeasurement, writeAgeHeader),
+    FastHttpEndpoint("/api/freshness", "application/json", writeFreshness),
+    FastHttpEndpoint("/api/sampling", "application/json", writeSampling),
+    FastHttpEndpoint("/api/stats", "application/json", writeStats, writeNextSampleHeader),
+    FastHttpEndpoint("/api/trend", "application/json", writeTrend, writeNextSampleHeader),
+};
+#endif
 
 // ============================== ARDUINO SETUP+LOOP ==============================
 
@@ -149,33 +329,95 @@ void setup()
     Serial.println(WiFi.localIP());
     digitalWrite(STATUS_LED_PIN, HIGH); //keep LED on until end of setup()
 
-    // Initialize NTP client
-    clientNTP.begin();
-    clientNTP.update();
+    // SNTP sets the system clock (UTC, microseconds), onNtpSync() dates each update
+    sntp_set_time_sync_notification_cb(onNtpSync);
+    sntp_set_sync_interval(NTP_SYNC_INTERVAL);
+    configTime(0, 0, NTP_SERVER);
+
+    // Split the web page template once, values are then served from a cache
+    if (!initTemplate(index_html))
+    {
+      Serial.println("Failed to split index_html template!");
+    }
+    // Serve the last measurement of the previous boot (warm restart) until the first sample, else no values
+    Measurement oStartMeasurement = {0, 0, 0, 0, 0, 0, NTP_NONE, NAN, NAN, NAN, NAN, 0UL, ""};
+    time_t tEpoch = time(nullptr);
+    if (restoreRtcSnapshot(oStartMeasurement, (tEpoch < (time_t)NTP_VALID_EPOCH) ? 0 : (uint32_t)tEpoch, esp_timer_get_time()))
+    {
+      uMeasureSeq = oStartMeasurement.uSeq;
+      Serial.printf("Restored measurement #%u from RTC memory (%u warm restarts)\n", oStartMeasurement.uSeq, rtcRestoreCount());
+    }
+    beginMeasureNow(uMeasureSeq);
+    updateTemplateValues(oStartMeasurement);
+    keepLastMeasurement(oStartMeasurement);
+
+    // Sample history ring : PSRAM if the module has some, else internal RAM
+    beginHistoryStore();
+    HistoryInfo oHistory;
+    getHistoryInfo(oHistory);
+    Serial.printf("Sample history : %u samples (%u bytes) in %s\n", oHistory.uCapacity, oHistory.uBytes,
+                  (oHistory.eMemory == HISTORY_PSRAM) ? "PSRAM" : "internal RAM");
+
+    // Persistent sample log in the "history" flash partition (optional)
+    if (beginFlashLog(FLOG_PARTITION_LABEL))
+    {
+      FlashLogStats oTier;
+      for (uint8_t uTier = 0; getFlashLogStats(uTier, oTier); uTier++)
+      {
+        Serial.printf("Sample log tier %u (%u s) : %u records in %u/%u blocks\n", uTier, oTier.uStep, oTier.uRecords,
+                      oTier.uBlocks, oTier.uCapacity);
+      }
+      beginFlashCompaction();
+    }
+
+    // Measurement consumers, fed by the measurement bus
+    subscribeMeasurements("serial", SINK_EVERY, 1, printMeasurement);
+    subscribeMeasurements("web", SINK_LATEST, 1, updateTemplateValues);
+    subscribeMeasurements("api", SINK_LATEST, 1, keepLastMeasurement);
+    subscribeMeasurements("stats", SINK_EVERY, 1, addStatsSample);
+    subscribeMeasurements("sketch", SINK_EVERY, 1, addSketchSample);
+    subscribeMeasurements("alarms", SINK_EVERY, 1, checkAnomalies);
+    setAlarmHandler(printAlarm);
+    subscribeMeasurements("trend", SINK_EVERY, 1, updateTrend);
+    subscribeMeasurements("history", SINK_EVERY, 1, addHistorySample);
+    subscribeMeasurements("flashlog", SINK_EVERY, 1, appendFlashLog);
+    beginMeasurementBus();
+
+    // Sample on wall-clock slots (aligned on boot until the first NTP second is seen)
+    if (!beginSampleClock(DHT_MEASURETIME / 1000))
+    {
+      Serial.println("Failed to start the sample clock!");
+    }
 
     // Routes for root / web page and measurement output
-    oWebServer.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/html", index_html, processOutput);
-    });
-    oWebServer.on("/temperature", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/plain", outputTemperature().c_str());
-    });
-    oWebServer.on("/humidity", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/plain", outputHumidity().c_str());
-    });
-    oWebServer.on("/measuretime", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/plain", outputMeasureTime().c_str());
-    });
-    oWebServer.on("/refreshtime", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/plain", outputCurrentTime().c_str());
-    });
+    if (!oRouteTable.begin())
+    {
+      Serial.println("Failed to build the route table!");
+    }
+    oWebServer.addHandler(&oRouteTable);
+
+    // Static assets from the "assets" flash partition (optional)
+    if (beginAssetStore(ASSET_PARTITION_LABEL))
+    {
+      Serial.print("Static assets : ");
+      Serial.println(assetCount());
+    }
+    oWebServer.addHandler(&oAssetHandler);
+    oWebServer.onNotFound(handleNotFound);
 
     // Start server
     oWebServer.begin();
+#ifdef FAST_HTTP_PORT
+    beginFastHttp(FAST_HTTP_PORT, aFastEndpoints, sizeof(aFastEndpoints) / sizeof(aFastEndpoints[0]));
+#endif
 
     Serial.println();
+    char acTime[9];
+    formatLocalTime((uint32_t)time(nullptr), acTime);
     Serial.print("Ready ! Time : ");
-    Serial.println(clientNTP.getFormattedTime());
+    Serial.println(acTime);
+    Serial.printf("Free heap : %u bytes, largest block %u, min. ever %u\n", ESP.getFreeHeap(), ESP.getMaxAllocHeap(),
+                  ESP.getMinFreeHeap());
     // Serial.print("Soft-AP MAC  : ");  Serial.println(WiFi.softAPmacAddress());
     // Serial.print("Soft-AP IP   : ");  Serial.println(WiFi.softAPIP());
     Serial.print("Station IP   : ");
@@ -191,42 +433,44 @@ void setup()
 void loop()
 {
   ulTime = millis();
-  // Take a measurement every DHT_MEASURETIME milliseconds
-  if (bRunServer && (ulTime - ulMeasureTime > DHT_MEASURETIME))
+
+  // Anchor the sample slots on the SNTP system clock at each new second :
+  // tv_usec places the second start exactly, however late loop() sees it
+  struct timeval tvNow;
+  gettimeofday(&tvNow, nullptr);
+  uint64_t ullMicros = esp_timer_get_time();
+  if (tvNow.tv_sec != tLoopEpoch)
+  {
+    if (bRunServer && tvNow.tv_sec >= (time_t)NTP_VALID_EPOCH)
+    {
+      syncSampleClock((uint32_t)tvNow.tv_sec, ullMicros - tvNow.tv_usec);
+    }
+    tLoopEpoch = tvNow.tv_sec;
+  }
+
+  // Take a measurement on every sample slot, or when requested by /api/measure-now
+  SampleSlot oSlot;
+  bool bSlotDue = sampleDue(oSlot);
+  if (bRunServer && (bSlotDue || measureNowPending(ulTime)))
   {
     // Serial.println();
     digitalWrite(LED_BUILTIN, LED_ON);  //LED on during measurement update
-    clientNTP.update();
-    sMeasureTime = clientNTP.getFormattedTime();
-
-    // Get readings from sensor
-    fTmp = dhtSensor.readTemperature(false);
-    fHum = dhtSensor.readHumidity();
-    // Get Heat Index
-    fHtIdx = dhtSensor.computeHeatIndex(fTmp, fHum, false);
-    // Calculate the Speed of Sound in m/s
-    fSndSpd = 331.4 + (0.606 * fTmp) + (0.0124 * fHum);
-
-    ulMeasureTime = ulTime;
-
-    Serial.print(sMeasureTime);
-    Serial.print(" - ");
-    Serial.print("Temp.  : ");
-    Serial.print(fTmp, 1);
-    Serial.print(" C");
-    Serial.print(" - Humid. : ");
-    Serial.print(fHum, 1);
-    Serial.print(" %");
-    Serial.print(" - Heat Idx. : ");
-    Serial.print(fHtIdx, 1);
-    Serial.print(" C");
-    Serial.print(" - Snd.Sp.: ");
-    Serial.print(fSndSpd, 1);
-    Serial.print(" m/s ");
-    Serial.println();
-
+    takeMeasurement(bSlotDue ? &oSlot : nullptr);
     digitalWrite(LED_BUILTIN, LED_OFF);  //LED off after measurement update
-  } // if (bRunServer && (ulTime - ulMeasureTime > DHT_MEASURETIME))
+  } // if (bRunServer && (bSlotDue || measureNowPending(ulTime)))
+
+  // Watch the heap fragmentation trend
+  if (ulTime - ulHeapTime >= HEAP_SAMPLE_PERIOD)
+  {
+    ulHeapTime = ulTime;
+    if (sampleHeap(ulTime, ESP.getFreeHeap(), ESP.getMaxAllocHeap()))
+    {
+      HeapTrend oTrend;
+      getHeapTrend(oTrend);
+      Serial.printf("Heap fragmentation rising : %u permille, +%.1f permille/day, largest block %u\n",
+                    oTrend.uFragPermille, oTrend.fSlopePerDay, oTrend.uMaxBlock);
+    }
+  }
 
   delayMicroseconds(100);
   // Serial.print(".");
@@ -247,6 +491,14 @@ void configModeCallback(WiFiManager *myWiFiManager)
 } // void configModeCallback (WiFiManager *myWiFiManager)
 // ----------------------------------------------------------------------
 
+// SNTP has set the system clock (lwIP task) : date the update for ntpQuality()
+void onNtpSync(struct timeval *pTime)
+{
+  ulNtpSyncMillis = millis();
+  bNtpSynced = true;
+} // void onNtpSync(struct timeval *pTime)
+// ----------------------------------------------------------------------
+
 // ============================== UTILITY FUNCTIONS ==============================
 
 // blink STATUS_LED_PIN
@@ -257,70 +509,1296 @@ void tickLED()
 } // void tickLED()
 // ----------------------------------------------------------------------
 
-// Replaces placeholder with DHT values
-String processOutput(const String &var)
+// NtpQuality of the system clock at UTC second tNow : NTP_NONE before any
+// NTP time (the clock may still hold one from before a restart : stale),
+// NTP_STALE if SNTP has not updated it for NTP_STALE_AFTER
+uint8_t ntpQuality(time_t tNow)
 {
-  //Serial.println(var);
-  if (var == "TEMPERATURE")
+  if (tNow < (time_t)NTP_VALID_EPOCH)
   {
-    return outputTemperature();
+    return NTP_NONE;
   }
-  else if (var == "HUMIDITY")
+  if (!bNtpSynced || millis() - ulNtpSyncMillis > NTP_STALE_AFTER)
   {
-    return outputHumidity();
+    return NTP_STALE;
   }
-  else if (var == "MEASURETIME")
+  return NTP_SYNCED;
+} // uint8_t ntpQuality(time_t tNow)
+// ----------------------------------------------------------------------
+
+// Local wall-clock time of UTC second uEpoch as HH:MM:SS into pTime (9 chars)
+void formatLocalTime(uint32_t uEpoch, char *pTime)
+{
+  unsigned long ulLocalTime = uEpoch + NTP_TIME_OFFSET;
+  snprintf(pTime, 9, "%02lu:%02lu:%02lu", (ulLocalTime % 86400UL) / 3600UL, (ulLocalTime % 3600UL) / 60UL,
+           ulLocalTime % 60UL);
+} // void formatLocalTime(uint32_t uEpoch, char *pTime)
+// ----------------------------------------------------------------------
+
+// Read the sensor and publish a new measurement record to the consumers
+// (serial, web...) : sequence number, time stamps, read duration, retries,
+// NTP quality and validity flags travel with the values. pSlot is the due
+// sample slot, nullptr for an on-demand read.
+void takeMeasurement(const SampleSlot *pSlot)
+{
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+
+  // Sensor first, right on the slot time, with the clock read at the same time
+  oMeasurement.ullMicros = esp_timer_get_time();
+  oMeasurement.ulMillis = millis();
+  time_t tEpoch = time(nullptr);
+  if (pSlot != nullptr)
   {
-    return outputMeasureTime();
+    recordSampleStart(*pSlot, oMeasurement.ullMicros);
   }
-  else if (var == "REFRESHTIME")
+
+  // Get readings from sensor, retry failed reads. A slot within
+  // MEASURE_NOW_MIN_INTERVAL of the last read (e.g. right after an on-demand
+  // read) reuses it : the DHT22 cannot be read that often.
+  bool bReused = (pSlot != nullptr && !sensorReadAllowed(oMeasurement.ulMillis));
+  if (bReused)
   {
-    return outputCurrentTime();
+    oMeasurement.fTmp = oLastRead.fTmp;
+    oMeasurement.fHum = oLastRead.fHum;
+    oMeasurement.fHtIdx = oLastRead.fHtIdx;
+    oMeasurement.fSndSpd = oLastRead.fSndSpd;
   }
-  return String();
-} // String processOutput(const String& var)
+  else
+  {
+    bool bRead = dhtSensor.read();
+    while (!bRead && oMeasurement.uRetries < DHT_READ_RETRIES)
+    {
+      oMeasurement.uRetries++;
+      delay(DHT_RETRY_DELAY);
+      bRead = dhtSensor.read(true);
+    }
+    oMeasurement.fTmp = dhtSensor.readTemperature(false);
+    oMeasurement.fHum = dhtSensor.readHumidity();
+    oMeasurement.uReadMicros = (uint32_t)(esp_timer_get_time() - oMeasurement.ullMicros);
+    // Get Heat Index
+    oMeasurement.fHtIdx = dhtSensor.computeHeatIndex(oMeasurement.fTmp, oMeasurement.fHum, false);
+    // Calculate the Speed of Sound in m/s
+    oMeasurement.fSndSpd = 331.4 + (0.606 * oMeasurement.fTmp) + (0.0124 * oMeasurement.fHum);
+    oLastRead = oMeasurement;
+  }
+
+  // Time and NTP quality from the same (SNTP) clock
+  oMeasurement.uNtpQuality = ntpQuality(tEpoch);
+  // Slot samples are stamped with the slot time : identical on every device
+  oMeasurement.uEpoch = (pSlot != nullptr && pSlot->bSynced) ? pSlot->uEpoch : (uint32_t)tEpoch;
+  formatLocalTime(oMeasurement.uEpoch, oMeasurement.acTime);
+
+  oMeasurement.uFlags = (isnan(oMeasurement.fTmp) ? 0 : MEAS_TMP_VALID) | (isnan(oMeasurement.fHum) ? 0 : MEAS_HUM_VALID) |
+                        ((pSlot == nullptr) ? MEAS_ON_DEMAND : 0) | (bReused ? MEAS_REUSED : 0);
+  oMeasurement.uSeq = ++uMeasureSeq;
+
+  publishMeasurement(oMeasurement);
+  saveRtcSnapshot(oMeasurement);
+  measureNowTaken(oMeasurement.uSeq, bReused ? oLastRead.ulMillis : oMeasurement.ulMillis);
+} // void takeMeasurement(const SampleSlot *pSlot)
 //-------------------------------------
 
-String outputTemperature()
+// Keep a copy of the last measurement for the API
+void keepLastMeasurement(const Measurement &oMeasurement)
 {
-  // Check if any reads failed and exit early (to try again).
-  if (isnan(fTmp))
+  portENTER_CRITICAL(&muxLastMeasurement);
+  oLastMeasurement = oMeasurement;
+  portEXIT_CRITICAL(&muxLastMeasurement);
+} // void keepLastMeasurement(const Measurement &oMeasurement)
+//-------------------------------------
+
+// Age of the last measurement (milliseconds), false if there is none yet
+bool getMeasurementAge(uint32_t &uAgeMs)
+{
+  portENTER_CRITICAL(&muxLastMeasurement);
+  uint32_t uSeq = oLastMeasurement.uSeq;
+  uint64_t ullMicros = oLastMeasurement.ullMicros;
+  portEXIT_CRITICAL(&muxLastMeasurement);
+
+  if (uSeq == 0)
   {
-    Serial.println("Failed to get Temperature from DHT sensor!");
-    return "N/A";
+    return false;
+  }
+  uAgeMs = (uint32_t)((esp_timer_get_time() - ullMicros) / 1000);
+  return true;
+} // bool getMeasurementAge(uint32_t &uAgeMs)
+//-------------------------------------
+
+// Milliseconds until the next sample : until the armed slot, or 0 while the
+// slot before it is still being read (not published yet)
+uint32_t nextSampleMs()
+{
+  SampleSlot oSlot;
+  getNextSlot(oSlot);
+  portENTER_CRITICAL(&muxLastMeasurement);
+  uint64_t ullLastMicros = oLastMeasurement.ullMicros;
+  portEXIT_CRITICAL(&muxLastMeasurement);
+
+  uint64_t ullNow = esp_timer_get_time();
+  if (oSlot.ullMicros <= ullNow)
+  {
+    return 0;
+  }
+  // (restored measurements may be stamped before boot : signed comparison)
+  uint64_t ullPrevious = oSlot.ullMicros - DHT_MEASURETIME * 1000ULL;
+  if (oSlot.ullMicros > DHT_MEASURETIME * 1000ULL && ullNow - ullPrevious < DHT_PUBLISH_MAX * 1000ULL &&
+      (int64_t)(ullLastMicros - ullPrevious) < 0)
+  {
+    return 0;
+  }
+  return (uint32_t)((oSlot.ullMicros - ullNow) / 1000);
+} // uint32_t nextSampleMs()
+//-------------------------------------
+
+// Refresh the pre-formatted values served by the web page template
+void updateTemplateValues(const Measurement &oMeasurement)
+{
+  char acValue[TPL_VALUE_LEN];
+
+  if (isnan(oMeasurement.fTmp))
+  {
+    setTemplateValue(TPL_TEMPERATURE, "N/A");
   }
   else
   {
-    // Serial.println(fTmp, 1);
-    return String(fTmp);
+    snprintf(acValue, sizeof(acValue), "%.2f", oMeasurement.fTmp);
+    setTemplateValue(TPL_TEMPERATURE, acValue);
+  }
+  if (isnan(oMeasurement.fHum))
+  {
+    setTemplateValue(TPL_HUMIDITY, "N/A");
   }
-} // String outputTemperature()
+  else
+  {
+    snprintf(acValue, sizeof(acValue), "%.2f", oMeasurement.fHum);
+    setTemplateValue(TPL_HUMIDITY, acValue);
+  }
+  if (oMeasurement.uFlags & MEAS_RESTORED)
+  {
+    snprintf(acValue, sizeof(acValue), "%s (restored)", oMeasurement.acTime);
+    setTemplateValue(TPL_MEASURETIME, acValue);
+  }
+  else
+  {
+    setTemplateValue(TPL_MEASURETIME, oMeasurement.acTime);
+  }
+} // void updateTemplateValues(const Measurement &oMeasurement)
 //-------------------------------------
 
-String outputHumidity()
+// Print a measurement on the serial port
+void printMeasurement(const Measurement &oMeasurement)
 {
+  // Check if any reads failed
+  if (isnan(oMeasurement.fTmp))
+  {
+    Serial.println("Failed to get Temperature from DHT sensor!");
+  }
   // Sensor readings may also be up to 2 seconds 'old' (its a very slow sensor)
-  if (isnan(fHum))
+  if (isnan(oMeasurement.fHum))
   {
     Serial.println("Failed to get Humidity from DHT sensor!");
-    return "N/A";
   }
-  else
+
+  Serial.print(oMeasurement.acTime);
+  Serial.print(" #");
+  Serial.print(oMeasurement.uSeq);
+  Serial.print(" - ");
+  Serial.print("Temp.  : ");
+  Serial.print(oMeasurement.fTmp, 1);
+  Serial.print(" C");
+  Serial.print(" - Humid. : ");
+  Serial.print(oMeasurement.fHum, 1);
+  Serial.print(" %");
+  Serial.print(" - Heat Idx. : ");
+  Serial.print(oMeasurement.fHtIdx, 1);
+  Serial.print(" C");
+  Serial.print(" - Snd.Sp.: ");
+  Serial.print(oMeasurement.fSndSpd, 1);
+  Serial.print(" m/s ");
+  Serial.printf("- Read : %u us, %u retries%s", oMeasurement.uReadMicros, oMeasurement.uRetries,
+                oMeasurement.uNtpQuality == NTP_SYNCED ? "" : " (time not synced)");
+  Serial.println();
+} // void printMeasurement(const Measurement &oMeasurement)
+//-------------------------------------
+
+// Print an alarm raise / clear on the serial port
+void printAlarm(const AlarmEvent &oEvent)
+{
+  Serial.printf("ALARM %s : %s %s #%u (%.2f, limit %.2f)\n", oEvent.bRaised ? "RAISED" : "cleared",
+                (oEvent.uChannel == STATS_TMP) ? "temperature" : "humidity", alarmKindName(oEvent.uKind),
+                oEvent.uSeq, oEvent.fValue, oEvent.fLimit);
+} // void printAlarm(const AlarmEvent &oEvent)
+//-------------------------------------
+
+// ============================== WEB HANDLERS ==============================
+
+void handleRoot(AsyncWebServerRequest *request)
+{
+  char acTime[9];
+  formatLocalTime((uint32_t)time(nullptr), acTime);
+  setTemplateValue(TPL_REFRESHTIME, acTime);
+  AsyncWebServerResponse *response = beginTemplateResponse(request, "text/html");
+  if (response == nullptr)
+  {
+    response = request->beginResponse(503, "text/plain", "Busy");
+    response->addHeader("Retry-After", "1");
+  }
+  request->send(response);
+} // void handleRoot(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleTemperature(AsyncWebServerRequest *request)
+{
+  sendMeasurementData(request, "text/plain", writeTemperature);
+} // void handleTemperature(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleHumidity(AsyncWebServerRequest *request)
+{
+  sendMeasurementData(request, "text/plain", writeHumidity);
+} // void handleHumidity(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleMeasureTime(AsyncWebServerRequest *request)
+{
+  sendMeasurementData(request, "text/plain", writeMeasureTime);
+} // void handleMeasureTime(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Device clock, the page ticks it locally from this single exchange
+void handleTime(AsyncWebServerRequest *request)
+{
+  sendFromWriter(request, "application/json", writeTime);
+} // void handleTime(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Neither a route nor a static asset (see asset_handler.h)
+void handleNotFound(AsyncWebServerRequest *request)
+{
+  request->send(404, "text/plain", "Not found");
+} // void handleNotFound(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Streamed one sink at a time : no body buffer sized for MBUS_MAX_SINKS on the stack
+void handleBusStats(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  char acSink[BUS_SINK_JSON_LEN];
+  response->print('[');
+  for (uint8_t uSink = 0; uSink < sinkCount(); uSink++)
+  {
+    response->write((const uint8_t *)acSink, writeSinkStats(uSink, acSink, sizeof(acSink)));
+  }
+  response->print(']');
+  request->send(response);
+} // void handleBusStats(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleMemoryStats(AsyncWebServerRequest *request)
+{
+  sendFromWriter(request, "application/json", writeMemoryStats);
+} // void handleMemoryStats(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleHeapTrend(AsyncWebServerRequest *request)
+{
+  sendFromWriter(request, "application/json", writeHeapTrend);
+} // void handleHeapTrend(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleMeasurement(AsyncWebServerRequest *request)
+{
+  sendMeasurementData(request, "application/json", writeMeasurement);
+} // void handleMeasurement(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleFreshness(AsyncWebServerRequest *request)
+{
+  sendFromWriter(request, "application/json", writeFreshness);
+} // void handleFreshness(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Sensor-to-screen latency of a newly displayed sample, reported by the page
+// (?ms=, unauthenticated : recordFreshness() clamps it)
+void handleFreshnessReport(AsyncWebServerRequest *request)
+{
+  if (!request->hasParam("ms"))
+  {
+    request->send(400, "text/plain", "Missing ms");
+    return;
+  }
+  int iMs = request->getParam("ms")->value().toInt();
+  if (iMs >= 0)
   {
-    // Serial.println(fHum, 1);
-    return String(fHum);
+    recordFreshness(FRESH_DISPLAYED, (uint32_t)iMs);
   }
-} // String outputHumidity()
+  request->send(204);
+} // void handleFreshnessReport(AsyncWebServerRequest *request)
 //-------------------------------------
 
-String outputMeasureTime()
+// On-demand measurement : POST answers with the last measurement if it is
+// less than 2 s old, else 202 with the sample number to wait for on
+// /api/measurement (the read is done by loop(), concurrent callers share it).
+// GET returns the request counters.
+void handleMeasureNow(AsyncWebServerRequest *request)
 {
-  return sMeasureTime;
-} // String outputMeasureTime()
+  char acBody[96];
+  if (request->method() == HTTP_GET)
+  {
+    uint32_t uCached, uScheduled, uJoined;
+    getMeasureNowStats(uCached, uScheduled, uJoined);
+    snprintf(acBody, sizeof(acBody), "{\"cached\":%u,\"scheduled\":%u,\"joined\":%u}", uCached, uScheduled, uJoined);
+    request->send(200, "application/json", acBody);
+    return;
+  }
+
+  uint32_t uSeq;
+  MeasureNowResult eResult = requestMeasureNow(millis(), uSeq);
+  if (eResult == MEASURE_NOW_CACHED)
+  {
+    sendMeasurementData(request, "application/json", writeMeasurement);
+    return;
+  }
+  snprintf(acBody, sizeof(acBody), "{\"pending\":true,\"seq\":%u,\"joined\":%s}", uSeq,
+           (eResult == MEASURE_NOW_JOINED) ? "true" : "false");
+  AsyncWebServerResponse *response = request->beginResponse(202, "application/json", acBody);
+  response->addHeader("Location", "/api/measurement");
+  response->addHeader("Retry-After", "1");
+  request->send(response);
+} // void handleMeasureNow(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleSampling(AsyncWebServerRequest *request)
+{
+  sendFromWriter(request, "application/json", writeSampling);
+} // void handleSampling(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleStats(AsyncWebServerRequest *request)
+{
+  sendSampleData(request, "application/json", writeStats);
+} // void handleStats(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void handleTrend(AsyncWebServerRequest *request)
+{
+  sendSampleData(request, "application/json", writeTrend);
+} // void handleTrend(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Percentiles over the last ?days= days (default and max. QSKETCH_DAYS, today included)
+void handleQuantiles(AsyncWebServerRequest *request)
+{
+  static const char *apChannelNames[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+  static const float afQuantiles[] = {0.05f, 0.25f, 0.5f, 0.75f, 0.95f};
+  const uint8_t uCount = sizeof(afQuantiles) / sizeof(afQuantiles[0]);
+  uint8_t uDays = requestedDays(request);
+  float afValues[uCount];
+  char acBody[WEB_BODY_LEN];
+
+  size_t uPos = snprintf(acBody, sizeof(acBody), "{\"days\":%u,\"quantiles\":[0.05,0.25,0.5,0.75,0.95]", uDays);
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT && uPos < sizeof(acBody); uChannel++)
+  {
+    uint32_t uSamples = getQuantiles((StatsChannel)uChannel, uDays, afQuantiles, uCount, afValues);
+    uPos += snprintf(acBody + uPos, sizeof(acBody) - uPos, ",\"%s\":{\"count\":%u,\"values\":", apChannelNames[uChannel], uSamples);
+    for (uint8_t uQuantile = 0; uQuantile < uCount && uPos < sizeof(acBody); uQuantile++)
+    {
+      if (uSamples == 0)
+      {
+        uPos += snprintf(acBody + uPos, sizeof(acBody) - uPos, "null");
+        break;
+      }
+      uPos += snprintf(acBody + uPos, sizeof(acBody) - uPos, "%s%.2f", uQuantile ? "," : "[", afValues[uQuantile]);
+    }
+    if (uPos < sizeof(acBody))
+    {
+      uPos += snprintf(acBody + uPos, sizeof(acBody) - uPos, (uSamples == 0) ? "}" : "]}");
+    }
+  }
+  if (uPos < sizeof(acBody))
+  {
+    snprintf(acBody + uPos, sizeof(acBody) - uPos, "}");
+  }
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", acBody);
+  addNextSampleHeader(response);
+  request->send(response);
+} // void handleQuantiles(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Serialized sketch over the last ?days= days, mergeable across devices by
+// adding the counts of equal bins : per channel its bin layout and the
+// non-empty bins as [bin,count] pairs
+void handleSketch(AsyncWebServerRequest *request)
+{
+  static const char *apChannelNames[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+  uint8_t uDays = requestedDays(request);
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"days\":%u", uDays);
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    const SketchAxis &oAxis = sketchAxis((StatsChannel)uChannel);
+    response->printf(",\"%s\":{\"min\":%.2f,\"step\":%.2f,\"bins\":%u,\"counts\":[",
+                     apChannelNames[uChannel], oAxis.fMin, oAxis.fStep, oAxis.uBins);
+    bool bFirst = true;
+    for (uint16_t uBin = 0; uBin < oAxis.uBins; uBin++)
+    {
+      uint32_t uBinCount = sketchBinCount((StatsChannel)uChannel, uDays, uBin);
+      if (uBinCount != 0)
+      {
+        response->printf("%s[%u,%u]", bFirst ? "" : ",", uBin, uBinCount);
+        bFirst = false;
+      }
+    }
+    response->print("]}");
+  }
+  response->print("}");
+  addNextSampleHeader(response);
+  request->send(response);
+} // void handleSketch(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Active alarms, then the logged raise / clear events after ?after= (event
+// number, default 0 : the whole log) as [number,seq,epoch,channel,kind,raised,value,limit]
+void handleAlarms(AsyncWebServerRequest *request)
+{
+  static const char *apChannelNames[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+  uint32_t uAfter = request->hasParam("after") ? (uint32_t)request->getParam("after")->value().toInt() : 0;
+  uint32_t uMask = activeAlarms();
+  uint32_t uLast = lastAlarmEvent();
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"last\":%u,\"active\":[", uLast);
+  bool bFirst = true;
+  for (uint8_t uBit = 0; uBit < STATS_CHANNEL_COUNT * ALARM_KIND_COUNT; uBit++)
+  {
+    if (uMask & (1UL << uBit))
+    {
+      response->printf("%s[\"%s\",\"%s\"]", bFirst ? "" : ",", apChannelNames[uBit / ALARM_KIND_COUNT],
+                       alarmKindName(uBit % ALARM_KIND_COUNT));
+      bFirst = false;
+    }
+  }
+  response->print("],\"events\":[");
+  AlarmEvent oEvent;
+  bFirst = true;
+  for (uint32_t uNumber = (uLast > uAfter + ALARM_LOG_LEN) ? uLast - ALARM_LOG_LEN + 1 : uAfter + 1; uNumber <= uLast; uNumber++)
+  {
+    if (getAlarmEvent(uNumber, oEvent))
+    {
+      response->printf("%s[%u,%u,%u,\"%s\",\"%s\",%s,%.2f,%.2f]", bFirst ? "" : ",", oEvent.uNumber, oEvent.uSeq,
+                       oEvent.uEpoch, apChannelNames[oEvent.uChannel], alarmKindName(oEvent.uKind),
+                       oEvent.bRaised ? "true" : "false", oEvent.fValue, oEvent.fLimit);
+      bFirst = false;
+    }
+  }
+  response->print("]}");
+  addNextSampleHeader(response);
+  request->send(response);
+} // void handleAlarms(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Chart-ready history : ?from= and ?to= (UTC epochs, default the whole
+// store, 400 if from is after to) downsampled by LTTB to ?points= points
+// (default SERIES_DEFAULT_POINTS, max. SERIES_MAX_POINTS) of ?channel=
+// (temperature, default, or humidity), as [epoch,value] pairs. The LTTB
+// buffers and the history block cache are taken from the heap for the
+// request only (off the async_tcp task stack) : 503 if it cannot spare them.
+void handleSeries(AsyncWebServerRequest *request)
+{
+  static const char *apChannelNames[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+
+  uint32_t uFrom = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+  uint32_t uTo = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : UINT32_MAX;
+  if (uFrom > uTo)
+  {
+    request->send(400, "text/plain", "from is after to");
+    return;
+  }
+  long lPoints = request->hasParam("points") ? request->getParam("points")->value().toInt() : SERIES_DEFAULT_POINTS;
+  uint16_t uPoints = (lPoints < 3) ? 3 : (lPoints > SERIES_MAX_POINTS) ? SERIES_MAX_POINTS : (uint16_t)lPoints;
+  SeriesContext *pContext = (SeriesContext *)malloc(sizeof(SeriesContext) + uPoints * sizeof(uint32_t) +
+                                                    LTTB_SCRATCH_LEN(uPoints) * sizeof(float));
+  if (pContext == nullptr)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Out of memory, ask for fewer points");
+    response->addHeader("Retry-After", "5");
+    request->send(response);
+    return;
+  }
+  uint32_t *auSelected = (uint32_t *)(pContext + 1);
+  float *afScratch = (float *)(auSelected + uPoints);
+  StatsChannel eChannel = (request->hasParam("channel") && request->getParam("channel")->value() == "humidity")
+                              ? STATS_HUM : STATS_TMP;
+  uint32_t uFirst = findHistory(uFrom);
+  uint32_t uEnd = (uTo == UINT32_MAX) ? historyEnd() : findHistory(uTo + 1);
+  uEnd = max(uEnd, uFirst); // ring overwritten between the two lookups
+  pContext->eChannel = eChannel;
+  pContext->uBlockFirst = 0;
+  pContext->uBlockCount = 0;
+  const HistoryRecord *pRecord = (uFirst < uEnd) ? readSeriesRecord(uFirst, pContext) : nullptr;
+  pContext->uEpoch0 = (pRecord != nullptr) ? pRecord->uEpoch : 0;
+  uint16_t uSelected = (uFirst < uEnd) ? lttbDownsample(uFirst, uEnd, uPoints, readSeriesPoint, pContext, auSelected, afScratch)
+                                       : 0;
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"channel\":\"%s\",\"samples\":%u,\"points\":[", apChannelNames[eChannel], uEnd - uFirst);
+  bool bFirst = true;
+  for (uint16_t uPoint = 0; uPoint < uSelected; uPoint++)
+  {
+    pRecord = readSeriesRecord(auSelected[uPoint], pContext);
+    int16_t iValue = (pRecord == nullptr) ? HISTORY_NONE : (eChannel == STATS_HUM) ? pRecord->iHum : pRecord->iTmp;
+    if (iValue != HISTORY_NONE)
+    {
+      response->printf("%s[%u,%.2f]", bFirst ? "" : ",", pRecord->uEpoch, iValue / 100.0f);
+      bFirst = false;
+    }
+  }
+  free(pContext);
+  response->print("]}");
+  addNextSampleHeader(response);
+  request->send(response);
+} // void handleSeries(AsyncWebServerRequest *request)
 //-------------------------------------
 
-String outputCurrentTime()
+// Samples of the history ring newer than ?since= (sequence number), for the
+// page's local store, as [seq,epoch,temperature,humidity] : at most
+// SAMPLES_MAX_RECORDS per response ("more" : ask again from "last"). A
+// ?generation= other than the ring's (the device restarted) makes ?since=
+// stale : everything stored is sent again. The block buffer is taken from
+// the heap (off the async_tcp task stack) : 503 if it cannot spare it.
+void handleSamples(AsyncWebServerRequest *request)
 {
-  return clientNTP.getFormattedTime();
-} // String outputCurrentTime()
+  uint32_t uGeneration = historyGeneration();
+  uint32_t uSince = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : 0;
+  if (!request->hasParam("generation") ||
+      strtoul(request->getParam("generation")->value().c_str(), nullptr, 10) != uGeneration)
+  {
+    uSince = 0;
+  }
+  uint32_t uIndex = findHistorySince(uSince);
+  uint32_t uEnd = historyEnd();
+  uint32_t uLast = uSince;
+  uint32_t uSent = 0;
+  HistoryRecord *aBlock = (HistoryRecord *)malloc(HISTORY_BLOCK_LEN * sizeof(HistoryRecord));
+  if (aBlock == nullptr)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Out of memory");
+    response->addHeader("Retry-After", "5");
+    request->send(response);
+    return;
+  }
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"generation\":%u,\"samples\":[", uGeneration);
+  while (uIndex < uEnd && uSent < SAMPLES_MAX_RECORDS)
+  {
+    uint32_t uCount = readHistoryBlock(uIndex, aBlock);
+    if (uCount == 0)
+    {
+      uIndex = historyFirst(); // overwritten meanwhile
+      continue;
+    }
+    for (uint32_t uRecord = 0; uRecord < uCount && uSent < SAMPLES_MAX_RECORDS; uRecord++, uIndex++)
+    {
+      const HistoryRecord &oRecord = aBlock[uRecord];
+      char acTmp[8] = "null";
+      char acHum[8] = "null";
+      if (oRecord.iTmp != HISTORY_NONE)
+      {
+        snprintf(acTmp, sizeof(acTmp), "%.2f", oRecord.iTmp / 100.0f);
+      }
+      if (oRecord.iHum != HISTORY_NONE)
+      {
+        snprintf(acHum, sizeof(acHum), "%.2f", oRecord.iHum / 100.0f);
+      }
+      response->printf("%s[%u,%u,%s,%s]", uSent++ ? "," : "", oRecord.uSeq, oRecord.uEpoch, acTmp, acHum);
+      uLast = oRecord.uSeq;
+    }
+  }
+  free(aBlock);
+  response->printf("],\"last\":%u,\"more\":%s}", uLast, (uIndex < uEnd) ? "true" : "false");
+  addNextSampleHeader(response);
+  request->send(response);
+} // void handleSamples(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// History record uIndex through the block cache of a series (sequential
+// reads), nullptr if it was overwritten meanwhile
+const HistoryRecord *readSeriesRecord(uint32_t uIndex, SeriesContext *pSeries)
+{
+  if (uIndex - pSeries->uBlockFirst >= pSeries->uBlockCount)
+  {
+    pSeries->uBlockFirst = uIndex;
+    pSeries->uBlockCount = readHistoryBlock(uIndex, pSeries->aBlock);
+    if (pSeries->uBlockCount == 0)
+    {
+      return nullptr;
+    }
+  }
+  return &pSeries->aBlock[uIndex - pSeries->uBlockFirst];
+} // const HistoryRecord *readSeriesRecord(uint32_t uIndex, SeriesContext *pSeries)
+//-------------------------------------
+
+// LTTB reader over the history store : x in seconds since the first point
+// (relative, to keep the float resolution), y the value of the channel
+bool readSeriesPoint(uint32_t uIndex, float &fX, float &fY, void *pContext)
+{
+  SeriesContext *pSeries = (SeriesContext *)pContext;
+  const HistoryRecord *pRecord = readSeriesRecord(uIndex, pSeries);
+  if (pRecord == nullptr)
+  {
+    return false;
+  }
+  int16_t iValue = (pSeries->eChannel == STATS_HUM) ? pRecord->iHum : pRecord->iTmp;
+  if (iValue == HISTORY_NONE)
+  {
+    return false;
+  }
+  fX = (float)(pRecord->uEpoch - pSeries->uEpoch0);
+  fY = iValue / 100.0f;
+  return true;
+} // bool readSeriesPoint(uint32_t uIndex, float &fX, float &fY, void *pContext)
+//-------------------------------------
+
+// Long-term history from the flash sample log : records of [?from=, ?to=]
+// (UTC epochs, default the whole log) aggregated per ?step= seconds
+// (default HISTORY_DEFAULT_STEP, widened to at most HISTORY_MAX_STEPS steps),
+// as [start,count,mean,min,max] per channel for every non-empty step. Old
+// ranges come from the aggregated retention tiers. Sent as a chunked
+// response (see fillHistory()) : the body is never held in RAM.
+void handleHistory(AsyncWebServerRequest *request)
+{
+  uint32_t uOldest = UINT32_MAX;
+  uint32_t uNewest = 0;
+  FlashLogStats oTier;
+  for (uint8_t uTier = 0; getFlashLogStats(uTier, oTier); uTier++)
+  {
+    if (oTier.uRecords != 0)
+    {
+      uOldest = (oTier.uOldestEpoch < uOldest) ? oTier.uOldestEpoch : uOldest;
+      uNewest = (oTier.uNewestEpoch > uNewest) ? oTier.uNewestEpoch : uNewest;
+    }
+  }
+  uint32_t uFrom = request->hasParam("from") ? (uint32_t)request->getParam("from")->value().toInt()
+                                             : (uOldest == UINT32_MAX) ? 0 : uOldest;
+  uint32_t uTo = request->hasParam("to") ? (uint32_t)request->getParam("to")->value().toInt() : uNewest;
+  long lStep = request->hasParam("step") ? request->getParam("step")->value().toInt() : HISTORY_DEFAULT_STEP;
+  uint32_t uStep = (lStep < 1) ? 1 : (uint32_t)lStep;
+  if (uTo > uFrom && (uTo - uFrom) / uStep >= HISTORY_MAX_STEPS)
+  {
+    uStep = (uTo - uFrom) / HISTORY_MAX_STEPS + 1;
+  }
+
+  HistoryContext *pHistory = (HistoryContext *)malloc(sizeof(HistoryContext));
+  if (pHistory == nullptr)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Out of memory");
+    response->addHeader("Retry-After", "5");
+    request->send(response);
+    return;
+  }
+  memset(pHistory, 0, sizeof(HistoryContext));
+  pHistory->ullNext = uFrom;
+  pHistory->uTo = uTo;
+  pHistory->uStep = uStep;
+  pHistory->uLineLen = snprintf(pHistory->acLine, sizeof(pHistory->acLine), "{\"from\":%u,\"to\":%u,\"step\":%u,\"steps\":[",
+                                uFrom, uTo, uStep);
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [pHistory](uint8_t *pBuffer, size_t uMaxLen, size_t uIndex) -> size_t {
+    return fillHistory(pHistory, pBuffer, uMaxLen);
+  });
+  addNextSampleHeader(response);
+  request->onDisconnect([pHistory]() { free(pHistory); }); // sent or aborted
+  request->send(response);
+} // void handleHistory(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Flash sample log : retention tiers (span, flash writes) and compaction throughput
+void handleHistoryStats(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->print("{\"tiers\":[");
+  FlashLogStats oTier;
+  for (uint8_t uTier = 0; getFlashLogStats(uTier, oTier); uTier++)
+  {
+    response->printf("%s{\"step\":%u,\"records\":%u,\"blocks\":%u,\"capacity\":%u,\"oldest\":%u,\"newest\":%u,"
+                     "\"appended\":%u,\"bytesWritten\":%u,\"erases\":%u,\"errors\":%u}",
+                     uTier ? "," : "", oTier.uStep, oTier.uRecords, oTier.uBlocks, oTier.uCapacity, oTier.uOldestEpoch,
+                     oTier.uNewestEpoch, oTier.uAppended, oTier.uBytesWritten, oTier.uErases, oTier.uErrors);
+  }
+  CompactionStats oCompaction;
+  getCompactionStats(oCompaction);
+  uint32_t uBusyMs = (uint32_t)(oCompaction.ullBusyMicros / 1000);
+  response->printf("],\"compaction\":{\"slices\":%u,\"recordsRead\":%u,\"aggregates\":%u,\"busyMs\":%u,"
+                   "\"maxSliceUs\":%u,\"backlog\":%u,\"recordsPerSecond\":%u}}",
+                   oCompaction.uSlices, oCompaction.uRecordsRead, oCompaction.uAggregates, uBusyMs,
+                   oCompaction.uMaxSliceMicros, oCompaction.uBacklog,
+                   uBusyMs ? (uint32_t)(oCompaction.uRecordsRead * 1000ULL / uBusyMs) : 0);
+  request->send(response);
+} // void handleHistoryStats(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Bulk export of the flash sample log : records of tier ?tier= (0 : raw
+// samples, default, 1 and 2 : aggregates) in [?from=, ?to=] (UTC epochs,
+// default everything) as ?format=csv (default), ndjson or bin, gzip
+// compressed on the fly when the client accepts it (unless ?gzip=0). Sent
+// as a chunked response, one export at a time : 503 with Retry-After while
+// another one runs, 404 without a flash log or records in the tier.
+void handleExport(AsyncWebServerRequest *request)
+{
+  static const char *const acContentTypes[] = {"text/csv", "application/x-ndjson", "application/octet-stream"};
+  static const char *const acFileNames[] = {"attachment; filename=\"history.csv\"",
+                                            "attachment; filename=\"history.ndjson\"",
+                                            "attachment; filename=\"history.bin\""};
+  String sFormat = request->hasParam("format") ? request->getParam("format")->value() : String("csv");
+  ExportFormat eFormat = (sFormat == "ndjson") ? EXPORT_NDJSON : (sFormat == "bin") ? EXPORT_BINARY : EXPORT_CSV;
+  long lTier = request->hasParam("tier") ? request->getParam("tier")->value().toInt() : 0;
+  if (lTier < 0 || lTier >= FLOG_TIER_COUNT)
+  {
+    request->send(400, "text/plain", "Bad tier");
+    return;
+  }
+  uint32_t uFrom = request->hasParam("from") ? (uint32_t)request->getParam("from")->value().toInt() : 0;
+  uint32_t uTo = request->hasParam("to") ? (uint32_t)request->getParam("to")->value().toInt() : UINT32_MAX;
+  bool bGzip = request->hasHeader("Accept-Encoding") && acceptsEncoding(request->header("Accept-Encoding").c_str(), "gzip") &&
+               !(request->hasParam("gzip") && request->getParam("gzip")->value() == "0");
+
+  uint32_t uId;
+  ExportResult eResult = beginExport(eFormat, (uint8_t)lTier, uFrom, uTo, bGzip, uId);
+  if (eResult == EXPORT_BUSY)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Another export is running");
+    response->addHeader("Retry-After", "10");
+    request->send(response);
+    return;
+  }
+  if (eResult != EXPORT_STARTED)
+  {
+    request->send((eResult == EXPORT_BAD_TIER) ? 400 : 404, "text/plain",
+                  (eResult == EXPORT_NO_LOG) ? "No flash log" : (eResult == EXPORT_EMPTY) ? "No records in this tier yet" : "Bad tier");
+    return;
+  }
+  AsyncWebServerResponse *response = request->beginChunkedResponse(acContentTypes[eFormat], [uId](uint8_t *pBuffer, size_t uMaxLen, size_t uIndex) -> size_t {
+    return fillExport(uId, pBuffer, uMaxLen);
+  });
+  if (bGzip)
+  {
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("Vary", "Accept-Encoding"); // the encoding depends on it, gzip or not
+  response->addHeader("Content-Disposition", acFileNames[eFormat]);
+  request->onDisconnect([uId]() { endExport(uId); }); // release the export slot, whether sent or aborted
+  request->send(response);
+} // void handleExport(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Export counters : compression ratio and formatting / compression throughput
+void handleExportStats(AsyncWebServerRequest *request)
+{
+  ExportStats oStats;
+  getExportStats(oStats);
+  uint32_t uBusyMs = (uint32_t)(oStats.ullBusyMicros / 1000);
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"started\":%u,\"completed\":%u,\"refused\":%u,\"records\":%u,\"bytesIn\":%u,\"bytesOut\":%u,"
+                   "\"ratio\":%.2f,\"busyMs\":%u,\"maxChunkUs\":%u,\"kBytesPerSecond\":%u}",
+                   oStats.uStarted, oStats.uCompleted, oStats.uRefused, oStats.uRecords, (uint32_t)oStats.ullBytesIn,
+                   (uint32_t)oStats.ullBytesOut, oStats.ullBytesOut ? (double)oStats.ullBytesIn / oStats.ullBytesOut : 0.0,
+                   uBusyMs, oStats.uMaxChunkMicros, uBusyMs ? (uint32_t)(oStats.ullBytesIn / uBusyMs) : 0);
+  request->send(response);
+} // void handleExportStats(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Next bytes of an /api/history response (at most uMaxLen), 0 once it is
+// over : the text left over from the previous chunk, then the steps of a
+// query resumed at the first step not sent, then the closing text
+size_t fillHistory(HistoryContext *pHistory, uint8_t *pBuffer, size_t uMaxLen)
+{
+  pHistory->pBuffer = pBuffer;
+  pHistory->uMaxLen = uMaxLen;
+  pHistory->uLen = 0;
+  while (pHistory->uLen < uMaxLen)
+  {
+    if (pHistory->uLineSent < pHistory->uLineLen)
+    {
+      size_t uCopy = min(pHistory->uLineLen - pHistory->uLineSent, uMaxLen - pHistory->uLen);
+      memcpy(pBuffer + pHistory->uLen, pHistory->acLine + pHistory->uLineSent, uCopy);
+      pHistory->uLineSent += uCopy;
+      pHistory->uLen += uCopy;
+      continue;
+    }
+    if (pHistory->bDone)
+    {
+      break;
+    }
+    if (!pHistory->bStepsDone)
+    {
+      FlogQueryStats oQuery;
+      pHistory->bFull = false;
+      queryFlashLog((uint32_t)pHistory->ullNext, pHistory->uTo, pHistory->uStep, printHistoryStep, pHistory, &oQuery,
+                    pHistory->uQueries ? (int8_t)pHistory->oQuery.uTier : -1); // same tiers as one query
+      pHistory->oQuery.uTier = (pHistory->uQueries++ == 0) ? oQuery.uTier : pHistory->oQuery.uTier;
+      pHistory->oQuery.uBlocksRead += oQuery.uBlocksRead;
+      pHistory->oQuery.uRecordsRead += oQuery.uRecordsRead;
+      pHistory->bStepsDone = !pHistory->bFull || pHistory->ullNext > pHistory->uTo;
+      continue;
+    }
+    pHistory->uLineLen = snprintf(pHistory->acLine, sizeof(pHistory->acLine), "],\"tier\":%u,\"blocksRead\":%u,\"recordsRead\":%u}",
+                                  pHistory->oQuery.uTier, pHistory->oQuery.uBlocksRead, pHistory->oQuery.uRecordsRead);
+    pHistory->uLineSent = 0;
+    pHistory->bDone = true;
+  }
+  return pHistory->uLen;
+} // size_t fillHistory(HistoryContext *pHistory, uint8_t *pBuffer, size_t uMaxLen)
+//-------------------------------------
+
+// queryFlashLog() handler of /api/history : one step into the chunk, or
+// kept for the next chunk (and the query stopped) if it does not fit
+bool printHistoryStep(const FlogStep &oStep, void *pContext)
+{
+  HistoryContext *pHistory = (HistoryContext *)pContext;
+  char *pLine = pHistory->acLine;
+  const size_t uSize = sizeof(pHistory->acLine);
+  size_t uLen = snprintf(pLine, uSize, "%s[%u", pHistory->uSteps ? "," : "", oStep.uStart);
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    if (oStep.auCount[uChannel] == 0)
+    {
+      uLen += snprintf(pLine + uLen, uSize - uLen, ",0,null,null,null");
+    }
+    else
+    {
+      uLen += snprintf(pLine + uLen, uSize - uLen, ",%u,%.2f,%.2f,%.2f", oStep.auCount[uChannel],
+                       oStep.afMean[uChannel], oStep.afMin[uChannel], oStep.afMax[uChannel]);
+    }
+  }
+  uLen += snprintf(pLine + uLen, uSize - uLen, "]");
+  pHistory->uSteps++;
+  pHistory->ullNext = (uint64_t)oStep.uStart + pHistory->uStep;
+  if (uLen <= pHistory->uMaxLen - pHistory->uLen)
+  {
+    memcpy(pHistory->pBuffer + pHistory->uLen, pLine, uLen);
+    pHistory->uLen += uLen;
+    return true;
+  }
+  pHistory->uLineLen = uLen;
+  pHistory->uLineSent = 0;
+  pHistory->bFull = true;
+  return false;
+} // bool printHistoryStep(const FlogStep &oStep, void *pContext)
+//-------------------------------------
+
+// ?days= parameter of the quantile endpoints, clamped to 1..QSKETCH_DAYS
+uint8_t requestedDays(AsyncWebServerRequest *request)
+{
+  if (!request->hasParam("days"))
+  {
+    return QSKETCH_DAYS;
+  }
+  long lDays = request->getParam("days")->value().toInt();
+  return (lDays < 1) ? 1 : (lDays > QSKETCH_DAYS) ? QSKETCH_DAYS : (uint8_t)lDays;
+} // uint8_t requestedDays(AsyncWebServerRequest *request)
+//-------------------------------------
+
+// Send the body built by a FAST HTTP writer
+void sendFromWriter(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter)
+{
+  char acBody[WEB_BODY_LEN];
+  pWriter(acBody, sizeof(acBody));
+  request->send(200, pContentType, acBody);
+} // void sendFromWriter(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter)
+//-------------------------------------
+
+// Send measurement data with its age (Age header, seconds) and record the served age
+void sendMeasurementData(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter)
+{
+  char acBody[WEB_BODY_LEN];
+  pWriter(acBody, sizeof(acBody));
+  AsyncWebServerResponse *response = request->beginResponse(200, pContentType, acBody);
+  uint32_t uAgeMs;
+  if (getMeasurementAge(uAgeMs))
+  {
+    recordFreshness(FRESH_SERVED, uAgeMs);
+    response->addHeader("Age", String((unsigned long)(uAgeMs / 1000)));
+  }
+  addNextSampleHeader(response);
+  request->send(response);
+} // void sendMeasurementData(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter)
+//-------------------------------------
+
+// Send data derived from the samples, with the time until it next changes
+void sendSampleData(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter)
+{
+  char acBody[WEB_BODY_LEN];
+  pWriter(acBody, sizeof(acBody));
+  AsyncWebServerResponse *response = request->beginResponse(200, pContentType, acBody);
+  addNextSampleHeader(response);
+  request->send(response);
+} // void sendSampleData(AsyncWebServerRequest *request, const char *pContentType, FastHttpWriter pWriter)
+//-------------------------------------
+
+// X-Next-Sample-Ms header : the page schedules its next fetch just after that
+void addNextSampleHeader(AsyncWebServerResponse *response)
+{
+  response->addHeader("X-Next-Sample-Ms", String((unsigned long)nextSampleMs()));
+} // void addNextSampleHeader(AsyncWebServerResponse *response)
+//-------------------------------------
+
+// ============================== FAST HTTP WRITERS ==============================
+
+size_t writeTemperature(char *pBuffer, size_t uLen)
+{
+  getTemplateValue(TPL_TEMPERATURE, pBuffer, uLen);
+  return strlen(pBuffer);
+} // size_t writeTemperature(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+size_t writeHumidity(char *pBuffer, size_t uLen)
+{
+  getTemplateValue(TPL_HUMIDITY, pBuffer, uLen);
+  return strlen(pBuffer);
+} // size_t writeHumidity(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+size_t writeMeasureTime(char *pBuffer, size_t uLen)
+{
+  getTemplateValue(TPL_MEASURETIME, pBuffer, uLen);
+  return strlen(pBuffer);
+} // size_t writeMeasureTime(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Device clock : UTC epoch and milliseconds into that second (SNTP system
+// clock, 0 until synchronised), local time offset (seconds) and NtpQuality
+// of that same clock (NTP_NONE while epoch is 0)
+size_t writeTime(char *pBuffer, size_t uLen)
+{
+  struct timeval tvNow;
+  gettimeofday(&tvNow, nullptr);
+  uint8_t uQuality = ntpQuality(tvNow.tv_sec);
+  bool bSynced = uQuality != NTP_NONE;
+  size_t uPos = snprintf(pBuffer, uLen, "{\"epoch\":%u,\"ms\":%u,\"offset\":%d,\"ntp\":%u}",
+                         bSynced ? (uint32_t)tvNow.tv_sec : 0, bSynced ? (uint32_t)(tvNow.tv_usec / 1000) : 0,
+                         NTP_TIME_OFFSET, uQuality);
+  return min(uPos, uLen - 1);
+} // size_t writeTime(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Measurement bus counters of one sink ({...}, preceded by a comma but for the first sink),
+// at most BUS_SINK_JSON_LEN - 1 chars, 0 if uSink is not subscribed
+size_t writeSinkStats(uint8_t uSink, char *pBuffer, size_t uLen)
+{
+  MeasurementSinkStats oStats;
+  if (!getSinkStats(uSink, oStats))
+  {
+    return 0;
+  }
+  int iLen = snprintf(pBuffer, uLen,
+                      "%s{\"sink\":\"%.16s\",\"offered\":%u,\"delivered\":%u,\"skipped\":%u,\"dropped\":%u,\"lag\":%u,\"maxLag\":%u}",
+                      uSink ? "," : "", oStats.pName, oStats.uOffered, oStats.uDelivered, oStats.uSkipped,
+                      oStats.uDropped, oStats.uLag, oStats.uMaxLag);
+  return (iLen < 0) ? 0 : min((size_t)iLen, uLen - 1);
+} // size_t writeSinkStats(uint8_t uSink, char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Measurement bus counters, one JSON object per sink (all MBUS_MAX_SINKS
+// fit the FAST HTTP body, a smaller buffer ends on a whole sink)
+static_assert(BUS_STATS_JSON_LEN < FAST_HTTP_BODY_LEN, "FAST_HTTP_BODY_LEN too small for /api/bus");
+size_t writeBusStats(char *pBuffer, size_t uLen)
+{
+  size_t uPos = snprintf(pBuffer, uLen, "[");
+  for (uint8_t uSink = 0; uSink < sinkCount() && uPos + BUS_SINK_JSON_LEN < uLen; uSink++)
+  {
+    uPos += writeSinkStats(uSink, pBuffer + uPos, uLen - uPos);
+  }
+  uPos += snprintf(pBuffer + uPos, uLen - uPos, "]");
+  return min(uPos, uLen - 1);
+} // size_t writeBusStats(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Heap and block pool counters : pools as [size,inUse,highWater,hits,misses],
+// then where the sample history ring lives and its capacity
+size_t writeMemoryStats(char *pBuffer, size_t uLen)
+{
+  BlockPoolStats oStats;
+  size_t uPos = snprintf(pBuffer, uLen, "{\"freeHeap\":%u,\"maxBlock\":%u,\"minFreeHeap\":%u,\"oversize\":%u,\"pools\":[",
+                         ESP.getFreeHeap(), ESP.getMaxAllocHeap(), ESP.getMinFreeHeap(), poolOversize());
+  for (uint8_t uClass = 0; getPoolStats(uClass, oStats) && uPos < uLen; uClass++)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s[%u,%u,%u,%u,%u]", uClass ? "," : "",
+                     oStats.uBlockSize, oStats.uInUse, oStats.uHighWater, oStats.uHits, oStats.uMisses);
+  }
+  if (uPos < uLen)
+  {
+    HistoryInfo oHistory;
+    getHistoryInfo(oHistory);
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "],\"history\":{\"memory\":\"%s\",\"capacity\":%u,\"bytes\":%u}}",
+                     (oHistory.eMemory == HISTORY_PSRAM) ? "psram" : "dram", oHistory.uCapacity, oHistory.uBytes);
+  }
+  return min(uPos, uLen - 1);
+} // size_t writeMemoryStats(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Heap fragmentation trend, and in DEBUG builds the HEAP_REPORT_SITES call
+// sites allocating the most bytes (the others only counted, so the body
+// stays within WEB_BODY_LEN and ends on a whole site)
+static_assert(HEAP_TREND_JSON_LEN <= WEB_BODY_LEN, "WEB_BODY_LEN too small for /api/heap");
+size_t writeHeapTrend(char *pBuffer, size_t uLen)
+{
+  HeapTrend oTrend;
+  HeapSite aoSites[HEAP_MAX_SITES];
+  uint8_t uSites = 0;
+  getHeapTrend(oTrend);
+  while (uSites < HEAP_MAX_SITES && getHeapSite(uSites, aoSites[uSites]))
+  {
+    uSites++;
+  }
+  size_t uPos = snprintf(pBuffer, uLen,
+                         "{\"samples\":%u,\"freeHeap\":%u,\"maxBlock\":%u,\"minMaxBlock\":%u,"
+                         "\"fragPermille\":%u,\"slopePerDay\":%.2f,\"rising\":%s,\"sites\":[",
+                         oTrend.uSamples, oTrend.uFreeHeap, oTrend.uMaxBlock, oTrend.uMinMaxBlock,
+                         oTrend.uFragPermille, oTrend.fSlopePerDay, oTrend.bRising ? "true" : "false");
+  uint8_t uWritten = 0;
+  for (; uWritten < uSites && uWritten < HEAP_REPORT_SITES &&
+         uPos + HEAP_SITE_JSON_LEN + HEAP_TREND_TAIL_LEN < uLen;
+       uWritten++)
+  {
+    // Selection : bring the largest remaining site to position uWritten
+    uint8_t uLargest = uWritten;
+    for (uint8_t uSite = uWritten + 1; uSite < uSites; uSite++)
+    {
+      uLargest = (aoSites[uSite].uBytes > aoSites[uLargest].uBytes) ? uSite : uLargest;
+    }
+    HeapSite oSite = aoSites[uLargest];
+    aoSites[uLargest] = aoSites[uWritten];
+    aoSites[uWritten] = oSite;
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s[\"%p\",%u,%u]", uWritten ? "," : "",
+                     oSite.pCaller, oSite.uCount, oSite.uBytes);
+  }
+  uPos += snprintf(pBuffer + uPos, uLen - uPos, "],\"otherSites\":%u}", uSites - uWritten);
+  return min(uPos, uLen - 1);
+} // size_t writeHeapTrend(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Last measurement record (invalid values as null)
+size_t writeMeasurement(char *pBuffer, size_t uLen)
+{
+  Measurement oMeasurement;
+  portENTER_CRITICAL(&muxLastMeasurement);
+  oMeasurement = oLastMeasurement;
+  portEXIT_CRITICAL(&muxLastMeasurement);
+
+  char acAge[12] = "null";
+  char acTmp[12] = "null";
+  char acHum[12] = "null";
+  if (oMeasurement.uSeq != 0)
+  {
+    snprintf(acAge, sizeof(acAge), "%u", (uint32_t)((esp_timer_get_time() - oMeasurement.ullMicros) / 1000));
+  }
+  if (oMeasurement.uFlags & MEAS_TMP_VALID)
+  {
+    snprintf(acTmp, sizeof(acTmp), "%.2f", oMeasurement.fTmp);
+  }
+  if (oMeasurement.uFlags & MEAS_HUM_VALID)
+  {
+    snprintf(acHum, sizeof(acHum), "%.2f", oMeasurement.fHum);
+  }
+  size_t uPos = snprintf(pBuffer, uLen,
+                         "{\"seq\":%u,\"micros\":%lld,\"epoch\":%u,\"time\":\"%s\",\"readMicros\":%u,"
+                         "\"retries\":%u,\"ntp\":%u,\"flags\":%u,\"ageMs\":%s,\"temperature\":%s,\"humidity\":%s}",
+                         oMeasurement.uSeq, (long long)oMeasurement.ullMicros, oMeasurement.uEpoch,
+                         oMeasurement.acTime, oMeasurement.uReadMicros, oMeasurement.uRetries,
+                         oMeasurement.uNtpQuality, oMeasurement.uFlags, acAge, acTmp, acHum);
+  return min(uPos, uLen - 1);
+} // size_t writeMeasurement(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Freshness histograms : bucket bounds (ms, last one unbounded), then per kind
+// count, mean, max, last and bucket counts
+size_t writeFreshness(char *pBuffer, size_t uLen)
+{
+  static const char *apKindNames[FRESH_KIND_COUNT] = {"served", "displayed"};
+  FreshnessHistogram oHistogram;
+  size_t uPos = snprintf(pBuffer, uLen, "{\"boundsMs\":[");
+  for (uint8_t uBucket = 0; uBucket < FRESH_BUCKET_COUNT - 1 && uPos < uLen; uBucket++)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s%u", uBucket ? "," : "", freshnessBound(uBucket));
+  }
+  for (uint8_t uKind = 0; uKind < FRESH_KIND_COUNT && uPos < uLen; uKind++)
+  {
+    getFreshness((FreshnessKind)uKind, oHistogram);
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "],\"%s\":{\"count\":%u,\"meanMs\":%u,\"maxMs\":%u,\"lastMs\":%u,\"buckets\":[",
+                     apKindNames[uKind], oHistogram.uCount, oHistogram.uMeanMs, oHistogram.uMaxMs, oHistogram.uLastMs);
+    for (uint8_t uBucket = 0; uBucket < FRESH_BUCKET_COUNT && uPos < uLen; uBucket++)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s%u", uBucket ? "," : "", oHistogram.auBuckets[uBucket]);
+    }
+    if (uPos < uLen)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "]}");
+    }
+  }
+  if (uPos < uLen)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "}");
+  }
+  return min(uPos, uLen - 1);
+} // size_t writeFreshness(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Age (records the served age) and X-Next-Sample-Ms headers of the
+// measurement data endpoints
+size_t writeAgeHeader(char *pBuffer, size_t uLen)
+{
+  uint32_t uAgeMs;
+  size_t uPos = 0;
+  if (getMeasurementAge(uAgeMs))
+  {
+    recordFreshness(FRESH_SERVED, uAgeMs);
+    uPos = snprintf(pBuffer, uLen, "\r\nAge: %u", uAgeMs / 1000);
+    uPos = min(uPos, uLen - 1);
+  }
+  return uPos + writeNextSampleHeader(pBuffer + uPos, uLen - uPos);
+} // size_t writeAgeHeader(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Time until the next sample (see addNextSampleHeader())
+size_t writeNextSampleHeader(char *pBuffer, size_t uLen)
+{
+  size_t uPos = snprintf(pBuffer, uLen, "\r\nX-Next-Sample-Ms: %u", nextSampleMs());
+  return min(uPos, uLen - 1);
+} // size_t writeNextSampleHeader(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Sample clock : period, next slot, missed slots, then the jitter histograms
+// (bucket bounds in us, last one unbounded) of the timer alarm and of the
+// sensor read start after the scheduled slot time
+size_t writeSampling(char *pBuffer, size_t uLen)
+{
+  static const char *apKindNames[JITTER_KIND_COUNT] = {"alarm", "sample"};
+  SampleSlot oSlot;
+  SampleJitter oJitter;
+  getNextSlot(oSlot);
+  int64_t llNextMicros = (int64_t)(oSlot.ullMicros - (uint64_t)esp_timer_get_time());
+  size_t uPos = snprintf(pBuffer, uLen, "{\"periodS\":%u,\"synced\":%s,\"nextEpoch\":%u,\"nextInMs\":%d,\"missed\":%u,\"boundsUs\":[",
+                         DHT_MEASURETIME / 1000, oSlot.bSynced ? "true" : "false", oSlot.uEpoch,
+                         (int)(llNextMicros / 1000), missedSlots());
+  for (uint8_t uBucket = 0; uBucket < JITTER_BUCKET_COUNT - 1 && uPos < uLen; uBucket++)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s%u", uBucket ? "," : "", jitterBound(uBucket));
+  }
+  if (uPos < uLen)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "]");
+  }
+  for (uint8_t uKind = 0; uKind < JITTER_KIND_COUNT && uPos < uLen; uKind++)
+  {
+    getSampleJitter((JitterKind)uKind, oJitter);
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, ",\"%s\":{\"count\":%u,\"meanUs\":%u,\"maxUs\":%u,\"buckets\":[",
+                     apKindNames[uKind], oJitter.uCount, oJitter.uMeanMicros, oJitter.uMaxMicros);
+    for (uint8_t uBucket = 0; uBucket < JITTER_BUCKET_COUNT && uPos < uLen; uBucket++)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s%u", uBucket ? "," : "", oJitter.auBuckets[uBucket]);
+    }
+    if (uPos < uLen)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "]}");
+    }
+  }
+  if (uPos < uLen)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "}");
+  }
+  return min(uPos, uLen - 1);
+} // size_t writeSampling(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Sliding-window statistics : per window its length, then per channel
+// [count,mean,variance,min,max] (null before the first valid sample), and
+// the engine update cost
+size_t writeStats(char *pBuffer, size_t uLen)
+{
+  static const char *apChannelNames[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+  WindowStats oStats;
+  StatsCost oCost;
+  getStatsCost(oCost);
+  size_t uPos = snprintf(pBuffer, uLen, "{\"samples\":%u,\"updateUs\":%u,\"meanUpdateUs\":%u,\"maxUpdateUs\":%u,\"windows\":[",
+                         oCost.uSamples, oCost.uLastMicros, oCost.uMeanMicros, oCost.uMaxMicros);
+  for (uint8_t uWindow = 0; uWindow < RSTATS_WINDOW_COUNT && uPos < uLen; uWindow++)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s{\"seconds\":%u", uWindow ? "," : "",
+                     statsWindowLength(uWindow) * (DHT_MEASURETIME / 1000));
+    for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT && uPos < uLen; uChannel++)
+    {
+      if (getWindowStats(uWindow, (StatsChannel)uChannel, oStats))
+      {
+        uPos += snprintf(pBuffer + uPos, uLen - uPos, ",\"%s\":[%u,%.2f,%.3f,%.2f,%.2f]", apChannelNames[uChannel],
+                         oStats.uCount, oStats.fMean, oStats.fVariance, oStats.fMin, oStats.fMax);
+      }
+      else
+      {
+        uPos += snprintf(pBuffer + uPos, uLen - uPos, ",\"%s\":null", apChannelNames[uChannel]);
+      }
+    }
+    if (uPos < uLen)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "}");
+    }
+  }
+  if (uPos < uLen)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "]}");
+  }
+  return min(uPos, uLen - 1);
+} // size_t writeStats(char *pBuffer, size_t uLen)
+//-------------------------------------
+
+// Trends : horizons (s), then per channel level, slope (per hour), forecasts
+// at the horizons and seconds until the high / low thresholds are crossed
+// (null if not within TREND_ETA_MAX), null while warming up
+size_t writeTrend(char *pBuffer, size_t uLen)
+{
+  static const char *apChannelNames[STATS_CHANNEL_COUNT] = {"temperature", "humidity"};
+  ChannelTrend oTrend;
+  size_t uPos = snprintf(pBuffer, uLen, "{\"horizons\":[");
+  for (uint8_t uHorizon = 0; uHorizon < TREND_HORIZON_COUNT && uPos < uLen; uHorizon++)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s%u", uHorizon ? "," : "", trendHorizon(uHorizon));
+  }
+  if (uPos < uLen)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "]");
+  }
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT && uPos < uLen; uChannel++)
+  {
+    if (!getTrend((StatsChannel)uChannel, oTrend))
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, ",\"%s\":null", apChannelNames[uChannel]);
+      continue;
+    }
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, ",\"%s\":{\"level\":%.2f,\"slopePerHour\":%.2f,\"forecasts\":[",
+                     apChannelNames[uChannel], oTrend.fLevel, oTrend.fSlopePerHour);
+    for (uint8_t uHorizon = 0; uHorizon < TREND_HORIZON_COUNT && uPos < uLen; uHorizon++)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "%s%.2f", uHorizon ? "," : "", oTrend.afForecasts[uHorizon]);
+    }
+    char acHighEta[12] = "null";
+    char acLowEta[12] = "null";
+    if (oTrend.iHighEta >= 0)
+    {
+      snprintf(acHighEta, sizeof(acHighEta), "%d", oTrend.iHighEta);
+    }
+    if (oTrend.iLowEta >= 0)
+    {
+      snprintf(acLowEta, sizeof(acLowEta), "%d", oTrend.iLowEta);
+    }
+    if (uPos < uLen)
+    {
+      uPos += snprintf(pBuffer + uPos, uLen - uPos, "],\"high\":%.1f,\"highEta\":%s,\"low\":%.1f,\"lowEta\":%s}",
+                       oTrend.fHigh, acHighEta, oTrend.fLow, acLowEta);
+    }
+  }
+  if (uPos < uLen)
+  {
+    uPos += snprintf(pBuffer + uPos, uLen - uPos, "}");
+  }
+  return min(uPos, uLen - 1);
+} // size_t writeTrend(char *pBuffer, size_t uLen)
 //-------------------------------------
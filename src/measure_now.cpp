@@ -0,0 +1,112 @@
+// Coalesced on-demand measurement requests (see measure_now.h)
+
+#include "measure_now.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define NOW_LOCK() portENTER_CRITICAL(&muxMeasureNow)
+#define NOW_UNLOCK() portEXIT_CRITICAL(&muxMeasureNow)
+#else
+#include <atomic>
+#define NOW_LOCK()                                              \
+  while (flagMeasureNow.test_and_set(std::memory_order_acquire)) \
+  {                                                              \
+  }
+#define NOW_UNLOCK() flagMeasureNow.clear(std::memory_order_release)
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Last sample, last sensor read and pending request, updated together under the lock
+static uint32_t uLastSeq = 0;
+static unsigned long ulLastMillis = 0; // last sensor read
+static bool bHasSample = false;
+static bool bPending = false;
+
+static uint32_t uCachedCount = 0;
+static uint32_t uScheduledCount = 0;
+static uint32_t uJoinedCount = 0;
+
+#ifdef ARDUINO
+static portMUX_TYPE muxMeasureNow = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagMeasureNow = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+void beginMeasureNow(uint32_t uSeq)
+{
+  NOW_LOCK();
+  uLastSeq = uSeq;
+  NOW_UNLOCK();
+} // void beginMeasureNow(uint32_t uSeq)
+//-------------------------------------
+
+MeasureNowResult requestMeasureNow(unsigned long ulMillis, uint32_t &uSeq)
+{
+  MeasureNowResult eResult;
+
+  NOW_LOCK();
+  if (bPending)
+  {
+    eResult = MEASURE_NOW_JOINED;
+    uSeq = uLastSeq + 1;
+    uJoinedCount++;
+  }
+  else if (bHasSample && (unsigned long)(ulMillis - ulLastMillis) < MEASURE_NOW_MIN_INTERVAL)
+  {
+    eResult = MEASURE_NOW_CACHED;
+    uSeq = uLastSeq;
+    uCachedCount++;
+  }
+  else
+  {
+    eResult = MEASURE_NOW_SCHEDULED;
+    uSeq = uLastSeq + 1;
+    bPending = true;
+    uScheduledCount++;
+  }
+  NOW_UNLOCK();
+  return eResult;
+} // MeasureNowResult requestMeasureNow(unsigned long ulMillis, uint32_t &uSeq)
+//-------------------------------------
+
+bool measureNowPending(unsigned long ulMillis)
+{
+  NOW_LOCK();
+  bool bRead = bPending && (!bHasSample || (unsigned long)(ulMillis - ulLastMillis) >= MEASURE_NOW_MIN_INTERVAL);
+  NOW_UNLOCK();
+  return bRead;
+} // bool measureNowPending(unsigned long ulMillis)
+//-------------------------------------
+
+bool sensorReadAllowed(unsigned long ulMillis)
+{
+  NOW_LOCK();
+  bool bRead = !bHasSample || (unsigned long)(ulMillis - ulLastMillis) >= MEASURE_NOW_MIN_INTERVAL;
+  NOW_UNLOCK();
+  return bRead;
+} // bool sensorReadAllowed(unsigned long ulMillis)
+//-------------------------------------
+
+void measureNowTaken(uint32_t uSeq, unsigned long ulReadMillis)
+{
+  NOW_LOCK();
+  uLastSeq = uSeq;
+  ulLastMillis = ulReadMillis;
+  bHasSample = true;
+  bPending = false;
+  NOW_UNLOCK();
+} // void measureNowTaken(uint32_t uSeq, unsigned long ulReadMillis)
+//-------------------------------------
+
+void getMeasureNowStats(uint32_t &uCached, uint32_t &uScheduled, uint32_t &uJoined)
+{
+  NOW_LOCK();
+  uCached = uCachedCount;
+  uScheduled = uScheduledCount;
+  uJoined = uJoinedCount;
+  NOW_UNLOCK();
+} // void getMeasureNowStats(uint32_t &uCached, uint32_t &uScheduled, uint32_t &uJoined)
+//-------------------------------------
@@ -0,0 +1,174 @@
+// In-firmware publish/subscribe bus for measurement records (see measurement_bus.h)
+
+#include "measurement_bus.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define MBUS_TASK_STACK 4096 // delivery task stack (sink handlers run on it)
+#define MBUS_TASK_PRIORITY 1 // as loopTask (time-sliced with loop()), below async_tcp and lwIP
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// One subscribed sink
+struct MeasurementSink
+{
+  const char *pName;
+  SinkPolicy ePolicy;
+  uint8_t uDecimation;
+  uint8_t uDecimationCount; // producer side
+  MeasurementHandler pHandler;
+  SpscRing<Measurement, MBUS_QUEUE_LEN> oQueue;
+  std::atomic<uint32_t> uOffered;   // producer side
+  std::atomic<uint32_t> uDropped;   // producer side
+  std::atomic<uint32_t> uDelivered; // consumer side
+  std::atomic<uint32_t> uSkipped;   // producer (decimation) + consumer (latest-only) side
+  std::atomic<uint32_t> uMaxLag;    // producer side
+};
+
+static MeasurementSink aSinks[MBUS_MAX_SINKS];
+static uint8_t uSinkCount = 0;
+
+#ifdef ARDUINO
+static TaskHandle_t hBusTask = nullptr;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+int subscribeMeasurements(const char *pName, SinkPolicy ePolicy, uint8_t uDecimation, MeasurementHandler pHandler)
+{
+  if (uSinkCount >= MBUS_MAX_SINKS)
+  {
+    return -1;
+  }
+  MeasurementSink &oSink = aSinks[uSinkCount];
+  oSink.pName = pName;
+  oSink.ePolicy = ePolicy;
+  oSink.uDecimation = (uDecimation == 0) ? 1 : uDecimation;
+  oSink.uDecimationCount = 0;
+  oSink.pHandler = pHandler;
+  return uSinkCount++;
+} // int subscribeMeasurements(...)
+//-------------------------------------
+
+void publishMeasurement(const Measurement &oMeasurement)
+{
+  for (uint8_t uSink = 0; uSink < uSinkCount; uSink++)
+  {
+    MeasurementSink &oSink = aSinks[uSink];
+    oSink.uOffered.fetch_add(1, std::memory_order_relaxed);
+
+    if (oSink.ePolicy == SINK_DECIMATED && oSink.uDecimationCount++ % oSink.uDecimation != 0)
+    {
+      oSink.uSkipped.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    if (!oSink.oQueue.push(oMeasurement))
+    {
+      oSink.uDropped.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    uint32_t uLag = oSink.oQueue.size();
+    if (uLag > oSink.uMaxLag.load(std::memory_order_relaxed))
+    {
+      oSink.uMaxLag.store(uLag, std::memory_order_relaxed);
+    }
+  }
+#ifdef ARDUINO
+  if (hBusTask != nullptr)
+  {
+    xTaskNotifyGive(hBusTask);
+  }
+#endif
+} // void publishMeasurement(const Measurement &oMeasurement)
+//-------------------------------------
+
+uint32_t deliverMeasurements()
+{
+  uint32_t uTotal = 0;
+  Measurement oMeasurement;
+
+  for (uint8_t uSink = 0; uSink < uSinkCount; uSink++)
+  {
+    MeasurementSink &oSink = aSinks[uSink];
+    if (oSink.ePolicy == SINK_LATEST)
+    {
+      // Drain the queue, hand over only the newest record
+      bool bAny = false;
+      while (oSink.oQueue.pop(oMeasurement))
+      {
+        if (bAny)
+        {
+          oSink.uSkipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        bAny = true;
+      }
+      if (bAny)
+      {
+        oSink.pHandler(oMeasurement);
+        oSink.uDelivered.fetch_add(1, std::memory_order_relaxed);
+        uTotal++;
+      }
+    }
+    else
+    {
+      while (oSink.oQueue.pop(oMeasurement))
+      {
+        oSink.pHandler(oMeasurement);
+        oSink.uDelivered.fetch_add(1, std::memory_order_relaxed);
+        uTotal++;
+      }
+    }
+  }
+  return uTotal;
+} // uint32_t deliverMeasurements()
+//-------------------------------------
+
+#ifdef ARDUINO
+// Delivery task : sleeps until a record is published, then feeds the sinks
+static void busTask(void *pParameters)
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    deliverMeasurements();
+  }
+} // static void busTask(void *pParameters)
+//-------------------------------------
+#endif
+
+void beginMeasurementBus()
+{
+#ifdef ARDUINO
+  if (hBusTask == nullptr)
+  {
+    xTaskCreate(busTask, "mbus", MBUS_TASK_STACK, nullptr, MBUS_TASK_PRIORITY, &hBusTask);
+  }
+#endif
+} // void beginMeasurementBus()
+//-------------------------------------
+
+bool getSinkStats(uint8_t uSink, MeasurementSinkStats &oStats)
+{
+  if (uSink >= uSinkCount)
+  {
+    return false;
+  }
+  const MeasurementSink &oSink = aSinks[uSink];
+  oStats.pName = oSink.pName;
+  oStats.uOffered = oSink.uOffered.load(std::memory_order_relaxed);
+  oStats.uDelivered = oSink.uDelivered.load(std::memory_order_relaxed);
+  oStats.uSkipped = oSink.uSkipped.load(std::memory_order_relaxed);
+  oStats.uDropped = oSink.uDropped.load(std::memory_order_relaxed);
+  oStats.uLag = oSink.oQueue.size();
+  oStats.uMaxLag = oSink.uMaxLag.load(std::memory_order_relaxed);
+  return true;
+} // bool getSinkStats(uint8_t uSink, MeasurementSinkStats &oStats)
+//-------------------------------------
+
+uint8_t sinkCount()
+{
+  return uSinkCount;
+} // uint8_t sinkCount()
+//-------------------------------------
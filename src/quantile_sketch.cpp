@@ -0,0 +1,171 @@
+// Streaming quantile sketches of temperature and humidity (see quantile_sketch.h)
+
+#include "quantile_sketch.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define SKETCH_LOCK() portENTER_CRITICAL(&muxSketch)
+#define SKETCH_UNLOCK() portEXIT_CRITICAL(&muxSketch)
+#else
+#include <atomic>
+#define SKETCH_LOCK()                                         \
+  while (flagSketch.test_and_set(std::memory_order_acquire)) \
+  {                                                           \
+  }
+#define SKETCH_UNLOCK() flagSketch.clear(std::memory_order_release)
+#endif
+
+#define SECONDS_PER_DAY 86400UL
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+static const SketchAxis aAxes[STATS_CHANNEL_COUNT] = {
+    {QSKETCH_TMP_MIN, QSKETCH_TMP_STEP, QSKETCH_TMP_BINS},
+    {QSKETCH_HUM_MIN, QSKETCH_HUM_STEP, QSKETCH_HUM_BINS},
+};
+static const uint16_t auOffsets[STATS_CHANNEL_COUNT] = {0, QSKETCH_TMP_BINS};
+
+// One day : both channels, uint16 is enough for 2880 samples per day
+static uint16_t aauDays[QSKETCH_DAYS][QSKETCH_TMP_BINS + QSKETCH_HUM_BINS];
+static uint8_t uToday = 0;      // slot of today in aauDays
+static uint8_t uDaysUsed = 0;   // slots holding data, today included
+static uint32_t uTodayDay = 0;  // day number (epoch / 86400) of today
+
+#ifdef ARDUINO
+static portMUX_TYPE muxSketch = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagSketch = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// Bin of a value (clamped to the axis)
+static uint16_t binOf(const SketchAxis &oAxis, float fValue)
+{
+  float fBin = floorf((fValue - oAxis.fMin) / oAxis.fStep);
+  if (fBin < 0.0f)
+  {
+    return 0;
+  }
+  return (fBin >= oAxis.uBins) ? oAxis.uBins - 1 : (uint16_t)fBin;
+} // static uint16_t binOf(const SketchAxis &oAxis, float fValue)
+//-------------------------------------
+
+// Move today to day uDay, clearing the skipped days (lock held)
+static void rollDay(uint32_t uDay)
+{
+  if (uDaysUsed == 0)
+  {
+    uTodayDay = uDay;
+    uDaysUsed = 1;
+    return;
+  }
+  if (uDay <= uTodayDay)
+  {
+    return; // same day, or the clock stepped back : keep filling today
+  }
+  uint32_t uSteps = uDay - uTodayDay;
+  if (uSteps > QSKETCH_DAYS)
+  {
+    uSteps = QSKETCH_DAYS; // e.g. first NTP sync : everything before is gone
+  }
+  for (uint32_t uStep = 0; uStep < uSteps; uStep++)
+  {
+    uToday = (uToday + 1) % QSKETCH_DAYS;
+    memset(aauDays[uToday], 0, sizeof(aauDays[uToday]));
+  }
+  uDaysUsed = (uDaysUsed + uSteps > QSKETCH_DAYS) ? QSKETCH_DAYS : uDaysUsed + uSteps;
+  uTodayDay = uDay;
+} // static void rollDay(uint32_t uDay)
+//-------------------------------------
+
+void addSketchSample(const Measurement &oMeasurement)
+{
+  if (oMeasurement.uFlags & (MEAS_RESTORED | MEAS_ON_DEMAND))
+  {
+    return;
+  }
+  SKETCH_LOCK();
+  rollDay(oMeasurement.uEpoch / SECONDS_PER_DAY);
+  uint16_t *pDay = aauDays[uToday];
+  if (oMeasurement.uFlags & MEAS_TMP_VALID)
+  {
+    uint16_t &uBin = pDay[auOffsets[STATS_TMP] + binOf(aAxes[STATS_TMP], oMeasurement.fTmp)];
+    uBin += (uBin < UINT16_MAX) ? 1 : 0;
+  }
+  if (oMeasurement.uFlags & MEAS_HUM_VALID)
+  {
+    uint16_t &uBin = pDay[auOffsets[STATS_HUM] + binOf(aAxes[STATS_HUM], oMeasurement.fHum)];
+    uBin += (uBin < UINT16_MAX) ? 1 : 0;
+  }
+  SKETCH_UNLOCK();
+} // void addSketchSample(const Measurement &oMeasurement)
+//-------------------------------------
+
+uint32_t sketchBinCount(StatsChannel eChannel, uint8_t uDays, uint16_t uBin)
+{
+  if (eChannel >= STATS_CHANNEL_COUNT || uBin >= aAxes[eChannel].uBins)
+  {
+    return 0;
+  }
+  uint32_t uCount = 0;
+  SKETCH_LOCK();
+  uint8_t uUsed = (uDays < uDaysUsed) ? uDays : uDaysUsed;
+  for (uint8_t uDay = 0; uDay < uUsed; uDay++)
+  {
+    uCount += aauDays[(uToday + QSKETCH_DAYS - uDay) % QSKETCH_DAYS][auOffsets[eChannel] + uBin];
+  }
+  SKETCH_UNLOCK();
+  return uCount;
+} // uint32_t sketchBinCount(StatsChannel eChannel, uint8_t uDays, uint16_t uBin)
+//-------------------------------------
+
+uint32_t getQuantiles(StatsChannel eChannel, uint8_t uDays, const float *pfQuantiles, uint8_t uCount, float *pfValues)
+{
+  if (eChannel >= STATS_CHANNEL_COUNT)
+  {
+    return 0;
+  }
+  const SketchAxis &oAxis = aAxes[eChannel];
+
+  // Total first, then one cumulative pass for all the quantiles (nearest rank)
+  uint32_t uTotal = 0;
+  for (uint16_t uBin = 0; uBin < oAxis.uBins; uBin++)
+  {
+    uTotal += sketchBinCount(eChannel, uDays, uBin);
+  }
+  if (uTotal == 0)
+  {
+    return 0;
+  }
+  uint32_t uCumul = 0;
+  uint8_t uNext = 0;
+  for (uint16_t uBin = 0; uBin < oAxis.uBins && uNext < uCount; uBin++)
+  {
+    uCumul += sketchBinCount(eChannel, uDays, uBin);
+    while (uNext < uCount && uCumul >= ceilf(pfQuantiles[uNext] * uTotal) && uCumul > 0)
+    {
+      pfValues[uNext++] = oAxis.fMin + (uBin + 0.5f) * oAxis.fStep;
+    }
+  }
+  return uTotal;
+} // uint32_t getQuantiles(StatsChannel eChannel, uint8_t uDays, const float *pfQuantiles, uint8_t uCount, float *pfValues)
+//-------------------------------------
+
+const SketchAxis &sketchAxis(StatsChannel eChannel)
+{
+  return aAxes[(eChannel < STATS_CHANNEL_COUNT) ? eChannel : STATS_TMP];
+} // const SketchAxis &sketchAxis(StatsChannel eChannel)
+//-------------------------------------
+
+uint8_t sketchDays()
+{
+  SKETCH_LOCK();
+  uint8_t uUsed = uDaysUsed;
+  SKETCH_UNLOCK();
+  return uUsed;
+} // uint8_t sketchDays()
+//-------------------------------------
@@ -0,0 +1,273 @@
+// Sliding-window statistics of temperature and humidity (see rolling_stats.h)
+
+#include "rolling_stats.h"
+
+#include <math.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#define STATS_LOCK() portENTER_CRITICAL(&muxStats)
+#define STATS_UNLOCK() portEXIT_CRITICAL(&muxStats)
+#define STATS_MICROS() ((uint64_t)esp_timer_get_time())
+#else
+#include <atomic>
+#include <chrono>
+#define STATS_LOCK()                                         \
+  while (flagStats.test_and_set(std::memory_order_acquire)) \
+  {                                                          \
+  }
+#define STATS_UNLOCK() flagStats.clear(std::memory_order_release)
+#define STATS_MICROS() ((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count())
+#endif
+
+#define STATS_HOLE INT16_MIN // ring value of a missing reading
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+static constexpr uint16_t auLengths[RSTATS_WINDOW_COUNT] = RSTATS_WINDOWS;
+
+// Sum of the window lengths from uWindow on (compile time)
+static constexpr uint32_t sumLengths(uint8_t uWindow)
+{
+  return (uWindow >= RSTATS_WINDOW_COUNT) ? 0 : auLengths[uWindow] + sumLengths(uWindow + 1);
+}
+
+static_assert(auLengths[RSTATS_WINDOW_COUNT - 1] <= RSTATS_RING_LEN, "RSTATS_RING_LEN must hold the largest window");
+
+// Fixed-capacity deque of ring positions, storage carved from auDequePool
+struct PosDeque
+{
+  uint16_t *pItems;
+  uint16_t uCap;
+  uint16_t uFront;
+  uint16_t uSize;
+
+  uint16_t front() const { return pItems[uFront]; }
+  uint16_t back() const { return pItems[(uFront + uSize - 1) % uCap]; }
+  void popFront()
+  {
+    uFront = (uFront + 1) % uCap;
+    uSize--;
+  }
+  void popBack() { uSize--; }
+  void pushBack(uint16_t uPos) { pItems[(uFront + uSize++) % uCap] = uPos; } // never full : holds live samples only
+};
+
+// Running state of one channel over one window
+struct ChannelWindow
+{
+  uint32_t uCount;
+  double dMean; // hundredths
+  double dM2;   // sum of squared deviations (hundredths^2)
+  PosDeque oMin; // increasing values, front = min
+  PosDeque oMax; // decreasing values, front = max
+};
+
+static int16_t aaRing[RSTATS_RING_LEN][STATS_CHANNEL_COUNT]; // values (hundredths)
+static uint32_t uRingCount = 0;                              // samples added, holes included
+static ChannelWindow aaWindows[RSTATS_WINDOW_COUNT][STATS_CHANNEL_COUNT];
+static uint16_t auDequePool[sumLengths(0) * STATS_CHANNEL_COUNT * 2];
+static bool bDequesReady = false;
+
+// Published summary (lock)
+static WindowStats aaSummary[RSTATS_WINDOW_COUNT][STATS_CHANNEL_COUNT];
+static StatsCost oStatsCost = {0, 0, 0, 0};
+static uint64_t ullCostSum = 0;
+
+#ifdef ARDUINO
+static portMUX_TYPE muxStats = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagStats = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// Give every deque its share of the pool
+static void initDeques()
+{
+  uint16_t *pNext = auDequePool;
+  for (uint8_t uWindow = 0; uWindow < RSTATS_WINDOW_COUNT; uWindow++)
+  {
+    for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+    {
+      ChannelWindow &oWin = aaWindows[uWindow][uChannel];
+      oWin.oMin = {pNext, auLengths[uWindow], 0, 0};
+      pNext += auLengths[uWindow];
+      oWin.oMax = {pNext, auLengths[uWindow], 0, 0};
+      pNext += auLengths[uWindow];
+    }
+  }
+  bDequesReady = true;
+} // static void initDeques()
+//-------------------------------------
+
+// Remove the sample at ring position uPos (value iValue) from a window
+static void downdate(ChannelWindow &oWin, uint16_t uPos, int16_t iValue)
+{
+  if (iValue == STATS_HOLE)
+  {
+    return;
+  }
+  oWin.uCount--;
+  if (oWin.uCount == 0)
+  {
+    oWin.dMean = 0.0;
+    oWin.dM2 = 0.0;
+  }
+  else
+  {
+    double dDelta = iValue - oWin.dMean;
+    oWin.dMean -= dDelta / oWin.uCount;
+    oWin.dM2 -= dDelta * (iValue - oWin.dMean);
+    if (oWin.dM2 < 0.0)
+    {
+      oWin.dM2 = 0.0; // rounding
+    }
+  }
+  // The oldest sample of the window is at the front if it is still a min/max candidate
+  if (oWin.oMin.uSize > 0 && oWin.oMin.front() == uPos)
+  {
+    oWin.oMin.popFront();
+  }
+  if (oWin.oMax.uSize > 0 && oWin.oMax.front() == uPos)
+  {
+    oWin.oMax.popFront();
+  }
+} // static void downdate(ChannelWindow &oWin, uint16_t uPos, int16_t iValue)
+//-------------------------------------
+
+// Add the sample at ring position uPos (value iValue) to a window
+static void update(ChannelWindow &oWin, uint16_t uPos, int16_t iValue, uint8_t uChannel)
+{
+  if (iValue == STATS_HOLE)
+  {
+    return;
+  }
+  oWin.uCount++;
+  double dDelta = iValue - oWin.dMean;
+  oWin.dMean += dDelta / oWin.uCount;
+  oWin.dM2 += dDelta * (iValue - oWin.dMean);
+
+  // Older samples dominated by the new one can never be the min/max again
+  while (oWin.oMin.uSize > 0 && aaRing[oWin.oMin.back()][uChannel] >= iValue)
+  {
+    oWin.oMin.popBack();
+  }
+  oWin.oMin.pushBack(uPos);
+  while (oWin.oMax.uSize > 0 && aaRing[oWin.oMax.back()][uChannel] <= iValue)
+  {
+    oWin.oMax.popBack();
+  }
+  oWin.oMax.pushBack(uPos);
+} // static void update(ChannelWindow &oWin, uint16_t uPos, int16_t iValue, uint8_t uChannel)
+//-------------------------------------
+
+// Value in hundredths, STATS_HOLE if invalid or out of the int16 range
+static int16_t toHundredths(float fValue, bool bValid)
+{
+  if (!bValid || isnan(fValue) || fabsf(fValue) >= 327.0f)
+  {
+    return STATS_HOLE;
+  }
+  return (int16_t)lroundf(fValue * 100.0f);
+} // static int16_t toHundredths(float fValue, bool bValid)
+//-------------------------------------
+
+void addStatsSample(const Measurement &oMeasurement)
+{
+  if (oMeasurement.uFlags & (MEAS_RESTORED | MEAS_ON_DEMAND))
+  {
+    return;
+  }
+  uint64_t ullStart = STATS_MICROS();
+  if (!bDequesReady)
+  {
+    initDeques();
+  }
+
+  int16_t aiValues[STATS_CHANNEL_COUNT];
+  aiValues[STATS_TMP] = toHundredths(oMeasurement.fTmp, oMeasurement.uFlags & MEAS_TMP_VALID);
+  aiValues[STATS_HUM] = toHundredths(oMeasurement.fHum, oMeasurement.uFlags & MEAS_HUM_VALID);
+  uint16_t uPos = uRingCount % RSTATS_RING_LEN;
+
+  // Samples leaving the windows first : the largest window's one is overwritten below
+  for (uint8_t uWindow = 0; uWindow < RSTATS_WINDOW_COUNT; uWindow++)
+  {
+    if (uRingCount < auLengths[uWindow])
+    {
+      continue;
+    }
+    uint16_t uOldPos = (uRingCount - auLengths[uWindow]) % RSTATS_RING_LEN;
+    for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+    {
+      downdate(aaWindows[uWindow][uChannel], uOldPos, aaRing[uOldPos][uChannel]);
+    }
+  }
+
+  WindowStats aaNew[RSTATS_WINDOW_COUNT][STATS_CHANNEL_COUNT];
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    aaRing[uPos][uChannel] = aiValues[uChannel];
+    for (uint8_t uWindow = 0; uWindow < RSTATS_WINDOW_COUNT; uWindow++)
+    {
+      ChannelWindow &oWin = aaWindows[uWindow][uChannel];
+      update(oWin, uPos, aiValues[uChannel], uChannel);
+
+      WindowStats &oStats = aaNew[uWindow][uChannel];
+      oStats.uCount = oWin.uCount;
+      oStats.fMean = (float)(oWin.dMean / 100.0);
+      oStats.fVariance = (oWin.uCount == 0) ? 0.0f : (float)(oWin.dM2 / oWin.uCount / 10000.0);
+      oStats.fMin = (oWin.uCount == 0) ? NAN : aaRing[oWin.oMin.front()][uChannel] / 100.0f;
+      oStats.fMax = (oWin.uCount == 0) ? NAN : aaRing[oWin.oMax.front()][uChannel] / 100.0f;
+    }
+  }
+  uRingCount++;
+  uint32_t uMicros = (uint32_t)(STATS_MICROS() - ullStart);
+
+  STATS_LOCK();
+  for (uint8_t uWindow = 0; uWindow < RSTATS_WINDOW_COUNT; uWindow++)
+  {
+    for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+    {
+      aaSummary[uWindow][uChannel] = aaNew[uWindow][uChannel];
+    }
+  }
+  oStatsCost.uSamples++;
+  oStatsCost.uLastMicros = uMicros;
+  if (uMicros > oStatsCost.uMaxMicros)
+  {
+    oStatsCost.uMaxMicros = uMicros;
+  }
+  ullCostSum += uMicros;
+  oStatsCost.uMeanMicros = (uint32_t)(ullCostSum / oStatsCost.uSamples);
+  STATS_UNLOCK();
+} // void addStatsSample(const Measurement &oMeasurement)
+//-------------------------------------
+
+bool getWindowStats(uint8_t uWindow, StatsChannel eChannel, WindowStats &oStats)
+{
+  if (uWindow >= RSTATS_WINDOW_COUNT || eChannel >= STATS_CHANNEL_COUNT)
+  {
+    return false;
+  }
+  STATS_LOCK();
+  oStats = aaSummary[uWindow][eChannel];
+  STATS_UNLOCK();
+  return oStats.uCount > 0;
+} // bool getWindowStats(uint8_t uWindow, StatsChannel eChannel, WindowStats &oStats)
+//-------------------------------------
+
+uint16_t statsWindowLength(uint8_t uWindow)
+{
+  return (uWindow < RSTATS_WINDOW_COUNT) ? auLengths[uWindow] : 0;
+} // uint16_t statsWindowLength(uint8_t uWindow)
+//-------------------------------------
+
+void getStatsCost(StatsCost &oCost)
+{
+  STATS_LOCK();
+  oCost = oStatsCost;
+  STATS_UNLOCK();
+} // void getStatsCost(StatsCost &oCost)
+//-------------------------------------
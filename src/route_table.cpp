@@ -0,0 +1,59 @@
+// Route table with constant-time dispatch (see route_table.h)
+
+#include "route_table.h"
+
+RouteTable::RouteTable(const Route *pRoutes, uint8_t uCount)
+    : _pRoutes(pRoutes), _uCount(uCount)
+{
+} // RouteTable::RouteTable(const Route *pRoutes, uint8_t uCount)
+//-------------------------------------
+
+bool RouteTable::begin()
+{
+  const Route *pDuplicate = nullptr;
+  if (!_oIndex.begin(_pRoutes, _uCount, &pDuplicate))
+  {
+    if (pDuplicate != nullptr)
+    {
+      Serial.print("Duplicate route : ");
+      Serial.println(pDuplicate->pPath);
+    }
+    return false;
+  }
+  return true;
+} // bool RouteTable::begin()
+//-------------------------------------
+
+const Route *RouteTable::find(const char *pPath) const
+{
+  return _oIndex.find(pPath);
+} // const Route *RouteTable::find(const char *pPath) const
+//-------------------------------------
+
+// As AsyncCallbackWebHandler : a handled request keeps all its headers (the
+// server drops the headers no handler declared interesting)
+bool RouteTable::canHandle(AsyncWebServerRequest *request)
+{
+  const Route *pRoute = find(request->url().c_str());
+  if (pRoute == nullptr || !(pRoute->uMethod & request->method()))
+  {
+    return false;
+  }
+  request->addInterestingHeader("ANY");
+  return true;
+} // bool RouteTable::canHandle(AsyncWebServerRequest *request)
+//-------------------------------------
+
+void RouteTable::handleRequest(AsyncWebServerRequest *request)
+{
+  const Route *pRoute = find(request->url().c_str());
+  if (pRoute != nullptr)
+  {
+    pRoute->pHandler(request);
+  }
+  else
+  {
+    request->send(404);
+  }
+} // void RouteTable::handleRequest(AsyncWebServerRequest *request)
+//-------------------------------------
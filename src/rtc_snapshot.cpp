@@ -0,0 +1,77 @@
+// Last measurement snapshot in RTC slow memory (see rtc_snapshot.h)
+
+#include "rtc_snapshot.h"
+#include "crc32.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h> // RTC_NOINIT_ATTR
+#else
+#define RTC_NOINIT_ATTR
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Not initialized at boot : random after power-on, kept over other resets
+RTC_NOINIT_ATTR static RtcSnapshot oSnapshot;
+
+// ============================== FUNCTIONS ==============================
+
+static bool snapshotValid()
+{
+  return oSnapshot.uMagic == RTC_SNAPSHOT_MAGIC && oSnapshot.uSize == sizeof(RtcSnapshot) &&
+         oSnapshot.uCrc == crc32(&oSnapshot, offsetof(RtcSnapshot, uCrc));
+} // static bool snapshotValid()
+//-------------------------------------
+
+void saveRtcSnapshot(const Measurement &oMeasurement)
+{
+  uint32_t uRestoreCount = snapshotValid() ? oSnapshot.uRestoreCount : 0;
+  oSnapshot.uMagic = RTC_SNAPSHOT_MAGIC;
+  oSnapshot.uSize = sizeof(RtcSnapshot);
+  oSnapshot.uRestoreCount = uRestoreCount;
+  oSnapshot.oMeasurement = oMeasurement;
+  oSnapshot.uCrc = crc32(&oSnapshot, offsetof(RtcSnapshot, uCrc));
+} // void saveRtcSnapshot(const Measurement &oMeasurement)
+//-------------------------------------
+
+bool restoreRtcSnapshot(Measurement &oMeasurement, uint32_t uEpochNow, uint64_t ullMicrosNow)
+{
+  if (!snapshotValid())
+  {
+    memset(&oSnapshot, 0, sizeof(oSnapshot)); // power-on : forget the random content
+    return false;
+  }
+  oMeasurement = oSnapshot.oMeasurement;
+  oMeasurement.uFlags |= MEAS_RESTORED;
+
+  // Rebase the sample time on this boot : the esp_timer restarted from 0
+  uint64_t ullAgeMicros = 0;
+  if (uEpochNow != 0 && oMeasurement.uNtpQuality != NTP_NONE && uEpochNow >= oMeasurement.uEpoch)
+  {
+    ullAgeMicros = (uint64_t)(uEpochNow - oMeasurement.uEpoch) * 1000000ULL;
+  }
+  oMeasurement.ullMicros = ullMicrosNow - ullAgeMicros;
+  oMeasurement.ulMillis = 0;
+
+  oSnapshot.uRestoreCount++;
+  oSnapshot.uCrc = crc32(&oSnapshot, offsetof(RtcSnapshot, uCrc));
+  return true;
+} // bool restoreRtcSnapshot(Measurement &oMeasurement, uint32_t uEpochNow, uint64_t ullMicrosNow)
+//-------------------------------------
+
+uint32_t rtcRestoreCount()
+{
+  return snapshotValid() ? oSnapshot.uRestoreCount : 0;
+} // uint32_t rtcRestoreCount()
+//-------------------------------------
+
+#ifndef ARDUINO
+RtcSnapshot &rtcSnapshotMemory()
+{
+  return oSnapshot;
+} // RtcSnapshot &rtcSnapshotMemory()
+//-------------------------------------
+#endif
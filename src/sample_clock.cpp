@@ -0,0 +1,264 @@
+// Wall-clock aligned sample clock (see sample_clock.h)
+
+#include "sample_clock.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#define CLOCK_LOCK() portENTER_CRITICAL(&muxSampleClock)
+#define CLOCK_UNLOCK() portEXIT_CRITICAL(&muxSampleClock)
+#else
+#include <atomic>
+#define CLOCK_LOCK()                                             \
+  while (flagSampleClock.test_and_set(std::memory_order_acquire)) \
+  {                                                               \
+  }
+#define CLOCK_UNLOCK() flagSampleClock.clear(std::memory_order_release)
+#endif
+
+#define CLOCK_RESYNC_MICROS 1000 // re-arm the timer when the grid moved by more (microseconds)
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+struct JitterCounters
+{
+  uint32_t uCount;
+  uint64_t ullSumMicros;
+  uint32_t uMaxMicros;
+  uint32_t auBuckets[JITTER_BUCKET_COUNT];
+};
+
+static const uint32_t auBounds[JITTER_BUCKET_COUNT] = JITTER_BUCKET_BOUNDS;
+static JitterCounters aJitter[JITTER_KIND_COUNT];
+
+// Slot grid : wall-clock second uAnchorEpoch started at esp_timer time ullAnchorMicros
+static uint32_t uPeriodSec = 30;
+static uint32_t uAnchorEpoch = 0;
+static uint64_t ullAnchorMicros = 0;
+static bool bAnchorSynced = false;
+
+static SampleSlot oArmedSlot = {0, 0, false}; // slot the timer is armed for
+static SampleSlot oDueSlot = {0, 0, false};   // slot waiting for loop()
+static bool bSlotDue = false;
+static uint32_t uMissedSlots = 0;
+
+#ifdef ARDUINO
+static portMUX_TYPE muxSampleClock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t hSampleTimer = nullptr;
+#else
+static std::atomic_flag flagSampleClock = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// First slot of the grid strictly after ullMicros (lock held)
+static SampleSlot nextSlot(uint64_t ullMicros)
+{
+  // Signed : the anchor may lie after ullMicros right after a sync
+  int64_t llElapsed = (int64_t)(ullMicros - ullAnchorMicros);
+  int64_t llEpochMicros = (int64_t)uAnchorEpoch * 1000000LL + llElapsed;
+  int64_t llPeriodMicros = (int64_t)uPeriodSec * 1000000LL;
+  int64_t llSlot = (llEpochMicros / llPeriodMicros + 1) * llPeriodMicros;
+
+  SampleSlot oSlot;
+  oSlot.uEpoch = (uint32_t)(llSlot / 1000000LL);
+  oSlot.ullMicros = ullAnchorMicros + (uint64_t)(llSlot - (int64_t)uAnchorEpoch * 1000000LL);
+  oSlot.bSynced = bAnchorSynced;
+  return oSlot;
+} // static SampleSlot nextSlot(uint64_t ullMicros)
+//-------------------------------------
+
+// Count a delay in a jitter histogram (lock held)
+static void recordJitter(JitterKind eKind, int64_t llMicros)
+{
+  uint32_t uMicros = (llMicros < 0) ? 0 : (llMicros > (int64_t)UINT32_MAX) ? UINT32_MAX : (uint32_t)llMicros;
+  uint8_t uBucket = 0;
+  while (uBucket < JITTER_BUCKET_COUNT - 1 && uMicros > auBounds[uBucket])
+  {
+    uBucket++;
+  }
+  JitterCounters &oCounters = aJitter[eKind];
+  oCounters.uCount++;
+  oCounters.ullSumMicros += uMicros;
+  if (uMicros > oCounters.uMaxMicros)
+  {
+    oCounters.uMaxMicros = uMicros;
+  }
+  oCounters.auBuckets[uBucket]++;
+} // static void recordJitter(JitterKind eKind, int64_t llMicros)
+//-------------------------------------
+
+// Timer alarm at ullNow : mark the armed slot due, arm the next one (lock held)
+static void takeAlarm(uint64_t ullNow)
+{
+  if (bSlotDue)
+  {
+    uMissedSlots++;
+  }
+  oDueSlot = oArmedSlot;
+  bSlotDue = true;
+  recordJitter(JITTER_ALARM, (int64_t)(ullNow - oArmedSlot.ullMicros));
+  oArmedSlot = nextSlot((ullNow > oArmedSlot.ullMicros) ? ullNow : oArmedSlot.ullMicros); // late alarm : no catch-up burst
+} // static void takeAlarm(uint64_t ullNow)
+//-------------------------------------
+
+#ifdef ARDUINO
+// Arm the timer for oArmedSlot
+static void armSampleTimer()
+{
+  CLOCK_LOCK();
+  uint64_t ullAt = oArmedSlot.ullMicros;
+  CLOCK_UNLOCK();
+  int64_t llDelay = (int64_t)(ullAt - (uint64_t)esp_timer_get_time());
+  esp_timer_stop(hSampleTimer); // fails harmlessly if not running
+  esp_timer_start_once(hSampleTimer, (llDelay > 0) ? llDelay : 1);
+} // static void armSampleTimer()
+//-------------------------------------
+
+// Timer alarm (esp_timer task)
+static void onSampleTimer(void * /* pArg */)
+{
+  uint64_t ullNow = esp_timer_get_time();
+  CLOCK_LOCK();
+  takeAlarm(ullNow);
+  CLOCK_UNLOCK();
+  armSampleTimer();
+} // static void onSampleTimer(void *pArg)
+//-------------------------------------
+#endif
+
+bool beginSampleClock(uint32_t uPeriod)
+{
+  CLOCK_LOCK();
+  uPeriodSec = (uPeriod == 0) ? 1 : uPeriod;
+  CLOCK_UNLOCK();
+#ifdef ARDUINO
+  if (hSampleTimer == nullptr)
+  {
+    esp_timer_create_args_t oArgs = {};
+    oArgs.callback = onSampleTimer;
+    oArgs.name = "sample";
+    if (esp_timer_create(&oArgs, &hSampleTimer) != ESP_OK)
+    {
+      return false;
+    }
+  }
+  CLOCK_LOCK();
+  oArmedSlot = nextSlot(esp_timer_get_time());
+  CLOCK_UNLOCK();
+  armSampleTimer();
+#endif
+  return true;
+} // bool beginSampleClock(uint32_t uPeriod)
+//-------------------------------------
+
+void syncSampleClock(uint32_t uEpoch, uint64_t ullMicros)
+{
+  CLOCK_LOCK();
+  bool bWasSynced = bAnchorSynced;
+  uAnchorEpoch = uEpoch;
+  ullAnchorMicros = ullMicros;
+  bAnchorSynced = true;
+
+  // Keep the armed slot (same wall-clock time, re-timed on the new anchor) :
+  // re-arming from "now" would skip it when the clock steps forward over it
+  // (it fires at once instead, as after a late alarm) and repeat the last
+  // slot when the clock steps back over that one. Only a step back by more
+  // than a period, which would pause the samples as long, re-arms from now.
+  SampleSlot oSlot = oArmedSlot;
+  oSlot.ullMicros = ullAnchorMicros + (uint64_t)(((int64_t)oSlot.uEpoch - (int64_t)uAnchorEpoch) * 1000000LL);
+  if (!bWasSynced || (int64_t)(oSlot.ullMicros - ullMicros) > 2LL * uPeriodSec * 1000000LL)
+  {
+    oSlot = nextSlot(ullMicros);
+  }
+  int64_t llMoved = (int64_t)(oSlot.ullMicros - oArmedSlot.ullMicros);
+  bool bMoved = oSlot.uEpoch != oArmedSlot.uEpoch || oSlot.bSynced != oArmedSlot.bSynced ||
+                llMoved > CLOCK_RESYNC_MICROS || llMoved < -CLOCK_RESYNC_MICROS;
+  if (bMoved)
+  {
+    oArmedSlot = oSlot;
+  }
+  CLOCK_UNLOCK();
+#ifdef ARDUINO
+  if (bMoved && hSampleTimer != nullptr)
+  {
+    armSampleTimer();
+  }
+#endif
+} // void syncSampleClock(uint32_t uEpoch, uint64_t ullMicros)
+//-------------------------------------
+
+bool sampleDue(SampleSlot &oSlot)
+{
+  CLOCK_LOCK();
+  bool bDue = bSlotDue;
+  if (bDue)
+  {
+    oSlot = oDueSlot;
+    bSlotDue = false;
+  }
+  CLOCK_UNLOCK();
+  return bDue;
+} // bool sampleDue(SampleSlot &oSlot)
+//-------------------------------------
+
+void recordSampleStart(const SampleSlot &oSlot, uint64_t ullMicros)
+{
+  CLOCK_LOCK();
+  recordJitter(JITTER_SAMPLE, (int64_t)(ullMicros - oSlot.ullMicros));
+  CLOCK_UNLOCK();
+} // void recordSampleStart(const SampleSlot &oSlot, uint64_t ullMicros)
+//-------------------------------------
+
+void getNextSlot(SampleSlot &oSlot)
+{
+  CLOCK_LOCK();
+  oSlot = oArmedSlot;
+  CLOCK_UNLOCK();
+} // void getNextSlot(SampleSlot &oSlot)
+//-------------------------------------
+
+uint32_t missedSlots()
+{
+  CLOCK_LOCK();
+  uint32_t uMissed = uMissedSlots;
+  CLOCK_UNLOCK();
+  return uMissed;
+} // uint32_t missedSlots()
+//-------------------------------------
+
+bool getSampleJitter(JitterKind eKind, SampleJitter &oJitter)
+{
+  if (eKind >= JITTER_KIND_COUNT)
+  {
+    return false;
+  }
+  CLOCK_LOCK();
+  const JitterCounters &oCounters = aJitter[eKind];
+  oJitter.uCount = oCounters.uCount;
+  oJitter.uMeanMicros = (oCounters.uCount == 0) ? 0 : (uint32_t)(oCounters.ullSumMicros / oCounters.uCount);
+  oJitter.uMaxMicros = oCounters.uMaxMicros;
+  for (uint8_t uBucket = 0; uBucket < JITTER_BUCKET_COUNT; uBucket++)
+  {
+    oJitter.auBuckets[uBucket] = oCounters.auBuckets[uBucket];
+  }
+  CLOCK_UNLOCK();
+  return true;
+} // bool getSampleJitter(JitterKind eKind, SampleJitter &oJitter)
+//-------------------------------------
+
+uint32_t jitterBound(uint8_t uBucket)
+{
+  return (uBucket < JITTER_BUCKET_COUNT) ? auBounds[uBucket] : UINT32_MAX;
+} // uint32_t jitterBound(uint8_t uBucket)
+//-------------------------------------
+
+#ifndef ARDUINO
+void fireSampleTimer(uint64_t ullMicros)
+{
+  CLOCK_LOCK();
+  takeAlarm(ullMicros);
+  CLOCK_UNLOCK();
+} // void fireSampleTimer(uint64_t ullMicros)
+//-------------------------------------
+#endif
@@ -0,0 +1,129 @@
+// Incremental trend estimation and short-horizon forecasting (see trend.h)
+
+#include "trend.h"
+#include "anomaly.h"
+
+#include <math.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define TREND_LOCK() portENTER_CRITICAL(&muxTrend)
+#define TREND_UNLOCK() portEXIT_CRITICAL(&muxTrend)
+#else
+#include <atomic>
+#define TREND_LOCK()                                        \
+  while (flagTrend.test_and_set(std::memory_order_acquire)) \
+  {                                                         \
+  }
+#define TREND_UNLOCK() flagTrend.clear(std::memory_order_release)
+#endif
+
+// ============================== GLOBAL VARS/CONSTS ==============================
+
+// Holt state of one channel
+struct HoltState
+{
+  uint32_t uSamples;
+  uint64_t ullLastMicros;
+  float fLevel;
+  float fSlope; // per second
+};
+
+static const uint32_t auHorizons[TREND_HORIZON_COUNT] = TREND_HORIZONS;
+static const AlarmLimits aLimits[STATS_CHANNEL_COUNT] = {ALARM_TMP_LIMITS, ALARM_HUM_LIMITS};
+
+static HoltState aStates[STATS_CHANNEL_COUNT];
+static ChannelTrend aTrends[STATS_CHANNEL_COUNT]; // published (lock)
+
+#ifdef ARDUINO
+static portMUX_TYPE muxTrend = portMUX_INITIALIZER_UNLOCKED;
+#else
+static std::atomic_flag flagTrend = ATOMIC_FLAG_INIT;
+#endif
+
+// ============================== FUNCTIONS ==============================
+
+// Seconds until fLevel moving at fSlope (per second) reaches fLimit, -1 if never or too far
+static int32_t etaTo(float fLevel, float fSlope, float fLimit)
+{
+  float fSeconds = (fSlope == 0.0f) ? -1.0f : (fLimit - fLevel) / fSlope;
+  return (fSeconds < 0.0f || fSeconds > TREND_ETA_MAX) ? -1 : (int32_t)fSeconds;
+} // static int32_t etaTo(float fLevel, float fSlope, float fLimit)
+//-------------------------------------
+
+// Update one channel with a valid value
+static void updateChannel(uint8_t uChannel, float fValue, uint64_t ullMicros)
+{
+  HoltState &oState = aStates[uChannel];
+  if (oState.uSamples == 0)
+  {
+    oState.fLevel = fValue;
+    oState.fSlope = 0.0f;
+  }
+  else
+  {
+    float fDt = (ullMicros > oState.ullLastMicros) ? (ullMicros - oState.ullLastMicros) / 1.0e6f : 0.0f;
+    float fPrevious = oState.fLevel;
+    oState.fLevel = TREND_ALPHA * fValue + (1.0f - TREND_ALPHA) * (fPrevious + oState.fSlope * fDt);
+    if (fDt > 0.0f)
+    {
+      oState.fSlope = TREND_BETA * (oState.fLevel - fPrevious) / fDt + (1.0f - TREND_BETA) * oState.fSlope;
+    }
+  }
+  oState.uSamples++;
+  oState.ullLastMicros = ullMicros;
+
+  ChannelTrend oTrend;
+  oTrend.uSamples = oState.uSamples;
+  oTrend.fLevel = oState.fLevel;
+  oTrend.fSlopePerHour = oState.fSlope * 3600.0f;
+  for (uint8_t uHorizon = 0; uHorizon < TREND_HORIZON_COUNT; uHorizon++)
+  {
+    oTrend.afForecasts[uHorizon] = oState.fLevel + oState.fSlope * auHorizons[uHorizon];
+  }
+  oTrend.fHigh = aLimits[uChannel].fHigh;
+  oTrend.fLow = aLimits[uChannel].fLow;
+  oTrend.iHighEta = (oState.fLevel > oTrend.fHigh) ? 0 : etaTo(oState.fLevel, oState.fSlope, oTrend.fHigh);
+  oTrend.iLowEta = (oState.fLevel < oTrend.fLow) ? 0 : etaTo(oState.fLevel, oState.fSlope, oTrend.fLow);
+
+  TREND_LOCK();
+  aTrends[uChannel] = oTrend;
+  TREND_UNLOCK();
+} // static void updateChannel(uint8_t uChannel, float fValue, uint64_t ullMicros)
+//-------------------------------------
+
+void updateTrend(const Measurement &oMeasurement)
+{
+  if (oMeasurement.uFlags & MEAS_RESTORED)
+  {
+    return;
+  }
+  if (oMeasurement.uFlags & MEAS_TMP_VALID)
+  {
+    updateChannel(STATS_TMP, oMeasurement.fTmp, oMeasurement.ullMicros);
+  }
+  if (oMeasurement.uFlags & MEAS_HUM_VALID)
+  {
+    updateChannel(STATS_HUM, oMeasurement.fHum, oMeasurement.ullMicros);
+  }
+} // void updateTrend(const Measurement &oMeasurement)
+//-------------------------------------
+
+bool getTrend(StatsChannel eChannel, ChannelTrend &oTrend)
+{
+  if (eChannel >= STATS_CHANNEL_COUNT)
+  {
+    return false;
+  }
+  TREND_LOCK();
+  oTrend = aTrends[eChannel];
+  TREND_UNLOCK();
+  return oTrend.uSamples >= TREND_WARMUP;
+} // bool getTrend(StatsChannel eChannel, ChannelTrend &oTrend)
+//-------------------------------------
+
+uint32_t trendHorizon(uint8_t uHorizon)
+{
+  return (uHorizon < TREND_HORIZON_COUNT) ? auHorizons[uHorizon] : 0;
+} // uint32_t trendHorizon(uint8_t uHorizon)
+//-------------------------------------
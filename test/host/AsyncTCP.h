@@ -0,0 +1,44 @@
+// Host stand-in for the AsyncTCP client used by fast_http ([env:native] only)
+//
+// Only the AsyncClient calls of the responder, with the response bytes kept
+// (last FAST_HTTP_HOST_OUT_LEN) and counted instead of sent : the parsing,
+// dispatch and response path then runs unchanged on host (test/test_fast_http).
+
+#ifndef HOST_ASYNC_TCP_H
+#define HOST_ASYNC_TCP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FAST_HTTP_HOST_OUT_LEN 2048
+#define FAST_HTTP_HOST_WINDOW 5744 // a full ESP32 lwIP send window
+
+class AsyncClient
+{
+public:
+  size_t add(const char *pData, size_t uLen, uint8_t /* uFlags */ = 0)
+  {
+    size_t uKeep = (uLen < sizeof(acOut) - uOutLen) ? uLen : sizeof(acOut) - uOutLen;
+    memcpy(acOut + uOutLen, pData, uKeep);
+    uOutLen += uKeep;
+    ullBytesOut += uLen;
+    return uLen;
+  }
+  bool send()
+  {
+    uSends++;
+    return true;
+  }
+  size_t space() { return FAST_HTTP_HOST_WINDOW; }
+  void close(bool /* bNow */ = false) { bClosed = true; }
+
+  char acOut[FAST_HTTP_HOST_OUT_LEN]; // output since the last clearOutput()
+  size_t uOutLen = 0;
+  uint64_t ullBytesOut = 0;
+  uint32_t uSends = 0;
+  bool bClosed = false;
+  void clearOutput() { uOutLen = 0; }
+};
+
+#endif // HOST_ASYNC_TCP_H
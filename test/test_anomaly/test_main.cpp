@@ -0,0 +1,147 @@
+// Anomaly detection : replay of three days of noisy samples with injected
+// faults. Every fault must raise its alarm within a few samples, nothing may
+// be raised outside the faults, and every alarm must clear afterwards.
+
+#include <unity.h>
+
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+#include "anomaly.h"
+
+#define REPLAY_SAMPLES 8640 // 3 days at 30 s
+#define REPLAY_SETTLE 60    // samples after a fault during which its alarms may still change
+#define MAX_EVENTS 256
+
+// Injected faults (sample index, length)
+#define FAULT_AC_START 3000 // air conditioning failure : +0.1 C per sample (0.2 C/min)
+#define FAULT_AC_LEN 150
+#define FAULT_STEP_START 5000 // +1.5 C step (sun on the sensor)
+#define FAULT_STEP_LEN 5
+#define FAULT_SENSOR_START 6000 // invalid readings
+#define FAULT_SENSOR_LEN 2
+#define FAULT_LEAK_START 7000 // humidity ramp : +0.5 %RH per sample (1 %/min)
+#define FAULT_LEAK_LEN 60
+
+static AlarmEvent aoEvents[MAX_EVENTS];
+static uint32_t uEventCount = 0;
+
+static void keepEvent(const AlarmEvent &oEvent)
+{
+  if (uEventCount < MAX_EVENTS)
+  {
+    aoEvents[uEventCount++] = oEvent;
+  }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static bool inFault(uint32_t uSample, uint32_t uStart, uint32_t uLen)
+{
+  return uSample >= uStart && uSample < uStart + uLen + REPLAY_SETTLE;
+}
+
+// First raise of an alarm at or after uStart (sample index), -1 if none
+static int32_t firstRaise(uint8_t uChannel, uint8_t uKind, uint32_t uStart)
+{
+  for (uint32_t uEvent = 0; uEvent < uEventCount; uEvent++)
+  {
+    const AlarmEvent &oEvent = aoEvents[uEvent];
+    if (oEvent.bRaised && oEvent.uChannel == uChannel && oEvent.uKind == uKind && oEvent.uSeq - 1 >= uStart)
+    {
+      return (int32_t)(oEvent.uSeq - 1 - uStart);
+    }
+  }
+  return -1;
+}
+
+void test_replay_faults(void)
+{
+  setAlarmHandler(keepEvent);
+  std::mt19937 oRandom(3);
+  std::normal_distribution<double> oNoise(0.0, 1.0);
+  for (uint32_t uSample = 0; uSample < REPLAY_SAMPLES; uSample++)
+  {
+    // Slow swing, quantised sensor noise
+    double dTmp = 21.0 + 0.3 * sin(uSample / 300.0) + oNoise(oRandom) * 0.08;
+    double dHum = 45.0 + oNoise(oRandom) * 0.4;
+    if (uSample >= FAULT_AC_START && uSample < FAULT_AC_START + FAULT_AC_LEN)
+    {
+      dTmp += 0.1 * (uSample - FAULT_AC_START);
+    }
+    if (uSample >= FAULT_STEP_START && uSample < FAULT_STEP_START + FAULT_STEP_LEN)
+    {
+      dTmp += 1.5;
+    }
+    if (uSample >= FAULT_LEAK_START && uSample < FAULT_LEAK_START + FAULT_LEAK_LEN)
+    {
+      dHum += 0.5 * (uSample - FAULT_LEAK_START);
+    }
+    Measurement oMeasurement;
+    memset(&oMeasurement, 0, sizeof(oMeasurement));
+    oMeasurement.uSeq = uSample + 1;
+    oMeasurement.ullMicros = uSample * 30000000ULL;
+    oMeasurement.uEpoch = 1700000000 + uSample * 30;
+    oMeasurement.fTmp = roundf(dTmp * 10) / 10;
+    oMeasurement.fHum = roundf(dHum * 10) / 10;
+    oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+    if (uSample >= FAULT_SENSOR_START && uSample < FAULT_SENSOR_START + FAULT_SENSOR_LEN)
+    {
+      oMeasurement.fTmp = NAN;
+      oMeasurement.fHum = NAN;
+      oMeasurement.uFlags = 0;
+    }
+    checkAnomalies(oMeasurement);
+  }
+  setAlarmHandler(nullptr);
+
+  // No alarm outside the faults
+  uint32_t uFalseAlarms = 0;
+  for (uint32_t uEvent = 0; uEvent < uEventCount; uEvent++)
+  {
+    uint32_t uSample = aoEvents[uEvent].uSeq - 1;
+    if (aoEvents[uEvent].bRaised && !inFault(uSample, FAULT_AC_START, FAULT_AC_LEN) &&
+        !inFault(uSample, FAULT_STEP_START, FAULT_STEP_LEN) && !inFault(uSample, FAULT_SENSOR_START, FAULT_SENSOR_LEN) &&
+        !inFault(uSample, FAULT_LEAK_START, FAULT_LEAK_LEN))
+    {
+      uFalseAlarms++;
+    }
+  }
+
+  int32_t iStepRate = firstRaise(STATS_TMP, ALARM_RATE, FAULT_STEP_START);
+  int32_t iStepZ = firstRaise(STATS_TMP, ALARM_ZSCORE, FAULT_STEP_START);
+  int32_t iSensor = firstRaise(STATS_TMP, ALARM_SENSOR, FAULT_SENSOR_START);
+  int32_t iAcZ = firstRaise(STATS_TMP, ALARM_ZSCORE, FAULT_AC_START);
+  int32_t iAcHigh = firstRaise(STATS_TMP, ALARM_HIGH, FAULT_AC_START);
+  int32_t iLeakZ = firstRaise(STATS_HUM, ALARM_ZSCORE, FAULT_LEAK_START);
+
+  char acMessage[200];
+  snprintf(acMessage, sizeof(acMessage),
+           "%u events, %u false alarms ; samples to detect : step rate %d z %d, sensor %d, AC z %d high %d, leak z %d",
+           uEventCount, uFalseAlarms, iStepRate, iStepZ, iSensor, iAcZ, iAcHigh, iLeakZ);
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_EQUAL(0, uFalseAlarms);
+  TEST_ASSERT_EQUAL(0, iStepRate);
+  TEST_ASSERT_EQUAL(0, iStepZ);
+  TEST_ASSERT_EQUAL(0, iSensor);
+  TEST_ASSERT_EQUAL(0, firstRaise(STATS_HUM, ALARM_SENSOR, FAULT_SENSOR_START));
+  TEST_ASSERT_TRUE(iAcZ >= 0 && iAcZ <= 10);
+  TEST_ASSERT_TRUE(iAcHigh >= 0 && iAcHigh < FAULT_AC_LEN);
+  TEST_ASSERT_TRUE(iLeakZ >= 0 && iLeakZ <= 10);
+  TEST_ASSERT_EQUAL(0, activeAlarms());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_faults);
+  return UNITY_END();
+}
@@ -0,0 +1,254 @@
+// Block pools : soak test with the web layer's allocation churn over a month
+// of virtual uptime (every block checked for overlap, nothing leaked, free
+// lists intact afterwards), a multi-threaded soak, and cost against malloc
+
+#include <unity.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "block_pool.h"
+
+#define SOAK_DAYS 30
+#define SOAK_REQUEST_PERIOD 10 // one web request every n seconds (virtual time)
+#define SOAK_MAX_LIVE 24       // requests in flight at once, at most
+#define SOAK_THREADS 4
+
+// One allocation, filled with its owner's tag to catch two owners of a block
+struct Block
+{
+  uint8_t *pData;
+  size_t uSize;
+  uint8_t uTag;
+};
+
+// Allocations of one request, as the web layer makes them
+struct Request
+{
+  Block aBlocks[10];
+  uint8_t uCount;
+};
+
+// Sizes seen per request : request/response/client objects, std::function
+// captures, header Strings, now and then a large body (heap fallback)
+static size_t requestSize(uint32_t uRandom, uint8_t uIndex)
+{
+  static const uint16_t auSizes[] = {24, 24, 32, 48, 64, 96, 120, 180, 240, 300, 460, 900};
+  return auSizes[(uRandom >> (uIndex * 3)) % (sizeof(auSizes) / sizeof(auSizes[0]))] + (uRandom >> 28);
+}
+
+static uint32_t uRandomState = 12345;
+static uint32_t nextRandom()
+{
+  uRandomState = uRandomState * 1664525u + 1013904223u;
+  return uRandomState;
+}
+
+static void allocRequest(Request &oRequest, uint32_t uRandom, uint8_t uTag)
+{
+  oRequest.uCount = 3 + uRandom % 8;
+  for (uint8_t uBlock = 0; uBlock < oRequest.uCount; uBlock++)
+  {
+    Block &oBlock = oRequest.aBlocks[uBlock];
+    oBlock.uSize = requestSize(uRandom, uBlock);
+    oBlock.pData = (uint8_t *)poolAlloc(oBlock.uSize);
+    oBlock.uTag = uTag;
+    memset(oBlock.pData, uTag, oBlock.uSize);
+  }
+}
+
+// Free the blocks of a request, returns the number of corrupted ones
+static uint32_t freeRequest(Request &oRequest)
+{
+  uint32_t uCorrupted = 0;
+  for (uint8_t uBlock = 0; uBlock < oRequest.uCount; uBlock++)
+  {
+    Block &oBlock = oRequest.aBlocks[uBlock];
+    for (size_t uByte = 0; uByte < oBlock.uSize; uByte++)
+    {
+      if (oBlock.pData[uByte] != oBlock.uTag)
+      {
+        uCorrupted++;
+        break;
+      }
+    }
+    poolFree(oBlock.pData);
+  }
+  oRequest.uCount = 0;
+  return uCorrupted;
+}
+
+static void getAllStats(BlockPoolStats *pStats)
+{
+  for (uint8_t uClass = 0; uClass < POOL_CLASS_COUNT; uClass++)
+  {
+    TEST_ASSERT_TRUE(getPoolStats(uClass, pStats[uClass]));
+  }
+}
+
+// Nothing in use, and every block of every pool can be taken once
+static void assertPoolsIntact()
+{
+  BlockPoolStats aStats[POOL_CLASS_COUNT];
+  getAllStats(aStats);
+  for (uint8_t uClass = 0; uClass < POOL_CLASS_COUNT; uClass++)
+  {
+    TEST_ASSERT_EQUAL(0, aStats[uClass].uInUse);
+    TEST_ASSERT_TRUE(aStats[uClass].uHighWater <= aStats[uClass].uBlockCount);
+
+    std::vector<void *> apBlocks;
+    for (uint16_t uBlock = 0; uBlock < aStats[uClass].uBlockCount; uBlock++)
+    {
+      apBlocks.push_back(poolAlloc(aStats[uClass].uBlockSize));
+    }
+    BlockPoolStats oFull;
+    getPoolStats(uClass, oFull);
+    TEST_ASSERT_EQUAL(aStats[uClass].uHits + aStats[uClass].uBlockCount, oFull.uHits);
+    TEST_ASSERT_EQUAL(aStats[uClass].uMisses, oFull.uMisses);
+    for (size_t uBlock = 1; uBlock < apBlocks.size(); uBlock++)
+    {
+      TEST_ASSERT_TRUE(apBlocks[uBlock] != apBlocks[uBlock - 1]);
+    }
+    for (void *pBlock : apBlocks)
+    {
+      poolFree(pBlock);
+    }
+  }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_soak_virtual_month(void)
+{
+  static Request aLive[SOAK_MAX_LIVE];
+  const uint32_t uRequests = SOAK_DAYS * 86400u / SOAK_REQUEST_PERIOD;
+  uint32_t uCorrupted = 0;
+  uint64_t ullAllocations = 0;
+  BlockPoolStats aBefore[POOL_CLASS_COUNT], aAfter[POOL_CLASS_COUNT];
+  getAllStats(aBefore);
+  uint32_t uOversizeBefore = poolOversize();
+
+  for (uint32_t uRequest = 0; uRequest < uRequests; uRequest++)
+  {
+    // A random request in flight completes, a new one takes its place
+    uint32_t uRandom = nextRandom();
+    Request &oSlot = aLive[uRandom % SOAK_MAX_LIVE];
+    uCorrupted += freeRequest(oSlot);
+    allocRequest(oSlot, nextRandom(), (uint8_t)(uRequest | 1));
+    ullAllocations += oSlot.uCount;
+  }
+  for (Request &oRequest : aLive)
+  {
+    uCorrupted += freeRequest(oRequest);
+  }
+  getAllStats(aAfter);
+
+  TEST_ASSERT_EQUAL(0, uCorrupted);
+  uint64_t ullHits = 0, ullMisses = 0;
+  char acMessage[200];
+  for (uint8_t uClass = 0; uClass < POOL_CLASS_COUNT; uClass++)
+  {
+    uint32_t uHits = aAfter[uClass].uHits - aBefore[uClass].uHits;
+    uint32_t uMisses = aAfter[uClass].uMisses - aBefore[uClass].uMisses;
+    ullHits += uHits;
+    ullMisses += uMisses;
+    snprintf(acMessage, sizeof(acMessage), "%3u-byte blocks : %u hits, %u misses, high water %u/%u",
+             aAfter[uClass].uBlockSize, uHits, uMisses, aAfter[uClass].uHighWater, aAfter[uClass].uBlockCount);
+    TEST_MESSAGE(acMessage);
+  }
+  uint32_t uOversize = poolOversize() - uOversizeBefore;
+  TEST_ASSERT_EQUAL(ullAllocations, ullHits + ullMisses + uOversize);
+  snprintf(acMessage, sizeof(acMessage), "%u days, %u requests : %.1f%% of %llu allocations from the pools, %u oversize",
+           SOAK_DAYS, uRequests, 100.0 * ullHits / ullAllocations, (unsigned long long)ullAllocations, uOversize);
+  TEST_MESSAGE(acMessage);
+  assertPoolsIntact();
+}
+
+// Several tasks allocating and freeing at once (web, network, loop)
+void test_soak_threads(void)
+{
+  uint32_t auCorrupted[SOAK_THREADS] = {};
+  std::vector<std::thread> aThreads;
+  for (uint8_t uThread = 0; uThread < SOAK_THREADS; uThread++)
+  {
+    aThreads.emplace_back([uThread, &auCorrupted]() {
+      Request aLive[SOAK_MAX_LIVE / SOAK_THREADS] = {};
+      uint32_t uState = 777 + uThread;
+      for (uint32_t uRequest = 0; uRequest < 200000; uRequest++)
+      {
+        uState = uState * 1664525u + 1013904223u;
+        Request &oSlot = aLive[uState % (SOAK_MAX_LIVE / SOAK_THREADS)];
+        auCorrupted[uThread] += freeRequest(oSlot);
+        uState = uState * 1664525u + 1013904223u;
+        allocRequest(oSlot, uState, (uint8_t)(uThread * 64 + (uRequest & 63) + 1));
+      }
+      for (Request &oRequest : aLive)
+      {
+        auCorrupted[uThread] += freeRequest(oRequest);
+      }
+    });
+  }
+  for (std::thread &oThread : aThreads)
+  {
+    oThread.join();
+  }
+  for (uint8_t uThread = 0; uThread < SOAK_THREADS; uThread++)
+  {
+    TEST_ASSERT_EQUAL(0, auCorrupted[uThread]);
+  }
+  assertPoolsIntact();
+}
+
+// Alloc + free cost of a typical small object, pool against malloc
+void test_bench_against_malloc(void)
+{
+  const uint32_t uCount = 10000000;
+  void *apLive[16] = {};
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uAlloc = 0; uAlloc < uCount; uAlloc++)
+  {
+    poolFree(apLive[uAlloc & 15]);
+    apLive[uAlloc & 15] = poolAlloc(24 + (uAlloc & 7) * 24);
+  }
+  double dPool = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / uCount;
+  for (void *&pBlock : apLive)
+  {
+    poolFree(pBlock);
+    pBlock = nullptr;
+  }
+  oStart = std::chrono::steady_clock::now();
+  for (uint32_t uAlloc = 0; uAlloc < uCount; uAlloc++)
+  {
+    free(apLive[uAlloc & 15]);
+    apLive[uAlloc & 15] = malloc(24 + (uAlloc & 7) * 24);
+  }
+  double dMalloc = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / uCount;
+  for (void *pBlock : apLive)
+  {
+    free(pBlock);
+  }
+
+  char acMessage[120];
+  snprintf(acMessage, sizeof(acMessage), "alloc + free : pools %.1f ns, host malloc %.1f ns", dPool, dMalloc);
+  TEST_MESSAGE(acMessage);
+  assertPoolsIntact();
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_soak_virtual_month);
+  RUN_TEST(test_soak_threads);
+  RUN_TEST(test_bench_against_malloc);
+  return UNITY_END();
+}
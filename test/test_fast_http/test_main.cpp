@@ -0,0 +1,385 @@
+// FAST HTTP responder : protocol checks, and requests/s and heap per
+// connection through the real parse/dispatch/response path, the TCP
+// transport being the in-memory host AsyncClient. These are the responder's
+// own costs, not a comparison : ESPAsyncWebServer needs the Arduino core and
+// has no host build to measure against.
+
+#include <unity.h>
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fast_http.h"
+#include "asset_store.h"
+
+#define BENCH_REQUESTS 1000000 // keep-alive requests per measurement
+#define BENCH_CONNECTIONS 200000 // one-request connections per measurement
+
+// ============================== ALLOCATION COUNTER ==============================
+
+static size_t uAllocations = 0;
+static size_t uAllocatedBytes = 0;
+
+void *operator new(size_t uSize)
+{
+  uAllocations++;
+  uAllocatedBytes += uSize;
+  void *p = malloc(uSize ? uSize : 1);
+  if (p == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// ============================== ENDPOINTS ==============================
+
+// Same shape as the firmware's /temperature endpoint
+static size_t writeTemperature(char *pBuffer, size_t uLen)
+{
+  return snprintf(pBuffer, uLen, "%.1f", 21.5);
+}
+
+static size_t writeAge(char *pBuffer, size_t uLen)
+{
+  return snprintf(pBuffer, uLen, "\r\nAge: %u", 3u);
+}
+
+static const FastHttpEndpoint aEndpoints[] = {
+    FastHttpEndpoint("/temperature", "text/plain", writeTemperature, writeAge),
+    FastHttpEndpoint("/humidity", "text/plain", writeTemperature),
+};
+
+static const char pcGet[] = "GET /temperature HTTP/1.1\r\nHost: esp32\r\nAccept: */*\r\n\r\n";
+
+void setUp(void)
+{
+  beginFastHttp(81, aEndpoints, sizeof(aEndpoints) / sizeof(aEndpoints[0]));
+}
+
+void tearDown(void)
+{
+}
+
+static unsigned countOf(const AsyncClient &oClient, const char *pNeedle)
+{
+  unsigned uCount = 0;
+  const char *pFrom = oClient.acOut;
+  const char *pEnd = oClient.acOut + oClient.uOutLen;
+  size_t uNeedleLen = strlen(pNeedle);
+  for (; pFrom + uNeedleLen <= pEnd; pFrom++)
+  {
+    uCount += (memcmp(pFrom, pNeedle, uNeedleLen) == 0);
+  }
+  return uCount;
+}
+
+// ============================== PROTOCOL ==============================
+
+void test_serves_endpoint(void)
+{
+  AsyncClient oClient;
+  TEST_ASSERT_TRUE(acceptFastHttp(&oClient));
+  receiveFastHttp(&oClient, pcGet, strlen(pcGet));
+  oClient.acOut[oClient.uOutLen < FAST_HTTP_HOST_OUT_LEN ? oClient.uOutLen : FAST_HTTP_HOST_OUT_LEN - 1] = '\0';
+  TEST_ASSERT_EQUAL(0, strncmp(oClient.acOut, "HTTP/1.1 200", 12));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\nAge: 3"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "Content-Length: 4\r\n"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\n\r\n21.5"));
+  TEST_ASSERT_FALSE(oClient.bClosed);
+  dropFastHttp(&oClient);
+}
+
+void test_split_and_pipelined(void)
+{
+  AsyncClient oClient;
+  TEST_ASSERT_TRUE(acceptFastHttp(&oClient));
+  // One request across two segments, then three in one segment
+  receiveFastHttp(&oClient, pcGet, 10);
+  TEST_ASSERT_EQUAL(0, oClient.uOutLen);
+  receiveFastHttp(&oClient, pcGet + 10, strlen(pcGet) - 10);
+  char acThree[3 * sizeof(pcGet)];
+  snprintf(acThree, sizeof(acThree), "%s%s%s", pcGet, pcGet, pcGet);
+  receiveFastHttp(&oClient, acThree, strlen(acThree));
+  TEST_ASSERT_EQUAL(4, countOf(oClient, "HTTP/1.1 200"));
+  TEST_ASSERT_FALSE(oClient.bClosed);
+  dropFastHttp(&oClient);
+}
+
+void test_errors_and_close(void)
+{
+  AsyncClient oClient;
+  TEST_ASSERT_TRUE(acceptFastHttp(&oClient));
+  const char pcPost[] = "POST /temperature HTTP/1.1\r\n\r\n";
+  receiveFastHttp(&oClient, pcPost, strlen(pcPost));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "405"));
+  const char pcMissing[] = "GET /nothing HTTP/1.1\r\n\r\n";
+  receiveFastHttp(&oClient, pcMissing, strlen(pcMissing));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "404"));
+  TEST_ASSERT_FALSE(oClient.bClosed);
+  const char pcOld[] = "GET /humidity HTTP/1.0\r\n\r\n";
+  receiveFastHttp(&oClient, pcOld, strlen(pcOld));
+  TEST_ASSERT_TRUE(oClient.bClosed);
+  dropFastHttp(&oClient);
+
+  // Request larger than the parse buffer
+  AsyncClient oLarge;
+  TEST_ASSERT_TRUE(acceptFastHttp(&oLarge));
+  static char acHuge[FAST_HTTP_BUFFER_LEN + 1];
+  memset(acHuge, 'a', sizeof(acHuge));
+  receiveFastHttp(&oLarge, acHuge, sizeof(acHuge));
+  TEST_ASSERT_EQUAL(1, countOf(oLarge, "431"));
+  TEST_ASSERT_TRUE(oLarge.bClosed);
+  dropFastHttp(&oLarge);
+}
+
+// Browser request : cookies, user agent and accept lines far beyond the
+// parse buffer, the header read (Connection) last
+static size_t writeBrowserRequest(char *pBuffer, size_t uLen, const char *pConnection)
+{
+  static char acCookie[1500];
+  memset(acCookie, 'c', sizeof(acCookie) - 1);
+  acCookie[sizeof(acCookie) - 1] = '\0';
+  return snprintf(pBuffer, uLen,
+                  "GET /temperature HTTP/1.1\r\nHost: 192.168.1.20:8080\r\n"
+                  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+                  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+                  "Accept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\n"
+                  "Cookie: session=%s\r\nUpgrade-Insecure-Requests: 1\r\nConnection: %s\r\n\r\n",
+                  acCookie, pConnection);
+}
+
+void test_long_browser_headers(void)
+{
+  static char acRequest[2 * 2048];
+  size_t uLen = writeBrowserRequest(acRequest, sizeof(acRequest), "keep-alive");
+  uLen += writeBrowserRequest(acRequest + uLen, sizeof(acRequest) - uLen, "close");
+  TEST_ASSERT_TRUE(uLen > 4 * FAST_HTTP_BUFFER_LEN);
+
+  // In one segment, then in small segments : both answered, the second closes
+  const size_t auSegments[] = {uLen, 7, 100};
+  for (size_t uSegment : auSegments)
+  {
+    AsyncClient oClient;
+    TEST_ASSERT_TRUE(acceptFastHttp(&oClient));
+    for (size_t uSent = 0; uSent < uLen; uSent += uSegment)
+    {
+      receiveFastHttp(&oClient, acRequest + uSent, (uLen - uSent < uSegment) ? uLen - uSent : uSegment);
+    }
+    TEST_ASSERT_EQUAL(2, countOf(oClient, "HTTP/1.1 200"));
+    TEST_ASSERT_EQUAL(0, countOf(oClient, "431"));
+    TEST_ASSERT_EQUAL(1, countOf(oClient, "Connection: keep-alive"));
+    TEST_ASSERT_EQUAL(1, countOf(oClient, "Connection: close"));
+    TEST_ASSERT_TRUE(oClient.bClosed);
+    dropFastHttp(&oClient);
+  }
+}
+
+void test_pool_limit(void)
+{
+  AsyncClient aClients[FAST_HTTP_MAX_CLIENTS + 1];
+  for (uint8_t uConn = 0; uConn < FAST_HTTP_MAX_CLIENTS; uConn++)
+  {
+    TEST_ASSERT_TRUE(acceptFastHttp(&aClients[uConn]));
+  }
+  TEST_ASSERT_FALSE(acceptFastHttp(&aClients[FAST_HTTP_MAX_CLIENTS]));
+  dropFastHttp(&aClients[0]);
+  TEST_ASSERT_TRUE(acceptFastHttp(&aClients[FAST_HTTP_MAX_CLIENTS]));
+  for (uint8_t uConn = 1; uConn <= FAST_HTTP_MAX_CLIENTS; uConn++)
+  {
+    dropFastHttp(&aClients[uConn]);
+  }
+}
+
+// ============================== ASSETS ==============================
+
+void test_accept_encoding(void)
+{
+  AssetEntry oGzip = {};
+  oGzip.uEncoding = ASSET_GZIP;
+  AssetEntry oPlain = {};
+  oPlain.uEncoding = ASSET_IDENTITY;
+
+  TEST_ASSERT_TRUE(assetAcceptable(&oPlain, nullptr));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, nullptr));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, ""));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, "identity"));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, "br, deflate"));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, "x-gzip"));
+  TEST_ASSERT_TRUE(assetAcceptable(&oGzip, "gzip"));
+  TEST_ASSERT_TRUE(assetAcceptable(&oGzip, "gzip, deflate, br"));
+  TEST_ASSERT_TRUE(assetAcceptable(&oGzip, "br;q=1.0, GZIP;q=0.5"));
+  TEST_ASSERT_TRUE(assetAcceptable(&oGzip, "*"));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, "gzip;q=0"));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, "gzip ; q=0.000, br"));
+  TEST_ASSERT_FALSE(assetAcceptable(&oGzip, "gzip;q=0, *"));
+  TEST_ASSERT_TRUE(assetAcceptable(&oGzip, "*;q=0, gzip"));
+
+  // Other codings, as for the history export
+  TEST_ASSERT_FALSE(acceptsEncoding(nullptr, "gzip"));
+  TEST_ASSERT_TRUE(acceptsEncoding("deflate, br", "br"));
+  TEST_ASSERT_FALSE(acceptsEncoding("br;q=0, gzip", "br"));
+}
+
+// Image with one gzip and one identity asset, as written by tools/mkassets.py
+static bool writeTestImage(const char *pFileName)
+{
+  static const char acData[] = "0123456789abcdef";
+  struct
+  {
+    AssetImageHeader oHeader;
+    AssetEntry aEntries[2];
+    char acData[16];
+  } __attribute__((packed)) oImage = {};
+  oImage.oHeader = {ASSET_MAGIC, ASSET_VERSION, 2, sizeof(oImage), 0};
+  strcpy(oImage.aEntries[0].acPath, "/app.js");
+  strcpy(oImage.aEntries[0].acContentType, "application/javascript");
+  oImage.aEntries[0].uOffset = sizeof(oImage) - sizeof(oImage.acData);
+  oImage.aEntries[0].uLength = 10;
+  oImage.aEntries[0].uCrc32 = 0x12345678;
+  oImage.aEntries[0].uEncoding = ASSET_GZIP;
+  strcpy(oImage.aEntries[1].acPath, "/robots.txt");
+  strcpy(oImage.aEntries[1].acContentType, "text/plain");
+  oImage.aEntries[1].uOffset = sizeof(oImage) - sizeof(oImage.acData) + 10;
+  oImage.aEntries[1].uLength = 6;
+  oImage.aEntries[1].uEncoding = ASSET_IDENTITY;
+  memcpy(oImage.acData, acData, sizeof(oImage.acData));
+  FILE *pFile = fopen(pFileName, "wb");
+  if (pFile == nullptr)
+  {
+    return false;
+  }
+  bool bWritten = fwrite(&oImage, sizeof(oImage), 1, pFile) == 1;
+  fclose(pFile);
+  return bWritten;
+}
+
+static void requestAsset(AsyncClient &oClient, const char *pPath, const char *pHeaders)
+{
+  char acRequest[256];
+  snprintf(acRequest, sizeof(acRequest), "GET %s HTTP/1.1\r\nHost: esp32\r\n%s\r\n", pPath, pHeaders);
+  oClient.clearOutput();
+  receiveFastHttp(&oClient, acRequest, strlen(acRequest));
+}
+
+void test_gzip_asset_negotiation(void)
+{
+  char acFileName[] = "/tmp/test_assets_XXXXXX";
+  int iFile = mkstemp(acFileName);
+  TEST_ASSERT_TRUE(iFile >= 0);
+  close(iFile);
+  TEST_ASSERT_TRUE(writeTestImage(acFileName));
+  TEST_ASSERT_TRUE(beginAssetStore(acFileName));
+
+  AsyncClient oClient;
+  TEST_ASSERT_TRUE(acceptFastHttp(&oClient));
+
+  requestAsset(oClient, "/app.js", "Accept-Encoding: gzip, deflate\r\n");
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "HTTP/1.1 200"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\nContent-Encoding: gzip"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\nVary: Accept-Encoding"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\n\r\n0123456789"));
+
+  // No Accept-Encoding, or gzip refused : 406, never gzip bytes
+  requestAsset(oClient, "/app.js", "");
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "HTTP/1.1 406"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\nVary: Accept-Encoding"));
+  TEST_ASSERT_EQUAL(0, countOf(oClient, "Content-Encoding"));
+  requestAsset(oClient, "/app.js", "Accept-Encoding: identity, gzip;q=0\r\n");
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "HTTP/1.1 406"));
+
+  // Revalidation keeps Vary
+  requestAsset(oClient, "/app.js", "If-None-Match: \"12345678\"\r\n");
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "HTTP/1.1 304"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\nVary: Accept-Encoding"));
+
+  // An identity asset does not vary
+  requestAsset(oClient, "/robots.txt", "");
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "HTTP/1.1 200"));
+  TEST_ASSERT_EQUAL(0, countOf(oClient, "Vary"));
+  TEST_ASSERT_EQUAL(1, countOf(oClient, "\r\n\r\nabcdef"));
+  TEST_ASSERT_FALSE(oClient.bClosed);
+
+  dropFastHttp(&oClient);
+  unlink(acFileName);
+}
+
+// ============================== BENCHMARK ==============================
+
+// Keep-alive requests spread over the full pool, then one connection per
+// request : requests/s and heap allocations of the responder itself (no
+// AsyncWebServer baseline on host)
+void test_bench_requests(void)
+{
+  AsyncClient aClients[FAST_HTTP_MAX_CLIENTS];
+  for (uint8_t uConn = 0; uConn < FAST_HTTP_MAX_CLIENTS; uConn++)
+  {
+    TEST_ASSERT_TRUE(acceptFastHttp(&aClients[uConn]));
+  }
+  size_t uGetLen = strlen(pcGet);
+  size_t uStartAllocations = uAllocations;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uRequest = 0; uRequest < BENCH_REQUESTS; uRequest++)
+  {
+    AsyncClient &oClient = aClients[uRequest % FAST_HTTP_MAX_CLIENTS];
+    oClient.clearOutput();
+    receiveFastHttp(&oClient, pcGet, uGetLen);
+  }
+  double dKeepAlive = BENCH_REQUESTS / std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+  size_t uKeepAliveAllocations = uAllocations - uStartAllocations;
+  uint32_t uSends = 0;
+  for (uint8_t uConn = 0; uConn < FAST_HTTP_MAX_CLIENTS; uConn++)
+  {
+    uSends += aClients[uConn].uSends;
+    dropFastHttp(&aClients[uConn]);
+  }
+  TEST_ASSERT_EQUAL(BENCH_REQUESTS, uSends);
+
+  AsyncClient oClient;
+  uStartAllocations = uAllocations;
+  oStart = std::chrono::steady_clock::now();
+  for (uint32_t uRequest = 0; uRequest < BENCH_CONNECTIONS; uRequest++)
+  {
+    oClient.clearOutput();
+    acceptFastHttp(&oClient);
+    receiveFastHttp(&oClient, pcGet, uGetLen);
+    dropFastHttp(&oClient);
+  }
+  double dPerConnection = BENCH_CONNECTIONS / std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+  size_t uConnectionAllocations = uAllocations - uStartAllocations;
+
+  char acMessage[200];
+  snprintf(acMessage, sizeof(acMessage), "keep-alive : %.0f requests/s, %zu allocations / %u requests",
+           dKeepAlive, uKeepAliveAllocations, BENCH_REQUESTS);
+  TEST_MESSAGE(acMessage);
+  snprintf(acMessage, sizeof(acMessage), "connection per request : %.0f requests/s, %zu allocations / %u connections",
+           dPerConnection, uConnectionAllocations, BENCH_CONNECTIONS);
+  TEST_MESSAGE(acMessage);
+  snprintf(acMessage, sizeof(acMessage), "per connection : %zu bytes static (pool of %u = %zu bytes), 0 heap",
+           fastHttpConnBytes(), FAST_HTTP_MAX_CLIENTS, fastHttpConnBytes() * FAST_HTTP_MAX_CLIENTS);
+  TEST_MESSAGE(acMessage);
+
+  // The responder allocates nothing per request nor per connection
+  TEST_ASSERT_EQUAL(0, uKeepAliveAllocations);
+  TEST_ASSERT_EQUAL(0, uConnectionAllocations);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_serves_endpoint);
+  RUN_TEST(test_split_and_pipelined);
+  RUN_TEST(test_errors_and_close);
+  RUN_TEST(test_long_browser_headers);
+  RUN_TEST(test_pool_limit);
+  RUN_TEST(test_accept_encoding);
+  RUN_TEST(test_gzip_asset_negotiation);
+  RUN_TEST(test_bench_requests);
+  return UNITY_END();
+}
@@ -0,0 +1,602 @@
+// Flash sample log on the host file backend : the raw tier wrapped over and
+// its index rebuilt at boot, cursors and queries reaching back past the
+// recycled oldest block, torn and corrupted records skipped, the query
+// cost as the log grows, and the compaction into the aggregated tiers
+// (aggregates, resumed after reboots, queries across tiers, throughput)
+
+#include <unity.h>
+
+#include <fcntl.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "flash_log.h"
+
+#define LOG_PATH "/tmp/test_flash_log.bin"
+#define EPOCH0 1699999200UL // a whole hour : steps of every tier start on a sample
+#define SAMPLE_PERIOD 30
+#define RAW_PER_BLOCK ((FLOG_SECTOR_LEN - sizeof(FlogBlockHeader)) / sizeof(FlogRecord))
+#define READ_ITEMS 64
+
+static uint32_t epochOf(uint32_t uSeq)
+{
+  return EPOCH0 + uSeq * SAMPLE_PERIOD;
+}
+
+// Stored values of sample uSeq (hundredths, INT16_MIN : invalid)
+static float tmpOf(uint32_t uSeq)
+{
+  return 20.0f + 5.0f * sinf(uSeq / 50.0f);
+}
+
+static float humOf(uint32_t uSeq)
+{
+  return 40.0f + (uSeq % 37) * 0.5f;
+}
+
+static bool tmpValid(uint32_t uSeq)
+{
+  return uSeq % 53 != 0;
+}
+
+static int16_t storedTmp(uint32_t uSeq)
+{
+  return tmpValid(uSeq) ? (int16_t)lroundf(tmpOf(uSeq) * 100.0f) : INT16_MIN;
+}
+
+static int16_t storedHum(uint32_t uSeq)
+{
+  return (int16_t)lroundf(humOf(uSeq) * 100.0f);
+}
+
+static void appendSample(uint32_t uSeq)
+{
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+  oMeasurement.uSeq = uSeq;
+  oMeasurement.uEpoch = epochOf(uSeq);
+  oMeasurement.uNtpQuality = NTP_SYNCED;
+  oMeasurement.fTmp = tmpOf(uSeq);
+  oMeasurement.fHum = humOf(uSeq);
+  oMeasurement.uFlags = MEAS_HUM_VALID | (tmpValid(uSeq) ? MEAS_TMP_VALID : 0);
+  appendFlashLog(oMeasurement);
+}
+
+// A new, erased partition file
+static void freshLog()
+{
+  unlink(LOG_PATH);
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+}
+
+// Overwrite bytes of the partition file, as a power loss or a bit flip would
+static void patchLog(uint32_t uOffset, const void *pData, size_t uLen)
+{
+  int iFile = open(LOG_PATH, O_RDWR);
+  TEST_ASSERT_TRUE(iFile >= 0);
+  TEST_ASSERT_EQUAL(uLen, pwrite(iFile, pData, uLen, uOffset));
+  close(iFile);
+}
+
+// Offset of a raw record of a log that has not wrapped yet (block = sector)
+static uint32_t rawRecordOffset(uint32_t uBlockNo, uint32_t uSlot)
+{
+  return uBlockNo * FLOG_SECTOR_LEN + sizeof(FlogBlockHeader) + uSlot * sizeof(FlogRecord);
+}
+
+// Read the rest of a raw tier cursor : the sequence numbers must increase,
+// the values match the samples. Returns the records read, uFirstSeq / uLastSeq
+// the first and last sequence numbers
+static uint32_t drainRawCursor(FlogCursor &oCursor, uint32_t &uFirstSeq, uint32_t &uLastSeq)
+{
+  FlogItem aItems[READ_ITEMS];
+  uint32_t uTotal = 0;
+  uint32_t uRead;
+  while ((uRead = readFlashCursor(oCursor, aItems, READ_ITEMS, nullptr)) > 0)
+  {
+    for (uint32_t uItem = 0; uItem < uRead; uItem++)
+    {
+      const FlogItem &oItem = aItems[uItem];
+      if (uTotal > 0)
+      {
+        TEST_ASSERT_TRUE(oItem.uSeq > uLastSeq);
+      }
+      else
+      {
+        uFirstSeq = oItem.uSeq;
+      }
+      TEST_ASSERT_EQUAL(epochOf(oItem.uSeq), oItem.uEpoch);
+      TEST_ASSERT_EQUAL(storedTmp(oItem.uSeq), oItem.aiMean[STATS_TMP]);
+      TEST_ASSERT_EQUAL(storedHum(oItem.uSeq), oItem.aiMean[STATS_HUM]);
+      TEST_ASSERT_EQUAL(tmpValid(oItem.uSeq) ? 1 : 0, oItem.auCount[STATS_TMP]);
+      uLastSeq = oItem.uSeq;
+      uTotal++;
+    }
+  }
+  return uTotal;
+}
+
+// Query handler : steps in time order, counts and first / last step kept
+struct StepCheck
+{
+  uint32_t uSteps;
+  uint32_t uFirstStart;
+  uint32_t uLastStart;
+  uint32_t auSamples[STATS_CHANNEL_COUNT];
+};
+
+static bool checkStep(const FlogStep &oStep, void *pContext)
+{
+  StepCheck *pCheck = (StepCheck *)pContext;
+  if (pCheck->uSteps > 0)
+  {
+    TEST_ASSERT_TRUE(oStep.uStart > pCheck->uLastStart);
+  }
+  else
+  {
+    pCheck->uFirstStart = oStep.uStart;
+  }
+  pCheck->uLastStart = oStep.uStart;
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    pCheck->auSamples[uChannel] += oStep.auCount[uChannel];
+  }
+  pCheck->uSteps++;
+  return true;
+}
+
+// Aggregate the compaction should store for the samples 1..uLastSeq of
+// [uStart, uStart + uLen) : a 5-min step from the samples, an hour from the
+// 5-min aggregates (means in hundredths, rounded half away from zero)
+static void expectedAggregate(uint32_t uLastSeq, uint32_t uStart, uint32_t uLen, FlogItem &oItem)
+{
+  int64_t aiSum[STATS_CHANNEL_COUNT] = {0, 0};
+  oItem.uEpoch = uStart;
+  oItem.uSeq = 0;
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    oItem.auCount[uChannel] = 0;
+    oItem.aiMin[uChannel] = INT16_MAX;
+    oItem.aiMax[uChannel] = INT16_MIN;
+  }
+  for (uint32_t uPart = 0; uPart < uLen / 300; uPart++)
+  {
+    uint32_t uPartStart = uStart + uPart * 300;
+    int64_t aiPartSum[STATS_CHANNEL_COUNT] = {0, 0};
+    uint32_t auPartCount[STATS_CHANNEL_COUNT] = {0, 0};
+    for (uint32_t uSeq = (uPartStart - EPOCH0) / SAMPLE_PERIOD; uSeq < (uPartStart + 300 - EPOCH0) / SAMPLE_PERIOD; uSeq++)
+    {
+      if (uSeq == 0 || uSeq > uLastSeq)
+      {
+        continue;
+      }
+      const int16_t aiValues[STATS_CHANNEL_COUNT] = {storedTmp(uSeq), storedHum(uSeq)};
+      for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+      {
+        if (aiValues[uChannel] != INT16_MIN)
+        {
+          auPartCount[uChannel]++;
+          aiPartSum[uChannel] += aiValues[uChannel];
+          oItem.aiMin[uChannel] = (aiValues[uChannel] < oItem.aiMin[uChannel]) ? aiValues[uChannel] : oItem.aiMin[uChannel];
+          oItem.aiMax[uChannel] = (aiValues[uChannel] > oItem.aiMax[uChannel]) ? aiValues[uChannel] : oItem.aiMax[uChannel];
+        }
+      }
+    }
+    for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+    {
+      if (auPartCount[uChannel] != 0)
+      {
+        int64_t iMean = (aiPartSum[uChannel] + auPartCount[uChannel] / 2) / auPartCount[uChannel];
+        oItem.auCount[uChannel] += auPartCount[uChannel];
+        aiSum[uChannel] += (uLen == 300) ? aiPartSum[uChannel] : iMean * auPartCount[uChannel];
+      }
+    }
+  }
+  for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+  {
+    uint32_t uCount = oItem.auCount[uChannel];
+    oItem.aiMean[uChannel] = uCount ? (int16_t)((aiSum[uChannel] + uCount / 2) / uCount) : INT16_MIN;
+    oItem.aiMin[uChannel] = uCount ? oItem.aiMin[uChannel] : INT16_MIN;
+    oItem.aiMax[uChannel] = uCount ? oItem.aiMax[uChannel] : INT16_MIN;
+  }
+}
+
+// Aggregated tier uTier must hold one aggregate per uLen seconds from
+// EPOCH0, uAggregates of them, as computed from the samples 1..uLastSeq
+static void checkAggregates(uint8_t uTier, uint32_t uLen, uint32_t uLastSeq, uint32_t uAggregates)
+{
+  FlogCursor oCursor;
+  FlogItem aItems[READ_ITEMS], oExpected;
+  uint32_t uItems = 0, uRead;
+  TEST_ASSERT_TRUE(openFlashCursor(oCursor, uTier, 0, UINT32_MAX));
+  while ((uRead = readFlashCursor(oCursor, aItems, READ_ITEMS, nullptr)) > 0)
+  {
+    for (uint32_t uItem = 0; uItem < uRead; uItem++, uItems++)
+    {
+      expectedAggregate(uLastSeq, EPOCH0 + uItems * uLen, uLen, oExpected);
+      TEST_ASSERT_EQUAL(oExpected.uEpoch, aItems[uItem].uEpoch);
+      for (uint8_t uChannel = 0; uChannel < STATS_CHANNEL_COUNT; uChannel++)
+      {
+        TEST_ASSERT_EQUAL(oExpected.auCount[uChannel], aItems[uItem].auCount[uChannel]);
+        TEST_ASSERT_EQUAL(oExpected.aiMean[uChannel], aItems[uItem].aiMean[uChannel]);
+        TEST_ASSERT_EQUAL(oExpected.aiMin[uChannel], aItems[uItem].aiMin[uChannel]);
+        TEST_ASSERT_EQUAL(oExpected.aiMax[uChannel], aItems[uItem].aiMax[uChannel]);
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL(uAggregates, uItems);
+}
+
+// Compact until there is nothing left, returns the slices run
+static uint32_t compactAll()
+{
+  uint32_t uSlices = 0;
+  while (compactFlashLog(FLOG_COMPACT_SLICE) > 0)
+  {
+    uSlices++;
+  }
+  return uSlices;
+}
+
+static double elapsedMicros(std::chrono::steady_clock::time_point tStart)
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tStart).count();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Past the end of the raw tier the oldest blocks are recycled ; a reboot
+// rebuilds the same index and appends after the newest record
+void test_append_wraps(void)
+{
+  freshLog();
+  FlashLogStats oStats;
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  const uint32_t uCapacity = oStats.uCapacity;
+  TEST_ASSERT_EQUAL(0, oStats.uBlocks);
+
+  const uint32_t uSamples = (uCapacity + 2) * RAW_PER_BLOCK + 10; // 3 blocks recycled
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+  const uint32_t uOldestSeq = 3 * RAW_PER_BLOCK + 1;
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  TEST_ASSERT_EQUAL(uCapacity, oStats.uBlocks);
+  TEST_ASSERT_EQUAL(uCapacity + 3, oStats.uErases);
+  TEST_ASSERT_EQUAL(uSamples - uOldestSeq + 1, oStats.uRecords);
+  TEST_ASSERT_EQUAL(epochOf(uOldestSeq), oStats.uOldestEpoch);
+  TEST_ASSERT_EQUAL(epochOf(uSamples), oStats.uNewestEpoch);
+  TEST_ASSERT_EQUAL(0, oStats.uErrors);
+
+  FlogCursor oCursor;
+  uint32_t uFirstSeq = 0, uLastSeq = 0;
+  TEST_ASSERT_TRUE(openFlashCursor(oCursor, 0, 0, UINT32_MAX));
+  TEST_ASSERT_EQUAL(oStats.uRecords, drainRawCursor(oCursor, uFirstSeq, uLastSeq));
+  TEST_ASSERT_EQUAL(uOldestSeq, uFirstSeq);
+  TEST_ASSERT_EQUAL(uSamples, uLastSeq);
+
+  // Reboot
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+  FlashLogStats oReopened;
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oReopened));
+  TEST_ASSERT_EQUAL(oStats.uBlocks, oReopened.uBlocks);
+  TEST_ASSERT_EQUAL(oStats.uRecords, oReopened.uRecords);
+  TEST_ASSERT_EQUAL(oStats.uOldestEpoch, oReopened.uOldestEpoch);
+  TEST_ASSERT_EQUAL(oStats.uNewestEpoch, oReopened.uNewestEpoch);
+  appendSample(uSamples + 1);
+  TEST_ASSERT_TRUE(openFlashCursor(oCursor, 0, epochOf(uSamples - 4), UINT32_MAX));
+  TEST_ASSERT_EQUAL(6, drainRawCursor(oCursor, uFirstSeq, uLastSeq));
+  TEST_ASSERT_EQUAL(uSamples - 4, uFirstSeq);
+  TEST_ASSERT_EQUAL(uSamples + 1, uLastSeq);
+}
+
+// A cursor left behind while its block is recycled resumes at the oldest
+// stored record ; queries starting before the oldest block read from it
+void test_read_across_recycled_block(void)
+{
+  freshLog();
+  FlashLogStats oStats;
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  const uint32_t uFull = oStats.uCapacity * RAW_PER_BLOCK;
+  for (uint32_t uSeq = 1; uSeq <= uFull; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+
+  FlogCursor oCursor;
+  FlogItem aItems[100];
+  TEST_ASSERT_TRUE(openFlashCursor(oCursor, 0, 0, UINT32_MAX));
+  TEST_ASSERT_EQUAL(100, readFlashCursor(oCursor, aItems, 100, nullptr));
+  TEST_ASSERT_EQUAL(100, aItems[99].uSeq);
+
+  // Blocks 0 and 1 recycled under the cursor
+  const uint32_t uSamples = uFull + 2 * RAW_PER_BLOCK;
+  for (uint32_t uSeq = uFull + 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+  uint32_t uFirstSeq = 0, uLastSeq = 0;
+  uint32_t uRead = drainRawCursor(oCursor, uFirstSeq, uLastSeq);
+  TEST_ASSERT_EQUAL(2 * RAW_PER_BLOCK + 1, uFirstSeq);
+  TEST_ASSERT_EQUAL(uSamples, uLastSeq);
+  TEST_ASSERT_EQUAL(uFull, uRead);
+
+  // One step per stored sample, from the oldest one
+  StepCheck oCheck;
+  memset(&oCheck, 0, sizeof(oCheck));
+  FlogQueryStats oQuery;
+  uint32_t uSteps = queryFlashLog(EPOCH0, epochOf(uSamples), SAMPLE_PERIOD, checkStep, &oCheck, &oQuery);
+  TEST_ASSERT_EQUAL(uFull, uSteps);
+  TEST_ASSERT_EQUAL(uFull, oCheck.uSteps);
+  TEST_ASSERT_EQUAL(epochOf(2 * RAW_PER_BLOCK + 1), oCheck.uFirstStart);
+  TEST_ASSERT_EQUAL(epochOf(uSamples), oCheck.uLastStart);
+  TEST_ASSERT_EQUAL(uFull, oCheck.auSamples[STATS_HUM]);
+  TEST_ASSERT_EQUAL(0, oQuery.uTier);
+  TEST_ASSERT_EQUAL(oStats.uCapacity, oQuery.uBlocksRead);
+}
+
+// A record failing its CRC is skipped, a record torn by a power loss too and
+// the next boot appends after it ; a block whose header fails its CRC leaves
+// the index at the next boot
+void test_torn_and_corrupt_records(void)
+{
+  freshLog();
+  const uint32_t uSamples = 2 * RAW_PER_BLOCK + 100;
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+
+  // Bit flip in the temperature of sample 41 (block 0, slot 40)
+  uint8_t uFlipped = 0x5A;
+  patchLog(rawRecordOffset(0, 40) + offsetof(FlogRecord, iTmp), &uFlipped, 1);
+
+  // Sample uSamples + 1 torn : sequence number and time written, the rest still erased
+  FlogRecord oTorn;
+  memset(&oTorn, 0xFF, sizeof(oTorn));
+  oTorn.uSeq = uSamples + 1;
+  oTorn.uEpoch = epochOf(uSamples + 1);
+  patchLog(rawRecordOffset(2, 100), &oTorn, sizeof(oTorn));
+
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+  FlashLogStats oStats;
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  TEST_ASSERT_EQUAL(uSamples + 1, oStats.uRecords); // the torn slot is used
+  TEST_ASSERT_EQUAL(epochOf(uSamples), oStats.uNewestEpoch);
+  for (uint32_t uSeq = uSamples + 2; uSeq <= uSamples + 6; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+
+  FlogCursor oCursor;
+  FlogItem aItems[READ_ITEMS];
+  uint32_t uItems = 0, uRead;
+  TEST_ASSERT_TRUE(openFlashCursor(oCursor, 0, 0, UINT32_MAX));
+  while ((uRead = readFlashCursor(oCursor, aItems, READ_ITEMS, nullptr)) > 0)
+  {
+    for (uint32_t uItem = 0; uItem < uRead; uItem++)
+    {
+      TEST_ASSERT_NOT_EQUAL(41, aItems[uItem].uSeq);
+      TEST_ASSERT_NOT_EQUAL(uSamples + 1, aItems[uItem].uSeq);
+      TEST_ASSERT_EQUAL(storedTmp(aItems[uItem].uSeq), aItems[uItem].aiMean[STATS_TMP]);
+    }
+    uItems += uRead;
+  }
+  TEST_ASSERT_EQUAL(uSamples - 1 + 5, uItems);
+
+  StepCheck oCheck;
+  memset(&oCheck, 0, sizeof(oCheck));
+  TEST_ASSERT_EQUAL(uSamples - 1 + 5, queryFlashLog(EPOCH0, UINT32_MAX, SAMPLE_PERIOD, checkStep, &oCheck, nullptr));
+
+  // Header of block 0 corrupted : the index starts at block 1 after a reboot
+  uint8_t uZero = 0;
+  patchLog(offsetof(FlogBlockHeader, uFirstEpoch), &uZero, 1);
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  TEST_ASSERT_EQUAL(2, oStats.uBlocks);
+  TEST_ASSERT_EQUAL(epochOf(RAW_PER_BLOCK + 1), oStats.uOldestEpoch);
+}
+
+// Cost of a query of the last hour and of the whole raw tier as the log fills
+void test_query_latency_vs_log_size(void)
+{
+  static const uint32_t auSizes[] = {1, 12, 48, 96};
+  static const uint32_t uRepeats = 20;
+  char acMessage[160];
+
+  freshLog();
+  uint32_t uSeq = 0;
+  for (uint32_t uSize : auSizes)
+  {
+    while (uSeq < uSize * RAW_PER_BLOCK)
+    {
+      appendSample(++uSeq);
+    }
+
+    StepCheck oCheck;
+    FlogQueryStats oHour, oWhole;
+    auto tStart = std::chrono::steady_clock::now();
+    for (uint32_t uRepeat = 0; uRepeat < uRepeats; uRepeat++)
+    {
+      memset(&oCheck, 0, sizeof(oCheck));
+      queryFlashLog(epochOf(uSeq) - 3600, epochOf(uSeq), 300, checkStep, &oCheck, &oHour);
+    }
+    double dHourMicros = elapsedMicros(tStart) / uRepeats;
+    TEST_ASSERT_EQUAL(3600 / SAMPLE_PERIOD, oCheck.auSamples[STATS_HUM] - 1); // both ends included
+    tStart = std::chrono::steady_clock::now();
+    for (uint32_t uRepeat = 0; uRepeat < uRepeats; uRepeat++)
+    {
+      memset(&oCheck, 0, sizeof(oCheck));
+      queryFlashLog(EPOCH0, epochOf(uSeq), 3600, checkStep, &oCheck, &oWhole);
+    }
+    double dWholeMicros = elapsedMicros(tStart) / uRepeats;
+    TEST_ASSERT_EQUAL(uSeq, oCheck.auSamples[STATS_HUM]);
+    TEST_ASSERT_EQUAL(uSize, oWhole.uBlocksRead);
+
+    snprintf(acMessage, sizeof(acMessage),
+             "%3u blocks (%5u records) : last hour %7.1f us (%u blocks read), whole log %8.1f us (%u blocks)", uSize,
+             uSeq, dHourMicros, oHour.uBlocksRead, dWholeMicros, oWhole.uBlocksRead);
+    TEST_MESSAGE(acMessage);
+  }
+}
+
+// Every closed 5-min step of the samples becomes one aggregate with their
+// count, mean, min and max, every closed hour one aggregate of those
+void test_compaction_aggregates(void)
+{
+  freshLog();
+  const uint32_t uSamples = 3 * 3600 / SAMPLE_PERIOD + 1; // hours 0 and 1 closed, 2 still open
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+  TEST_ASSERT_TRUE(compactAll() > 0);
+  checkAggregates(1, 300, uSamples, 36);
+  checkAggregates(2, 3600, uSamples, 2);
+
+  FlashLogStats oStats;
+  TEST_ASSERT_TRUE(getFlashLogStats(1, oStats));
+  TEST_ASSERT_EQUAL(36, oStats.uRecords);
+  TEST_ASSERT_EQUAL(EPOCH0 + 35 * 300, oStats.uNewestEpoch);
+  CompactionStats oCompaction;
+  getCompactionStats(oCompaction);
+  TEST_ASSERT_EQUAL(0, oCompaction.uBacklog);
+}
+
+// Reboots in the middle of the compaction (the aggregate being built is lost)
+// leave the same aggregates as one uninterrupted run, none twice
+void test_compaction_resumes_after_reboot(void)
+{
+  freshLog();
+  const uint32_t uSamples = 12 * 3600 / SAMPLE_PERIOD + 1; // 11 hours closed
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+  // A reboot every 5 slices, until the backlog is read : a resumed
+  // compaction reads its source block again from the start, then goes on
+  uint32_t uReboots = 0;
+  CompactionStats oCompaction;
+  for (;;)
+  {
+    for (uint8_t uSlice = 0; uSlice < 5; uSlice++)
+    {
+      compactFlashLog(FLOG_COMPACT_SLICE);
+    }
+    getCompactionStats(oCompaction);
+    if (oCompaction.uBacklog == 0 || uReboots == 100)
+    {
+      break;
+    }
+    TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+    uReboots++;
+  }
+  TEST_ASSERT_TRUE(uReboots > 3);
+  TEST_ASSERT_TRUE(uReboots < 100);
+  checkAggregates(1, 300, uSamples, 144);
+  checkAggregates(2, 3600, uSamples, 11);
+
+  // One more reboot once caught up : nothing written twice
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+  compactAll();
+  checkAggregates(1, 300, uSamples, 144);
+  checkAggregates(2, 3600, uSamples, 11);
+
+  // Samples appended after the last reboot close the open hour
+  for (uint32_t uSeq = uSamples + 1; uSeq <= uSamples + 3600 / SAMPLE_PERIOD; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+  compactAll();
+  checkAggregates(1, 300, uSamples + 3600 / SAMPLE_PERIOD, 156);
+  checkAggregates(2, 3600, uSamples + 3600 / SAMPLE_PERIOD, 12);
+}
+
+// Compacting as the samples come, past the raw tier span : a query from the
+// first sample reads the hourly tier, then the 5-min one, then the raw
+// samples not compacted yet, with every sample counted once
+void test_query_spans_tiers(void)
+{
+  freshLog();
+  FlashLogStats oStats;
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  const uint32_t uSamples = oStats.uCapacity * RAW_PER_BLOCK + 5000; // the first days only in the aggregates
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+    if (uSeq % 64 == 0)
+    {
+      compactFlashLog(FLOG_COMPACT_SLICE);
+    }
+  }
+  TEST_ASSERT_TRUE(getFlashLogStats(0, oStats));
+  TEST_ASSERT_TRUE(oStats.uOldestEpoch > EPOCH0 + 86400);
+
+  static const uint32_t auSteps[] = {3600, 300};
+  for (uint32_t uStep : auSteps)
+  {
+    StepCheck oCheck;
+    memset(&oCheck, 0, sizeof(oCheck));
+    FlogQueryStats oQuery;
+    uint32_t uSteps = queryFlashLog(EPOCH0, epochOf(uSamples), uStep, checkStep, &oCheck, &oQuery);
+    TEST_ASSERT_EQUAL((uStep == 3600) ? 2 : 1, oQuery.uTier);
+    TEST_ASSERT_EQUAL((epochOf(uSamples) - EPOCH0) / uStep + 1, uSteps);
+    TEST_ASSERT_EQUAL(EPOCH0, oCheck.uFirstStart);
+    TEST_ASSERT_EQUAL(uSamples, oCheck.auSamples[STATS_HUM]);
+    TEST_ASSERT_EQUAL(uSamples - uSamples / 53, oCheck.auSamples[STATS_TMP]);
+  }
+}
+
+// Compaction of a raw backlog, in slices of FLOG_COMPACT_SLICE records
+void test_compaction_throughput(void)
+{
+  char acMessage[160];
+  freshLog();
+  const uint32_t uSamples = 20000;
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    appendSample(uSeq);
+  }
+  CompactionStats oBefore, oAfter;
+  getCompactionStats(oBefore);
+  auto tStart = std::chrono::steady_clock::now();
+  uint32_t uSlices = compactAll();
+  double dMicros = elapsedMicros(tStart);
+  getCompactionStats(oAfter);
+  uint32_t uRead = oAfter.uRecordsRead - oBefore.uRecordsRead;
+  TEST_ASSERT_TRUE(uRead >= uSamples);
+  TEST_ASSERT_EQUAL(0, oAfter.uBacklog);
+  checkAggregates(1, 300, uSamples, (epochOf(uSamples) - EPOCH0) / 300);
+
+  snprintf(acMessage, sizeof(acMessage),
+           "%u records read (%u aggregates written) in %u slices : %.1f ms, %.0f records/s, %.1f us per slice",
+           uRead, oAfter.uAggregates - oBefore.uAggregates, uSlices, dMicros / 1000.0, uRead / (dMicros / 1e6),
+           dMicros / uSlices);
+  TEST_MESSAGE(acMessage);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_append_wraps);
+  RUN_TEST(test_read_across_recycled_block);
+  RUN_TEST(test_torn_and_corrupt_records);
+  RUN_TEST(test_query_latency_vs_log_size);
+  RUN_TEST(test_compaction_aggregates);
+  RUN_TEST(test_compaction_resumes_after_reboot);
+  RUN_TEST(test_query_spans_tiers);
+  RUN_TEST(test_compaction_throughput);
+  unlink(LOG_PATH);
+  return UNITY_END();
+}
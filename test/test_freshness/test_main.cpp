@@ -0,0 +1,84 @@
+// Freshness histograms : bucket boundaries, mean / max / last, and the
+// clamp of the latencies reported by the page
+
+#include <unity.h>
+
+#include <stdint.h>
+
+#include "freshness.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// A value on a bound falls in that bucket, one more in the next one
+void test_bucket_bounds(void)
+{
+  FreshnessHistogram oBefore, oAfter;
+  for (uint8_t uBucket = 0; uBucket < FRESH_BUCKET_COUNT - 1; uBucket++)
+  {
+    getFreshness(FRESH_SERVED, oBefore);
+    recordFreshness(FRESH_SERVED, freshnessBound(uBucket));
+    recordFreshness(FRESH_SERVED, freshnessBound(uBucket) + 1);
+    TEST_ASSERT_TRUE(getFreshness(FRESH_SERVED, oAfter));
+    TEST_ASSERT_EQUAL(oBefore.auBuckets[uBucket] + 1, oAfter.auBuckets[uBucket]);
+    TEST_ASSERT_EQUAL(oBefore.auBuckets[uBucket + 1] + 1, oAfter.auBuckets[uBucket + 1]);
+    TEST_ASSERT_EQUAL(freshnessBound(uBucket) + 1, oAfter.uLastMs);
+  }
+  getFreshness(FRESH_SERVED, oBefore);
+  recordFreshness(FRESH_SERVED, 0);
+  getFreshness(FRESH_SERVED, oAfter);
+  TEST_ASSERT_EQUAL(oBefore.auBuckets[0] + 1, oAfter.auBuckets[0]);
+  TEST_ASSERT_EQUAL(UINT32_MAX, freshnessBound(FRESH_BUCKET_COUNT - 1));
+  TEST_ASSERT_EQUAL(UINT32_MAX, freshnessBound(FRESH_BUCKET_COUNT));
+}
+
+void test_count_mean_max(void)
+{
+  FreshnessHistogram oHistogram;
+  TEST_ASSERT_TRUE(getFreshness(FRESH_DISPLAYED, oHistogram));
+  TEST_ASSERT_EQUAL(0, oHistogram.uCount);
+  TEST_ASSERT_EQUAL(0, oHistogram.uMeanMs);
+  recordFreshness(FRESH_DISPLAYED, 10000);
+  recordFreshness(FRESH_DISPLAYED, 30000);
+  recordFreshness(FRESH_DISPLAYED, 20000);
+  getFreshness(FRESH_DISPLAYED, oHistogram);
+  TEST_ASSERT_EQUAL(3, oHistogram.uCount);
+  TEST_ASSERT_EQUAL(20000, oHistogram.uMeanMs);
+  TEST_ASSERT_EQUAL(30000, oHistogram.uMaxMs);
+  TEST_ASSERT_EQUAL(20000, oHistogram.uLastMs);
+
+  FreshnessHistogram oInvalid;
+  TEST_ASSERT_FALSE(getFreshness(FRESH_KIND_COUNT, oInvalid));
+  recordFreshness(FRESH_KIND_COUNT, 1000); // ignored
+}
+
+// A bogus report is clamped, a served age is not
+void test_displayed_clamp(void)
+{
+  FreshnessHistogram oBefore, oAfter;
+  getFreshness(FRESH_DISPLAYED, oBefore);
+  recordFreshness(FRESH_DISPLAYED, 2000000000);
+  getFreshness(FRESH_DISPLAYED, oAfter);
+  TEST_ASSERT_EQUAL(FRESH_DISPLAYED_MAX_MS, oAfter.uMaxMs);
+  TEST_ASSERT_EQUAL(FRESH_DISPLAYED_MAX_MS, oAfter.uLastMs);
+  TEST_ASSERT_EQUAL(oBefore.auBuckets[FRESH_BUCKET_COUNT - 1] + 1, oAfter.auBuckets[FRESH_BUCKET_COUNT - 1]);
+  TEST_ASSERT_EQUAL((oBefore.uMeanMs * oBefore.uCount + FRESH_DISPLAYED_MAX_MS) / oAfter.uCount, oAfter.uMeanMs);
+
+  recordFreshness(FRESH_SERVED, 2000000000);
+  getFreshness(FRESH_SERVED, oAfter);
+  TEST_ASSERT_EQUAL(2000000000, oAfter.uMaxMs);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bucket_bounds);
+  RUN_TEST(test_count_mean_max);
+  RUN_TEST(test_displayed_clamp);
+  return UNITY_END();
+}
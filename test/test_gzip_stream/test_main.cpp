@@ -0,0 +1,299 @@
+// Streaming gzip compressor and history export : every output inflated by
+// zlib must give the input back, whatever the gzipCompress() input sizes
+// and the fillExport() buffer sizes, in every export format ; the CSV
+// export must compress at least MIN_CSV_RATIO, incompressible input may
+// only grow by the stored block overhead, and a refused export says why
+
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <chrono>
+
+#include "flash_log.h"
+#include "gzip_stream.h"
+#include "history_export.h"
+
+#define LOG_PATH "/tmp/test_gzip_stream.bin"
+#define EPOCH0 1699999200UL
+#define SAMPLES 8000           // about 2.8 days of 30 s samples
+#define BUFFER_LEN (640 * 1024) // largest export (NDJSON of the raw tier) and its compressed form
+#define MIN_CSV_RATIO 3.3 // measured 3.45x (zlib -6 : 3.63x with the same 2 KB window)
+
+static uint8_t auPlain[BUFFER_LEN];
+static uint8_t auPacked[BUFFER_LEN];
+static uint8_t auInflated[BUFFER_LEN];
+static GzipStream oStream;
+
+// Compress pIn with gzipCompress() calls of uChunk bytes
+static size_t gzipAll(const uint8_t *pIn, size_t uLen, size_t uChunk, uint8_t *pOut)
+{
+  size_t uOutLen = gzipBegin(oStream, 0, pOut);
+  for (size_t uAt = 0; uAt < uLen; uAt += uChunk)
+  {
+    size_t uWritten = gzipCompress(oStream, pIn + uAt, (uLen - uAt < uChunk) ? uLen - uAt : uChunk, pOut + uOutLen);
+    TEST_ASSERT_TRUE(uWritten <= GZIP_OUT_MAX);
+    uOutLen += uWritten;
+  }
+  size_t uWritten = gzipFinish(oStream, pOut + uOutLen);
+  TEST_ASSERT_TRUE(uWritten <= GZIP_OUT_MAX);
+  return uOutLen + uWritten;
+}
+
+// Inflate a gzip stream with zlib (header, CRC and length checked), returns the output length
+static size_t gunzip(const uint8_t *pIn, size_t uLen, uint8_t *pOut, size_t uMaxLen)
+{
+  z_stream oZlib;
+  memset(&oZlib, 0, sizeof(oZlib));
+  TEST_ASSERT_EQUAL(Z_OK, inflateInit2(&oZlib, 16 + MAX_WBITS));
+  oZlib.next_in = (Bytef *)pIn;
+  oZlib.avail_in = uLen;
+  oZlib.next_out = pOut;
+  oZlib.avail_out = uMaxLen;
+  TEST_ASSERT_EQUAL(Z_STREAM_END, inflate(&oZlib, Z_FINISH));
+  TEST_ASSERT_EQUAL(0, oZlib.avail_in);
+  size_t uOutLen = oZlib.total_out;
+  inflateEnd(&oZlib);
+  return uOutLen;
+}
+
+// zlib gzip stream size at a level and window (reference ratios)
+static size_t zlibSize(const uint8_t *pIn, size_t uLen, int iLevel, int iWindowBits)
+{
+  z_stream oZlib;
+  memset(&oZlib, 0, sizeof(oZlib));
+  TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&oZlib, iLevel, Z_DEFLATED, 16 + iWindowBits, 8, Z_DEFAULT_STRATEGY));
+  oZlib.next_in = (Bytef *)pIn;
+  oZlib.avail_in = uLen;
+  oZlib.next_out = auInflated;
+  oZlib.avail_out = sizeof(auInflated);
+  TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&oZlib, Z_FINISH));
+  size_t uOutLen = oZlib.total_out;
+  deflateEnd(&oZlib);
+  return uOutLen;
+}
+
+// Compress with uChunk byte inputs, inflate and compare, returns the compressed length
+static size_t checkRoundTrip(const uint8_t *pIn, size_t uLen, size_t uChunk)
+{
+  size_t uPacked = gzipAll(pIn, uLen, uChunk, auPacked);
+  TEST_ASSERT_EQUAL(uLen, gunzip(auPacked, uPacked, auInflated, sizeof(auInflated)));
+  TEST_ASSERT_EQUAL(0, memcmp(pIn, auInflated, uLen));
+  return uPacked;
+}
+
+// A whole export through fillExport() calls of at most uBufferLen bytes
+static size_t exportAll(ExportFormat eFormat, uint8_t uTier, bool bGzip, size_t uBufferLen, uint8_t *pOut)
+{
+  uint32_t uId;
+  TEST_ASSERT_EQUAL(EXPORT_STARTED, beginExport(eFormat, uTier, 0, UINT32_MAX, bGzip, uId));
+  TEST_ASSERT_TRUE(uId != 0);
+  size_t uOutLen = 0, uFilled;
+  while ((uFilled = fillExport(uId, pOut + uOutLen, uBufferLen)) > 0)
+  {
+    TEST_ASSERT_TRUE(uFilled <= uBufferLen);
+    uOutLen += uFilled;
+    TEST_ASSERT_TRUE(uOutLen + uBufferLen <= BUFFER_LEN);
+  }
+  endExport(uId);
+  return uOutLen;
+}
+
+// A flash log of SAMPLES drifting samples, compacted
+static void fillLog()
+{
+  unlink(LOG_PATH);
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+  srand(1);
+  float fTmp = 21.0f, fHum = 45.0f;
+  for (uint32_t uSeq = 1; uSeq <= SAMPLES; uSeq++)
+  {
+    Measurement oMeasurement;
+    memset(&oMeasurement, 0, sizeof(oMeasurement));
+    fTmp += (rand() % 21 - 10) / 100.0f;
+    fHum += (rand() % 41 - 20) / 100.0f;
+    oMeasurement.uSeq = uSeq;
+    oMeasurement.uEpoch = EPOCH0 + uSeq * 30;
+    oMeasurement.uNtpQuality = NTP_SYNCED;
+    oMeasurement.fTmp = fTmp;
+    oMeasurement.fHum = fHum;
+    oMeasurement.uFlags = (uSeq % 500) ? (MEAS_TMP_VALID | MEAS_HUM_VALID) : MEAS_HUM_VALID;
+    appendFlashLog(oMeasurement);
+  }
+  while (compactFlashLog(FLOG_COMPACT_SLICE) > 0)
+  {
+  }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// The CSV export and synthetic inputs across gzipCompress() input sizes
+void test_round_trip_chunk_sizes(void)
+{
+  static const size_t auChunks[] = {1, 7, 100, 1000, GZIP_BLOCK_LEN};
+  fillLog();
+  size_t uCsvLen = exportAll(EXPORT_CSV, 0, false, 4096, auPlain);
+  TEST_ASSERT_TRUE(uCsvLen > 200000);
+  for (size_t uChunk : auChunks)
+  {
+    checkRoundTrip(auPlain, uCsvLen, uChunk);
+  }
+
+  // Empty, zeros, random bytes, then random bytes repeated past the window
+  checkRoundTrip(auPlain, 0, GZIP_BLOCK_LEN);
+  static uint8_t auSynthetic[96 * 1024];
+  memset(auSynthetic, 0, sizeof(auSynthetic));
+  checkRoundTrip(auSynthetic, sizeof(auSynthetic), GZIP_BLOCK_LEN);
+  for (size_t uAt = 0; uAt < sizeof(auSynthetic); uAt++)
+  {
+    auSynthetic[uAt] = (uAt < 1500 || uAt % 5000 < 3000) ? rand() : auSynthetic[uAt % 1500];
+  }
+  for (size_t uChunk : auChunks)
+  {
+    checkRoundTrip(auSynthetic, sizeof(auSynthetic), uChunk);
+  }
+}
+
+// Every format of both tier kinds, gzipped through fillExport() buffers of
+// several sizes, inflates to the plain export
+void test_export_formats(void)
+{
+  static const ExportFormat aeFormats[] = {EXPORT_CSV, EXPORT_NDJSON, EXPORT_BINARY};
+  static const char *const apNames[] = {"csv", "ndjson", "bin"};
+  static const size_t auBuffers[] = {1, 64, 1436, 5744};
+  char acMessage[160];
+  fillLog();
+  for (uint8_t uTier = 0; uTier < 2; uTier++)
+  {
+    for (uint8_t uFormat = 0; uFormat < 3; uFormat++)
+    {
+      size_t uPlainLen = exportAll(aeFormats[uFormat], uTier, false, 4096, auPlain);
+      TEST_ASSERT_TRUE(uPlainLen > 0);
+      size_t uPackedLen = 0;
+      for (size_t uBuffer : auBuffers)
+      {
+        uPackedLen = exportAll(aeFormats[uFormat], uTier, true, uBuffer, auPacked);
+        TEST_ASSERT_EQUAL(uPlainLen, gunzip(auPacked, uPackedLen, auInflated, sizeof(auInflated)));
+        TEST_ASSERT_EQUAL(0, memcmp(auPlain, auInflated, uPlainLen));
+      }
+      snprintf(acMessage, sizeof(acMessage), "tier %u %-6s : %7u -> %6u bytes, %.2fx (zlib -6 %.2fx)", uTier,
+               apNames[uFormat], (unsigned)uPlainLen, (unsigned)uPackedLen, (double)uPlainLen / uPackedLen,
+               (double)uPlainLen / zlibSize(auPlain, uPlainLen, 6, MAX_WBITS));
+      TEST_MESSAGE(acMessage);
+    }
+  }
+  ExportStats oStats;
+  getExportStats(oStats);
+  TEST_ASSERT_EQUAL(oStats.uStarted, oStats.uCompleted);
+}
+
+// Ratio on the raw CSV export against zlib with the same and the default window
+void test_csv_ratio(void)
+{
+  char acMessage[160];
+  fillLog();
+  size_t uCsvLen = exportAll(EXPORT_CSV, 0, false, 4096, auPlain);
+  size_t uPacked = checkRoundTrip(auPlain, uCsvLen, GZIP_BLOCK_LEN);
+  double dRatio = (double)uCsvLen / uPacked;
+  snprintf(acMessage, sizeof(acMessage), "CSV %u bytes : %.2fx, zlib -6 with a 2 KB window %.2fx, 32 KB %.2fx",
+           (unsigned)uCsvLen, dRatio, (double)uCsvLen / zlibSize(auPlain, uCsvLen, 6, 11),
+           (double)uCsvLen / zlibSize(auPlain, uCsvLen, 6, MAX_WBITS));
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_TRUE(dRatio >= MIN_CSV_RATIO);
+}
+
+// Random bytes are stored (5 bytes per deflate block), zeros shrink
+void test_incompressible_and_zeros(void)
+{
+  static uint8_t auInput[64 * 1024];
+  char acMessage[160];
+  srand(7);
+  for (size_t uAt = 0; uAt < sizeof(auInput); uAt++)
+  {
+    auInput[uAt] = rand();
+  }
+  size_t uBlocks = (sizeof(auInput) + GZIP_DEFLATE_BLOCK - 1) / GZIP_DEFLATE_BLOCK;
+  size_t uPacked = checkRoundTrip(auInput, sizeof(auInput), GZIP_BLOCK_LEN);
+  TEST_ASSERT_TRUE(uPacked <= sizeof(auInput) + GZIP_HEADER_LEN + 8 + 5 * uBlocks + 1);
+  snprintf(acMessage, sizeof(acMessage), "random %u bytes : %u bytes (%.3fx)", (unsigned)sizeof(auInput),
+           (unsigned)uPacked, (double)sizeof(auInput) / uPacked);
+  TEST_MESSAGE(acMessage);
+
+  memset(auInput, 0, sizeof(auInput));
+  uPacked = checkRoundTrip(auInput, sizeof(auInput), GZIP_BLOCK_LEN);
+  snprintf(acMessage, sizeof(acMessage), "zeros %u bytes : %u bytes (%.0fx, zlib -6 %.0fx)", (unsigned)sizeof(auInput),
+           (unsigned)uPacked, (double)sizeof(auInput) / uPacked,
+           (double)sizeof(auInput) / zlibSize(auInput, sizeof(auInput), 6, MAX_WBITS));
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_TRUE(sizeof(auInput) / uPacked >= 100);
+}
+
+// Compression speed on the CSV export
+void test_throughput(void)
+{
+  char acMessage[160];
+  fillLog();
+  size_t uCsvLen = exportAll(EXPORT_CSV, 0, false, 4096, auPlain);
+  const uint32_t uRepeats = 5;
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t uRepeat = 0; uRepeat < uRepeats; uRepeat++)
+  {
+    gzipAll(auPlain, uCsvLen, GZIP_BLOCK_LEN, auPacked);
+  }
+  double dMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tStart).count();
+  snprintf(acMessage, sizeof(acMessage), "CSV compressed at %.1f MB/s (%.0f us per %u byte call)",
+           uRepeats * uCsvLen / dMicros, dMicros / uRepeats / ((uCsvLen + GZIP_BLOCK_LEN - 1) / GZIP_BLOCK_LEN),
+           GZIP_BLOCK_LEN);
+  TEST_MESSAGE(acMessage);
+}
+
+// Each refusal has its own reason, only a running export makes the next one wait
+void test_export_refusals(void)
+{
+  uint32_t uId, uOther;
+  TEST_ASSERT_FALSE(beginFlashLog("/nonexistent/test_gzip_stream.bin"));
+  TEST_ASSERT_EQUAL(EXPORT_NO_LOG, beginExport(EXPORT_CSV, 0, 0, UINT32_MAX, false, uId));
+  TEST_ASSERT_EQUAL(0, uId);
+  unlink(LOG_PATH);
+  TEST_ASSERT_TRUE(beginFlashLog(LOG_PATH));
+  TEST_ASSERT_EQUAL(EXPORT_EMPTY, beginExport(EXPORT_CSV, 0, 0, UINT32_MAX, false, uId));
+  TEST_ASSERT_EQUAL(EXPORT_BAD_TIER, beginExport(EXPORT_CSV, FLOG_TIER_COUNT, 0, UINT32_MAX, false, uId));
+
+  fillLog();
+  ExportStats oBefore, oAfter;
+  getExportStats(oBefore);
+  TEST_ASSERT_EQUAL(EXPORT_STARTED, beginExport(EXPORT_CSV, 0, 0, UINT32_MAX, false, uId));
+  TEST_ASSERT_EQUAL(EXPORT_BUSY, beginExport(EXPORT_NDJSON, 1, 0, UINT32_MAX, false, uOther));
+  TEST_ASSERT_EQUAL(0, uOther);
+  TEST_ASSERT_EQUAL(EXPORT_BAD_TIER, beginExport(EXPORT_CSV, FLOG_TIER_COUNT, 0, UINT32_MAX, false, uOther));
+  endExport(uId);
+  TEST_ASSERT_EQUAL(EXPORT_STARTED, beginExport(EXPORT_NDJSON, 1, 0, UINT32_MAX, false, uOther));
+  TEST_ASSERT_TRUE(uOther != uId);
+  endExport(uOther);
+  getExportStats(oAfter);
+  TEST_ASSERT_EQUAL(oBefore.uRefused + 1, oAfter.uRefused);
+  TEST_ASSERT_EQUAL(oBefore.uStarted + 2, oAfter.uStarted);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_chunk_sizes);
+  RUN_TEST(test_export_formats);
+  RUN_TEST(test_csv_ratio);
+  RUN_TEST(test_incompressible_and_zeros);
+  RUN_TEST(test_throughput);
+  RUN_TEST(test_export_refusals);
+  unlink(LOG_PATH);
+  return UNITY_END();
+}
@@ -0,0 +1,321 @@
+// Heap fragmentation monitor : soak test at virtual time. A first-fit heap
+// model (address-ordered free list with coalescing, as a small MCU heap)
+// takes the firmware's allocations, sampleHeap() is fed its free size and
+// largest free block every HEAP_SAMPLE_PERIOD. The web layer's churn going
+// through the block pools must keep the trend flat for a month ; a slow leak
+// of scattered small blocks must be reported as rising. Both runs follow each
+// other on one virtual clock, as the monitor keeps its window across them.
+
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "heap_monitor.h"
+#include "block_pool.h"
+
+#define SIM_HEAP_LEN (96 * 1024) // heap left to the application (bytes)
+#define SIM_MAX_BLOCKS 4096
+#define SIM_ALIGN 8
+#define SIM_HEADER 8              // per-block overhead
+#define SIM_REQUEST_PERIOD 10000  // one web request every n ms (virtual time)
+#define SIM_MAX_LIVE 16           // requests in flight
+#define SIM_DAYS 30
+
+// ============================== HEAP MODEL ==============================
+
+// Blocks sorted by address, free or used, covering the whole heap
+struct SimBlock
+{
+  uint32_t uOffset;
+  uint32_t uLen;
+  bool bUsed;
+};
+
+static SimBlock aBlocks[SIM_MAX_BLOCKS];
+static uint32_t uBlockCount = 0;
+
+static void heapReset()
+{
+  aBlocks[0] = {0, SIM_HEAP_LEN, false};
+  uBlockCount = 1;
+}
+
+// First fit, returns the block offset + 1 (0 : out of memory)
+static uint32_t heapAlloc(uint32_t uSize)
+{
+  uint32_t uLen = (uSize + SIM_HEADER + SIM_ALIGN - 1) & ~(SIM_ALIGN - 1);
+  for (uint32_t uBlock = 0; uBlock < uBlockCount; uBlock++)
+  {
+    SimBlock &oBlock = aBlocks[uBlock];
+    if (oBlock.bUsed || oBlock.uLen < uLen)
+    {
+      continue;
+    }
+    if (oBlock.uLen - uLen >= SIM_HEADER + SIM_ALIGN && uBlockCount < SIM_MAX_BLOCKS)
+    {
+      memmove(&aBlocks[uBlock + 2], &aBlocks[uBlock + 1], (uBlockCount - uBlock - 1) * sizeof(SimBlock));
+      aBlocks[uBlock + 1] = {oBlock.uOffset + uLen, oBlock.uLen - uLen, false};
+      oBlock.uLen = uLen;
+      uBlockCount++;
+    }
+    oBlock.bUsed = true;
+    return oBlock.uOffset + 1;
+  }
+  return 0;
+}
+
+static void heapFree(uint32_t uHandle)
+{
+  if (uHandle == 0)
+  {
+    return;
+  }
+  uint32_t uBlock = 0;
+  while (aBlocks[uBlock].uOffset != uHandle - 1)
+  {
+    uBlock++;
+  }
+  aBlocks[uBlock].bUsed = false;
+  // Coalesce with the next then the previous free neighbour
+  if (uBlock + 1 < uBlockCount && !aBlocks[uBlock + 1].bUsed)
+  {
+    aBlocks[uBlock].uLen += aBlocks[uBlock + 1].uLen;
+    memmove(&aBlocks[uBlock + 1], &aBlocks[uBlock + 2], (uBlockCount - uBlock - 2) * sizeof(SimBlock));
+    uBlockCount--;
+  }
+  if (uBlock > 0 && !aBlocks[uBlock - 1].bUsed)
+  {
+    aBlocks[uBlock - 1].uLen += aBlocks[uBlock].uLen;
+    memmove(&aBlocks[uBlock], &aBlocks[uBlock + 1], (uBlockCount - uBlock - 1) * sizeof(SimBlock));
+    uBlockCount--;
+  }
+}
+
+static void heapState(uint32_t &uFree, uint32_t &uMaxBlock)
+{
+  uFree = 0;
+  uMaxBlock = 0;
+  for (uint32_t uBlock = 0; uBlock < uBlockCount; uBlock++)
+  {
+    if (!aBlocks[uBlock].bUsed)
+    {
+      uFree += aBlocks[uBlock].uLen;
+      uMaxBlock = (aBlocks[uBlock].uLen > uMaxBlock) ? aBlocks[uBlock].uLen : uMaxBlock;
+    }
+  }
+}
+
+// ============================== ALLOCATION PATTERN ==============================
+
+// One allocation : from a block pool, or from the heap model
+struct SimAlloc
+{
+  void *pPooled;
+  uint32_t uHandle;
+};
+
+static bool bUsePools = true;
+
+static SimAlloc simAlloc(uint32_t uSize)
+{
+  SimAlloc oAlloc = {nullptr, 0};
+  if (bUsePools)
+  {
+    BlockPoolStats oStats;
+    uint32_t uMissesBefore = 0;
+    for (uint8_t uClass = 0; getPoolStats(uClass, oStats); uClass++)
+    {
+      uMissesBefore += oStats.uMisses;
+    }
+    uint32_t uOversizeBefore = poolOversize();
+    void *pBlock = poolAlloc(uSize);
+    uint32_t uMissesAfter = 0;
+    for (uint8_t uClass = 0; getPoolStats(uClass, oStats); uClass++)
+    {
+      uMissesAfter += oStats.uMisses;
+    }
+    if (uMissesAfter == uMissesBefore && poolOversize() == uOversizeBefore)
+    {
+      oAlloc.pPooled = pBlock;
+      return oAlloc;
+    }
+    poolFree(pBlock); // pool fallback : the device heap takes it, i.e. the model
+  }
+  oAlloc.uHandle = heapAlloc(uSize);
+  return oAlloc;
+}
+
+static void simFree(SimAlloc &oAlloc)
+{
+  if (oAlloc.pPooled != nullptr)
+  {
+    poolFree(oAlloc.pPooled);
+  }
+  heapFree(oAlloc.uHandle);
+  oAlloc = {nullptr, 0};
+}
+
+static uint32_t uRandomState = 1;
+static uint32_t nextRandom()
+{
+  uRandomState = uRandomState * 1664525u + 1013904223u;
+  return uRandomState >> 8;
+}
+
+struct SimRequest
+{
+  SimAlloc aAllocs[8];
+  uint8_t uCount;
+};
+
+static SimRequest aLive[SIM_MAX_LIVE];
+static unsigned long ulVirtualMillis = 1000;
+static SimAlloc aLongLived[64]; // e.g. TCP control blocks, DNS entries
+static uint32_t auLongLivedUntil[64];
+
+struct SoakResult
+{
+  float fMaxSlope;   // max. slope once the window is full
+  float fFirstRiseDay; // first day reported rising, -1 if never
+  uint32_t uFailedAllocs;
+  HeapTrend oTrend;
+};
+
+// SIM_DAYS of traffic, uLeakPeriod : one 24..88-byte block never freed every
+// n requests (0 : no leak)
+static SoakResult soak(uint32_t uLeakPeriod)
+{
+  SoakResult oResult = {-1000.0f, -1.0f, 0, {}};
+  const uint32_t uRequests = SIM_DAYS * 86400000ULL / SIM_REQUEST_PERIOD;
+  const uint32_t uSamplePeriod = HEAP_SAMPLE_PERIOD / SIM_REQUEST_PERIOD;
+  uint32_t uSamplesAtStart = 0;
+  HeapTrend oTrend;
+  getHeapTrend(oTrend);
+  uSamplesAtStart = oTrend.uSamples;
+
+  for (uint32_t uRequest = 0; uRequest < uRequests; uRequest++, ulVirtualMillis += SIM_REQUEST_PERIOD)
+  {
+    // A request completes, another one arrives
+    SimRequest &oRequest = aLive[nextRandom() % SIM_MAX_LIVE];
+    for (uint8_t uAlloc = 0; uAlloc < oRequest.uCount; uAlloc++)
+    {
+      simFree(oRequest.aAllocs[uAlloc]);
+    }
+    static const uint16_t auSizes[] = {24, 32, 48, 64, 96, 120, 180, 240, 300, 460, 1100};
+    oRequest.uCount = 3 + nextRandom() % 6;
+    for (uint8_t uAlloc = 0; uAlloc < oRequest.uCount; uAlloc++)
+    {
+      oRequest.aAllocs[uAlloc] = simAlloc(auSizes[nextRandom() % (sizeof(auSizes) / sizeof(auSizes[0]))]);
+      oResult.uFailedAllocs += (oRequest.aAllocs[uAlloc].pPooled == nullptr && oRequest.aAllocs[uAlloc].uHandle == 0);
+    }
+
+    // Now and then a connection-lifetime object, kept for 1 to 48 hours
+    if (uRequest % 60 == 0)
+    {
+      uint32_t uSlot = nextRandom() % 64;
+      if (uRequest >= auLongLivedUntil[uSlot])
+      {
+        simFree(aLongLived[uSlot]);
+        aLongLived[uSlot] = simAlloc(16 + nextRandom() % 240);
+        auLongLivedUntil[uSlot] = uRequest + (1 + nextRandom() % 48) * 360;
+      }
+    }
+
+    if (uLeakPeriod != 0 && uRequest % uLeakPeriod == 0)
+    {
+      heapAlloc(24 + nextRandom() % 64); // lost : never freed
+    }
+
+    if (uRequest % uSamplePeriod == 0)
+    {
+      uint32_t uFree, uMaxBlock;
+      heapState(uFree, uMaxBlock);
+      bool bRising = sampleHeap(ulVirtualMillis, uFree, uMaxBlock);
+      getHeapTrend(oTrend);
+      if (oTrend.uSamples - uSamplesAtStart >= HEAP_HISTORY_LEN)
+      {
+        oResult.fMaxSlope = (oTrend.fSlopePerDay > oResult.fMaxSlope) ? oTrend.fSlopePerDay : oResult.fMaxSlope;
+        if (bRising && oResult.fFirstRiseDay < 0.0f)
+        {
+          oResult.fFirstRiseDay = (float)uRequest * SIM_REQUEST_PERIOD / 86400000.0f;
+        }
+      }
+    }
+  }
+  getHeapTrend(oResult.oTrend);
+  return oResult;
+}
+
+static void releaseAll()
+{
+  for (SimRequest &oRequest : aLive)
+  {
+    for (uint8_t uAlloc = 0; uAlloc < oRequest.uCount; uAlloc++)
+    {
+      simFree(oRequest.aAllocs[uAlloc]);
+    }
+    oRequest.uCount = 0;
+  }
+  for (uint32_t uSlot = 0; uSlot < 64; uSlot++)
+  {
+    simFree(aLongLived[uSlot]);
+    auLongLivedUntil[uSlot] = 0;
+  }
+}
+
+static void report(const char *pName, const SoakResult &oResult)
+{
+  char acMessage[200];
+  snprintf(acMessage, sizeof(acMessage),
+           "%s : max. slope %.2f permille/day (limit %.1f), first rise day %.1f, frag %u permille, "
+           "min. max. block %u, failed allocs %u",
+           pName, oResult.fMaxSlope, HEAP_FRAG_SLOPE_LIMIT, oResult.fFirstRiseDay, oResult.oTrend.uFragPermille,
+           oResult.oTrend.uMinMaxBlock, oResult.uFailedAllocs);
+  TEST_MESSAGE(acMessage);
+}
+
+// ============================== TESTS ==============================
+
+void setUp(void)
+{
+  heapReset();
+  uRandomState = 1;
+}
+
+void tearDown(void)
+{
+  releaseAll();
+}
+
+// The firmware's pattern with the web churn in the pools : flat for a month,
+// boot-time growth included
+void test_soak_pooled_month_is_flat(void)
+{
+  bUsePools = true;
+  SoakResult oResult = soak(0);
+  report("pooled", oResult);
+  TEST_ASSERT_EQUAL(0, oResult.uFailedAllocs);
+  TEST_ASSERT_TRUE(oResult.fFirstRiseDay < 0.0f);
+  TEST_ASSERT_LESS_OR_EQUAL(HEAP_FRAG_SLOPE_LIMIT, oResult.fMaxSlope);
+}
+
+// Scattered small blocks lost over time (about 10 a day) : the monitor must
+// report the rise well before an allocation fails
+void test_soak_leak_is_reported(void)
+{
+  bUsePools = true;
+  SoakResult oResult = soak(900);
+  report("leaking", oResult);
+  TEST_ASSERT_EQUAL(0, oResult.uFailedAllocs);
+  TEST_ASSERT_TRUE(oResult.fFirstRiseDay >= 0.0f);
+  TEST_ASSERT_GREATER_THAN(HEAP_FRAG_SLOPE_LIMIT, oResult.fMaxSlope);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_soak_pooled_month_is_flat);
+  RUN_TEST(test_soak_leak_is_reported);
+  return UNITY_END();
+}
@@ -0,0 +1,173 @@
+// Sample history store : nothing kept before the ring is placed, then the
+// ring wrapped over (internal RAM, or the PSRAM sized one when built with
+// -D HISTORY_EMULATE_PSRAM, pio test -e native_psram), block reads
+// identical to record reads, the time / sequence searches, and the write /
+// read throughput of the ring of that build
+
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "history_store.h"
+
+#define EPOCH0 1700000000UL
+#define BENCH_RECORDS (1UL << 20) // records written and read per throughput pass
+
+#ifdef HISTORY_EMULATE_PSRAM
+#define RING_MEMORY HISTORY_PSRAM
+#define RING_LEN HISTORY_PSRAM_LEN
+#define RING_NAME "PSRAM (emulated)"
+#else
+#define RING_MEMORY HISTORY_DRAM
+#define RING_LEN HISTORY_RAM_LEN
+#define RING_NAME "internal RAM"
+#endif
+
+static void addSample(uint32_t uSeq)
+{
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+  oMeasurement.uSeq = uSeq;
+  oMeasurement.uEpoch = EPOCH0 + uSeq * 30;
+  oMeasurement.fTmp = 20.0f + 5.0f * sinf(uSeq / 500.0f);
+  oMeasurement.fHum = 50.0f;
+  oMeasurement.uFlags = (uSeq % 97) ? (MEAS_TMP_VALID | MEAS_HUM_VALID) : MEAS_HUM_VALID;
+  addHistorySample(oMeasurement);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Before beginHistoryStore() there is no ring : samples are dropped, reads fail
+void test_unplaced_ring(void)
+{
+  HistoryInfo oInfo;
+  getHistoryInfo(oInfo);
+  TEST_ASSERT_EQUAL(0, oInfo.uCapacity);
+  addSample(1);
+  TEST_ASSERT_EQUAL(0, historyEnd());
+  TEST_ASSERT_EQUAL(0, historyFirst());
+  HistoryRecord oRecord;
+  TEST_ASSERT_FALSE(readHistory(0, oRecord));
+  TEST_ASSERT_EQUAL(0, findHistory(EPOCH0));
+}
+
+void test_ring_wraps(void)
+{
+  beginHistoryStore();
+  HistoryInfo oInfo;
+  getHistoryInfo(oInfo);
+  TEST_ASSERT_EQUAL(RING_MEMORY, oInfo.eMemory);
+  TEST_ASSERT_EQUAL(RING_LEN, oInfo.uCapacity);
+  TEST_ASSERT_EQUAL(RING_LEN * sizeof(HistoryRecord), oInfo.uBytes);
+
+  const uint32_t uSamples = oInfo.uCapacity + oInfo.uCapacity / 3 + 7;
+  for (uint32_t uSeq = 1; uSeq <= uSamples; uSeq++)
+  {
+    addSample(uSeq);
+  }
+  uint32_t uFirst = historyFirst(), uEnd = historyEnd();
+  TEST_ASSERT_EQUAL(uSamples, uEnd);
+  TEST_ASSERT_EQUAL(uSamples - oInfo.uCapacity, uFirst);
+
+  HistoryRecord aBlock[HISTORY_BLOCK_LEN], oRecord;
+  TEST_ASSERT_EQUAL(0, readHistoryBlock(uFirst - 1, aBlock));
+  for (uint32_t uIndex = uFirst; uIndex < uEnd;)
+  {
+    uint32_t uCount = readHistoryBlock(uIndex, aBlock);
+    TEST_ASSERT_TRUE(uCount > 0);
+    for (uint32_t uRecord = 0; uRecord < uCount; uRecord++)
+    {
+      TEST_ASSERT_TRUE(readHistory(uIndex + uRecord, oRecord));
+      TEST_ASSERT_EQUAL(0, memcmp(&oRecord, &aBlock[uRecord], sizeof(oRecord)));
+      TEST_ASSERT_EQUAL(uIndex + uRecord + 1, oRecord.uSeq);
+      if ((uIndex + uRecord + 1) % 97 == 0)
+      {
+        TEST_ASSERT_EQUAL(HISTORY_NONE, oRecord.iTmp);
+      }
+    }
+    uIndex += uCount;
+  }
+
+  // Searches : by time and by sequence number
+  TEST_ASSERT_EQUAL(uFirst, findHistory(0));
+  TEST_ASSERT_EQUAL(uFirst + 10, findHistory(EPOCH0 + (uFirst + 11) * 30));
+  TEST_ASSERT_EQUAL(uEnd, findHistory(EPOCH0 + (uEnd + 1) * 30));
+  TEST_ASSERT_EQUAL(uEnd - 5, findHistorySince(uEnd - 5));
+  TEST_ASSERT_EQUAL(uEnd, findHistorySince(uEnd));
+}
+
+// Appends, then reads of every stored record one by one and by blocks, over
+// BENCH_RECORDS records : compare the outputs of the native and native_psram
+// builds. On the host both rings are plain heap memory, so this measures the
+// cache footprint of the ring size, not the SPI RAM latency of the ESP32.
+void test_throughput(void)
+{
+  char acMessage[160];
+  beginHistoryStore();
+  HistoryInfo oInfo;
+  getHistoryInfo(oInfo);
+  uint32_t uSeq = historyEnd();
+
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uRecord = 0; uRecord < BENCH_RECORDS; uRecord++)
+  {
+    addSample(++uSeq);
+  }
+  double dWrite = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / BENCH_RECORDS;
+
+  HistoryRecord aBlock[HISTORY_BLOCK_LEN], oRecord;
+  uint32_t uChecksum = 0, uRead = 0;
+  oStart = std::chrono::steady_clock::now();
+  while (uRead < BENCH_RECORDS)
+  {
+    for (uint32_t uIndex = historyFirst(); uIndex < historyEnd(); uIndex++, uRead++)
+    {
+      TEST_ASSERT_TRUE(readHistory(uIndex, oRecord));
+      uChecksum += oRecord.uSeq;
+    }
+  }
+  double dRecord = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / uRead;
+
+  uint32_t uBlockChecksum = 0, uBlockRead = 0;
+  oStart = std::chrono::steady_clock::now();
+  while (uBlockRead < uRead)
+  {
+    for (uint32_t uIndex = historyFirst(); uIndex < historyEnd();)
+    {
+      uint32_t uCount = readHistoryBlock(uIndex, aBlock);
+      TEST_ASSERT_TRUE(uCount > 0);
+      for (uint32_t uAt = 0; uAt < uCount; uAt++)
+      {
+        uBlockChecksum += aBlock[uAt].uSeq;
+      }
+      uIndex += uCount;
+      uBlockRead += uCount;
+    }
+  }
+  double dBlock = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / uBlockRead;
+  TEST_ASSERT_EQUAL(uRead, uBlockRead);
+  TEST_ASSERT_EQUAL(uChecksum, uBlockChecksum);
+
+  snprintf(acMessage, sizeof(acMessage),
+           "%s ring of %u records (%u KB) : append %.1f ns, readHistory() %.1f ns, readHistoryBlock() %.1f ns per record",
+           RING_NAME, oInfo.uCapacity, oInfo.uBytes / 1024, dWrite, dRecord, dBlock);
+  TEST_MESSAGE(acMessage);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_unplaced_ring);
+  RUN_TEST(test_ring_wraps);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
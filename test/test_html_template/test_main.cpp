@@ -0,0 +1,220 @@
+// Pre-split template renderer : output and benchmark against the template
+// processor it replaced (ESPAsyncWebServer's byte-by-byte %PLACEHOLDER%
+// scan calling a processor that returns a String per placeholder)
+
+#include <unity.h>
+
+#include <chrono>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index_html.h"
+#include "html_template.h"
+
+#define CHUNK_LEN 1436 // a TCP segment, as asked by the web server
+#define BENCH_PAGES 20000
+
+// ============================== ALLOCATION COUNTER ==============================
+
+static size_t uAllocations = 0;
+static size_t uAllocatedBytes = 0;
+
+void *operator new(size_t uSize)
+{
+  uAllocations++;
+  uAllocatedBytes += uSize;
+  void *p = malloc(uSize ? uSize : 1);
+  if (p == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// ============================== REFERENCE PROCESSOR ==============================
+
+// Arduino String of the 1.0 core : every non-empty value is a heap block
+class HeapString
+{
+public:
+  explicit HeapString(const char *pText, size_t uLen) : _uLen(uLen), _pText(new char[uLen + 1])
+  {
+    memcpy(_pText, pText, uLen);
+    _pText[uLen] = '\0';
+  }
+  ~HeapString() { delete[] _pText; }
+  bool operator==(const char *pText) const { return strcmp(_pText, pText) == 0; }
+  const char *c_str() const { return _pText; }
+  size_t length() const { return _uLen; }
+
+private:
+  size_t _uLen;
+  char *_pText;
+};
+
+static const char *const apNames[TPL_VAR_COUNT] = {"MEASURETIME", "REFRESHTIME", "TEMPERATURE", "HUMIDITY"};
+static const char *const apValues[TPL_VAR_COUNT] = {"12:34:30", "12:34:56", "21.50", "48.20"};
+
+static HeapString processOutput(const HeapString &oVar)
+{
+  for (uint8_t uVar = 0; uVar < TPL_VAR_COUNT; uVar++)
+  {
+    if (oVar == apNames[uVar])
+    {
+      return HeapString(apValues[uVar], strlen(apValues[uVar]));
+    }
+  }
+  return HeapString("", 0);
+}
+
+// The replaced path : the template is scanned for '%', each name becomes a
+// String and is replaced by the processor's String. Returns the page length
+static size_t renderWithProcessor(char *pPage)
+{
+  size_t uOut = 0;
+  size_t uLen = strlen(index_html);
+  for (size_t uPos = 0; uPos < uLen;)
+  {
+    char c = index_html[uPos];
+    const char *pEnd = (c == '%') ? strchr(index_html + uPos + 1, '%') : nullptr;
+    if (pEnd == nullptr || pEnd - (index_html + uPos) > TPL_NAME_LEN)
+    {
+      pPage[uOut++] = c;
+      uPos++;
+      continue;
+    }
+    HeapString oName(index_html + uPos + 1, pEnd - index_html - uPos - 1);
+    HeapString oValue = processOutput(oName);
+    bool bKnown = false;
+    for (uint8_t uVar = 0; uVar < TPL_VAR_COUNT; uVar++)
+    {
+      bKnown = bKnown || oName == apNames[uVar];
+    }
+    if (!bKnown)
+    {
+      pPage[uOut++] = c;
+      uPos++;
+      continue;
+    }
+    memcpy(pPage + uOut, oValue.c_str(), oValue.length());
+    uOut += oValue.length();
+    uPos = pEnd - index_html + 1;
+  }
+  return uOut;
+}
+
+// ============================== TESTS ==============================
+
+static uint8_t auChunk[CHUNK_LEN];
+static uint8_t auPage[16384];
+static char acExpected[16384];
+
+void setUp(void)
+{
+  for (uint8_t uVar = 0; uVar < TPL_VAR_COUNT; uVar++)
+  {
+    setTemplateValue((TemplateVar)uVar, apValues[uVar]);
+  }
+}
+
+void tearDown(void)
+{
+}
+
+// Whole page in chunks of uChunk bytes, returns its length
+static size_t renderPage(const TemplateSnapshot &oSnapshot, size_t uTotal, size_t uChunk)
+{
+  size_t uIndex = 0;
+  while (uIndex < uTotal)
+  {
+    size_t uLen = renderTemplate(oSnapshot, auChunk, uChunk, uIndex);
+    if (uLen == 0)
+    {
+      break;
+    }
+    memcpy(auPage + uIndex, auChunk, uLen);
+    uIndex += uLen;
+  }
+  return uIndex;
+}
+
+void test_split_template(void)
+{
+  TEST_ASSERT_TRUE(initTemplate(index_html));
+}
+
+void test_same_page_as_processor(void)
+{
+  size_t uExpected = renderWithProcessor(acExpected);
+  TemplateSnapshot oSnapshot;
+  size_t uTotal = snapshotTemplate(oSnapshot);
+  TEST_ASSERT_EQUAL(uExpected, uTotal);
+  // Any chunk size the web server may ask for
+  const size_t auChunks[] = {1, 7, 64, 536, CHUNK_LEN};
+  for (size_t uChunk : auChunks)
+  {
+    memset(auPage, 0, sizeof(auPage));
+    TEST_ASSERT_EQUAL(uTotal, renderPage(oSnapshot, uTotal, uChunk));
+    TEST_ASSERT_EQUAL_MEMORY(acExpected, auPage, uTotal);
+  }
+}
+
+void test_snapshot_isolated_from_updates(void)
+{
+  TemplateSnapshot oSnapshot;
+  size_t uTotal = snapshotTemplate(oSnapshot);
+  setTemplateValue(TPL_TEMPERATURE, "-10.25");
+  TEST_ASSERT_EQUAL(uTotal, renderPage(oSnapshot, uTotal, CHUNK_LEN));
+  auPage[uTotal] = '\0';
+  TEST_ASSERT_NOT_NULL(strstr((const char *)auPage, "21.50"));
+  TEST_ASSERT_NULL(strstr((const char *)auPage, "-10.25"));
+}
+
+void test_bench_against_processor(void)
+{
+  TemplateSnapshot oSnapshot;
+  size_t uTotal = snapshotTemplate(oSnapshot);
+
+  size_t uAllocBefore = uAllocations;
+  size_t uBytesBefore = uAllocatedBytes;
+  auto oStart = std::chrono::steady_clock::now();
+  for (int iPage = 0; iPage < BENCH_PAGES; iPage++)
+  {
+    renderPage(oSnapshot, snapshotTemplate(oSnapshot), CHUNK_LEN);
+  }
+  double dSegmentUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - oStart).count() / BENCH_PAGES;
+  size_t uSegmentAllocs = uAllocations - uAllocBefore;
+
+  uAllocBefore = uAllocations;
+  uBytesBefore = uAllocatedBytes;
+  size_t uCheck = 0;
+  oStart = std::chrono::steady_clock::now();
+  for (int iPage = 0; iPage < BENCH_PAGES; iPage++)
+  {
+    uCheck += renderWithProcessor(acExpected);
+  }
+  double dProcessorUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - oStart).count() / BENCH_PAGES;
+  double dProcessorAllocs = (double)(uAllocations - uAllocBefore) / BENCH_PAGES;
+  double dProcessorBytes = (double)(uAllocatedBytes - uBytesBefore) / BENCH_PAGES;
+
+  char acLine[160];
+  snprintf(acLine, sizeof(acLine), "page %u bytes : segments %.2f us, %u allocations ; processor %.2f us, %.1f allocations (%.0f bytes)",
+           (unsigned)uTotal, dSegmentUs, (unsigned)uSegmentAllocs, dProcessorUs, dProcessorAllocs, dProcessorBytes);
+  TEST_MESSAGE(acLine);
+  TEST_ASSERT_EQUAL(uTotal * BENCH_PAGES, uCheck);
+  TEST_ASSERT_EQUAL(0, uSegmentAllocs);
+  TEST_ASSERT_LESS_THAN(dProcessorUs, dSegmentUs);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_split_template);
+  RUN_TEST(test_same_page_as_processor);
+  RUN_TEST(test_snapshot_isolated_from_updates);
+  RUN_TEST(test_bench_against_processor);
+  return UNITY_END();
+}
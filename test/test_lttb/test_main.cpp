@@ -0,0 +1,209 @@
+// LTTB downsampling : the selection against a straightforward reference on
+// fixed series, first and last points kept, the pass-through of small
+// series, holes, and the time for a year of 30 s samples
+
+#include <unity.h>
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "lttb.h"
+
+#define SERIES_LEN 10000
+#define YEAR_LEN 1051200 // a year of 30 s samples
+#define HOLE NAN
+
+static std::vector<float> afSeries; // y of point i (x = 30 i), NAN for a hole
+
+static bool readPoint(uint32_t uIndex, float &fX, float &fY, void *pContext)
+{
+  const std::vector<float> &afY = *(const std::vector<float> *)pContext;
+  if (isnan(afY[uIndex]))
+  {
+    return false;
+  }
+  fX = 30.0f * uIndex;
+  fY = afY[uIndex];
+  return true;
+}
+
+static void makeSeries(std::vector<float> &afY, uint32_t uLen, uint32_t uSeed)
+{
+  std::mt19937 oRandom(uSeed);
+  std::normal_distribution<float> oNoise(0.0f, 0.2f);
+  afY.resize(uLen);
+  for (uint32_t uIndex = 0; uIndex < uLen; uIndex++)
+  {
+    afY[uIndex] = 20.0f + 3.0f * sinf(uIndex / 300.0f) + oNoise(oRandom);
+  }
+}
+
+// Textbook LTTB on [uFirst, uEnd) without holes, in double : interior
+// bucket b is [uFirst + 1 + floor(b * every), uFirst + 1 + floor((b + 1) * every)),
+// the last one ending before the last point
+static std::vector<uint32_t> referenceLttb(const std::vector<float> &afY, uint32_t uFirst, uint32_t uEnd, uint16_t uPoints)
+{
+  std::vector<uint32_t> auSelected;
+  uint32_t uBuckets = uPoints - 2;
+  double dEvery = (double)(uEnd - uFirst - 2) / uBuckets;
+  auto bucketStart = [&](uint32_t uBucket) {
+    return (uBucket >= uBuckets) ? uEnd - 1 : uFirst + 1 + (uint32_t)(uBucket * dEvery);
+  };
+  uint32_t uA = uFirst;
+  auSelected.push_back(uFirst);
+  for (uint32_t uBucket = 0; uBucket < uBuckets; uBucket++)
+  {
+    // C : average of the next bucket, or the last point
+    double dCX = 0.0, dCY = 0.0;
+    uint32_t uNextStart = bucketStart(uBucket + 1), uNextEnd = (uBucket + 1 < uBuckets) ? bucketStart(uBucket + 2) : uEnd;
+    for (uint32_t uIndex = uNextStart; uIndex < uNextEnd; uIndex++)
+    {
+      dCX += 30.0 * uIndex;
+      dCY += afY[uIndex];
+    }
+    dCX /= uNextEnd - uNextStart;
+    dCY /= uNextEnd - uNextStart;
+
+    double dMaxArea = -1.0;
+    uint32_t uMax = 0;
+    for (uint32_t uIndex = bucketStart(uBucket); uIndex < bucketStart(uBucket + 1); uIndex++)
+    {
+      double dArea = fabs((30.0 * uA - dCX) * (afY[uIndex] - afY[uA]) - (30.0 * uA - 30.0 * uIndex) * (dCY - afY[uA]));
+      if (dArea > dMaxArea)
+      {
+        dMaxArea = dArea;
+        uMax = uIndex;
+      }
+    }
+    auSelected.push_back(uMax);
+    uA = uMax;
+  }
+  auSelected.push_back(uEnd - 1);
+  return auSelected;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_matches_reference(void)
+{
+  const struct
+  {
+    uint32_t uFirst, uEnd;
+    uint16_t uPoints;
+  } aCases[] = {{0, SERIES_LEN, 300}, {1234, 8765, 300}, {0, SERIES_LEN, 3}, {17, 1017, 999}, {0, SERIES_LEN, 1000}};
+  std::vector<uint32_t> auSelected(1000);
+  std::vector<float> afScratch(LTTB_SCRATCH_LEN(1000));
+  for (uint32_t uSeed = 1; uSeed <= 5; uSeed++)
+  {
+    makeSeries(afSeries, SERIES_LEN, uSeed);
+    for (const auto &oCase : aCases)
+    {
+      uint16_t uSelected = lttbDownsample(oCase.uFirst, oCase.uEnd, oCase.uPoints, readPoint, &afSeries,
+                                          auSelected.data(), afScratch.data());
+      std::vector<uint32_t> auReference = referenceLttb(afSeries, oCase.uFirst, oCase.uEnd, oCase.uPoints);
+      TEST_ASSERT_EQUAL(auReference.size(), uSelected);
+      TEST_ASSERT_EQUAL_UINT32_ARRAY(auReference.data(), auSelected.data(), uSelected);
+    }
+  }
+}
+
+// First and last points kept, uPoints points, increasing
+void test_first_and_last_kept(void)
+{
+  makeSeries(afSeries, SERIES_LEN, 7);
+  std::vector<uint32_t> auSelected(500);
+  std::vector<float> afScratch(LTTB_SCRATCH_LEN(500));
+  for (uint16_t uPoints : {3, 4, 50, 500})
+  {
+    uint16_t uSelected = lttbDownsample(100, 9100, uPoints, readPoint, &afSeries, auSelected.data(), afScratch.data());
+    TEST_ASSERT_EQUAL(uPoints, uSelected);
+    TEST_ASSERT_EQUAL(100, auSelected[0]);
+    TEST_ASSERT_EQUAL(9099, auSelected[uSelected - 1]);
+    for (uint16_t uPoint = 1; uPoint < uSelected; uPoint++)
+    {
+      TEST_ASSERT_TRUE(auSelected[uPoint] > auSelected[uPoint - 1]);
+    }
+  }
+}
+
+// No more points than asked : every valid point, in order
+void test_small_series_pass_through(void)
+{
+  makeSeries(afSeries, 100, 3);
+  std::vector<uint32_t> auSelected(300);
+  std::vector<float> afScratch(LTTB_SCRATCH_LEN(300));
+  for (uint16_t uPoints : {100, 101, 300})
+  {
+    TEST_ASSERT_EQUAL(100, lttbDownsample(0, 100, uPoints, readPoint, &afSeries, auSelected.data(), afScratch.data()));
+    for (uint32_t uIndex = 0; uIndex < 100; uIndex++)
+    {
+      TEST_ASSERT_EQUAL(uIndex, auSelected[uIndex]);
+    }
+  }
+  afSeries[5] = afSeries[50] = HOLE;
+  TEST_ASSERT_EQUAL(98, lttbDownsample(0, 100, 100, readPoint, &afSeries, auSelected.data(), afScratch.data()));
+  TEST_ASSERT_EQUAL(6, auSelected[5]);
+  TEST_ASSERT_EQUAL(0, lttbDownsample(40, 40, 100, readPoint, &afSeries, auSelected.data(), afScratch.data()));
+}
+
+// Holes are never selected, leading ones start the series at the first valid point
+void test_holes(void)
+{
+  makeSeries(afSeries, SERIES_LEN, 11);
+  for (uint32_t uIndex = 0; uIndex < SERIES_LEN; uIndex += 7)
+  {
+    afSeries[uIndex] = HOLE;
+  }
+  for (uint32_t uIndex = 0; uIndex < 40; uIndex++)
+  {
+    afSeries[uIndex] = HOLE;
+  }
+  std::vector<uint32_t> auSelected(300);
+  std::vector<float> afScratch(LTTB_SCRATCH_LEN(300));
+  uint16_t uSelected = lttbDownsample(0, SERIES_LEN, 300, readPoint, &afSeries, auSelected.data(), afScratch.data());
+  TEST_ASSERT_TRUE(uSelected >= 290 && uSelected <= 300);
+  TEST_ASSERT_EQUAL(40, auSelected[0]);
+  for (uint16_t uPoint = 0; uPoint < uSelected; uPoint++)
+  {
+    TEST_ASSERT_FALSE(isnan(afSeries[auSelected[uPoint]]));
+  }
+}
+
+// A year of 30 s samples down to a chart
+void test_bench_year(void)
+{
+  makeSeries(afSeries, YEAR_LEN, 5);
+  std::vector<uint32_t> auSelected(1000);
+  std::vector<float> afScratch(LTTB_SCRATCH_LEN(1000));
+  char acMessage[120];
+  for (uint16_t uPoints : {300, 1000})
+  {
+    auto oStart = std::chrono::steady_clock::now();
+    uint16_t uSelected = lttbDownsample(0, YEAR_LEN, uPoints, readPoint, &afSeries, auSelected.data(), afScratch.data());
+    double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count();
+    TEST_ASSERT_EQUAL(uPoints, uSelected);
+    snprintf(acMessage, sizeof(acMessage), "%u samples -> %u points : %.1f ms (%.1f ns per sample)", YEAR_LEN, uPoints,
+             dMs, dMs * 1e6 / YEAR_LEN);
+    TEST_MESSAGE(acMessage);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_reference);
+  RUN_TEST(test_first_and_last_kept);
+  RUN_TEST(test_small_series_pass_through);
+  RUN_TEST(test_holes);
+  RUN_TEST(test_bench_year);
+  return UNITY_END();
+}
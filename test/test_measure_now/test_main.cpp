@@ -0,0 +1,173 @@
+// On-demand measurements : concurrent callers against a simulated sampler
+// on a virtual clock, periodic slots included. The sensor is never read
+// twice within MEASURE_NOW_MIN_INTERVAL, cached answers are recent enough,
+// every waiting caller gets a sample read after its request.
+
+#include <unity.h>
+
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "measure_now.h"
+
+#define SIM_CALLERS 6
+#define SIM_STEP 50            // sampler loop period (virtual milliseconds)
+#define SIM_SLOT_PERIOD 5000   // periodic sample slots (virtual milliseconds)
+#define SIM_DURATION 3600000UL // virtual run length (milliseconds)
+#define SIM_MAX_SAMPLES (SIM_DURATION / SIM_STEP + 2)
+
+static std::atomic<unsigned long> ulNow(0);
+static std::atomic<uint32_t> uPublishedSeq(0);
+static std::atomic<bool> bDone(false);
+// Sensor read time carried by each sample (written before it is published)
+static std::vector<std::atomic<unsigned long>> aulReadMillis(SIM_MAX_SAMPLES);
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct CallerResult
+{
+  uint32_t uRequests;
+  uint32_t uStale;  // cached answer older than MEASURE_NOW_MIN_INTERVAL
+  uint32_t uTooOld; // waited for a sample read before the request
+};
+
+// One web caller : request, wait for the sample if pending, check it
+static void runCaller(uint32_t uCaller, CallerResult &oResult)
+{
+  uint32_t uState = 99 + uCaller;
+  oResult = {0, 0, 0};
+  while (!bDone.load(std::memory_order_acquire))
+  {
+    uint32_t uSeq;
+    unsigned long ulRequest = ulNow.load(std::memory_order_acquire);
+    MeasureNowResult eResult = requestMeasureNow(ulRequest, uSeq);
+    oResult.uRequests++;
+    if (eResult == MEASURE_NOW_CACHED)
+    {
+      unsigned long ulRead = aulReadMillis[uSeq].load(std::memory_order_acquire);
+      oResult.uStale += (ulRequest - ulRead >= MEASURE_NOW_MIN_INTERVAL);
+    }
+    else
+    {
+      while (uPublishedSeq.load(std::memory_order_acquire) < uSeq && !bDone.load(std::memory_order_acquire))
+      {
+        std::this_thread::yield();
+      }
+      if (uPublishedSeq.load(std::memory_order_acquire) >= uSeq)
+      {
+        oResult.uTooOld += (aulReadMillis[uSeq].load(std::memory_order_acquire) < ulRequest);
+      }
+    }
+    // Think time : a few sampler steps
+    uState = uState * 1664525u + 1013904223u;
+    for (uint32_t uYield = (uState >> 24) % 64; uYield > 0; uYield--)
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void test_concurrent_callers(void)
+{
+  CallerResult aoResults[SIM_CALLERS];
+  std::vector<std::thread> aCallers;
+  beginMeasureNow(0);
+  for (uint32_t uCaller = 0; uCaller < SIM_CALLERS; uCaller++)
+  {
+    aCallers.emplace_back(runCaller, uCaller, std::ref(aoResults[uCaller]));
+  }
+
+  // Sampler, as loop() : slot due or pending request, the slot path reusing
+  // the last read when it is too recent
+  uint32_t uSeq = 0, uReads = 0, uReused = 0, uOnDemand = 0, uTooClose = 0;
+  unsigned long ulLastRead = 0;
+  for (unsigned long ulMillis = SIM_STEP; ulMillis < SIM_DURATION; ulMillis += SIM_STEP)
+  {
+    ulNow.store(ulMillis, std::memory_order_release);
+    bool bSlotDue = (ulMillis % SIM_SLOT_PERIOD == 0);
+    if (bSlotDue || measureNowPending(ulMillis))
+    {
+      unsigned long ulReadMillis = ulLastRead;
+      if (!bSlotDue || sensorReadAllowed(ulMillis))
+      {
+        uTooClose += (uReads > 0 && ulMillis - ulLastRead < MEASURE_NOW_MIN_INTERVAL);
+        ulLastRead = ulReadMillis = ulMillis;
+        uReads++;
+        uOnDemand += !bSlotDue;
+      }
+      else
+      {
+        uReused++;
+      }
+      aulReadMillis[++uSeq].store(ulReadMillis, std::memory_order_release);
+      measureNowTaken(uSeq, ulReadMillis);
+      uPublishedSeq.store(uSeq, std::memory_order_release);
+    }
+    for (uint8_t uYield = 0; uYield < 4; uYield++)
+    {
+      std::this_thread::yield();
+    }
+  }
+  bDone.store(true, std::memory_order_release);
+  for (std::thread &oCaller : aCallers)
+  {
+    oCaller.join();
+  }
+
+  uint32_t uRequests = 0, uStale = 0, uTooOld = 0;
+  for (const CallerResult &oResult : aoResults)
+  {
+    uRequests += oResult.uRequests;
+    uStale += oResult.uStale;
+    uTooOld += oResult.uTooOld;
+  }
+  uint32_t uCached, uScheduled, uJoined;
+  getMeasureNowStats(uCached, uScheduled, uJoined);
+
+  char acMessage[200];
+  snprintf(acMessage, sizeof(acMessage),
+           "%u requests : %u cached, %u scheduled, %u joined ; %u sensor reads (%u on demand), %u slots reused",
+           uRequests, uCached, uScheduled, uJoined, uReads, uOnDemand, uReused);
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_EQUAL(0, uTooClose);
+  TEST_ASSERT_EQUAL(0, uStale);
+  TEST_ASSERT_EQUAL(0, uTooOld);
+  TEST_ASSERT_EQUAL(uRequests, uCached + uScheduled + uJoined);
+  TEST_ASSERT_GREATER_OR_EQUAL(uOnDemand, uScheduled); // a slot may serve a scheduled read
+  TEST_ASSERT_GREATER_THAN(0, uReused);
+  TEST_ASSERT_GREATER_THAN(0, uJoined);
+}
+
+// A slot right after an on-demand read reuses it, the next one reads again
+void test_slot_reuses_recent_read(void)
+{
+  uint32_t uSeq;
+  unsigned long ulBase = 10000000UL;
+  TEST_ASSERT_TRUE(sensorReadAllowed(ulBase));
+  TEST_ASSERT_EQUAL(MEASURE_NOW_SCHEDULED, requestMeasureNow(ulBase, uSeq));
+  TEST_ASSERT_TRUE(measureNowPending(ulBase));
+  measureNowTaken(uSeq, ulBase);
+
+  TEST_ASSERT_FALSE(sensorReadAllowed(ulBase + 1500));
+  measureNowTaken(uSeq + 1, ulBase); // slot sample with the reused read
+  TEST_ASSERT_EQUAL(MEASURE_NOW_CACHED, requestMeasureNow(ulBase + 1900, uSeq));
+  TEST_ASSERT_FALSE(sensorReadAllowed(ulBase + 1999));
+  TEST_ASSERT_TRUE(sensorReadAllowed(ulBase + 2000));
+  TEST_ASSERT_EQUAL(MEASURE_NOW_SCHEDULED, requestMeasureNow(ulBase + 2000, uSeq));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_concurrent_callers);
+  RUN_TEST(test_slot_reuses_recent_read);
+  return UNITY_END();
+}
@@ -0,0 +1,197 @@
+// Measurement bus : delivery policies, counter consistency under a
+// concurrent producer and consumer, and publish/delivery throughput with
+// the firmware's sink count
+
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+#include "measurement_bus.h"
+
+#define BENCH_SINKS 10        // sinks subscribed by the firmware
+#define BENCH_RECORDS 2000000 // records published per measurement
+
+static std::atomic<uint32_t> auHandled[MBUS_MAX_SINKS];
+static uint32_t auLastSeq[MBUS_MAX_SINKS];
+static bool abOrdered[MBUS_MAX_SINKS];
+
+template <uint8_t SINK>
+static void countRecord(const Measurement &oMeasurement)
+{
+  if (auHandled[SINK].load(std::memory_order_relaxed) > 0 && oMeasurement.uSeq <= auLastSeq[SINK])
+  {
+    abOrdered[SINK] = false;
+  }
+  auLastSeq[SINK] = oMeasurement.uSeq;
+  auHandled[SINK].fetch_add(1, std::memory_order_relaxed);
+}
+
+static const MeasurementHandler apHandlers[BENCH_SINKS] = {
+    countRecord<0>, countRecord<1>, countRecord<2>, countRecord<3>, countRecord<4>,
+    countRecord<5>, countRecord<6>, countRecord<7>, countRecord<8>, countRecord<9>};
+
+static uint32_t uNextSeq = 1;
+
+void setUp(void)
+{
+  // Same mix as the firmware : mostly every-record sinks, some latest-only
+  if (sinkCount() == 0)
+  {
+    for (uint8_t uSink = 0; uSink < BENCH_SINKS; uSink++)
+    {
+      SinkPolicy ePolicy = (uSink == 1 || uSink == 2) ? SINK_LATEST : (uSink == 9) ? SINK_DECIMATED : SINK_EVERY;
+      subscribeMeasurements("sink", ePolicy, 4, apHandlers[uSink]);
+    }
+  }
+  deliverMeasurements();
+  for (uint8_t uSink = 0; uSink < BENCH_SINKS; uSink++)
+  {
+    auHandled[uSink] = 0;
+    abOrdered[uSink] = true;
+  }
+}
+
+void tearDown(void)
+{
+}
+
+static void publishNext()
+{
+  Measurement oMeasurement = {};
+  oMeasurement.uSeq = uNextSeq++;
+  oMeasurement.fTmp = 21.5f;
+  publishMeasurement(oMeasurement);
+}
+
+// Every record is delivered, dropped or skipped, nothing else
+static void assertCountersConsistent()
+{
+  MeasurementSinkStats oStats;
+  for (uint8_t uSink = 0; uSink < BENCH_SINKS; uSink++)
+  {
+    TEST_ASSERT_TRUE(getSinkStats(uSink, oStats));
+    TEST_ASSERT_EQUAL(0, oStats.uLag);
+    TEST_ASSERT_EQUAL(oStats.uOffered, oStats.uDelivered + oStats.uSkipped + oStats.uDropped);
+    TEST_ASSERT_TRUE(abOrdered[uSink]);
+  }
+}
+
+void test_policies(void)
+{
+  // Within the queue length : every sink sees its share, nothing dropped
+  for (uint8_t uRecord = 0; uRecord < MBUS_QUEUE_LEN; uRecord++)
+  {
+    publishNext();
+  }
+  TEST_ASSERT_EQUAL(7 * MBUS_QUEUE_LEN + 2 * 1 + MBUS_QUEUE_LEN / 4, deliverMeasurements());
+  TEST_ASSERT_EQUAL(MBUS_QUEUE_LEN, auHandled[0].load());
+  TEST_ASSERT_EQUAL(1, auHandled[1].load());                  // latest only
+  TEST_ASSERT_EQUAL(MBUS_QUEUE_LEN / 4, auHandled[9].load()); // one out of 4
+
+  // Past the queue length : the extra records are dropped and counted
+  MeasurementSinkStats oBefore, oAfter;
+  getSinkStats(0, oBefore);
+  for (uint8_t uRecord = 0; uRecord < MBUS_QUEUE_LEN + 3; uRecord++)
+  {
+    publishNext();
+  }
+  deliverMeasurements();
+  getSinkStats(0, oAfter);
+  TEST_ASSERT_EQUAL(3, oAfter.uDropped - oBefore.uDropped);
+  TEST_ASSERT_EQUAL(MBUS_QUEUE_LEN, oAfter.uMaxLag);
+  assertCountersConsistent();
+}
+
+// Sampler-side cost : one publish copies the record into every sink queue
+void test_bench_publish(void)
+{
+  auto oStart = std::chrono::steady_clock::now();
+  double dDeliverNs = 0;
+  for (uint32_t uRecord = 0; uRecord < BENCH_RECORDS; uRecord++)
+  {
+    publishNext();
+    if ((uRecord & (MBUS_QUEUE_LEN - 1)) == MBUS_QUEUE_LEN - 1)
+    {
+      auto oDeliver = std::chrono::steady_clock::now();
+      deliverMeasurements();
+      dDeliverNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oDeliver).count();
+    }
+  }
+  double dTotalNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count();
+  double dPublishNs = (dTotalNs - dDeliverNs) / BENCH_RECORDS;
+
+  char acMessage[160];
+  snprintf(acMessage, sizeof(acMessage), "%u sinks : publish %.0f ns, delivery %.0f ns per record (%.2f M records/s)",
+           BENCH_SINKS, dPublishNs, dDeliverNs / BENCH_RECORDS, BENCH_RECORDS / dTotalNs * 1000.0);
+  TEST_MESSAGE(acMessage);
+  assertCountersConsistent();
+  TEST_ASSERT_EQUAL(BENCH_RECORDS, auHandled[0].load());
+}
+
+// Sampler and delivery task on two threads : end-to-end hand-off rate (the
+// producer waits while a queue is full, as a slow sampler would), counters
+// consistent and every-record sinks served in order, none dropped
+static bool anyQueueFull()
+{
+  MeasurementSinkStats oStats;
+  for (uint8_t uSink = 0; getSinkStats(uSink, oStats); uSink++)
+  {
+    if (oStats.uLag >= MBUS_QUEUE_LEN)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void test_bench_concurrent(void)
+{
+  std::atomic<bool> bDone(false);
+  std::thread oConsumer([&bDone]() {
+    while (!bDone.load(std::memory_order_acquire))
+    {
+      if (deliverMeasurements() == 0)
+      {
+        std::this_thread::yield();
+      }
+    }
+    deliverMeasurements();
+  });
+
+  MeasurementSinkStats oBefore, oAfter;
+  getSinkStats(0, oBefore);
+  const uint32_t uRecords = BENCH_RECORDS / 4;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uRecord = 0; uRecord < uRecords; uRecord++)
+  {
+    while (anyQueueFull())
+    {
+      std::this_thread::yield();
+    }
+    publishNext();
+  }
+  bDone.store(true, std::memory_order_release);
+  oConsumer.join();
+  double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+
+  getSinkStats(0, oAfter);
+  char acMessage[200];
+  snprintf(acMessage, sizeof(acMessage), "concurrent : %.2f M records/s delivered to %u sinks (%u hardware threads)",
+           uRecords / dSeconds / 1e6, BENCH_SINKS, std::thread::hardware_concurrency());
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_EQUAL(uRecords, auHandled[0].load());
+  TEST_ASSERT_EQUAL(oBefore.uDropped, oAfter.uDropped);
+  assertCountersConsistent();
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_policies);
+  RUN_TEST(test_bench_publish);
+  RUN_TEST(test_bench_concurrent);
+  return UNITY_END();
+}
@@ -0,0 +1,129 @@
+// Quantile sketches : twenty days of drifting samples, the quantiles over
+// every day range checked against the exact order statistics of the same
+// samples (count exact, value within half a bin)
+
+#include <unity.h>
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "quantile_sketch.h"
+
+#define CHECK_DAYS 20
+#define CHECK_PERIOD 720 // query every n samples (6 h at 30 s)
+#define QUANTILE_COUNT 5
+
+static const float afQuantiles[QUANTILE_COUNT] = {0.05f, 0.25f, 0.5f, 0.75f, 0.95f};
+static std::vector<float> aafDays[STATS_CHANNEL_COUNT][QSKETCH_DAYS]; // samples per UTC day (ring)
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Exact quantiles of the last uDays days against the sketch, returns the max. error
+static float checkQuantiles(StatsChannel eChannel, uint32_t uToday, uint8_t uDays)
+{
+  std::vector<float> afAll;
+  for (uint8_t uDay = 0; uDay < uDays; uDay++)
+  {
+    const std::vector<float> &afDay = aafDays[eChannel][(uToday - uDay) % QSKETCH_DAYS];
+    afAll.insert(afAll.end(), afDay.begin(), afDay.end());
+  }
+  std::sort(afAll.begin(), afAll.end());
+
+  float afValues[QUANTILE_COUNT];
+  TEST_ASSERT_EQUAL(afAll.size(), getQuantiles(eChannel, uDays, afQuantiles, QUANTILE_COUNT, afValues));
+  float fError = 0.0f;
+  for (uint8_t uQuantile = 0; uQuantile < QUANTILE_COUNT; uQuantile++)
+  {
+    size_t uRank = (size_t)ceil(afQuantiles[uQuantile] * afAll.size());
+    fError = fmaxf(fError, fabsf(afAll[(uRank == 0) ? 0 : uRank - 1] - afValues[uQuantile]));
+  }
+  return fError;
+}
+
+void test_quantiles_within_half_bin(void)
+{
+  std::mt19937 oRandom(2);
+  std::normal_distribution<double> oNoise(0.0, 1.0);
+  uint32_t uEpoch = 1700000000;
+  uint32_t uLastDay = uEpoch / 86400;
+  double dTmp = 22.0, dHum = 45.0;
+  float afError[STATS_CHANNEL_COUNT] = {0.0f, 0.0f};
+  uint32_t uQueries = 0;
+
+  for (uint32_t uSample = 0; uSample < CHECK_DAYS * 2880; uSample++, uEpoch += 30)
+  {
+    // A new UTC day replaces the oldest one in the reference, as in the sketch
+    uint32_t uToday = uEpoch / 86400;
+    if (uToday != uLastDay)
+    {
+      aafDays[STATS_TMP][uToday % QSKETCH_DAYS].clear();
+      aafDays[STATS_HUM][uToday % QSKETCH_DAYS].clear();
+      uLastDay = uToday;
+    }
+    Measurement oMeasurement;
+    memset(&oMeasurement, 0, sizeof(oMeasurement));
+    dTmp += oNoise(oRandom) * 0.05 + 0.002 * sin(uEpoch / 5000.0);
+    dHum = fmin(100.0, fmax(0.0, dHum + oNoise(oRandom) * 0.3));
+    oMeasurement.uEpoch = uEpoch;
+    oMeasurement.fTmp = roundf(dTmp * 10) / 10;
+    oMeasurement.fHum = roundf(dHum * 10) / 10;
+    oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+    addSketchSample(oMeasurement);
+    aafDays[STATS_TMP][uToday % QSKETCH_DAYS].push_back(oMeasurement.fTmp);
+    aafDays[STATS_HUM][uToday % QSKETCH_DAYS].push_back(oMeasurement.fHum);
+
+    if (uSample % CHECK_PERIOD == 0)
+    {
+      for (uint8_t uDays = 1; uDays <= sketchDays(); uDays++)
+      {
+        afError[STATS_TMP] = fmaxf(afError[STATS_TMP], checkQuantiles(STATS_TMP, uToday, uDays));
+        afError[STATS_HUM] = fmaxf(afError[STATS_HUM], checkQuantiles(STATS_HUM, uToday, uDays));
+        uQueries++;
+      }
+    }
+  }
+
+  char acMessage[200];
+  snprintf(acMessage, sizeof(acMessage),
+           "%u queries : max. error temperature %.3f (half bin %.3f), humidity %.3f (half bin %.3f), %u bytes",
+           uQueries, afError[STATS_TMP], QSKETCH_TMP_STEP / 2, afError[STATS_HUM], QSKETCH_HUM_STEP / 2,
+           (unsigned)(QSKETCH_DAYS * (QSKETCH_TMP_BINS + QSKETCH_HUM_BINS) * sizeof(uint16_t)));
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_TRUE(afError[STATS_TMP] <= QSKETCH_TMP_STEP / 2 + 1e-4f);
+  TEST_ASSERT_TRUE(afError[STATS_HUM] <= QSKETCH_HUM_STEP / 2 + 1e-4f);
+}
+
+// On-demand and restored records are not counted
+void test_ignored_records(void)
+{
+  float fMedian;
+  uint32_t uBefore = getQuantiles(STATS_TMP, 1, &afQuantiles[2], 1, &fMedian);
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+  oMeasurement.uEpoch = 1700000000 + CHECK_DAYS * 86400 - 30;
+  oMeasurement.fTmp = 21.0f;
+  oMeasurement.fHum = 40.0f;
+  oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID | MEAS_ON_DEMAND;
+  addSketchSample(oMeasurement);
+  oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID | MEAS_RESTORED;
+  addSketchSample(oMeasurement);
+  TEST_ASSERT_EQUAL(uBefore, getQuantiles(STATS_TMP, 1, &afQuantiles[2], 1, &fMedian));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_quantiles_within_half_bin);
+  RUN_TEST(test_ignored_records);
+  return UNITY_END();
+}
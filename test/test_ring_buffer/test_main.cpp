@@ -0,0 +1,219 @@
+// Lock-free rings : multi-threaded stress (no item lost, duplicated, torn or
+// reordered per producer) and hand-off throughput. Also run under
+// ThreadSanitizer by [env:native_tsan] to check the memory ordering.
+
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "ring_buffer.h"
+
+#ifndef RING_STRESS_ITEMS
+#define RING_STRESS_ITEMS 2000000 // items per producer (fewer under TSan)
+#endif
+#define RING_PRODUCERS 4           // MPSC producers
+#define RING_LEN 64
+
+// Item larger than a word, so a torn copy shows up
+struct Item
+{
+  uint32_t uProducer;
+  uint32_t uSeq;
+  uint32_t uCheck; // ~uSeq ^ uProducer
+  uint32_t uPad;
+};
+
+static SpscRing<Item, RING_LEN> oSpsc;
+static MpscRing<Item, RING_LEN> oMpsc;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static Item makeItem(uint32_t uProducer, uint32_t uSeq)
+{
+  return {uProducer, uSeq, ~uSeq ^ uProducer, 0};
+}
+
+static void report(const char *pName, uint64_t ullItems, double dSeconds, uint64_t ullFull)
+{
+  char acMessage[160];
+  snprintf(acMessage, sizeof(acMessage), "%s : %.1f M items/s, %.0f ns per hand-off, producer found it full %llu times",
+           pName, ullItems / dSeconds / 1e6, dSeconds * 1e9 / ullItems, (unsigned long long)ullFull);
+  TEST_MESSAGE(acMessage);
+}
+
+// One producer thread, the consumer on the test thread : every item in order
+void test_spsc_stress(void)
+{
+  std::atomic<uint64_t> ullFull(0);
+  auto oStart = std::chrono::steady_clock::now();
+  std::thread oProducer([&ullFull]() {
+    uint64_t ullSpins = 0;
+    for (uint32_t uSeq = 0; uSeq < RING_STRESS_ITEMS; uSeq++)
+    {
+      while (!oSpsc.push(makeItem(0, uSeq)))
+      {
+        ullSpins++;
+        std::this_thread::yield();
+      }
+    }
+    ullFull = ullSpins;
+  });
+
+  uint32_t uExpected = 0;
+  uint32_t uErrors = 0;
+  Item oItem;
+  while (uExpected < RING_STRESS_ITEMS)
+  {
+    if (!oSpsc.pop(oItem))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    uErrors += (oItem.uSeq != uExpected || oItem.uCheck != (~oItem.uSeq ^ oItem.uProducer));
+    uExpected++;
+  }
+  oProducer.join();
+  double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+
+  TEST_ASSERT_EQUAL(0, uErrors);
+  TEST_ASSERT_TRUE(oSpsc.empty());
+  TEST_ASSERT_FALSE(oSpsc.pop(oItem));
+  report("SPSC", RING_STRESS_ITEMS, dSeconds, ullFull);
+}
+
+// RING_PRODUCERS producer threads : each producer's items arrive once, in order
+void test_mpsc_stress(void)
+{
+  std::atomic<uint64_t> ullFull(0);
+  std::vector<std::thread> aProducers;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uProducer = 0; uProducer < RING_PRODUCERS; uProducer++)
+  {
+    aProducers.emplace_back([uProducer, &ullFull]() {
+      uint64_t ullSpins = 0;
+      for (uint32_t uSeq = 0; uSeq < RING_STRESS_ITEMS; uSeq++)
+      {
+        while (!oMpsc.push(makeItem(uProducer, uSeq)))
+        {
+          ullSpins++;
+          std::this_thread::yield();
+        }
+      }
+      ullFull += ullSpins;
+    });
+  }
+
+  uint32_t auExpected[RING_PRODUCERS] = {};
+  uint64_t ullReceived = 0;
+  uint32_t uErrors = 0;
+  Item oItem;
+  while (ullReceived < (uint64_t)RING_PRODUCERS * RING_STRESS_ITEMS)
+  {
+    if (!oMpsc.pop(oItem))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    if (oItem.uProducer >= RING_PRODUCERS || oItem.uCheck != (~oItem.uSeq ^ oItem.uProducer) ||
+        oItem.uSeq != auExpected[oItem.uProducer])
+    {
+      uErrors++;
+    }
+    else
+    {
+      auExpected[oItem.uProducer]++;
+    }
+    ullReceived++;
+  }
+  for (std::thread &oProducer : aProducers)
+  {
+    oProducer.join();
+  }
+  double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+
+  TEST_ASSERT_EQUAL(0, uErrors);
+  for (uint32_t uProducer = 0; uProducer < RING_PRODUCERS; uProducer++)
+  {
+    TEST_ASSERT_EQUAL(RING_STRESS_ITEMS, auExpected[uProducer]);
+  }
+  TEST_ASSERT_TRUE(oMpsc.empty());
+  TEST_ASSERT_FALSE(oMpsc.pop(oItem));
+  report("MPSC", ullReceived, dSeconds, ullFull);
+}
+
+// Capacity limits and index wrap-around, single thread
+void test_full_and_wrap(void)
+{
+  Item oItem;
+  for (uint32_t uRound = 0; uRound < 3 * RING_LEN + 1; uRound++)
+  {
+    for (uint32_t uSeq = 0; uSeq < RING_LEN; uSeq++)
+    {
+      TEST_ASSERT_TRUE(oSpsc.push(makeItem(1, uSeq)));
+      TEST_ASSERT_TRUE(oMpsc.push(makeItem(2, uSeq)));
+    }
+    TEST_ASSERT_FALSE(oSpsc.push(makeItem(1, RING_LEN)));
+    TEST_ASSERT_FALSE(oMpsc.push(makeItem(2, RING_LEN)));
+    TEST_ASSERT_EQUAL(RING_LEN, oSpsc.size());
+    for (uint32_t uSeq = 0; uSeq < RING_LEN - uRound % 2; uSeq++)
+    {
+      TEST_ASSERT_TRUE(oSpsc.pop(oItem));
+      TEST_ASSERT_EQUAL(uSeq, oItem.uSeq);
+      TEST_ASSERT_TRUE(oMpsc.pop(oItem));
+      TEST_ASSERT_EQUAL(uSeq, oItem.uSeq);
+    }
+    // Odd rounds leave one item : drain it so the next round starts empty
+    while (oSpsc.pop(oItem) || oMpsc.pop(oItem))
+    {
+    }
+  }
+}
+
+// Same-thread push + pop : the cost of the ring operations alone
+void test_bench_uncontended(void)
+{
+  const uint32_t uCount = 10 * RING_STRESS_ITEMS;
+  Item oItem = {};
+  uint64_t ullCheck = 0;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uSeq = 0; uSeq < uCount; uSeq++)
+  {
+    oSpsc.push(makeItem(0, uSeq));
+    oSpsc.pop(oItem);
+    ullCheck += oItem.uSeq;
+  }
+  double dSpsc = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / uCount;
+  oStart = std::chrono::steady_clock::now();
+  for (uint32_t uSeq = 0; uSeq < uCount; uSeq++)
+  {
+    oMpsc.push(makeItem(0, uSeq));
+    oMpsc.pop(oItem);
+    ullCheck += oItem.uSeq;
+  }
+  double dMpsc = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / uCount;
+  TEST_ASSERT_EQUAL_UINT64((uint64_t)uCount * (uCount - 1), ullCheck);
+
+  char acMessage[120];
+  snprintf(acMessage, sizeof(acMessage), "push + pop, one thread : SPSC %.1f ns, MPSC %.1f ns", dSpsc, dMpsc);
+  TEST_MESSAGE(acMessage);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_full_and_wrap);
+  RUN_TEST(test_spsc_stress);
+  RUN_TEST(test_mpsc_stress);
+  RUN_TEST(test_bench_uncontended);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+// Sliding-window statistics : nine days of noisy samples with holes and
+// on-demand reads, every window checked against a brute-force recomputation
+// over the same samples, and the update cost per sample
+
+#include <unity.h>
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "rolling_stats.h"
+
+#define CHECK_DAYS 9
+#define CHECK_PERIOD 37         // compare with the reference every n samples
+#define HOLE (-32768)           // invalid value in the reference history
+#define MEAN_TOLERANCE 1e-4     // absolute (Celcius or percent)
+#define VARIANCE_TOLERANCE 1e-5 // relative
+#define BENCH_SAMPLES 1000000
+
+static const uint16_t auWindows[RSTATS_WINDOW_COUNT] = RSTATS_WINDOWS;
+static std::vector<int32_t> aaiHistory[STATS_CHANNEL_COUNT]; // hundredths, HOLE if invalid
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Brute force over the last window samples of one channel
+static void assertWindowMatches(uint8_t uWindow, StatsChannel eChannel, double &dMeanError, double &dVarianceError)
+{
+  const std::vector<int32_t> &aiValues = aaiHistory[eChannel];
+  size_t uBegin = (aiValues.size() > auWindows[uWindow]) ? aiValues.size() - auWindows[uWindow] : 0;
+  uint32_t uCount = 0;
+  int32_t iMin = INT32_MAX, iMax = INT32_MIN;
+  double dSum = 0.0;
+  for (size_t uSample = uBegin; uSample < aiValues.size(); uSample++)
+  {
+    if (aiValues[uSample] != HOLE)
+    {
+      uCount++;
+      dSum += aiValues[uSample];
+      iMin = (aiValues[uSample] < iMin) ? aiValues[uSample] : iMin;
+      iMax = (aiValues[uSample] > iMax) ? aiValues[uSample] : iMax;
+    }
+  }
+  double dMean = dSum / uCount, dSquares = 0.0;
+  for (size_t uSample = uBegin; uSample < aiValues.size(); uSample++)
+  {
+    if (aiValues[uSample] != HOLE)
+    {
+      dSquares += (aiValues[uSample] - dMean) * (aiValues[uSample] - dMean);
+    }
+  }
+  double dVariance = dSquares / uCount / 10000.0;
+
+  WindowStats oStats;
+  TEST_ASSERT_TRUE(getWindowStats(uWindow, eChannel, oStats));
+  TEST_ASSERT_EQUAL(uCount, oStats.uCount);
+  TEST_ASSERT_EQUAL(iMin, lroundf(oStats.fMin * 100));
+  TEST_ASSERT_EQUAL(iMax, lroundf(oStats.fMax * 100));
+  dMeanError = fmax(dMeanError, fabs(oStats.fMean - dMean / 100.0));
+  dVarianceError = fmax(dVarianceError, fabs(oStats.fVariance - dVariance) / ((dVariance > 1e-9) ? dVariance : 1.0));
+}
+
+void test_windows_match_brute_force(void)
+{
+  std::mt19937 oRandom(1);
+  std::normal_distribution<double> oNoise(0.0, 0.3);
+  const uint32_t uSamples = CHECK_DAYS * 86400 / 30;
+  double dTmp = 22.0, dHum = 45.0;
+  double dMeanError = 0.0, dVarianceError = 0.0;
+  uint32_t uChecks = 0;
+
+  for (uint32_t uSample = 0; uSample < uSamples; uSample++)
+  {
+    Measurement oMeasurement;
+    memset(&oMeasurement, 0, sizeof(oMeasurement));
+    dTmp += oNoise(oRandom) * 0.2 + 0.01 * sin(uSample / 500.0);
+    dHum = fmin(100.0, fmax(0.0, dHum + oNoise(oRandom) * 0.5));
+    oMeasurement.fTmp = roundf(dTmp * 10) / 10;
+    oMeasurement.fHum = roundf(dHum * 10) / 10;
+    oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+    if (uSample % 97 == 5)
+    {
+      oMeasurement.fHum = NAN;
+      oMeasurement.uFlags &= ~MEAS_HUM_VALID;
+    }
+    if (uSample % 1013 == 7)
+    {
+      // On-demand read : must not be counted
+      Measurement oOnDemand = oMeasurement;
+      oOnDemand.uFlags |= MEAS_ON_DEMAND;
+      addStatsSample(oOnDemand);
+    }
+    addStatsSample(oMeasurement);
+    aaiHistory[STATS_TMP].push_back(lroundf(oMeasurement.fTmp * 100));
+    aaiHistory[STATS_HUM].push_back((oMeasurement.uFlags & MEAS_HUM_VALID) ? lroundf(oMeasurement.fHum * 100) : HOLE);
+
+    if (uSample % CHECK_PERIOD == 0 || uSample == uSamples - 1)
+    {
+      for (uint8_t uWindow = 0; uWindow < RSTATS_WINDOW_COUNT; uWindow++)
+      {
+        assertWindowMatches(uWindow, STATS_TMP, dMeanError, dVarianceError);
+        assertWindowMatches(uWindow, STATS_HUM, dMeanError, dVarianceError);
+        uChecks++;
+      }
+    }
+  }
+
+  char acMessage[160];
+  snprintf(acMessage, sizeof(acMessage), "%u samples, %u window checks : max. mean error %.2g, max. relative variance error %.2g",
+           uSamples, uChecks, dMeanError, dVarianceError);
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_TRUE(dMeanError < MEAN_TOLERANCE);
+  TEST_ASSERT_TRUE(dVarianceError < VARIANCE_TOLERANCE);
+}
+
+// Update cost of all windows and channels for one sample
+void test_bench_add_sample(void)
+{
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+  oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uSample = 0; uSample < BENCH_SAMPLES; uSample++)
+  {
+    oMeasurement.fTmp = 20.0f + (uSample % 500) / 100.0f;
+    oMeasurement.fHum = 50.0f - (uSample % 700) / 100.0f;
+    addStatsSample(oMeasurement);
+  }
+  double dNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / BENCH_SAMPLES;
+
+  WindowStats oStats;
+  TEST_ASSERT_TRUE(getWindowStats(RSTATS_WINDOW_COUNT - 1, STATS_TMP, oStats));
+  TEST_ASSERT_EQUAL(RSTATS_RING_LEN, oStats.uCount);
+  char acMessage[80];
+  snprintf(acMessage, sizeof(acMessage), "add sample : %.0f ns (%u windows, 2 channels)", dNs, RSTATS_WINDOW_COUNT);
+  TEST_MESSAGE(acMessage);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_windows_match_brute_force);
+  RUN_TEST(test_bench_add_sample);
+  return UNITY_END();
+}
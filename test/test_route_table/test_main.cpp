@@ -0,0 +1,136 @@
+// Route lookup : correctness of the path index and benchmark at 5, 50 and
+// 200 routes against a linear scan (the stock handler list compares the URL
+// with every registered handler in turn)
+
+#include <unity.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "path_index.h"
+
+#define BENCH_SIZE 512        // index slots for up to 255 routes
+#define BENCH_LOOKUPS 1000000 // lookups per measurement
+
+struct TestRoute
+{
+  uint32_t uHash;
+  const char *pPath;
+};
+
+static char acPaths[256][32];
+static TestRoute aRoutes[256];
+static PathIndex<TestRoute, BENCH_SIZE> oIndex;
+static const char *apQueries[1024];
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Paths shaped like the firmware's routes
+static void makeRoutes(uint16_t uCount)
+{
+  for (uint16_t uRoute = 0; uRoute < uCount; uRoute++)
+  {
+    snprintf(acPaths[uRoute], sizeof(acPaths[uRoute]), "/api/route%u/stats", uRoute);
+    aRoutes[uRoute] = {hashPath(acPaths[uRoute]), acPaths[uRoute]};
+  }
+  srand(uCount);
+  for (uint16_t uQuery = 0; uQuery < 1024; uQuery++)
+  {
+    apQueries[uQuery] = acPaths[rand() % uCount];
+  }
+}
+
+static const TestRoute *findLinear(uint16_t uCount, const char *pPath)
+{
+  for (uint16_t uRoute = 0; uRoute < uCount; uRoute++)
+  {
+    if (strcmp(aRoutes[uRoute].pPath, pPath) == 0)
+    {
+      return &aRoutes[uRoute];
+    }
+  }
+  return nullptr;
+}
+
+// Mean lookup time (ns), indexed or linear
+static double benchLookups(uint16_t uCount, bool bIndexed)
+{
+  uintptr_t uCheck = 0;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uLookup = 0; uLookup < BENCH_LOOKUPS; uLookup++)
+  {
+    const char *pPath = apQueries[uLookup & 1023];
+    uCheck += (uintptr_t)(bIndexed ? oIndex.find(pPath) : findLinear(uCount, pPath));
+  }
+  double dNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / BENCH_LOOKUPS;
+  TEST_ASSERT_NOT_EQUAL(0, uCheck);
+  return dNs;
+}
+
+void test_finds_every_route(void)
+{
+  const uint16_t auCounts[] = {1, 5, 50, 200, 255};
+  for (uint16_t uCount : auCounts)
+  {
+    makeRoutes(uCount);
+    TEST_ASSERT_TRUE(oIndex.begin(aRoutes, uCount));
+    for (uint16_t uRoute = 0; uRoute < uCount; uRoute++)
+    {
+      TEST_ASSERT_TRUE(oIndex.find(acPaths[uRoute]) == &aRoutes[uRoute]);
+    }
+    TEST_ASSERT_NULL(oIndex.find("/api/route9999/stats"));
+    TEST_ASSERT_NULL(oIndex.find(""));
+    TEST_ASSERT_NULL(oIndex.find("/api/route1/stat"));
+  }
+}
+
+void test_refuses_duplicates_and_overload(void)
+{
+  makeRoutes(10);
+  aRoutes[7] = aRoutes[3];
+  const TestRoute *pRefused = nullptr;
+  TEST_ASSERT_FALSE(oIndex.begin(aRoutes, 10, &pRefused));
+  TEST_ASSERT_TRUE(pRefused == &aRoutes[7]);
+
+  makeRoutes(BENCH_SIZE / 2);
+  TEST_ASSERT_FALSE(oIndex.begin(aRoutes, BENCH_SIZE / 2));
+}
+
+void test_bench_5_50_200_routes(void)
+{
+  const uint16_t auCounts[] = {5, 50, 200};
+  double adIndexed[3];
+  for (uint8_t uCase = 0; uCase < 3; uCase++)
+  {
+    makeRoutes(auCounts[uCase]);
+    TEST_ASSERT_TRUE(oIndex.begin(aRoutes, auCounts[uCase]));
+    adIndexed[uCase] = benchLookups(auCounts[uCase], true);
+    double dLinear = benchLookups(auCounts[uCase], false);
+    char acLine[96];
+    snprintf(acLine, sizeof(acLine), "%u routes : index %.1f ns, linear scan %.1f ns per lookup",
+             auCounts[uCase], adIndexed[uCase], dLinear);
+    TEST_MESSAGE(acLine);
+    if (auCounts[uCase] == 200)
+    {
+      TEST_ASSERT_LESS_THAN(dLinear, adIndexed[uCase]);
+    }
+  }
+  // Constant time : 40x the routes, not 40x the time (generous bound for noisy hosts)
+  TEST_ASSERT_LESS_THAN(adIndexed[0] * 3, adIndexed[2]);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_finds_every_route);
+  RUN_TEST(test_refuses_duplicates_and_overload);
+  RUN_TEST(test_bench_5_50_200_routes);
+  return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// RTC snapshot : power-on garbage, corrupted and resized snapshots are
+// rejected, a valid one is restored flagged MEAS_RESTORED with its time
+// stamp rebased on the new boot, and warm restarts are counted
+
+#include <unity.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "rtc_snapshot.h"
+
+#define EPOCH0 1700000000UL
+
+static Measurement sampleAt(uint32_t uSeq, uint8_t uNtpQuality)
+{
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+  oMeasurement.uSeq = uSeq;
+  oMeasurement.ullMicros = 3600000000ULL;
+  oMeasurement.uEpoch = EPOCH0;
+  oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+  oMeasurement.uNtpQuality = uNtpQuality;
+  oMeasurement.fTmp = 21.5f;
+  oMeasurement.fHum = 48.0f;
+  oMeasurement.ulMillis = 3600000;
+  strcpy(oMeasurement.acTime, "12:00:00");
+  return oMeasurement;
+}
+
+// Reseal the emulated RTC memory after editing it, as another firmware would
+static void resealSnapshot()
+{
+  RtcSnapshot &oSnapshot = rtcSnapshotMemory();
+  oSnapshot.uCrc = crc32(&oSnapshot, offsetof(RtcSnapshot, uCrc));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_power_on_garbage(void)
+{
+  memset(&rtcSnapshotMemory(), 0xA5, sizeof(RtcSnapshot));
+  Measurement oRestored;
+  TEST_ASSERT_FALSE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+  TEST_ASSERT_EQUAL(0, rtcRestoreCount());
+  TEST_ASSERT_EQUAL(0, rtcSnapshotMemory().uMagic); // forgotten
+}
+
+void test_restore_and_rebase(void)
+{
+  saveRtcSnapshot(sampleAt(41, NTP_SYNCED));
+
+  // Rebooted 90 s after the sample, 5 s into the new boot : sampled 85 s before boot
+  Measurement oRestored;
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, EPOCH0 + 90, 5000000));
+  TEST_ASSERT_EQUAL(41, oRestored.uSeq);
+  TEST_ASSERT_EQUAL(MEAS_TMP_VALID | MEAS_HUM_VALID | MEAS_RESTORED, oRestored.uFlags);
+  TEST_ASSERT_EQUAL(EPOCH0, oRestored.uEpoch);
+  TEST_ASSERT_TRUE((int64_t)oRestored.ullMicros == -85000000LL);
+  TEST_ASSERT_EQUAL(0, oRestored.ulMillis);
+  TEST_ASSERT_EQUAL_STRING("12:00:00", oRestored.acTime);
+  TEST_ASSERT_TRUE(oRestored.fTmp == 21.5f);
+  TEST_ASSERT_EQUAL(1, rtcRestoreCount());
+
+  // Unknown time now, or a sample without NTP time : dated now
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, 0, 7000000));
+  TEST_ASSERT_TRUE(oRestored.ullMicros == 7000000ULL);
+  saveRtcSnapshot(sampleAt(42, NTP_NONE));
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, EPOCH0 + 90, 2000000));
+  TEST_ASSERT_TRUE(oRestored.ullMicros == 2000000ULL);
+
+  // Epoch now before the sample (clock stepped back) : dated now too
+  saveRtcSnapshot(sampleAt(43, NTP_SYNCED));
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, EPOCH0 - 10, 3000000));
+  TEST_ASSERT_TRUE(oRestored.ullMicros == 3000000ULL);
+}
+
+// Every restore counts, a save keeps the count
+void test_restore_count(void)
+{
+  uint32_t uCount = rtcRestoreCount();
+  Measurement oRestored;
+  saveRtcSnapshot(sampleAt(50, NTP_SYNCED));
+  TEST_ASSERT_EQUAL(uCount, rtcRestoreCount());
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+  TEST_ASSERT_EQUAL(uCount + 2, rtcRestoreCount());
+  saveRtcSnapshot(sampleAt(51, NTP_SYNCED));
+  TEST_ASSERT_EQUAL(uCount + 2, rtcRestoreCount());
+}
+
+void test_rejects_corrupted_and_resized(void)
+{
+  Measurement oRestored;
+
+  // One bit flipped in the record
+  saveRtcSnapshot(sampleAt(60, NTP_SYNCED));
+  ((uint8_t *)&rtcSnapshotMemory().oMeasurement.fTmp)[1] ^= 0x10;
+  TEST_ASSERT_FALSE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+  TEST_ASSERT_EQUAL(0, rtcRestoreCount());
+
+  // CRC itself damaged
+  saveRtcSnapshot(sampleAt(61, NTP_SYNCED));
+  rtcSnapshotMemory().uCrc ^= 1;
+  TEST_ASSERT_FALSE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+
+  // Another layout (size), or another magic, with a valid CRC
+  saveRtcSnapshot(sampleAt(62, NTP_SYNCED));
+  rtcSnapshotMemory().uSize = sizeof(RtcSnapshot) - 4;
+  resealSnapshot();
+  TEST_ASSERT_FALSE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+  saveRtcSnapshot(sampleAt(63, NTP_SYNCED));
+  rtcSnapshotMemory().uMagic = RTC_SNAPSHOT_MAGIC + 1;
+  resealSnapshot();
+  TEST_ASSERT_FALSE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+
+  // A fresh save is valid again
+  saveRtcSnapshot(sampleAt(64, NTP_SYNCED));
+  TEST_ASSERT_TRUE(restoreRtcSnapshot(oRestored, EPOCH0, 1000000));
+  TEST_ASSERT_EQUAL(64, oRestored.uSeq);
+  TEST_ASSERT_EQUAL(1, rtcRestoreCount());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_power_on_garbage);
+  RUN_TEST(test_restore_and_rebase);
+  RUN_TEST(test_restore_count);
+  RUN_TEST(test_rejects_corrupted_and_resized);
+  return UNITY_END();
+}
@@ -0,0 +1,219 @@
+// Sample clock : a virtual device (esp_timer time, SNTP wall clock seen by
+// loop() every second, timer alarm fired when due) checks the slot grid on
+// :00 / :30, that small re-syncs keep the armed slot, that clock steps
+// neither skip nor repeat a slot, and the jitter histogram buckets
+
+#include <unity.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "sample_clock.h"
+
+#define PERIOD 30                          // seconds
+#define TICK 1000                          // virtual loop() period (microseconds)
+#define WALL0 (1700000000000000LL + 7123456LL) // wall clock at esp_timer 0 (microseconds)
+#define RESYNC_SLACK 1000                  // re-syncs below this keep the armed slot time
+
+static uint64_t ullNow = 0;             // esp_timer time
+static int64_t llWallOffset = WALL0;    // wall clock = ullNow + llWallOffset
+static uint32_t uLastSecond = 0;        // last epoch second loop() saw
+static std::vector<SampleSlot> aoTaken; // samples taken by loop()
+
+static int64_t wallMicros(uint64_t ullMicros)
+{
+  return (int64_t)ullMicros + llWallOffset;
+}
+
+// Run the virtual device for ullMicros : loop() re-syncs on every epoch
+// second change with the time the second started, the alarm fires when due
+// and loop() takes the due slot
+static void runFor(uint64_t ullMicros)
+{
+  for (uint64_t ullEnd = ullNow + ullMicros; ullNow < ullEnd; ullNow += TICK)
+  {
+    int64_t llWall = wallMicros(ullNow);
+    uint32_t uSecond = (uint32_t)(llWall / 1000000);
+    if (uSecond != uLastSecond)
+    {
+      syncSampleClock(uSecond, ullNow - (uint64_t)(llWall % 1000000));
+      uLastSecond = uSecond;
+    }
+    SampleSlot oSlot;
+    getNextSlot(oSlot);
+    if (ullNow >= oSlot.ullMicros)
+    {
+      fireSampleTimer(ullNow);
+    }
+    if (sampleDue(oSlot))
+    {
+      recordSampleStart(oSlot, ullNow);
+      aoTaken.push_back(oSlot);
+    }
+  }
+}
+
+// Run until the wall clock reads uSecond + uMicros past a slot
+static void runToSlotPhase(uint32_t uMicros)
+{
+  int64_t llPhase = wallMicros(ullNow) % (PERIOD * 1000000LL);
+  int64_t llWait = ((int64_t)uMicros - llPhase + PERIOD * 1000000LL) % (PERIOD * 1000000LL);
+  runFor((uint64_t)llWait);
+}
+
+// Taken slots from uFrom on : consecutive grid epochs, each (but those
+// right after a step) scheduled when the wall clock read its epoch
+static void assertConsecutive(size_t uFrom)
+{
+  for (size_t uSlot = uFrom; uSlot < aoTaken.size(); uSlot++)
+  {
+    TEST_ASSERT_TRUE(aoTaken[uSlot].bSynced);
+    TEST_ASSERT_EQUAL(0, aoTaken[uSlot].uEpoch % PERIOD);
+    if (uSlot > uFrom)
+    {
+      TEST_ASSERT_EQUAL(aoTaken[uSlot - 1].uEpoch + PERIOD, aoTaken[uSlot].uEpoch);
+    }
+  }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_slots_on_grid(void)
+{
+  TEST_ASSERT_TRUE(beginSampleClock(PERIOD));
+  runFor(3600000000ULL);
+  TEST_ASSERT_EQUAL(120, aoTaken.size());
+  assertConsecutive(0);
+  for (const SampleSlot &oSlot : aoTaken)
+  {
+    TEST_ASSERT_TRUE(wallMicros(oSlot.ullMicros) == (int64_t)oSlot.uEpoch * 1000000LL);
+  }
+  TEST_ASSERT_EQUAL(0, missedSlots());
+}
+
+// Drift below the re-arm threshold keeps the armed slot as is, more moves it
+// in time but keeps its epoch
+void test_small_resync_keeps_slot(void)
+{
+  runToSlotPhase(10000000);
+  SampleSlot oBefore, oAfter;
+  getNextSlot(oBefore);
+  llWallOffset += RESYNC_SLACK / 2;
+  runFor(1000000);
+  getNextSlot(oAfter);
+  TEST_ASSERT_EQUAL(oBefore.uEpoch, oAfter.uEpoch);
+  TEST_ASSERT_TRUE(oBefore.ullMicros == oAfter.ullMicros);
+
+  llWallOffset += 5000; // wall clock 5 ms ahead : the slot comes 5 ms earlier
+  runFor(1000000);
+  getNextSlot(oAfter);
+  TEST_ASSERT_EQUAL(oBefore.uEpoch, oAfter.uEpoch);
+  TEST_ASSERT_TRUE(oBefore.ullMicros - 5000 - RESYNC_SLACK / 2 == oAfter.ullMicros);
+
+  size_t uFrom = aoTaken.size() - 1;
+  runFor(600000000ULL);
+  assertConsecutive(uFrom);
+}
+
+// Steps forward and back, within a period, between slots or over one
+void test_steps_neither_skip_nor_repeat(void)
+{
+  size_t uFrom = aoTaken.size() - 1;
+  const struct
+  {
+    uint32_t uPhase; // wall clock past the last slot when stepping (microseconds)
+    int64_t llStep;  // microseconds
+  } aSteps[] = {
+      {5000000, 10000000},   // :05 -> :15
+      {25000000, 10000000},  // :25 -> :35, over the armed slot : taken late
+      {2000000, -10000000},  // :32 -> :22, back over the last slot : not taken again
+      {10000000, -25000000}, // :10 -> :15 of the previous period
+      {29999000, 2000},      // right at the slot boundary
+      {500, -2000},          // right after it, back before it
+  };
+  char acMessage[120];
+  for (const auto &oStep : aSteps)
+  {
+    runToSlotPhase(oStep.uPhase);
+    llWallOffset += oStep.llStep;
+    runFor(3 * PERIOD * 1000000ULL);
+    snprintf(acMessage, sizeof(acMessage), "step %+lld us at :%02u : %zu slots taken", (long long)oStep.llStep,
+             oStep.uPhase / 1000000, aoTaken.size() - uFrom);
+    TEST_MESSAGE(acMessage);
+    assertConsecutive(uFrom);
+  }
+  TEST_ASSERT_EQUAL(0, missedSlots());
+}
+
+// A step back by far more than a period re-arms from now rather than
+// pausing the samples for as long
+void test_large_step_back(void)
+{
+  runToSlotPhase(1000000);
+  size_t uFrom = aoTaken.size();
+  llWallOffset -= 3600000000LL;
+  uint64_t ullStep = ullNow;
+  runFor(2 * PERIOD * 1000000ULL);
+  TEST_ASSERT_TRUE(aoTaken.size() > uFrom);
+  TEST_ASSERT_TRUE(aoTaken[uFrom].ullMicros - ullStep <= PERIOD * 1000000ULL);
+  assertConsecutive(uFrom);
+}
+
+// Alarm and sample start delays land in their buckets
+void test_jitter_buckets(void)
+{
+  const uint32_t auDelays[] = {0, 50, 51, 100, 101, 999, 1000, 1001, 60000, 2000000};
+  SampleJitter aoBefore[JITTER_KIND_COUNT], aoAfter[JITTER_KIND_COUNT];
+  for (uint8_t uKind = 0; uKind < JITTER_KIND_COUNT; uKind++)
+  {
+    TEST_ASSERT_TRUE(getSampleJitter((JitterKind)uKind, aoBefore[uKind]));
+  }
+  uint32_t auExpected[JITTER_BUCKET_COUNT] = {};
+  for (uint32_t uDelay : auDelays)
+  {
+    uint8_t uBucket = 0;
+    while (uDelay > jitterBound(uBucket))
+    {
+      uBucket++;
+    }
+    auExpected[uBucket]++;
+
+    SampleSlot oSlot;
+    getNextSlot(oSlot);
+    ullNow = oSlot.ullMicros + uDelay;
+    fireSampleTimer(ullNow);
+    TEST_ASSERT_TRUE(sampleDue(oSlot));
+    recordSampleStart(oSlot, oSlot.ullMicros + uDelay);
+  }
+  TEST_ASSERT_EQUAL(2, auExpected[0]); // 0 and 50
+  for (uint8_t uKind = 0; uKind < JITTER_KIND_COUNT; uKind++)
+  {
+    getSampleJitter((JitterKind)uKind, aoAfter[uKind]);
+    TEST_ASSERT_EQUAL(aoBefore[uKind].uCount + 10, aoAfter[uKind].uCount);
+    TEST_ASSERT_TRUE(aoAfter[uKind].uMaxMicros >= 2000000);
+    for (uint8_t uBucket = 0; uBucket < JITTER_BUCKET_COUNT; uBucket++)
+    {
+      TEST_ASSERT_EQUAL(aoBefore[uKind].auBuckets[uBucket] + auExpected[uBucket], aoAfter[uKind].auBuckets[uBucket]);
+    }
+  }
+  SampleJitter oInvalid;
+  TEST_ASSERT_FALSE(getSampleJitter(JITTER_KIND_COUNT, oInvalid));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_slots_on_grid);
+  RUN_TEST(test_small_resync_keeps_slot);
+  RUN_TEST(test_steps_neither_skip_nor_repeat);
+  RUN_TEST(test_large_step_back);
+  RUN_TEST(test_jitter_buckets);
+  return UNITY_END();
+}
@@ -0,0 +1,163 @@
+// Trend and forecasts : a synthetic three-day trace (diurnal swing,
+// quantised noise, air conditioning failure). Outside the fault the Holt
+// forecasts must beat persistence at every horizon and the slope must follow
+// the swing ; during the fault the threshold crossing estimate must converge
+// on the real crossing time, and none may be reported before it.
+
+#include <unity.h>
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "trend.h"
+
+#define TRACE_SAMPLES 8640       // 3 days at 30 s
+#define TRACE_PERIOD 30          // seconds
+#define FAULT_START 5000         // AC failure : +0.1 C per sample (0.2 C/min) for an hour,
+#define FAULT_LEN 120            // then back down
+#define FAULT_MARGIN 10          // forecast targets this close before the fault are not scored
+#define FAULT_RECOVERY 500       // samples after the fault start not scored
+#define SLOPE_MARGIN 100         // slope scored until this many samples before the fault
+#define SLOPE_RMS_LIMIT 0.2      // C/h, outside the fault
+#define ETA_CLOSE_MINUTES 22     // from this close to the crossing ...
+#define ETA_TOLERANCE 60         // ... the estimate is within this (seconds)
+#define BENCH_SAMPLES 1000000
+
+static std::vector<double> adTruth(TRACE_SAMPLES), adMeasured(TRACE_SAMPLES);
+static std::vector<int32_t> aiHighEta(TRACE_SAMPLES, -2); // -2 : no trend yet
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_trace(void)
+{
+  std::mt19937 oRandom(4);
+  std::normal_distribution<double> oNoise(0.0, 1.0);
+  for (uint32_t uSample = 0; uSample < TRACE_SAMPLES; uSample++)
+  {
+    double dTmp = 22.0 + 1.5 * sin(2 * M_PI * uSample / 2880.0);
+    if (uSample >= FAULT_START && uSample < FAULT_START + FAULT_LEN)
+    {
+      dTmp += 0.1 * (uSample - FAULT_START);
+    }
+    if (uSample >= FAULT_START + FAULT_LEN)
+    {
+      dTmp += 12.0 * exp(-(double)(uSample - FAULT_START - FAULT_LEN) / 40.0);
+    }
+    adTruth[uSample] = dTmp;
+    adMeasured[uSample] = round((dTmp + oNoise(oRandom) * 0.08) * 10) / 10;
+  }
+
+  double adHoltError[TREND_HORIZON_COUNT] = {}, adPersistError[TREND_HORIZON_COUNT] = {};
+  uint32_t auScored[TREND_HORIZON_COUNT] = {};
+  double dSlopeSquares = 0.0;
+  uint32_t uSlopeCount = 0;
+  for (uint32_t uSample = 0; uSample < TRACE_SAMPLES; uSample++)
+  {
+    Measurement oMeasurement;
+    memset(&oMeasurement, 0, sizeof(oMeasurement));
+    oMeasurement.ullMicros = 1000000ULL * TRACE_PERIOD * uSample;
+    oMeasurement.fTmp = adMeasured[uSample];
+    oMeasurement.fHum = 50.0f;
+    oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+    updateTrend(oMeasurement);
+    ChannelTrend oTrend;
+    if (!getTrend(STATS_TMP, oTrend))
+    {
+      continue;
+    }
+    aiHighEta[uSample] = oTrend.iHighEta;
+
+    if (uSample < FAULT_START - SLOPE_MARGIN)
+    {
+      double dTrueSlope = 1.5 * 2 * M_PI / 2880.0 * cos(2 * M_PI * uSample / 2880.0) * 3600 / TRACE_PERIOD;
+      dSlopeSquares += (oTrend.fSlopePerHour - dTrueSlope) * (oTrend.fSlopePerHour - dTrueSlope);
+      uSlopeCount++;
+    }
+    for (uint8_t uHorizon = 0; uHorizon < TREND_HORIZON_COUNT; uHorizon++)
+    {
+      uint32_t uTarget = uSample + trendHorizon(uHorizon) / TRACE_PERIOD;
+      if (uTarget >= TRACE_SAMPLES || (uTarget >= FAULT_START - FAULT_MARGIN && uSample < FAULT_START + FAULT_RECOVERY))
+      {
+        continue;
+      }
+      adHoltError[uHorizon] += fabs(oTrend.afForecasts[uHorizon] - adTruth[uTarget]);
+      adPersistError[uHorizon] += fabs(adMeasured[uSample] - adTruth[uTarget]);
+      auScored[uHorizon]++;
+    }
+  }
+
+  char acMessage[200];
+  for (uint8_t uHorizon = 0; uHorizon < TREND_HORIZON_COUNT; uHorizon++)
+  {
+    snprintf(acMessage, sizeof(acMessage), "%4u s ahead : MAE Holt %.3f C, persistence %.3f C", trendHorizon(uHorizon),
+             adHoltError[uHorizon] / auScored[uHorizon], adPersistError[uHorizon] / auScored[uHorizon]);
+    TEST_MESSAGE(acMessage);
+    TEST_ASSERT_TRUE(adHoltError[uHorizon] < adPersistError[uHorizon]);
+  }
+  double dSlopeRms = sqrt(dSlopeSquares / uSlopeCount);
+  snprintf(acMessage, sizeof(acMessage), "slope RMS error %.3f C/h outside the fault", dSlopeRms);
+  TEST_MESSAGE(acMessage);
+  TEST_ASSERT_TRUE(dSlopeRms < SLOPE_RMS_LIMIT);
+
+  // No crossing announced before the fault, then converging on the real one
+  for (uint32_t uSample = 0; uSample < FAULT_START; uSample++)
+  {
+    TEST_ASSERT_TRUE(aiHighEta[uSample] < 0);
+  }
+  ChannelTrend oTrend;
+  getTrend(STATS_TMP, oTrend);
+  uint32_t uCrossing = FAULT_START;
+  while (adTruth[uCrossing] <= oTrend.fHigh)
+  {
+    uCrossing++;
+  }
+  for (uint32_t uSample = FAULT_START; uSample < uCrossing; uSample += 10)
+  {
+    int32_t iTrueEta = (int32_t)(uCrossing - uSample) * TRACE_PERIOD;
+    snprintf(acMessage, sizeof(acMessage), "%2d min before crossing %.0f C : estimate %d s", iTrueEta / 60, oTrend.fHigh,
+             aiHighEta[uSample]);
+    TEST_MESSAGE(acMessage);
+    if (iTrueEta <= ETA_CLOSE_MINUTES * 60)
+    {
+      TEST_ASSERT_TRUE(aiHighEta[uSample] >= 0);
+      TEST_ASSERT_TRUE(abs(aiHighEta[uSample] - iTrueEta) <= ETA_TOLERANCE);
+    }
+  }
+}
+
+void test_bench_update(void)
+{
+  Measurement oMeasurement;
+  memset(&oMeasurement, 0, sizeof(oMeasurement));
+  oMeasurement.uFlags = MEAS_TMP_VALID | MEAS_HUM_VALID;
+  oMeasurement.fHum = 50.0f;
+  auto oStart = std::chrono::steady_clock::now();
+  for (uint32_t uSample = 0; uSample < BENCH_SAMPLES; uSample++)
+  {
+    oMeasurement.ullMicros += 1000000ULL * TRACE_PERIOD;
+    oMeasurement.fTmp = 20.0f + (uSample % 50) * 0.01f;
+    updateTrend(oMeasurement);
+  }
+  double dNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - oStart).count() / BENCH_SAMPLES;
+  char acMessage[80];
+  snprintf(acMessage, sizeof(acMessage), "update : %.0f ns per sample (2 channels)", dNs);
+  TEST_MESSAGE(acMessage);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_trace);
+  RUN_TEST(test_bench_update);
+  return UNITY_END();
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Build the static assets image for the "assets" flash partition.
+
+Every file of the source directory is stored gzip-compressed (unless that
+does not make it smaller) behind a header and a fixed-size index, in the
+layout read by src/asset_store.cpp. Flash the image without reflashing the
+application with :
+
+    python3 tools/mkassets.py data assets.bin
+    esptool.py --chip esp32 write_flash 0x290000 assets.bin
+
+(0x290000 is the "assets" partition offset in partitions.csv)
+"""
+
+import gzip
+import mimetypes
+import os
+import struct
+import sys
+import zlib
+
+ASSET_MAGIC = 0x53545341  # "ASTS"
+ASSET_VERSION = 1
+ASSET_MAX_COUNT = 32
+ASSET_PATH_LEN = 48
+ASSET_TYPE_LEN = 32
+ASSET_PARTITION_SIZE = 0x70000
+
+HEADER = struct.Struct("<IHHII")
+ENTRY = struct.Struct("<%ds%dsIIIB3x" % (ASSET_PATH_LEN, ASSET_TYPE_LEN))
+
+ENCODING_IDENTITY = 0
+ENCODING_GZIP = 1
+
+
+def collect(root):
+    """Return (url path, file path) for every file below root, sorted."""
+    assets = []
+    for folder, _, files in os.walk(root):
+        for name in files:
+            file_path = os.path.join(folder, name)
+            url = "/" + os.path.relpath(file_path, root).replace(os.sep, "/")
+            assets.append((url, file_path))
+    return sorted(assets)
+
+
+def build(root):
+    assets = collect(root)
+    if len(assets) > ASSET_MAX_COUNT:
+        sys.exit("too many assets (%d > %d)" % (len(assets), ASSET_MAX_COUNT))
+
+    offset = HEADER.size + ENTRY.size * len(assets)
+    index = b""
+    data = b""
+    for url, file_path in assets:
+        with open(file_path, "rb") as source:
+            raw = source.read()
+        packed = gzip.compress(raw, 9, mtime=0)
+        encoding = ENCODING_GZIP
+        if len(packed) >= len(raw):
+            packed, encoding = raw, ENCODING_IDENTITY
+        content_type = mimetypes.guess_type(url)[0] or "application/octet-stream"
+        if len(url) >= ASSET_PATH_LEN or len(content_type) >= ASSET_TYPE_LEN:
+            sys.exit("path or content type too long : %s" % url)
+        index += ENTRY.pack(url.encode(), content_type.encode(), offset + len(data),
+                            len(packed), zlib.crc32(packed) & 0xFFFFFFFF, encoding)
+        data += packed
+        # keep every asset 4-byte aligned in flash
+        data += b"\0" * (-len(data) % 4)
+        print("%-40s %-28s %7d -> %7d" % (url, content_type, len(raw), len(packed)))
+
+    image_len = HEADER.size + len(index) + len(data)
+    if image_len > ASSET_PARTITION_SIZE:
+        sys.exit("image too large (%d > %d)" % (image_len, ASSET_PARTITION_SIZE))
+    return HEADER.pack(ASSET_MAGIC, ASSET_VERSION, len(assets), image_len, 0) + index + data
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: mkassets.py <source dir> <image file>")
+    image = build(sys.argv[1])
+    with open(sys.argv[2], "wb") as target:
+        target.write(image)
+    print("%d bytes written to %s" % (len(image), sys.argv[2]))
+
+
+if __name__ == "__main__":
+    main()